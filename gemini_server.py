@@ -6,6 +6,7 @@ import os
 import tempfile
 from gtts import gTTS
 import hashlib
+from werkzeug.serving import WSGIRequestHandler
 
 app = Flask(__name__)
 
@@ -545,4 +546,7 @@ if __name__ == "__main__":
     print("  ✓ Sensor-based auto adjustment")
     print("  ✓ Null-safe JSON parsing")
     print("=" * 70)
-    app.run(host="0.0.0.0", port=5000, debug=True)
\ No newline at end of file
+    # threaded=True: ESP32 có nhiều voice worker gọi song song
+    # HTTP/1.1: giữ kết nối keep-alive của mỗi worker, khỏi bắt tay TCP mỗi lệnh
+    WSGIRequestHandler.protocol_version = "HTTP/1.1"
+    app.run(host="0.0.0.0", port=5000, debug=True, threaded=True)
\ No newline at end of file
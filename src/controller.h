@@ -0,0 +1,565 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "hal.h"
+#include "controller_state.h"
+#include "seqlock.h"
+#include "rule_engine.h"
+#include "ir_tx.h"
+#include "lcd_frame.h"
+#include "logring.h"
+#include "room_model.h"
+
+// ============ BỘ ĐIỀU KHIỂN (KHÔNG PHỤ THUỘC PHẦN CỨNG) ============
+// Logic chạy trên loop(): lấy mẫu cảm biến, áp dụng lệnh AC, luật tự động,
+// gom lệnh IR, vẽ màn hình chính và JSON của /sensors, /ac/status. Mọi truy
+// cập phần cứng đi qua Hal nên cùng một code chạy trên ESP32 và env:native.
+
+#define PIR_HOLD_MS 5000       // giữ "có chuyển động" sau xung PIR cuối
+#define PRESENCE_HOLD_MS 10000 // giữ "có người" sau lần radar thấy cuối
+#define PRESENCE_MIN_CM 1.0f
+#define PRESENCE_MAX_CM 150.0f
+#define TEST_PRESENCE_CM 50.0f
+#define RULE_COOLDOWN_MS 5000 // khoảng cách tối thiểu giữa 2 lệnh của luật
+#define PREDICT_INTERVAL_MS 60000 // chế độ dự báo: lập kế hoạch mỗi phút
+#define PREDICT_ABSENT_S 600      // vắng lâu hơn mới bỏ qua thoải mái
+
+class ClimateController
+{
+public:
+  explicit ClimateController(Hal &h) : hal(h) {}
+
+  void begin(const RuleDef *table, uint8_t count)
+  {
+    rules.begin(table, count);
+    publish();
+  }
+
+  // ===== Cảm biến =====
+  // DHT22 + LDR + PIR; giá trị nhiệt/ẩm cũ giữ nguyên khi chưa có mẫu mới
+  void sampleSensors(uint32_t nowMs)
+  {
+    SensorState &s = ctrl.sensors;
+    float t, h;
+    if (hal.sensors.readClimate(t, h))
+    {
+      s.temperature = t;
+      s.humidity = h;
+      climateSamples++;
+      model.observe(nowMs, hal.clock.hour() * 60 + hal.clock.minute(), t, ctrl.ac);
+    }
+    s.light = hal.sensors.readLight();
+
+    // Test mode: ép có người, không đọc PIR
+    if (s.testMode)
+    {
+      s.presence = true;
+      s.motion = true;
+      s.distance = TEST_PRESENCE_CM;
+      lastPresenceMs = nowMs;
+      lastMotionMs = nowMs;
+      LOG_DEBUG("T=%.1fC H=%.0f%% TEST_MODE:ON PRESENCE:FORCED", s.temperature, s.humidity);
+      return;
+    }
+
+    if (hal.sensors.readMotion())
+    {
+      s.motion = true;
+      lastMotionMs = nowMs;
+    }
+    else if (nowMs - lastMotionMs > PIR_HOLD_MS)
+    {
+      s.motion = false;
+    }
+
+    LOG_DEBUG("T=%.1fC H=%.0f%% Motion:%d Presence:%d Dist=%.0fcm",
+              s.temperature, s.humidity, s.motion, s.presence, s.distance);
+  }
+
+  // Radar; chỉ publish khi đổi >= 1cm hoặc đổi trạng thái có người
+  bool samplePresence(uint32_t nowMs)
+  {
+    SensorState &s = ctrl.sensors;
+    float cm;
+    if (!hal.sensors.readDistance(cm) || s.testMode)
+      return false;
+
+    s.distance = cm;
+    if (cm > PRESENCE_MIN_CM && cm < PRESENCE_MAX_CM)
+    {
+      s.presence = true;
+      lastPresenceMs = nowMs;
+    }
+    else if (nowMs - lastPresenceMs > PRESENCE_HOLD_MS)
+    {
+      s.presence = false;
+    }
+
+    int distanceCm = (int)cm;
+    if (s.presence == publishedPresence && distanceCm == publishedDistance)
+      return false;
+    publishedPresence = s.presence;
+    publishedDistance = distanceCm;
+    publish();
+    return true;
+  }
+
+  // Nút test: bật thì ép có người ngay, tắt thì lần đọc sau về cảm biến thật
+  void setTestMode(bool on, uint32_t nowMs)
+  {
+    SensorState &s = ctrl.sensors;
+    s.testMode = on;
+    if (on)
+    {
+      s.presence = true;
+      s.motion = true;
+      s.distance = TEST_PRESENCE_CM;
+      lastPresenceMs = nowMs;
+      lastMotionMs = nowMs;
+    }
+    publish();
+  }
+
+  bool climateValid() const { return climateSamples > 0; }
+
+  // ===== Trạng thái =====
+  void publish()
+  {
+    ctrl.version++;
+    ctrl.updatedMs = hal.clock.nowMs();
+    slot.publish(ctrl);
+  }
+
+  // Snapshot nhất quán, gọi được từ mọi task (không khóa)
+  ControllerState read() const { return slot.read(); }
+
+  // Chỉ chạy trên loop(): áp dụng lệnh, xếp IR, publish version mới
+  void apply(const AcCommand &cmd)
+  {
+    ctrl.ac = mergeAcCommand(ctrl.ac, cmd);
+    ctrl.acVersion++;
+    irTx.request(hal.clock.nowMs(), cmd.source);
+    publish();
+  }
+
+  // ===== IR =====
+  // Phát khung khi cửa sổ gom đã đóng; khung trước chưa phát xong thì tiếp
+  // tục gom, lần sau phát trạng thái mới nhất. true nếu vừa phát 1 khung.
+  bool transmitTick(uint32_t nowMs)
+  {
+    if (!irTx.due(nowMs) || hal.ir.busy())
+      return false;
+
+    const AcState &ac = ctrl.ac;
+    uint8_t frame[IR_TX_MAX_FRAME];
+    uint16_t len = hal.ir.encode(ac, frame, sizeof(frame));
+    if (!irTx.commit(frame, len, nowMs))
+    {
+      LOG_DEBUG("DAIKIN= %s | trùng khung trước, bỏ qua", irTx.source());
+      return false;
+    }
+    if (!hal.ir.transmit(frame, len))
+    {
+      LOG_WARN("DAIKIN: hàng đợi IR đầy, bỏ khung %s", irTx.source());
+      return false;
+    }
+
+    LOG_INFO("DAIKIN→ %s | PWR:%s T:%dC M:%s F:%s",
+             irTx.source(), ac.power ? "ON" : "OFF", ac.temp, acModeToString(ac.mode),
+             fanSpeedToString((FanSpeed)ac.fan));
+    return true;
+  }
+
+  // ===== Luật tự động =====
+  void buildRuleSnapshot(RuleSnapshot &snap, uint32_t nowMs)
+  {
+    const SensorState &s = ctrl.sensors;
+    bool present = s.presence || s.motion;
+    int32_t tempX10 = lroundf(s.temperature * 10);
+    int32_t overSet = tempX10 - ctrl.ac.temp * 10;
+
+    snap.field[RF_TEMP] = tempX10;
+    snap.field[RF_HUMIDITY] = lroundf(s.humidity * 10);
+    snap.field[RF_LIGHT] = s.light;
+    snap.field[RF_PRESENCE] = present ? 1 : 0;
+    snap.field[RF_ABSENT_S] = present ? 0 : (int32_t)((nowMs - lastPresenceMs) / 1000);
+    snap.field[RF_AC_ON] = ctrl.ac.power ? 1 : 0;
+    snap.field[RF_AC_TEMP] = ctrl.ac.temp;
+    snap.field[RF_AC_MODE] = ctrl.ac.mode;
+    snap.field[RF_AC_FAN] = ctrl.ac.fan;
+    snap.field[RF_HOUR] = hal.clock.hour();
+    snap.field[RF_TEMP_OVER_SET] = overSet;
+    snap.field[RF_TEMP_ERR_ABS] = overSet < 0 ? -overSet : overSet;
+  }
+
+  AcCommand ruleCommand(const RuleDef &rule) const
+  {
+    const RuleAction &act = rule.action;
+    AcCommand cmd = {0, ctrl.ac, "AI_ADJUST"};
+
+    if (act.kind == RA_TURN_OFF)
+    {
+      cmd.fields = AC_SET_POWER;
+      cmd.value.power = false;
+      cmd.source = "AI_OFF";
+      return cmd;
+    }
+
+    if (act.kind == RA_TURN_ON)
+    {
+      cmd.fields |= AC_SET_POWER;
+      cmd.value.power = true;
+      cmd.source = "AI_ON";
+    }
+    if (act.tempMode != RT_KEEP)
+    {
+      cmd.fields |= AC_SET_TEMP;
+      cmd.value.temp = (act.tempMode == RT_SET) ? act.temp : ctrl.ac.temp + act.temp;
+    }
+    if (act.fan != RULE_KEEP)
+    {
+      cmd.fields |= AC_SET_FAN;
+      cmd.value.fan = intToFanSpeed(act.fan);
+    }
+    if (act.mode != RULE_KEEP)
+    {
+      cmd.fields |= AC_SET_MODE;
+      cmd.value.mode = act.mode;
+    }
+    return cmd;
+  }
+
+  // Chạy mỗi giây khi AI bật; trả về index luật đã áp dụng, -1 nếu không có
+  int runRules(uint32_t nowMs)
+  {
+    if (!aiEnabled)
+      return -1;
+    if (lastRuleActionMs != 0 && nowMs - lastRuleActionMs < RULE_COOLDOWN_MS)
+      return -1;
+
+    RuleSnapshot snap;
+    buildRuleSnapshot(snap, nowMs);
+    int fired = rules.evaluate(snap, nowMs);
+    if (fired < 0)
+    {
+      LOG_DEBUG("⏸ RULES: Maintain - All OK");
+      return -1;
+    }
+
+    const RuleDef &rule = rules.rule(fired);
+    lastActionName = rule.name;
+    LOG_AI("⚡ Rule %s → %s: %s (T=%.1fC H=%.0f%%)",
+           rule.name, ruleActionToString(rule.action.kind), rule.reason,
+           ctrl.sensors.temperature, ctrl.sensors.humidity);
+    apply(ruleCommand(rule));
+    lastRuleReason = rule.reason;
+    autoOptimizations++;
+    lastRuleActionMs = nowMs;
+    return fired;
+  }
+
+  // ===== Điều khiển dự báo =====
+  // Khi bật predictive và mô hình phòng đã đủ tin cậy thì thay bảng luật;
+  // trước đó (hoặc sau POST /model reset) vẫn chạy luật.
+  bool usingPredictive() const { return predictive && model.ready(); }
+
+  // Chỉ loop(): áp dụng yêu cầu POST /model đang chờ; true nếu cài đặt dự
+  // báo đã đổi và cần lưu NVS
+  bool applyModelSettings()
+  {
+    int8_t on;
+    if (!model.takeSettingsRequest(on))
+      return false;
+    if (on >= 0)
+      predictive = on == 1;
+    return true;
+  }
+
+  // aiTask gọi mỗi giây; true nếu vừa áp dụng 1 lệnh (tên ở lastActionName)
+  bool runAuto(uint32_t nowMs)
+  {
+    if (usingPredictive())
+      return runPredictive(nowMs);
+    return runRules(nowMs) >= 0;
+  }
+
+  bool runPredictive(uint32_t nowMs)
+  {
+    if (!aiEnabled || !climateValid())
+      return false;
+    if (lastPredictMs != 0 && nowMs - lastPredictMs < PREDICT_INTERVAL_MS)
+      return false;
+    if (lastRuleActionMs != 0 && nowMs - lastRuleActionMs < RULE_COOLDOWN_MS)
+      return false;
+    lastPredictMs = nowMs;
+
+    const SensorState &s = ctrl.sensors;
+    bool present = s.presence || s.motion;
+    bool occupied = present || nowMs - lastPresenceMs < PREDICT_ABSENT_S * 1000UL;
+    PredictPlan plan;
+    model.plan(s.temperature, hal.clock.hour() * 60 + hal.clock.minute(), ctrl.ac, occupied, nowMs, plan);
+    if (!plan.change)
+    {
+      LOG_DEBUG("⏸ PREDICT: giữ nguyên (cost %.1f)", plan.keepCost);
+      return false;
+    }
+
+    AcCommand cmd = {AC_SET_POWER, plan.target, "AI_OFF"};
+    if (plan.target.power)
+    {
+      cmd.fields = AC_SET_POWER | AC_SET_TEMP | AC_SET_MODE | AC_SET_FAN;
+      cmd.source = "AI_PREDICT";
+    }
+    LOG_AI("🔮 PREDICT → %s %dC %s: dự báo %.1fC (cost %.1f → %.1f)",
+           plan.target.power ? "ON" : "OFF", plan.target.temp, fanSpeedToString((FanSpeed)plan.target.fan),
+           plan.predictedC, plan.keepCost, plan.bestCost);
+    apply(cmd);
+    lastRuleReason = plan.target.power ? "Predictive adjust" : "Predictive off";
+    lastActionName = "predictive";
+    autoOptimizations++;
+    lastRuleActionMs = nowMs;
+    return true;
+  }
+
+  // ===== Màn hình chính =====
+  void composeScreen(LcdFrame &frame, uint32_t nowMs)
+  {
+    const SensorState &s = ctrl.sensors;
+    frame.clear();
+
+    //  DÒNG 1: Luôn hiển thị nhiệt độ + độ ẩm
+    frame.setCursor(0, 0);
+    frame.print("T:");
+    frame.print(s.temperature, 1);
+    frame.print("C ");
+    frame.print("H:");
+    frame.print((int)s.humidity);
+    frame.print("%");
+
+    // Hiển thị chỉ báo presence/test ở góc phải
+    if (s.presence)
+    {
+      frame.setCursor(14, 0);
+      frame.print(s.testMode ? "T" : "P");
+    }
+
+    if (aiEnabled)
+    {
+      frame.setCursor(15, 0);
+      frame.print("*");
+    }
+
+    // DÒNG 2: Luân phiên hiển thị thông tin
+    frame.setCursor(0, 1);
+
+    if (ctrl.ac.power)
+    {
+      // KHI AC BẬT: "AC:24C C QUI" hoặc "AC:24C C HI" (16 ký tự)
+      frame.print("AC:");
+      frame.print((int)ctrl.ac.temp);
+      frame.print("C ");
+      frame.print(acModeToString(ctrl.ac.mode)[0]);
+      frame.print(" ");
+
+      const char *fanDisplay;
+      switch (ctrl.ac.fan)
+      {
+      case FAN_QUIET:
+        fanDisplay = "QUI";
+        break;
+      case FAN_LOW:
+        fanDisplay = "LOW";
+        break;
+      case FAN_HIGH:
+        fanDisplay = "HI ";
+        break;
+      case FAN_AUTO:
+        fanDisplay = "AUT";
+        break;
+      default:
+        fanDisplay = "MED";
+      }
+      frame.print(fanDisplay);
+      return;
+    }
+
+    // Khi AC tắt: luân phiên thông tin, đổi mỗi 3 giây
+    switch ((nowMs / 3000) % 3)
+    {
+    case 0: // Giờ + presence
+      frame.printf("%02d:%02d", hal.clock.hour(), hal.clock.minute());
+      frame.print(s.presence ? " PRESENT" : " EMPTY  ");
+      break;
+
+    case 1: // Khoảng cách
+      if (s.presence)
+      {
+        frame.print("Dist: ");
+        frame.print((int)s.distance);
+        frame.print("cm   ");
+      }
+      else
+      {
+        frame.print("No presence    ");
+      }
+      break;
+
+    default: // Ánh sáng
+      frame.print("Light: ");
+      frame.print(s.light);
+      frame.print("   ");
+      break;
+    }
+  }
+
+  // ctrl chỉ được loop() đọc/ghi; task khác dùng read()
+  ControllerState ctrl = {0, 0, 0, {false, 25, AC_MODE_COOL, FAN_MEDIUM}, {}};
+  bool aiEnabled = false;
+  bool predictive = false; // chỉ loop() ghi; POST /model qua model.requestSettings()
+  RuleEngine rules;
+  RoomModel model;
+  IrTxCoalescer irTx;
+  const char *lastRuleReason = "";
+  const char *lastActionName = "";
+  uint32_t autoOptimizations = 0;
+  uint32_t lastRuleActionMs = 0;
+  uint32_t lastMotionMs = 0;
+  uint32_t lastPresenceMs = 0;
+  uint32_t lastPredictMs = 0;
+
+private:
+  Hal &hal;
+  SeqSlot<ControllerState> slot;
+  uint32_t climateSamples = 0;
+  bool publishedPresence = false;
+  int publishedDistance = -1;
+};
+
+// ============ JSON ENDPOINT ============
+// Body của POST /ac/command → các trường lệnh; trường sai bị bỏ qua
+inline void acCommandFromJson(const JsonDocument &doc, AcCommand &cmd)
+{
+  if (doc.containsKey("status"))
+  {
+    cmd.value.power = doc["status"].as<bool>();
+    cmd.fields |= AC_SET_POWER;
+  }
+
+  if (doc.containsKey("temperature"))
+  {
+    int temp = doc["temperature"];
+    if (temp >= AC_TEMP_MIN && temp <= AC_TEMP_MAX)
+    {
+      cmd.value.temp = temp;
+      cmd.fields |= AC_SET_TEMP;
+    }
+  }
+
+  if (doc.containsKey("mode") && parseAcMode(doc["mode"].as<const char *>(), cmd.value.mode))
+    cmd.fields |= AC_SET_MODE;
+
+  if (doc.containsKey("fan_speed"))
+  {
+    if (doc["fan_speed"].is<const char *>())
+      cmd.value.fan = stringToFanSpeed(doc["fan_speed"].as<const char *>());
+    else
+      cmd.value.fan = intToFanSpeed(doc["fan_speed"].as<int>());
+    cmd.fields |= AC_SET_FAN;
+  }
+}
+
+inline void buildSensorsJson(JsonDocument &doc, const ControllerState &st, bool aiEnabled)
+{
+  doc["temperature"] = st.sensors.temperature;
+  doc["humidity"] = st.sensors.humidity;
+  doc["light"] = st.sensors.light;
+  doc["motion"] = st.sensors.motion;
+  doc["presence"] = st.sensors.presence;
+  doc["presence_distance"] = st.sensors.distance;
+  doc["test_mode"] = st.sensors.testMode;
+  doc["ac_status"] = st.ac.power;
+  doc["ac_temp"] = st.ac.temp;
+  doc["ac_mode"] = acModeToString(st.ac.mode);
+  doc["ac_fan"] = fanSpeedToString((FanSpeed)st.ac.fan);
+  doc["ac_fan_level"] = st.ac.fan;
+  doc["llm_enabled"] = aiEnabled;
+  doc["model"] = "Daikin";
+  doc["version"] = st.version;
+}
+
+inline void buildAcStatusJson(JsonDocument &doc, const ControllerState &st, bool aiEnabled)
+{
+  doc["status"] = st.ac.power ? "on" : "off";
+  doc["temperature"] = st.ac.temp;
+  doc["mode"] = acModeToString(st.ac.mode);
+  doc["fan_speed"] = fanSpeedToString((FanSpeed)st.ac.fan);
+  doc["fan_level"] = st.ac.fan;
+  doc["llm_enabled"] = aiEnabled;
+  doc["model"] = "Daikin";
+  // Cache theo acVersion nên không kèm version tổng (đổi theo cảm biến)
+  doc["ac_version"] = st.acVersion;
+}
+
+// GET /model: tham số đã học, cấu hình và kế hoạch gần nhất của chế độ dự báo
+inline void buildModelJson(JsonDocument &doc, const RoomModelSnapshot &m, bool predictive, bool active)
+{
+  doc["predictive"] = predictive;
+  doc["active"] = active; // predictive && mô hình đủ tin cậy
+  doc["ready"] = m.ready;
+  doc["updates"] = m.updates;
+  doc["window_s"] = RM_WINDOW_MS / 1000;
+  doc["tau_h"] = m.tauH;
+  doc["ambient_c"] = m.ambientC;
+  doc["ac_gain_c_per_h"] = m.gainCPerH;
+  doc["rms_c_per_h"] = m.rmsCPerH;
+  JsonArray theta = doc.createNestedArray("theta");
+  for (float v : m.theta)
+    theta.add(v);
+
+  JsonObject cfg = doc.createNestedObject("config");
+  cfg["comfort_low"] = m.config.comfortLowC;
+  cfg["comfort_high"] = m.config.comfortHighC;
+  cfg["set_min"] = m.config.setMin;
+  cfg["set_max"] = m.config.setMax;
+  cfg["horizon_min"] = m.config.horizonMin;
+  cfg["comfort_weight"] = m.config.comfortWeight;
+  cfg["change_cost"] = m.config.changeCost;
+
+  JsonObject plan = doc.createNestedObject("last_plan");
+  plan["plans"] = m.plans;
+  plan["changes"] = m.changes;
+  if (m.plans == 0)
+    return;
+  const PredictPlan &p = m.lastPlan;
+  plan["at_ms"] = p.atMs;
+  plan["change"] = p.change;
+  plan["power"] = p.target.power;
+  plan["temperature"] = p.target.temp;
+  plan["fan_speed"] = fanSpeedToString((FanSpeed)p.target.fan);
+  plan["predicted_c"] = p.predictedC;
+  plan["duty_min"] = p.dutyMin;
+  plan["keep_cost"] = p.keepCost;
+  plan["best_cost"] = p.bestCost;
+}
+
+// Body của POST /model → cấu hình; false nếu giá trị vô lý (không đổi gì)
+inline bool predictConfigFromJson(const JsonDocument &doc, PredictConfig &cfg)
+{
+  PredictConfig c = cfg;
+  c.comfortLowC = doc["comfort_low"] | c.comfortLowC;
+  c.comfortHighC = doc["comfort_high"] | c.comfortHighC;
+  int setMin = doc["set_min"] | (int)c.setMin;
+  int setMax = doc["set_max"] | (int)c.setMax;
+  int horizon = doc["horizon_min"] | (int)c.horizonMin;
+  c.comfortWeight = doc["comfort_weight"] | c.comfortWeight;
+  c.changeCost = doc["change_cost"] | c.changeCost;
+  if (c.comfortLowC >= c.comfortHighC || setMin < AC_TEMP_MIN || setMax > AC_TEMP_MAX ||
+      setMin > setMax || horizon < 1 || horizon > 240 || c.comfortWeight < 0 || c.changeCost < 0)
+    return false;
+  c.setMin = setMin;
+  c.setMax = setMax;
+  c.horizonMin = horizon;
+  cfg = c;
+  return true;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <Arduino.h>
+#include "seqlock.h"
+
+// ============ TRẠNG THÁI BỘ ĐIỀU KHIỂN (POD + SEQLOCK) ============
+// loop() là writer duy nhất: mọi thay đổi AC đi qua AcCommand (handler HTTP
+// và worker task chỉ xếp lệnh vào hàng đợi). Sau mỗi thay đổi, loop() publish
+// bản sao ControllerState qua SeqSlot; task khác đọc snapshot nhất quán mà
+// không khóa. version tăng đơn điệu ở mỗi lần publish.
+
+#define AC_TEMP_MIN 16
+#define AC_TEMP_MAX 30
+#define AC_COMMAND_QUEUE_DEPTH 8
+
+// Trường được đặt trong AcCommand
+#define AC_SET_POWER 0x01
+#define AC_SET_TEMP 0x02
+#define AC_SET_MODE 0x04
+#define AC_SET_FAN 0x08
+
+enum FanSpeed
+{
+  FAN_QUIET = 1,
+  FAN_LOW = 2,
+  FAN_MEDIUM = 3,
+  FAN_HIGH = 4,
+  FAN_AUTO = 5
+};
+
+enum AcMode : uint8_t
+{
+  AC_MODE_COOL,
+  AC_MODE_HEAT,
+  AC_MODE_DRY,
+  AC_MODE_FAN,
+  AC_MODE_AUTO
+};
+
+inline const char *fanSpeedToString(FanSpeed speed)
+{
+  switch (speed)
+  {
+  case FAN_QUIET:
+    return "QUIET";
+  case FAN_LOW:
+    return "LOW";
+  case FAN_MEDIUM:
+    return "MED";
+  case FAN_HIGH:
+    return "HIGH";
+  case FAN_AUTO:
+    return "AUTO";
+  default:
+    return "MED";
+  }
+}
+
+// "QUIET".."AUTO" hoặc "1".."5", không phân biệt hoa thường
+inline FanSpeed stringToFanSpeed(const char *speed)
+{
+  if (!speed)
+    return FAN_MEDIUM;
+  if (!strcasecmp(speed, "QUIET") || !strcmp(speed, "1"))
+    return FAN_QUIET;
+  if (!strcasecmp(speed, "LOW") || !strcmp(speed, "2"))
+    return FAN_LOW;
+  if (!strcasecmp(speed, "MEDIUM") || !strcasecmp(speed, "MED") || !strcmp(speed, "3"))
+    return FAN_MEDIUM;
+  if (!strcasecmp(speed, "HIGH") || !strcmp(speed, "4"))
+    return FAN_HIGH;
+  if (!strcasecmp(speed, "AUTO") || !strcmp(speed, "5"))
+    return FAN_AUTO;
+  return FAN_MEDIUM;
+}
+
+inline FanSpeed intToFanSpeed(int speed)
+{
+  if (speed < 1)
+    speed = 1;
+  if (speed > 5)
+    speed = 5;
+  return static_cast<FanSpeed>(speed);
+}
+
+inline const char *acModeToString(uint8_t mode)
+{
+  switch (mode)
+  {
+  case AC_MODE_HEAT:
+    return "HEAT";
+  case AC_MODE_DRY:
+    return "DRY";
+  case AC_MODE_FAN:
+    return "FAN";
+  case AC_MODE_AUTO:
+    return "AUTO";
+  default:
+    return "COOL";
+  }
+}
+
+// false nếu không phải tên mode hợp lệ (mode giữ nguyên)
+inline bool parseAcMode(const char *name, uint8_t &mode)
+{
+  static const char *const names[] = {"COOL", "HEAT", "DRY", "FAN", "AUTO"};
+  for (uint8_t i = 0; name && i < sizeof(names) / sizeof(names[0]); i++)
+  {
+    if (!strcasecmp(name, names[i]))
+    {
+      mode = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Tên lạ → COOL
+inline AcMode acModeFromString(const char *name)
+{
+  uint8_t mode = AC_MODE_COOL;
+  parseAcMode(name, mode);
+  return (AcMode)mode;
+}
+
+struct AcState
+{
+  bool power;
+  int8_t temp;
+  uint8_t mode; // AcMode
+  uint8_t fan;  // FanSpeed
+};
+
+struct SensorState
+{
+  float temperature;
+  float humidity;
+  int16_t light;
+  bool motion;
+  bool presence;
+  bool testMode;
+  float distance;
+};
+
+struct ControllerState
+{
+  uint32_t version;   // mỗi lần publish
+  uint32_t acVersion; // mỗi lệnh AC đã áp dụng
+  uint32_t updatedMs;
+  AcState ac;
+  SensorState sensors;
+};
+
+struct AcCommand
+{
+  uint8_t fields; // AC_SET_*
+  AcState value;
+  const char *source; // chuỗi hằng, vd "API_COMMAND"
+};
+
+// Ghép các trường được đặt của lệnh lên trạng thái hiện tại
+inline AcState mergeAcCommand(AcState base, const AcCommand &cmd)
+{
+  if (cmd.fields & AC_SET_POWER)
+    base.power = cmd.value.power;
+  if (cmd.fields & AC_SET_TEMP)
+    base.temp = constrain(cmd.value.temp, AC_TEMP_MIN, AC_TEMP_MAX);
+  if (cmd.fields & AC_SET_MODE)
+    base.mode = cmd.value.mode;
+  if (cmd.fields & AC_SET_FAN)
+    base.fan = cmd.value.fan;
+  return base;
+}
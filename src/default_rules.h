@@ -0,0 +1,37 @@
+#pragma once
+
+#include "controller_state.h"
+#include "rule_engine.h"
+
+// ============ BẢNG LUẬT MẶC ĐỊNH ============
+// Thay cho chuỗi if của mock LLM cũ, dùng chung cho firmware và env:native.
+// Nhiệt độ / độ ẩm tính theo 0.1 đơn vị; thứ tự trong bảng = độ ưu tiên.
+constexpr RuleDef DEFAULT_RULES[] = {
+    {"absent_off", "No presence", 3,
+     {{RF_PRESENCE, RO_EQ, 0, 0}, {RF_AC_ON, RO_EQ, 1, 0}, {RF_ABSENT_S, RO_GE, 10, 0}},
+     {RA_TURN_OFF, RT_KEEP, 0, RULE_KEEP, RULE_KEEP}},
+    {"very_hot_on", "Very hot", 3,
+     {{RF_TEMP, RO_GE, 310, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_AC_ON, RO_EQ, 0, 0}},
+     {RA_TURN_ON, RT_SET, 22, FAN_HIGH, AC_MODE_COOL}},
+    {"too_hot_on", "Very hot", 3,
+     {{RF_TEMP, RO_GE, 290, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_AC_ON, RO_EQ, 0, 0}},
+     {RA_TURN_ON, RT_SET, 24, FAN_MEDIUM, AC_MODE_COOL}},
+    {"hot_on", "Hot", 3,
+     {{RF_TEMP, RO_GE, 270, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_AC_ON, RO_EQ, 0, 0}},
+     {RA_TURN_ON, RT_SET, 25, FAN_MEDIUM, AC_MODE_COOL}},
+    {"cold_off", "Too cold", 2,
+     {{RF_TEMP, RO_LE, 220, 0}, {RF_AC_ON, RO_EQ, 1, 0}},
+     {RA_TURN_OFF, RT_KEEP, 0, RULE_KEEP, RULE_KEEP}},
+    {"humid_dry", "High humidity", 4,
+     {{RF_HUMIDITY, RO_GE, 750, 0}, {RF_TEMP, RO_IN, 240, 280}, {RF_AC_ON, RO_EQ, 1, 0}, {RF_AC_MODE, RO_NE, AC_MODE_DRY, 0}},
+     {RA_ADJUST, RT_SET, 26, FAN_MEDIUM, AC_MODE_DRY}},
+    {"warm_lower", "Still warm, lowering", 3,
+     {{RF_AC_ON, RO_EQ, 1, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_TEMP_OVER_SET, RO_GT, 30, 0}},
+     {RA_ADJUST, RT_DELTA, -2, FAN_HIGH, RULE_KEEP}},
+    {"near_target", "Near target, reduce", 4,
+     {{RF_AC_ON, RO_EQ, 1, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_TEMP_ERR_ABS, RO_LE, 10, 0}, {RF_AC_FAN, RO_NE, FAN_LOW, 0}},
+     {RA_ADJUST, RT_KEEP, 0, FAN_LOW, RULE_KEEP}},
+    {"night_quiet", "Night mode", 5,
+     {{RF_AC_ON, RO_EQ, 1, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_HOUR, RO_IN, 22, 6}, {RF_AC_FAN, RO_NE, FAN_QUIET, 0}, {RF_LIGHT, RO_GT, 2500, 0}},
+     {RA_ADJUST, RT_KEEP, 0, FAN_QUIET, RULE_KEEP}},
+};
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <Arduino.h>
+#include "seqlock.h"
+
+// ============ DHT22 KHÔNG CHẶN (ISR TIMESTAMP CẠNH) ============
+// Thư viện DHT cũ tắt ngắt ~5ms để bit-bang. Ở đây host kéo bus LOW rồi nhả,
+// ISR chỉ ghi timestamp từng cạnh; việc giải mã 40 bit + checksum chạy sau
+// trên loop(). Mẫu hợp lệ được publish qua SeqSlot kèm timestamp.
+
+#define DHT_START_LOW_MS 2   // DHT22 cần >= 1ms tín hiệu start
+#define DHT_CAPTURE_MS 8     // khung 40 bit dài ~5ms
+#define DHT_MAX_EDGES 96     // 2 cạnh/bit + cạnh phản hồi
+#define DHT_BIT_ONE_US 50    // HIGH ~26-28µs = 0, ~70µs = 1
+#define DHT_HEALTH_WINDOW 10 // số lần đọc gần nhất để tính tỉ lệ lỗi
+#define DHT_FAILING_STREAK 5 // lỗi liên tiếp → FAILING
+
+struct DhtSample
+{
+  float temperature;
+  float humidity;
+  uint32_t timestampMs;
+};
+
+enum DhtHealth : uint8_t
+{
+  DHT_OK,
+  DHT_DEGRADED, // có lỗi lẻ tẻ trong cửa sổ gần nhất
+  DHT_FAILING   // lỗi liên tiếp, giá trị đang cũ
+};
+
+enum DhtError : uint8_t
+{
+  DHT_ERR_NONE,
+  DHT_ERR_NO_RESPONSE, // quá ít cạnh: cảm biến không trả lời
+  DHT_ERR_FRAME,       // số xung HIGH không đủ 40 bit
+  DHT_ERR_CHECKSUM
+};
+
+struct DhtStats
+{
+  uint32_t reads;
+  uint32_t ok;
+  uint32_t noResponse;
+  uint32_t frameErrors;
+  uint32_t checksumErrors;
+  uint16_t failStreak;
+  uint32_t lastLatencyUs; // từ lúc kéo bus đến lúc publish
+  uint32_t maxLatencyUs;
+  uint64_t totalLatencyUs;
+};
+
+inline const char *dhtHealthToString(DhtHealth health)
+{
+  switch (health)
+  {
+  case DHT_OK:
+    return "ok";
+  case DHT_DEGRADED:
+    return "degraded";
+  default:
+    return "failing";
+  }
+}
+
+class Dht22Reader
+{
+public:
+  void begin(uint8_t dataPin)
+  {
+    pin = dataPin;
+    pinMode(pin, INPUT_PULLUP);
+  }
+
+  // Bước 1: kéo bus LOW. Trả về số ms cần chờ trước step() kế tiếp.
+  uint32_t startRead()
+  {
+    if (state != IDLE)
+      return 0;
+    startUs = (uint32_t)esp_timer_get_time();
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+    state = START_LOW;
+    return DHT_START_LOW_MS;
+  }
+
+  // Tiến state machine. Trả về ms đến lần step() tiếp theo, 0 = xong.
+  uint32_t step(uint32_t nowMs)
+  {
+    switch (state)
+    {
+    case START_LOW:
+      // Nhả bus, bắt đầu ghi cạnh
+      edgeCount = 0;
+      pinMode(pin, INPUT_PULLUP);
+      attachInterruptArg(digitalPinToInterrupt(pin), onEdge, this, CHANGE);
+      state = CAPTURE;
+      return DHT_CAPTURE_MS;
+
+    case CAPTURE:
+      detachInterrupt(digitalPinToInterrupt(pin));
+      state = IDLE;
+      finishRead(nowMs);
+      return 0;
+
+    default:
+      return 0;
+    }
+  }
+
+  DhtSample latest() const { return sample.read(); }
+  uint32_t sampleVersion() const { return sample.version(); }
+  const DhtStats &getStats() const { return stats; }
+  DhtError lastError() const { return lastErr; }
+
+  // Tỉ lệ lỗi trong DHT_HEALTH_WINDOW lần đọc gần nhất (0..1)
+  float failureRate() const
+  {
+    uint8_t n = windowCount;
+    if (n == 0)
+      return 0;
+    uint8_t fails = 0;
+    for (uint8_t i = 0; i < n; i++)
+      fails += (failWindow >> i) & 1;
+    return (float)fails / n;
+  }
+
+  DhtHealth health() const
+  {
+    if (stats.failStreak >= DHT_FAILING_STREAK)
+      return DHT_FAILING;
+    if (failWindow != 0)
+      return DHT_DEGRADED;
+    return DHT_OK;
+  }
+
+private:
+  enum State : uint8_t
+  {
+    IDLE,
+    START_LOW,
+    CAPTURE
+  };
+
+  static void IRAM_ATTR onEdge(void *arg)
+  {
+    Dht22Reader *self = static_cast<Dht22Reader *>(arg);
+    uint16_t n = self->edgeCount;
+    if (n >= DHT_MAX_EDGES)
+      return;
+    self->edgeUs[n] = (uint32_t)esp_timer_get_time();
+    self->edgeLevel[n] = digitalRead(self->pin);
+    self->edgeCount = n + 1;
+  }
+
+  void finishRead(uint32_t nowMs)
+  {
+    stats.reads++;
+    uint8_t bytes[5] = {0};
+    DhtError err = decode(bytes);
+
+    if (err == DHT_ERR_NONE)
+    {
+      DhtSample s;
+      s.humidity = ((bytes[0] << 8) | bytes[1]) * 0.1f;
+      s.temperature = (((bytes[2] & 0x7F) << 8) | bytes[3]) * 0.1f;
+      if (bytes[2] & 0x80)
+        s.temperature = -s.temperature;
+      s.timestampMs = nowMs;
+      sample.publish(s);
+
+      uint32_t latency = (uint32_t)esp_timer_get_time() - startUs;
+      stats.ok++;
+      stats.failStreak = 0;
+      stats.lastLatencyUs = latency;
+      stats.totalLatencyUs += latency;
+      if (latency > stats.maxLatencyUs)
+        stats.maxLatencyUs = latency;
+    }
+    else
+    {
+      stats.failStreak++;
+      if (err == DHT_ERR_NO_RESPONSE)
+        stats.noResponse++;
+      else if (err == DHT_ERR_FRAME)
+        stats.frameErrors++;
+      else
+        stats.checksumErrors++;
+    }
+
+    lastErr = err;
+    failWindow = (uint16_t)((failWindow << 1) | (err != DHT_ERR_NONE ? 1 : 0)) &
+                 ((1u << DHT_HEALTH_WINDOW) - 1);
+    if (windowCount < DHT_HEALTH_WINDOW)
+      windowCount++;
+  }
+
+  // Lấy 40 xung HIGH cuối cùng (bỏ xung phản hồi 80µs phía trước)
+  DhtError decode(uint8_t *bytes) const
+  {
+    uint16_t n = edgeCount;
+    if (n < 10)
+      return DHT_ERR_NO_RESPONSE;
+
+    uint8_t widths[48];
+    uint8_t highCount = 0;
+    for (uint16_t i = 1; i < n; i++)
+    {
+      // Xung HIGH = cạnh lên (level 1) rồi cạnh xuống (level 0)
+      if (edgeLevel[i - 1] == HIGH && edgeLevel[i] == LOW)
+      {
+        uint32_t w = edgeUs[i] - edgeUs[i - 1];
+        if (highCount == sizeof(widths))
+        {
+          memmove(widths, widths + 1, sizeof(widths) - 1);
+          highCount--;
+        }
+        widths[highCount++] = w > 255 ? 255 : (uint8_t)w;
+      }
+    }
+
+    if (highCount < 40)
+      return DHT_ERR_FRAME;
+
+    const uint8_t *bits = widths + (highCount - 40);
+    for (uint8_t i = 0; i < 40; i++)
+    {
+      bytes[i / 8] <<= 1;
+      if (bits[i] > DHT_BIT_ONE_US)
+        bytes[i / 8] |= 1;
+    }
+
+    if ((uint8_t)(bytes[0] + bytes[1] + bytes[2] + bytes[3]) != bytes[4])
+      return DHT_ERR_CHECKSUM;
+    return DHT_ERR_NONE;
+  }
+
+  uint8_t pin = 0;
+  State state = IDLE;
+  uint32_t startUs = 0;
+
+  // Ghi bởi ISR trong lúc CAPTURE
+  volatile uint32_t edgeUs[DHT_MAX_EDGES] = {};
+  volatile uint8_t edgeLevel[DHT_MAX_EDGES] = {};
+  volatile uint16_t edgeCount = 0;
+
+  SeqSlot<DhtSample> sample;
+  DhtStats stats = {};
+  DhtError lastErr = DHT_ERR_NONE;
+  uint16_t failWindow = 0; // bit = 1 là lần đọc lỗi
+  uint8_t windowCount = 0;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+#include "controller_state.h"
+
+// ============ HAL MỎNG (PHẦN CỨNG ↔ BỘ ĐIỀU KHIỂN) ============
+// ClimateController chỉ thấy phần cứng qua các interface này. Bản ESP32
+// (DHT22, radar, RMT, LCD I2C, RTC) nằm trong main.cpp; bản giả lập cho
+// env:native (cảm biến giả, IR ghi lại, LCD ảo, đồng hồ mô phỏng) nằm trong
+// src/native/. millis() / esp_timer_get_time() trên host cũng chạy theo
+// đồng hồ mô phỏng.
+
+class HalClock
+{
+public:
+  virtual uint32_t nowMs() = 0;
+  virtual uint8_t hour() = 0; // giờ địa phương (RTC)
+  virtual uint8_t minute() = 0;
+  virtual uint32_t unixTime() = 0; // giờ RTC dạng epoch giây (không đổi múi giờ)
+};
+
+class HalSensors
+{
+public:
+  // true nếu có mẫu nhiệt/ẩm mới kể từ lần gọi trước
+  virtual bool readClimate(float &temperature, float &humidity) = 0;
+  virtual int16_t readLight() = 0;
+  virtual bool readMotion() = 0; // mức PIR hiện tại
+  // true nếu có kết quả đo khoảng cách mới (cm)
+  virtual bool readDistance(float &cm) = 0;
+};
+
+class HalIrSink
+{
+public:
+  // Mã hóa trạng thái thành khung IR, trả về số byte
+  virtual uint16_t encode(const AcState &ac, uint8_t *frame, uint16_t maxLen) = 0;
+  virtual bool transmit(const uint8_t *frame, uint16_t len) = 0;
+  virtual bool busy() = 0; // khung trước chưa phát xong
+};
+
+// Đích của LcdFrame::flush()
+class HalDisplay
+{
+public:
+  virtual void setCursor(uint8_t col, uint8_t row) = 0;
+  virtual size_t write(uint8_t ch) = 0;
+};
+
+struct Hal
+{
+  HalClock &clock;
+  HalSensors &sensors;
+  HalIrSink &ir;
+  HalDisplay &display;
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ GOM BODY REQUEST POST ============
+// ESPAsyncWebServer gọi body callback theo từng đoạn TCP (data, len, index,
+// total), data không có '\0' ở cuối. Body nằm gọn trong 1 đoạn (thường gặp)
+// được trả lại chính con trỏ data để parse tại chỗ, không chép. Body nhiều
+// đoạn được gom vào 1 slot arena cố định (BODY_ARENA_SLOTS x BODY_MAX_BYTES,
+// không cấp phát heap) theo con trỏ request, handler chỉ nhận body đủ đúng
+// 1 lần ở đoạn cuối. Không dùng _tempObject: thư viện free() nó khi hủy
+// request và mọi handler đang coi _tempObject != NULL là "bỏ qua".
+//
+// Body > BODY_MAX_BYTES bị từ chối ngay ở đoạn đầu (total đã biết), hết slot
+// thì từ chối để client thử lại. Slot trả về khi handler xong hoặc client
+// ngắt giữa chừng; slot bị bỏ quên quá BODY_STALE_MS được lấy lại và đoạn
+// kế tiếp của request đó nhận BODY_EXPIRED. Mỗi request chỉ nhận đúng 1 trạng
+// thái cần trả lời (READY hoặc 1 lỗi); các đoạn sau đó là BODY_DROPPED.
+// Chỉ gọi từ task async_tcp nên không khóa.
+//
+// ArduinoJson 6 không parse tăng dần được nên body nhiều đoạn vẫn phải gom
+// đủ rồi mới parse; arena cố định thay cho malloc mỗi request.
+
+#define BODY_MAX_BYTES 1024
+#define BODY_ARENA_SLOTS 4
+#define BODY_STALE_MS 10000
+
+enum BodyStatus : uint8_t
+{
+  BODY_READY,        // body đủ, dùng body/bodyLen
+  BODY_PENDING,      // chờ đoạn tiếp
+  BODY_TOO_LARGE,    // đoạn đầu, total > BODY_MAX_BYTES
+  BODY_BUSY,         // đoạn đầu, hết slot
+  BODY_OUT_OF_ORDER, // đoạn không nối tiếp phần đã gom, slot bị bỏ
+  BODY_EXPIRED,      // slot đã bị lấy lại vì upload quá chậm
+  BODY_DROPPED       // request đã nhận 1 lỗi ở trên, bỏ qua im lặng
+};
+
+struct BodyStats
+{
+  uint32_t inPlace;   // 1 đoạn, parse tại chỗ
+  uint32_t assembled; // gom từ nhiều đoạn
+  uint32_t tooLarge;
+  uint32_t busy;
+  uint32_t outOfOrder;
+  uint32_t expired;   // slot bị lấy lại sau BODY_STALE_MS
+  uint32_t abandoned; // client ngắt trước khi đủ body
+  uint8_t inUse;
+  uint8_t peakInUse;
+};
+
+class BodyAssembler
+{
+public:
+  BodyStatus feed(const void *owner, uint8_t *data, size_t len, size_t index, size_t total,
+                  uint32_t nowMs, char *&body, size_t &bodyLen)
+  {
+    if (total > BODY_MAX_BYTES)
+    {
+      if (index != 0)
+        return BODY_DROPPED;
+      stats.tooLarge++;
+      return BODY_TOO_LARGE;
+    }
+    if (index == 0 && len >= total)
+    {
+      stats.inPlace++;
+      body = (char *)data;
+      bodyLen = total;
+      return BODY_READY;
+    }
+
+    Slot *slot = index == 0 ? claim(owner, nowMs) : find(owner);
+    if (!slot)
+    {
+      if (index != 0)
+        return forgetExpired(owner) ? BODY_EXPIRED : BODY_DROPPED;
+      stats.busy++;
+      return BODY_BUSY;
+    }
+    if (index != slot->len || index + len > total)
+    {
+      stats.outOfOrder++;
+      drop(*slot);
+      return BODY_OUT_OF_ORDER;
+    }
+    memcpy(slot->buf + index, data, len);
+    slot->len += len;
+    slot->lastMs = nowMs;
+    if (slot->len < total)
+      return BODY_PENDING;
+    stats.assembled++;
+    body = slot->buf;
+    bodyLen = slot->len;
+    return BODY_READY;
+  }
+
+  // Trả slot của owner (không có thì thôi). abandoned: client ngắt trước khi đủ body
+  void release(const void *owner, bool abandoned = false)
+  {
+    forgetExpired(owner);
+    Slot *slot = find(owner);
+    if (!slot)
+      return;
+    if (abandoned)
+      stats.abandoned++;
+    drop(*slot);
+  }
+
+  const BodyStats &getStats() const { return stats; }
+
+private:
+  struct Slot
+  {
+    const void *owner; // nullptr = trống
+    uint16_t len;
+    uint32_t lastMs;
+    char buf[BODY_MAX_BYTES];
+  };
+
+  Slot *find(const void *owner)
+  {
+    for (Slot &s : slots)
+      if (s.owner == owner)
+        return &s;
+    return nullptr;
+  }
+
+  // Slot trống → slot quá hạn. Owner cũ trùng địa chỉ thì dùng lại slot của nó.
+  Slot *claim(const void *owner, uint32_t nowMs)
+  {
+    forgetExpired(owner);
+    Slot *slot = find(owner);
+    if (!slot)
+      slot = find(nullptr);
+    if (!slot)
+    {
+      for (Slot &s : slots)
+        if (nowMs - s.lastMs >= BODY_STALE_MS)
+        {
+          stats.expired++;
+          expiredOwners[expiredNext] = s.owner;
+          expiredNext = (expiredNext + 1) % BODY_ARENA_SLOTS;
+          drop(s);
+          slot = &s;
+          break;
+        }
+      if (!slot)
+        return nullptr;
+    }
+    if (!slot->owner)
+    {
+      stats.inUse++;
+      if (stats.inUse > stats.peakInUse)
+        stats.peakInUse = stats.inUse;
+    }
+    slot->owner = owner;
+    slot->len = 0;
+    slot->lastMs = nowMs;
+    return slot;
+  }
+
+  // true nếu slot của owner đã bị lấy lại (và xóa dấu để chỉ báo 1 lần)
+  bool forgetExpired(const void *owner)
+  {
+    for (const void *&o : expiredOwners)
+      if (o == owner)
+      {
+        o = nullptr;
+        return true;
+      }
+    return false;
+  }
+
+  void drop(Slot &s)
+  {
+    if (s.owner)
+      stats.inUse--;
+    s.owner = nullptr;
+    s.len = 0;
+  }
+
+  Slot slots[BODY_ARENA_SLOTS] = {};
+  const void *expiredOwners[BODY_ARENA_SLOTS] = {}; // chờ nhận BODY_EXPIRED
+  uint8_t expiredNext = 0;
+  BodyStats stats = {};
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <Arduino.h>
+#include <driver/rmt.h>
+#include <ir_Daikin.h>
+
+// ============ PHÁT IR QUA RMT (TASK RIÊNG) ============
+// Khung Daikin đã mã hóa (getRaw()) được xếp vào hàng đợi; task IR chuyển
+// thành xung mark/space và để RMT tự điều chế sóng mang 38kHz. CPU rảnh
+// trong ~0.45s phát khung (task chỉ chờ rmt_write_items xong). Mỗi khung có
+// ticket: caller hỏi status()/wait() thay vì bị block.
+
+#define IR_RMT_QUEUE_DEPTH 2
+#define IR_RMT_TASK_STACK 3072
+#define IR_RMT_TASK_PRIORITY 2
+#define IR_RMT_CARRIER_HZ 38000
+#define IR_RMT_DUTY_PERCENT 50
+#define IR_RMT_MAX_BYTES 35 // kDaikinStateLength
+// 5 bit mở đầu + 3 section (header + bit + footer) + end marker
+#define IR_RMT_MAX_ITEMS (kDaikinHeaderLength + 1 + IR_RMT_MAX_BYTES * 8 + 3 * 2 + 1)
+
+enum IrTxStatus : uint8_t
+{
+  IR_TX_UNKNOWN, // ticket không hợp lệ
+  IR_TX_QUEUED,
+  IR_TX_SENDING,
+  IR_TX_DONE,
+  IR_TX_FAILED
+};
+
+inline const char *irTxStatusToString(IrTxStatus status)
+{
+  switch (status)
+  {
+  case IR_TX_QUEUED:
+    return "queued";
+  case IR_TX_SENDING:
+    return "sending";
+  case IR_TX_DONE:
+    return "done";
+  case IR_TX_FAILED:
+    return "failed";
+  default:
+    return "unknown";
+  }
+}
+
+struct IrRmtFrame
+{
+  uint32_t ticket;
+  int64_t enqueuedUs;
+  uint16_t len;
+  uint8_t data[IR_RMT_MAX_BYTES];
+};
+
+struct IrRmtStats
+{
+  uint32_t enqueued;
+  uint32_t rejected; // hàng đợi đầy
+  uint32_t sent;
+  uint32_t failed;
+  uint32_t lastQueueUs; // enqueue → bắt đầu phát
+  uint32_t lastAirUs;   // thời gian phát trên RMT
+  uint32_t lastTotalUs; // enqueue → phát xong
+  uint32_t maxTotalUs;
+  uint64_t totalUs;
+};
+
+class IrRmtTransmitter
+{
+public:
+  bool begin(uint8_t pin, rmt_channel_t ch)
+  {
+    channel = ch;
+    rmt_config_t cfg = {};
+    cfg.rmt_mode = RMT_MODE_TX;
+    cfg.channel = ch;
+    cfg.gpio_num = (gpio_num_t)pin;
+    cfg.clk_div = 80; // APB 80MHz → tick 1µs
+    cfg.mem_block_num = 1;
+    cfg.tx_config.carrier_en = true;
+    cfg.tx_config.carrier_freq_hz = IR_RMT_CARRIER_HZ;
+    cfg.tx_config.carrier_duty_percent = IR_RMT_DUTY_PERCENT;
+    cfg.tx_config.carrier_level = RMT_CARRIER_LEVEL_HIGH;
+    cfg.tx_config.idle_output_en = true;
+    cfg.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+    if (rmt_config(&cfg) != ESP_OK || rmt_driver_install(ch, 0, 0) != ESP_OK)
+      return false;
+
+    queue = xQueueCreate(IR_RMT_QUEUE_DEPTH, sizeof(IrRmtFrame));
+    return queue && xTaskCreate(taskEntry, "ir_tx", IR_RMT_TASK_STACK, this, IR_RMT_TASK_PRIORITY, &taskHandle) == pdPASS;
+  }
+
+  // Trả về ticket (> 0), 0 nếu hàng đợi đầy / khung sai độ dài.
+  // Chỉ 1 task gọi (loop) để ticket trong hàng đợi luôn liên tiếp.
+  uint32_t enqueue(const uint8_t *data, uint16_t len)
+  {
+    if (!queue || len != kDaikinStateLength)
+      return 0;
+
+    IrRmtFrame frame;
+    memcpy(frame.data, data, len);
+    frame.len = len;
+    frame.enqueuedUs = esp_timer_get_time();
+
+    portENTER_CRITICAL(&mux);
+    frame.ticket = nextTicket++;
+    portEXIT_CRITICAL(&mux);
+
+    if (xQueueSend(queue, &frame, 0) != pdTRUE)
+    {
+      portENTER_CRITICAL(&mux);
+      nextTicket--; // trả lại ticket chưa dùng
+      stats.rejected++;
+      portEXIT_CRITICAL(&mux);
+      return 0;
+    }
+    portENTER_CRITICAL(&mux);
+    stats.enqueued++;
+    portEXIT_CRITICAL(&mux);
+    return frame.ticket;
+  }
+
+  // Ticket hoàn thành theo thứ tự FIFO; chỉ nhớ lần lỗi gần nhất
+  IrTxStatus status(uint32_t ticket)
+  {
+    portENTER_CRITICAL(&mux);
+    IrTxStatus st;
+    if (ticket == 0 || ticket >= nextTicket)
+      st = IR_TX_UNKNOWN;
+    else if (ticket == sendingTicket)
+      st = IR_TX_SENDING;
+    else if (ticket > doneTicket)
+      st = IR_TX_QUEUED;
+    else
+      st = ticket == failedTicket ? IR_TX_FAILED : IR_TX_DONE;
+    portEXIT_CRITICAL(&mux);
+    return st;
+  }
+
+  // Chờ ticket xong (không gọi từ task async_tcp / loop)
+  IrTxStatus wait(uint32_t ticket, uint32_t timeoutMs)
+  {
+    uint32_t start = millis();
+    IrTxStatus st = status(ticket);
+    while ((st == IR_TX_QUEUED || st == IR_TX_SENDING) && millis() - start < timeoutMs)
+    {
+      vTaskDelay(pdMS_TO_TICKS(5));
+      st = status(ticket);
+    }
+    return st;
+  }
+
+  // Còn khung đang chờ hoặc đang phát
+  bool busy()
+  {
+    portENTER_CRITICAL(&mux);
+    bool b = doneTicket + 1 < nextTicket;
+    portEXIT_CRITICAL(&mux);
+    return b;
+  }
+
+  IrRmtStats getStats()
+  {
+    portENTER_CRITICAL(&mux);
+    IrRmtStats copy = stats;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+  }
+
+  TaskHandle_t task() const { return taskHandle; }
+
+  // Khung Daikin 280 bit → xung RMT, cùng định dạng IRsend::sendDaikin()
+  static uint16_t encodeDaikin(const uint8_t *data, uint16_t len, rmt_item32_t *items)
+  {
+    uint16_t n = 0;
+    // Mở đầu 0b00000 không có header
+    for (uint8_t i = 0; i < kDaikinHeaderLength; i++)
+      setItem(items[n++], kDaikinBitMark, kDaikinZeroSpace);
+    setItem(items[n++], kDaikinBitMark, kDaikinZeroSpace + kDaikinGap);
+
+    const uint16_t sections[3] = {kDaikinSection1Length, kDaikinSection2Length,
+                                  (uint16_t)(len - kDaikinSection1Length - kDaikinSection2Length)};
+    uint16_t offset = 0;
+    for (uint8_t s = 0; s < 3; s++)
+    {
+      setItem(items[n++], kDaikinHdrMark, kDaikinHdrSpace);
+      for (uint16_t b = 0; b < sections[s]; b++)
+      {
+        uint8_t byte = data[offset + b];
+        for (uint8_t bit = 0; bit < 8; bit++) // LSB trước
+          setItem(items[n++], kDaikinBitMark, (byte >> bit) & 1 ? kDaikinOneSpace : kDaikinZeroSpace);
+      }
+      setItem(items[n++], kDaikinBitMark, kDaikinZeroSpace + kDaikinGap);
+      offset += sections[s];
+    }
+    items[n++].val = 0; // end marker
+    return n;
+  }
+
+private:
+  static void setItem(rmt_item32_t &item, uint16_t markUs, uint16_t spaceUs)
+  {
+    item.level0 = 1;
+    item.duration0 = markUs;
+    item.level1 = 0;
+    item.duration1 = spaceUs;
+  }
+
+  static void taskEntry(void *param)
+  {
+    static_cast<IrRmtTransmitter *>(param)->run();
+  }
+
+  void run()
+  {
+    IrRmtFrame frame;
+    for (;;)
+    {
+      if (xQueueReceive(queue, &frame, portMAX_DELAY) != pdTRUE)
+        continue;
+
+      int64_t startUs = esp_timer_get_time();
+      portENTER_CRITICAL(&mux);
+      sendingTicket = frame.ticket;
+      portEXIT_CRITICAL(&mux);
+
+      uint16_t count = encodeDaikin(frame.data, frame.len, items);
+      // Block task này (không phải CPU) đến khi RMT phát xong
+      bool ok = rmt_write_items(channel, items, count, true) == ESP_OK;
+      int64_t endUs = esp_timer_get_time();
+
+      portENTER_CRITICAL(&mux);
+      sendingTicket = 0;
+      doneTicket = frame.ticket;
+      if (ok)
+        stats.sent++;
+      else
+      {
+        stats.failed++;
+        failedTicket = frame.ticket;
+      }
+      stats.lastQueueUs = (uint32_t)(startUs - frame.enqueuedUs);
+      stats.lastAirUs = (uint32_t)(endUs - startUs);
+      stats.lastTotalUs = (uint32_t)(endUs - frame.enqueuedUs);
+      stats.totalUs += stats.lastTotalUs;
+      if (stats.lastTotalUs > stats.maxTotalUs)
+        stats.maxTotalUs = stats.lastTotalUs;
+      portEXIT_CRITICAL(&mux);
+    }
+  }
+
+  rmt_channel_t channel = RMT_CHANNEL_0;
+  QueueHandle_t queue = nullptr;
+  TaskHandle_t taskHandle = nullptr;
+  rmt_item32_t items[IR_RMT_MAX_ITEMS];
+  uint32_t nextTicket = 1;
+  uint32_t sendingTicket = 0;
+  uint32_t doneTicket = 0;
+  uint32_t failedTicket = 0;
+  IrRmtStats stats = {};
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
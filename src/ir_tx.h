@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ GOM LỆNH IR (DESIRED STATE) ============
+// Mọi nguồn lệnh chỉ đánh dấu "trạng thái mong muốn đã đổi"; khung IR được
+// phát sau khi yêu cầu lắng xuống trong IR_TX_WINDOW_MS (kéo slider nhiệt độ
+// = 1 khung với giá trị cuối), tối đa trễ IR_TX_MAX_DELAY_MS. Khung trùng byte
+// với khung đã phát gần nhất bị bỏ; giữa 2 khung luôn cách IR_TX_MIN_GAP_MS.
+
+#define IR_TX_WINDOW_MS 120     // im lặng bao lâu thì phát
+#define IR_TX_MAX_DELAY_MS 500  // kéo liên tục vẫn phát ít nhất mỗi 0.5s
+#define IR_TX_MIN_GAP_MS 300    // khung Daikin ~130ms + nghỉ cho máy lạnh xử lý
+#define IR_TX_DUP_HOLD_MS 60000 // sau 1 phút cho phát lại khung trùng (remote có thể đã đổi máy)
+#define IR_TX_MAX_FRAME 64
+
+struct IrTxStats
+{
+  uint32_t requested;  // số lần sendDaikinCommand()
+  uint32_t emitted;    // khung thực sự phát
+  uint32_t coalesced;  // yêu cầu gộp vào khung đang chờ
+  uint32_t duplicates; // khung giống khung trước, không phát
+  uint32_t lastLatencyMs; // từ yêu cầu đầu tiên tới lúc phát/bỏ
+  uint32_t maxLatencyMs;
+};
+
+class IrTxCoalescer
+{
+public:
+  void request(uint32_t nowMs, const char *source)
+  {
+    stats.requested++;
+    if (pending)
+      stats.coalesced++;
+    else
+      firstRequestMs = nowMs;
+    pending = true;
+    lastRequestMs = nowMs;
+    lastSource = source;
+  }
+
+  // Đến lúc lấy trạng thái mong muốn để phát?
+  bool due(uint32_t nowMs) const
+  {
+    if (!pending)
+      return false;
+    bool settled = nowMs - lastRequestMs >= IR_TX_WINDOW_MS ||
+                   nowMs - firstRequestMs >= IR_TX_MAX_DELAY_MS;
+    return settled && (!hasSent || nowMs - lastSentMs >= IR_TX_MIN_GAP_MS);
+  }
+
+  // Khung của trạng thái mong muốn; true nếu caller phải phát nó
+  bool commit(const uint8_t *frame, uint16_t len, uint32_t nowMs)
+  {
+    pending = false;
+    uint32_t latency = nowMs - firstRequestMs;
+    stats.lastLatencyMs = latency;
+    if (latency > stats.maxLatencyMs)
+      stats.maxLatencyMs = latency;
+
+    if (len > IR_TX_MAX_FRAME)
+      len = IR_TX_MAX_FRAME;
+    if (hasSent && len == sentLen && memcmp(frame, sent, len) == 0 &&
+        nowMs - lastSentMs < IR_TX_DUP_HOLD_MS)
+    {
+      stats.duplicates++;
+      return false;
+    }
+
+    memcpy(sent, frame, len);
+    sentLen = len;
+    hasSent = true;
+    lastSentMs = nowMs;
+    stats.emitted++;
+    return true;
+  }
+
+  bool isPending() const { return pending; }
+  const char *source() const { return lastSource; }
+  const IrTxStats &getStats() const { return stats; }
+
+private:
+  bool pending = false;
+  uint32_t firstRequestMs = 0;
+  uint32_t lastRequestMs = 0;
+  const char *lastSource = "";
+  uint8_t sent[IR_TX_MAX_FRAME];
+  uint16_t sentLen = 0;
+  bool hasSent = false;
+  uint32_t lastSentMs = 0;
+  IrTxStats stats = {};
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <memory>
+
+// ============ CACHE JSON THEO VERSION (ETAG / 304) ============
+// Body JSON được serialize 1 lần cho mỗi key (version trạng thái) và giữ
+// dạng bất biến trong shared_ptr: response đang gửi dở vẫn giữ body cũ dù
+// cache đã build body mới. Chỉ dùng từ task async_tcp (mọi handler của
+// ESPAsyncWebServer chạy trên cùng task đó) nên không cần khóa.
+
+#define JSON_ETAG_SIZE 28 // 2 ngoặc kép + 24 hex + '\0'
+
+struct JsonCacheStats
+{
+  uint32_t requests;
+  uint32_t notModified; // 304, không đụng tới JSON
+  uint32_t hits;        // trả body đã cache
+  uint32_t rebuilds;
+  uint32_t heapBytes;   // heap đã cấp cho các lần build (doc + body)
+  uint32_t lastBodyLen;
+};
+
+class JsonCache
+{
+public:
+  explicit JsonCache(size_t docCapacity) : capacity(docCapacity) {}
+
+  // Key là bộ đếm theo phiên boot (đếm lại từ 0 sau reboot) → trộn nonce
+  // ngẫu nhiên của lần boot vào ETag để ETag cũ trong trình duyệt không khớp
+  // nhầm body mới. Gọi 1 lần trong setup() trước khi mở web server.
+  static void setBootNonce(uint32_t nonce) { bootNonce() = nonce; }
+
+  // ETag mạnh dạng "<nonce hex><key hex>", out >= JSON_ETAG_SIZE byte
+  static void etagFor(uint64_t key, char *out, size_t size)
+  {
+    snprintf(out, size, "\"%08x%08x%08x\"", (unsigned)bootNonce(), (unsigned)(key >> 32), (unsigned)key);
+  }
+
+  // Client đã có body của key này?
+  bool notModified(const String &ifNoneMatch, uint64_t key)
+  {
+    char etag[JSON_ETAG_SIZE];
+    etagFor(key, etag, sizeof(etag));
+    if (ifNoneMatch != etag)
+      return false;
+    stats.requests++;
+    stats.notModified++;
+    return true;
+  }
+
+  // Body cho key; fill(doc) chỉ được gọi khi key đổi
+  template <typename Fill>
+  std::shared_ptr<const String> get(uint64_t key, Fill fill)
+  {
+    stats.requests++;
+    if (body && bodyKey == key)
+    {
+      stats.hits++;
+      return body;
+    }
+
+    DynamicJsonDocument doc(capacity);
+    fill(doc);
+    std::shared_ptr<String> next(new String());
+    serializeJson(doc, *next);
+
+    body = next;
+    bodyKey = key;
+    stats.rebuilds++;
+    stats.lastBodyLen = next->length();
+    stats.heapBytes += capacity + next->length();
+    return body;
+  }
+
+  // Heap nếu mỗi request tự build doc + body như trước
+  uint32_t uncachedHeapBytes() const
+  {
+    return stats.requests * (capacity + stats.lastBodyLen);
+  }
+
+  const JsonCacheStats &getStats() const { return stats; }
+
+private:
+  static uint32_t &bootNonce()
+  {
+    static uint32_t nonce = 0;
+    return nonce;
+  }
+
+  size_t capacity;
+  std::shared_ptr<const String> body;
+  uint64_t bodyKey = 0;
+  JsonCacheStats stats = {};
+};
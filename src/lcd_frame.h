@@ -0,0 +1,117 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ FRAMEBUFFER LCD 16x2 (CHỈ GỬI Ô THAY ĐỔI) ============
+// Màn hình được vẽ vào bộ đệm "back" bằng API giống LiquidCrystal (Print).
+// flush() so với "front" (bản sao nội dung đang hiển thị trên LCD) và chỉ
+// gửi các đoạn ô liên tiếp bị đổi: 1 setCursor + N ký tự mỗi đoạn. Không
+// còn lcd.clear() (lệnh chậm ~2ms, gây nháy).
+
+#define LCD_COLS 16
+#define LCD_ROWS 2
+#define LCD_RUN_GAP 1 // ghi đè 1 ô không đổi rẻ bằng 1 lệnh setCursor
+// PCF8574 chạy 4-bit: mỗi byte LCD = 2 nibble x (ghi + EN lên + EN xuống)
+#define LCD_I2C_BYTES_PER_LCD_BYTE 6
+// Cách cũ: clear + 2 setCursor + 32 ký tự mỗi lần vẽ
+#define LCD_FULL_REDRAW_BYTES (1 + LCD_ROWS + LCD_COLS * LCD_ROWS)
+
+struct LcdFrameStats
+{
+  uint32_t flushes;
+  uint32_t unchangedFlushes; // không có ô nào đổi → không gửi gì
+  uint32_t runs;
+  uint32_t cellsChanged;
+  uint32_t lcdBytes;        // lệnh + dữ liệu thực sự gửi
+  uint32_t fullRedrawBytes; // ước tính nếu vẽ lại toàn bộ như trước
+};
+
+class LcdFrame : public Print
+{
+public:
+  // Gọi sau lcd.clear() phần cứng: cả hai bộ đệm là khoảng trắng
+  void reset()
+  {
+    memset(back, ' ', sizeof(back));
+    memset(front, ' ', sizeof(front));
+    col = row = 0;
+  }
+
+  void clear()
+  {
+    memset(back, ' ', sizeof(back));
+    col = row = 0;
+  }
+
+  void setCursor(uint8_t c, uint8_t r)
+  {
+    col = c;
+    row = r < LCD_ROWS ? r : LCD_ROWS - 1;
+  }
+
+  // Ký tự tràn cột bị bỏ (LCD thật sẽ ghi sang vùng DDRAM ẩn)
+  size_t write(uint8_t ch) override
+  {
+    if (col >= LCD_COLS)
+      return 0;
+    back[row][col++] = ch;
+    return 1;
+  }
+  using Print::write;
+
+  // Gửi các đoạn thay đổi ra LCD thật, trả về số byte LCD đã gửi
+  template <typename Display>
+  uint16_t flush(Display &lcd)
+  {
+    uint16_t sent = 0;
+    for (uint8_t r = 0; r < LCD_ROWS; r++)
+    {
+      uint8_t c = 0;
+      while (c < LCD_COLS)
+      {
+        if (back[r][c] == front[r][c])
+        {
+          c++;
+          continue;
+        }
+
+        // Mở rộng đoạn, nuốt các khoảng không đổi ngắn hơn LCD_RUN_GAP
+        uint8_t start = c;
+        uint8_t end = c; // ô đổi cuối cùng
+        for (uint8_t i = c + 1; i < LCD_COLS && i - end <= LCD_RUN_GAP + 1; i++)
+        {
+          if (back[r][i] != front[r][i])
+            end = i;
+        }
+
+        lcd.setCursor(start, r);
+        for (uint8_t i = start; i <= end; i++)
+        {
+          if (back[r][i] != front[r][i])
+            stats.cellsChanged++;
+          lcd.write(back[r][i]);
+          front[r][i] = back[r][i];
+        }
+        sent += 1 + (end - start + 1);
+        stats.runs++;
+        c = end + 1;
+      }
+    }
+
+    stats.flushes++;
+    if (sent == 0)
+      stats.unchangedFlushes++;
+    stats.lcdBytes += sent;
+    stats.fullRedrawBytes += LCD_FULL_REDRAW_BYTES;
+    return sent;
+  }
+
+  const LcdFrameStats &getStats() const { return stats; }
+
+private:
+  char back[LCD_ROWS][LCD_COLS];
+  char front[LCD_ROWS][LCD_COLS];
+  uint8_t col = 0;
+  uint8_t row = 0;
+  LcdFrameStats stats = {};
+};
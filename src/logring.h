@@ -0,0 +1,543 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ LOG RING (NHỊ PHÂN, KHÔNG CẤP PHÁT) ============
+// Mỗi lần log chỉ ghi vài byte vào arena cố định: level, id chuỗi format,
+// delta thời gian (varint) và tham số đóng gói. Việc format ra chữ chỉ làm
+// khi có ai đọc (Serial drain, /logs). Level dưới LOG_MIN_LEVEL bị loại bỏ
+// ngay lúc biên dịch.
+//
+// Bố cục 1 bản ghi trong arena:
+//   [len][level<<4 | argc][fmtId][types: 2 byte][tsDelta varint][args...]
+// types: 2 bit / tham số. int → zigzag varint, uint → varint, float → 4 byte,
+// chuỗi → [len] + byte (cắt ở LOG_MAX_STR_ARG).
+
+#define LOG_LVL_DEBUG 0
+#define LOG_LVL_INFO 1
+#define LOG_LVL_AI 2
+#define LOG_LVL_SUCCESS 3
+#define LOG_LVL_WARN 4
+#define LOG_LVL_ERROR 5
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LVL_INFO
+#endif
+
+#ifndef LOG_ARENA_SIZE
+#define LOG_ARENA_SIZE 8192
+#endif
+
+#define LOG_MAX_FORMATS 160
+#define LOG_MAX_ARGS 6
+#define LOG_MAX_STR_ARG 40
+#define LOG_MAX_RECORD 160
+#define LOG_LINE_MAX 192
+#define LOG_FMT_OVERFLOW 0xFF
+
+enum LogArgType : uint8_t
+{
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_FLOAT,
+  LOG_ARG_STR
+};
+
+// Bản ghi đã copy ra khỏi arena (để format ngoài vùng khóa)
+struct LogRecord
+{
+  uint32_t seq;
+  uint32_t timestampMs;
+  uint8_t level;
+  uint8_t fmtId;
+  uint8_t argc;
+  uint16_t types;
+  uint8_t argLen;
+  uint8_t args[LOG_MAX_RECORD];
+};
+
+// Vị trí đọc. Hết hạn khi bản ghi đã bị ghi đè (seq < firstSeq).
+struct LogCursor
+{
+  uint32_t seq;
+  uint16_t pos;
+  uint32_t prevTs; // timestamp bản ghi ngay trước pos
+};
+
+inline const char *logLevelToString(uint8_t level)
+{
+  switch (level)
+  {
+  case LOG_LVL_DEBUG:
+    return "DEBUG";
+  case LOG_LVL_INFO:
+    return "INFO";
+  case LOG_LVL_AI:
+    return "AI";
+  case LOG_LVL_SUCCESS:
+    return "SUCCESS";
+  case LOG_LVL_WARN:
+    return "WARN";
+  default:
+    return "ERROR";
+  }
+}
+
+// Đóng gói tham số vào buffer trên stack
+class LogArgEncoder
+{
+public:
+  uint8_t argc = 0;
+  uint16_t types = 0;
+  uint8_t len = 0;
+  uint8_t buf[LOG_MAX_RECORD - 10];
+
+  void add() {}
+
+  template <typename T, typename... Rest>
+  void add(const T &first, const Rest &...rest)
+  {
+    put(first);
+    add(rest...);
+  }
+
+private:
+  bool begin(LogArgType type, uint8_t need)
+  {
+    if (argc >= LOG_MAX_ARGS || len + need > sizeof(buf))
+      return false;
+    types |= (uint16_t)type << (argc * 2);
+    argc++;
+    return true;
+  }
+
+  void varint(uint32_t v)
+  {
+    while (v >= 0x80)
+    {
+      buf[len++] = (uint8_t)(v | 0x80);
+      v >>= 7;
+    }
+    buf[len++] = (uint8_t)v;
+  }
+
+  void putInt(int32_t v)
+  {
+    if (begin(LOG_ARG_INT, 5))
+      varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+  }
+
+  void putUint(uint32_t v)
+  {
+    if (begin(LOG_ARG_UINT, 5))
+      varint(v);
+  }
+
+  void put(int v) { putInt(v); }
+  void put(long v) { putInt((int32_t)v); }
+  void put(short v) { putInt(v); }
+  void put(char v) { putInt(v); }
+  void put(signed char v) { putInt(v); }
+  void put(unsigned v) { putUint(v); }
+  void put(unsigned long v) { putUint((uint32_t)v); }
+  void put(unsigned short v) { putUint(v); }
+  void put(unsigned char v) { putUint(v); }
+  // Tham số chỉ lưu 32 bit: ép kiểu 64 bit ở chỗ gọi thay vì cắt ngầm
+  void put(long long v) = delete;
+  void put(unsigned long long v) = delete;
+  void put(bool v) { putUint(v ? 1 : 0); }
+  void put(double v) { put((float)v); }
+
+  void put(float v)
+  {
+    if (!begin(LOG_ARG_FLOAT, 4))
+      return;
+    memcpy(buf + len, &v, 4);
+    len += 4;
+  }
+
+  void put(const char *s)
+  {
+    if (!s)
+      s = "(null)";
+    size_t n = strlen(s);
+    if (n > LOG_MAX_STR_ARG)
+      n = LOG_MAX_STR_ARG;
+    if (!begin(LOG_ARG_STR, n + 1))
+      return;
+    buf[len++] = (uint8_t)n;
+    memcpy(buf + len, s, n);
+    len += n;
+  }
+
+  void put(char *s) { put((const char *)s); }
+  void put(const String &s) { put(s.c_str()); }
+};
+
+class LogRing
+{
+public:
+  // Đăng ký chuỗi format (gọi 1 lần / call site qua biến static)
+  uint8_t intern(const char *fmt)
+  {
+    portENTER_CRITICAL(&mux);
+    uint8_t id = LOG_FMT_OVERFLOW;
+    for (uint8_t i = 0; i < formatCount; i++)
+    {
+      if (formats[i] == fmt)
+      {
+        id = i;
+        break;
+      }
+    }
+    if (id == LOG_FMT_OVERFLOW && formatCount < LOG_MAX_FORMATS)
+    {
+      formats[formatCount] = fmt;
+      id = formatCount++;
+    }
+    portEXIT_CRITICAL(&mux);
+    return id;
+  }
+
+  template <typename... Args>
+  void write(uint8_t level, uint8_t fmtId, const Args &...args)
+  {
+    LogArgEncoder enc;
+    enc.add(args...);
+    commit(level, fmtId, enc);
+  }
+
+  // Cursor tới bản ghi đầu tiên có seq >= since (hoặc bản ghi cũ nhất)
+  LogCursor cursorAt(uint32_t since)
+  {
+    portENTER_CRITICAL(&mux);
+    LogCursor c = oldestCursor();
+    while (c.seq < since && c.seq < nextSeq)
+    {
+      uint32_t delta;
+      readHeader(c.pos, delta);
+      c.prevTs += delta;
+      c.pos = wrap(c.pos + buf[c.pos]);
+      c.seq++;
+    }
+    portEXIT_CRITICAL(&mux);
+    return c;
+  }
+
+  // Copy bản ghi tại cursor rồi tiến cursor. Trả về false nếu hết.
+  // Cursor đã bị ghi đè (hoặc cursor rỗng {0}) sẽ nhảy về bản ghi cũ nhất.
+  bool next(LogCursor &c, LogRecord &out)
+  {
+    portENTER_CRITICAL(&mux);
+    if (c.seq <= firstSeq)
+      c = oldestCursor();
+    if (c.seq >= nextSeq)
+    {
+      portEXIT_CRITICAL(&mux);
+      return false;
+    }
+
+    uint8_t recLen = buf[c.pos];
+    uint32_t delta;
+    uint8_t hdrLen = readHeader(c.pos, delta);
+    out.seq = c.seq;
+    out.timestampMs = c.prevTs + delta;
+    out.level = buf[wrap(c.pos + 1)] >> 4;
+    out.argc = buf[wrap(c.pos + 1)] & 0x0F;
+    out.fmtId = buf[wrap(c.pos + 2)];
+    out.types = buf[wrap(c.pos + 3)] | (buf[wrap(c.pos + 4)] << 8);
+    out.argLen = recLen - hdrLen;
+    for (uint8_t i = 0; i < out.argLen; i++)
+      out.args[i] = buf[wrap(c.pos + hdrLen + i)];
+
+    c.prevTs = out.timestampMs;
+    c.pos = wrap(c.pos + recLen);
+    c.seq++;
+    portEXIT_CRITICAL(&mux);
+    return true;
+  }
+
+  // Format trễ: chạy printf từng tham số theo chuỗi format gốc
+  size_t format(const LogRecord &rec, char *out, size_t size) const
+  {
+    if (size == 0)
+      return 0;
+    const char *fmt = rec.fmtId < formatCount ? formats[rec.fmtId] : "<log format table full>";
+    size_t o = 0;
+    uint8_t argIndex = 0;
+    uint8_t p = 0;
+
+    while (*fmt && o + 1 < size)
+    {
+      if (*fmt != '%')
+      {
+        out[o++] = *fmt++;
+        continue;
+      }
+      if (fmt[1] == '%')
+      {
+        out[o++] = '%';
+        fmt += 2;
+        continue;
+      }
+
+      // Tách 1 conversion spec, bỏ length modifier (l, h, z)
+      char spec[16];
+      uint8_t s = 0;
+      spec[s++] = *fmt++;
+      while (*fmt && strchr("-+ #0123456789.lhz", *fmt))
+      {
+        if (!strchr("lhz", *fmt) && s < sizeof(spec) - 3)
+          spec[s++] = *fmt;
+        fmt++;
+      }
+      char conv = *fmt ? *fmt++ : 'd';
+
+      int n = 0;
+      if (argIndex >= rec.argc)
+      {
+        n = snprintf(out + o, size - o, "?");
+      }
+      else
+      {
+        LogArgType type = (LogArgType)((rec.types >> (argIndex * 2)) & 3);
+        argIndex++;
+        n = formatArg(type, rec, p, spec, s, conv, out + o, size - o);
+      }
+      if (n > 0)
+        o += (size_t)n < size - o ? (size_t)n : size - o - 1;
+    }
+    out[o] = '\0';
+    return o;
+  }
+
+  uint32_t firstSequence() const { return firstSeq; }
+  uint32_t nextSequence() const { return nextSeq; }
+  uint32_t evictedCount() const { return evicted; }
+  uint16_t bytesUsed() const { return used; }
+  uint8_t formatsUsed() const { return formatCount; }
+
+private:
+  void commit(uint8_t level, uint8_t fmtId, const LogArgEncoder &enc)
+  {
+    portENTER_CRITICAL(&mux);
+    uint32_t nowMs = millis();
+    if (nextSeq == firstSeq)
+    {
+      firstTs = nowMs;
+      lastTs = nowMs;
+    }
+
+    uint8_t hdr[10];
+    uint8_t h = 1;
+    hdr[h++] = (uint8_t)((level << 4) | enc.argc);
+    hdr[h++] = fmtId;
+    hdr[h++] = (uint8_t)enc.types;
+    hdr[h++] = (uint8_t)(enc.types >> 8);
+    uint32_t delta = nowMs - lastTs;
+    while (delta >= 0x80)
+    {
+      hdr[h++] = (uint8_t)(delta | 0x80);
+      delta >>= 7;
+    }
+    hdr[h++] = (uint8_t)delta;
+    hdr[0] = h + enc.len;
+
+    while (LOG_ARENA_SIZE - used < hdr[0])
+      evictOldest();
+
+    for (uint8_t i = 0; i < h; i++)
+      buf[wrap(head + i)] = hdr[i];
+    for (uint8_t i = 0; i < enc.len; i++)
+      buf[wrap(head + h + i)] = enc.buf[i];
+    head = wrap(head + hdr[0]);
+    used += hdr[0];
+    lastTs = nowMs;
+    nextSeq++;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void evictOldest()
+  {
+    used -= buf[tail];
+    tail = wrap(tail + buf[tail]);
+    firstSeq++;
+    evicted++;
+    if (firstSeq != nextSeq)
+    {
+      uint32_t delta;
+      readHeader(tail, delta);
+      firstTs += delta;
+    }
+  }
+
+  LogCursor oldestCursor() const
+  {
+    LogCursor c;
+    c.seq = firstSeq;
+    c.pos = tail;
+    c.prevTs = firstTs;
+    if (firstSeq != nextSeq)
+    {
+      uint32_t delta;
+      readHeader(tail, delta);
+      c.prevTs = firstTs - delta;
+    }
+    return c;
+  }
+
+  // Đọc tsDelta, trả về độ dài header
+  uint8_t readHeader(uint16_t pos, uint32_t &delta) const
+  {
+    uint8_t h = 5;
+    uint8_t shift = 0;
+    delta = 0;
+    uint8_t b;
+    do
+    {
+      b = buf[wrap(pos + h++)];
+      delta |= (uint32_t)(b & 0x7F) << shift;
+      shift += 7;
+    } while (b & 0x80);
+    return h;
+  }
+
+  static uint16_t wrap(uint32_t pos) { return pos % LOG_ARENA_SIZE; }
+
+  static uint32_t readVarint(const uint8_t *p, uint8_t &i, uint8_t end)
+  {
+    uint32_t v = 0;
+    uint8_t shift = 0;
+    while (i < end)
+    {
+      uint8_t b = p[i++];
+      v |= (uint32_t)(b & 0x7F) << shift;
+      shift += 7;
+      if (!(b & 0x80))
+        break;
+    }
+    return v;
+  }
+
+  static int formatArg(LogArgType type, const LogRecord &rec, uint8_t &p,
+                       char *spec, uint8_t s, char conv, char *out, size_t size)
+  {
+    bool floatConv = strchr("fFeEgG", conv) != nullptr;
+    bool strConv = conv == 's';
+
+    switch (type)
+    {
+    case LOG_ARG_INT:
+    case LOG_ARG_UINT:
+    {
+      uint32_t raw = readVarint(rec.args, p, rec.argLen);
+      int32_t sv = type == LOG_ARG_INT ? (int32_t)((raw >> 1) ^ (~(raw & 1) + 1)) : (int32_t)raw;
+      if (floatConv)
+      {
+        spec[s++] = conv;
+        spec[s] = '\0';
+        return snprintf(out, size, spec, type == LOG_ARG_INT ? (double)sv : (double)raw);
+      }
+      if (strConv)
+        conv = type == LOG_ARG_INT ? 'd' : 'u';
+      spec[s++] = conv;
+      spec[s] = '\0';
+      if (conv == 'd' || conv == 'i' || conv == 'c')
+        return snprintf(out, size, spec, (int)sv);
+      // %u/%x/%o: giá trị đã giải zigzag, không phải raw
+      return snprintf(out, size, spec, (unsigned)sv);
+    }
+
+    case LOG_ARG_FLOAT:
+    {
+      float v = 0;
+      if (p + 4 <= rec.argLen)
+        memcpy(&v, rec.args + p, 4);
+      p += 4;
+      if (!floatConv)
+        conv = 'g';
+      spec[s++] = conv;
+      spec[s] = '\0';
+      return snprintf(out, size, spec, (double)v);
+    }
+
+    default:
+    {
+      uint8_t n = p < rec.argLen ? rec.args[p++] : 0;
+      if (p + n > rec.argLen)
+        n = rec.argLen - p;
+      char text[LOG_MAX_STR_ARG + 1];
+      memcpy(text, rec.args + p, n);
+      text[n] = '\0';
+      p += n;
+      spec[s++] = 's';
+      spec[s] = '\0';
+      return snprintf(out, size, spec, text);
+    }
+    }
+  }
+
+  uint8_t buf[LOG_ARENA_SIZE];
+  uint16_t head = 0; // vị trí ghi
+  uint16_t tail = 0; // bản ghi cũ nhất
+  uint16_t used = 0;
+  uint32_t firstSeq = 0;
+  uint32_t nextSeq = 0;
+  uint32_t firstTs = 0; // timestamp bản ghi cũ nhất
+  uint32_t lastTs = 0;  // timestamp bản ghi mới nhất
+  uint32_t evicted = 0;
+
+  const char *formats[LOG_MAX_FORMATS];
+  uint8_t formatCount = 0;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+extern LogRing logRing;
+
+// ============ MACRO LOG ============
+// LOG_INFO("T=%.1fC", temperature); chuỗi format phải là literal
+#define LOG_WRITE(level, fmt, ...)                          \
+  do                                                        \
+  {                                                         \
+    static const uint8_t _logFmtId = logRing.intern(fmt);   \
+    logRing.write(level, _logFmtId, ##__VA_ARGS__);         \
+  } while (0)
+
+#if LOG_MIN_LEVEL <= LOG_LVL_DEBUG
+#define LOG_DEBUG(fmt, ...) LOG_WRITE(LOG_LVL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...) \
+  do                        \
+  {                         \
+  } while (0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LVL_INFO
+#define LOG_INFO(fmt, ...) LOG_WRITE(LOG_LVL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) \
+  do                       \
+  {                        \
+  } while (0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LVL_AI
+#define LOG_AI(fmt, ...) LOG_WRITE(LOG_LVL_AI, fmt, ##__VA_ARGS__)
+#else
+#define LOG_AI(fmt, ...) \
+  do                     \
+  {                      \
+  } while (0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LVL_SUCCESS
+#define LOG_SUCCESS(fmt, ...) LOG_WRITE(LOG_LVL_SUCCESS, fmt, ##__VA_ARGS__)
+#else
+#define LOG_SUCCESS(fmt, ...) \
+  do                          \
+  {                           \
+  } while (0)
+#endif
+
+#define LOG_WARN(fmt, ...) LOG_WRITE(LOG_LVL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_ERROR(fmt, ...) LOG_WRITE(LOG_LVL_ERROR, fmt, ##__VA_ARGS__)
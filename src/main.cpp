@@ -1,7 +1,5 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <HTTPClient.h>
-#include <DHT.h>
 #include <IRremoteESP8266.h>
 #include <IRrecv.h>
 #include <IRsend.h>
@@ -12,6 +10,30 @@
 #include <RTClib.h>
 #include <NTPClient.h>
 #include <WiFiUdp.h>
+#include <Preferences.h>
+#include <memory>
+#include "scheduler.h"
+#include "voice_jobs.h"
+#include "voice_intent.h"
+#include "voice_cache.h"
+#include "voice_http.h"
+#include "ultrasonic.h"
+#include "dht22.h"
+#include "logring.h"
+#include "timeseries.h"
+#include "lcd_frame.h"
+#include "rule_engine.h"
+#include "controller_state.h"
+#include "controller.h"
+#include "default_rules.h"
+#include "json_cache.h"
+#include "ir_tx.h"
+#include "ir_rmt.h"
+#include "metrics.h"
+#include "stall_profiler.h"
+#include "sensor_trace.h"
+#include "schedules.h"
+#include "http_body.h"
 
 // ============ CẤU HÌNH CHÂN ============
 #define DHT_PIN 4
@@ -26,6 +48,29 @@
 #define BTN_TEST_PRESENCE 33
 #define BUZZER_PIN 12
 
+// ============ CẤU HÌNH ZONE ============
+// Mỗi zone là 1 máy lạnh: LED IR riêng (RMT channel = index zone) + DHT22
+// riêng, PIR và LDR tùy chọn. Zone 0 là phòng chính, có thêm radar, LCD, nút
+// bấm, voice, lịch hẹn giờ. Thêm phòng = thêm 1 dòng. Zone thiếu PIR/LDR vẫn
+// dùng chung bảng luật; luật cần cảm biến đó bị báo "inactive_rules" ở
+// /zones/<id> (xem zoneFixedFields()).
+struct ZoneConfig
+{
+  const char *name; // dùng trong /zones/<name>/...
+  uint8_t irPin;
+  uint8_t dhtPin;
+  int8_t pirPin; // -1: không có PIR, luật coi phòng luôn có người
+  int8_t ldrPin; // -1: không có LDR (chân ADC1), ánh sáng luôn = 0
+};
+
+const ZoneConfig ZONE_CONFIG[] = {
+    {"main", IR_SEND_PIN, DHT_PIN, PIR_PIN, LDR_PIN},
+    // {"bedroom", 16, 5, -1, -1},
+    // {"office", 13, 14, 32, 35},
+};
+#define ZONE_COUNT (sizeof(ZONE_CONFIG) / sizeof(ZONE_CONFIG[0]))
+static_assert(ZONE_COUNT <= 8, "ESP32 chỉ có 8 RMT channel");
+
 // ============ CẤU HÌNH WIFI ============
 #define WIFI_SSID "Wokwi-GUEST"
 #define WIFI_PASSWORD ""
@@ -35,51 +80,240 @@
 #define API_KEY "AC_SECRET_KEY_2024_LLM_V5"
 
 // ============ KHỞI TẠO THIẾT BỊ ============
-#define DHT_TYPE DHT22
-DHT dht(DHT_PIN, DHT_TYPE);
 IRrecv irrecv(IR_RECV_PIN);
-IRDaikinESP irsend(IR_SEND_PIN);
+IRDaikinESP irsend(IR_SEND_PIN); // bộ mã hóa khung chung; bit-bang chỉ khi RMT zone 0 lỗi
 decode_results results;
-LiquidCrystal_I2C lcd(0x27, 16, 2);
+LiquidCrystal_I2C lcd(0x27, LCD_COLS, LCD_ROWS);
+LcdFrame lcdFrame;
+volatile bool lcdRedrawPending = false;
+volatile uint32_t lcdRedrawRequests = 0;
+uint32_t lastLcdRenderMs = 0;
 RTC_DS1307 rtc;
+UltrasonicRanger radar;
 AsyncWebServer server(80);
+AsyncEventSource events("/events");
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP, "pool.ntp.org", 7 * 3600);
 
-// ============ ENUM CHO TỐC ĐỘ QUẠT ============
-enum FanSpeed
+// ============ HAL ESP32 ============
+// Bản phần cứng thật của hal.h; logic điều khiển nằm trong ClimateController.
+// Mỗi zone có HalSensors + HalIrSink riêng, đồng hồ và LCD dùng chung.
+
+class DeviceClock : public HalClock
+{
+public:
+  uint32_t nowMs() override { return millis(); }
+  uint8_t hour() override { return rtcNow().hour(); }
+  uint8_t minute() override { return rtcNow().minute(); }
+  uint32_t unixTime() override { return rtcNow().unixtime(); }
+
+private:
+  // Đọc RTC qua I2C tối đa 1 lần/giây
+  const DateTime &rtcNow()
+  {
+    uint32_t ms = millis();
+    if (!valid || ms - readMs >= 1000)
+    {
+      cached = rtc.now();
+      readMs = ms;
+      valid = true;
+    }
+    return cached;
+  }
+
+  DateTime cached;
+  uint32_t readMs = 0;
+  bool valid = false;
+};
+
+struct Zone;
+
+class ZoneSensors : public HalSensors
+{
+public:
+  explicit ZoneSensors(Zone &z) : zone(z) {}
+  bool readClimate(float &t, float &h) override;
+  int16_t readLight() override;
+  bool readMotion() override;
+  bool readDistance(float &cm) override;
+
+private:
+  Zone &zone;
+  uint32_t lastDhtVersion = 0;
+};
+
+// Nạp trạng thái AC vào bộ mã hóa Daikin (chưa phát)
+void loadDaikinState(const AcState &ac);
+
+class ZoneIrSink : public HalIrSink
+{
+public:
+  explicit ZoneIrSink(Zone &z) : zone(z) {}
+
+  uint16_t encode(const AcState &ac, uint8_t *frame, uint16_t maxLen) override
+  {
+    loadDaikinState(ac);
+    uint16_t len = kDaikinStateLength < maxLen ? kDaikinStateLength : maxLen;
+    memcpy(frame, irsend.getRaw(), len);
+    return len;
+  }
+
+  bool transmit(const uint8_t *frame, uint16_t len) override;
+  bool busy() override;
+
+private:
+  Zone &zone;
+};
+
+class DeviceDisplay : public HalDisplay
+{
+public:
+  void setCursor(uint8_t col, uint8_t row) override { lcd.setCursor(col, row); }
+  size_t write(uint8_t ch) override { return lcd.write(ch); }
+};
+
+DeviceClock deviceClock;
+DeviceDisplay deviceDisplay;
+
+// ============ BỘ ĐIỀU KHIỂN THEO ZONE ============
+// Mọi trạng thái của 1 zone nằm liền trong 1 struct, các zone nằm trong 1
+// mảng: thêm zone chỉ tốn sizeof(Zone) + 1 task IR, loop() duyệt mảng.
+// zone.core.ctrl chỉ được loop() đọc/ghi; task khác dùng zone.core.read().
+struct Zone
 {
-  FAN_QUIET = 1,
-  FAN_LOW = 2,
-  FAN_MEDIUM = 3,
-  FAN_HIGH = 4,
-  FAN_AUTO = 5
+  Zone() : sensors(*this), ir(*this), hal{deviceClock, sensors, ir, deviceDisplay}, core(hal) {}
+
+  const ZoneConfig *cfg = nullptr; // setupZones()
+  Dht22Reader dht;
+  DhtHealth lastHealth = DHT_OK;
+  IrRmtTransmitter rmt;
+  bool rmtReady = false;
+  uint32_t lastIrTicket = 0;
+  ZoneSensors sensors;
+  ZoneIrSink ir;
+  Hal hal;
+  ClimateController core;
 };
 
-// ============ BIẾN CẢM BIẾN ============
-float temperature = 0;
-float humidity = 0;
-int lightLevel = 0;
-bool motionDetected = false;
-bool presenceDetected = false;
-float presenceDistance = 0;
-unsigned long lastMotionTime = 0;
-unsigned long lastPresenceTime = 0;
-DateTime now;
-bool testPresenceMode = false;
-
-// ============ BIẾN ĐIỀU KHIỂN AC DAIKIN ============
-bool acStatus = false;
-int acTemp = 25;
-String acMode = "COOL";
-FanSpeed acFan = FAN_MEDIUM;
+Zone zones[ZONE_COUNT];
+// Zone 0 (phòng chính) giữ tên cũ cho LCD, nút bấm, voice, /sensors...
+ClimateController &core = zones[0].core;
+Dht22Reader &dht = zones[0].dht;
+IrRmtTransmitter &irRmt = zones[0].rmt;
+QueueHandle_t acCommandQueue = NULL;
+
+bool ZoneSensors::readClimate(float &t, float &h)
+{
+  if (zone.dht.sampleVersion() == lastDhtVersion)
+    return false;
+  lastDhtVersion = zone.dht.sampleVersion();
+  DhtSample sample = zone.dht.latest();
+  t = sample.temperature;
+  h = sample.humidity;
+  return true;
+}
+
+int16_t ZoneSensors::readLight()
+{
+  return zone.cfg->ldrPin < 0 ? 0 : analogRead(zone.cfg->ldrPin);
+}
+
+bool ZoneSensors::readMotion()
+{
+  return zone.cfg->pirPin < 0 || digitalRead(zone.cfg->pirPin) == HIGH;
+}
+
+// Radar chỉ có ở zone 0: kết quả ping trước (đo bằng ngắt); radarTask() bắn ping kế tiếp
+bool ZoneSensors::readDistance(float &cm)
+{
+  if (&zone != &zones[0] || !radar.service())
+    return false;
+  cm = radar.distanceCm();
+  return true;
+}
+
+bool ZoneIrSink::transmit(const uint8_t *frame, uint16_t len)
+{
+  PROF_SCOPE("ir_send", STALL_IO_BUDGET_US);
+  if (!zone.rmtReady)
+  {
+    if (&zone != &zones[0])
+      return false; // irsend chỉ nối với chân IR của zone 0
+    irsend.setRaw(frame, len);
+    irsend.send(); // RMT lỗi → phát bit-bang như cũ
+    return true;
+  }
+  zone.lastIrTicket = zone.rmt.enqueue(frame, len);
+  return zone.lastIrTicket != 0;
+}
+
+bool ZoneIrSink::busy()
+{
+  return zone.rmtReady && zone.rmt.busy();
+}
+
+// Field luật bị cố định vì zone thiếu cảm biến: không LDR → RF_LIGHT = 0,
+// không PIR → luôn có người (RF_PRESENCE = 1, RF_ABSENT_S = 0)
+uint32_t zoneFixedFields(const Zone &z, RuleSnapshot &fixed)
+{
+  memset(&fixed, 0, sizeof(fixed));
+  uint32_t mask = 0;
+  if (z.cfg->ldrPin < 0)
+    mask |= 1UL << RF_LIGHT;
+  if (z.cfg->pirPin < 0)
+  {
+    mask |= (1UL << RF_PRESENCE) | (1UL << RF_ABSENT_S);
+    fixed.field[RF_PRESENCE] = 1;
+  }
+  return mask;
+}
+
+#define ZONE_PATH_NONE -1 // "/zones"
+#define ZONE_PATH_BAD -2  // zone không tồn tại
+
+// <index|name> → index, -1 nếu không có
+int findZone(const char *key, size_t len)
+{
+  if (len == 0)
+    return -1;
+  bool digits = true;
+  int index = 0;
+  for (size_t i = 0; i < len; i++)
+  {
+    digits = digits && isdigit((unsigned char)key[i]);
+    index = index * 10 + (key[i] - '0');
+  }
+  if (digits)
+    return len <= 2 && index < (int)ZONE_COUNT ? index : -1;
+  for (uint8_t i = 0; i < ZONE_COUNT; i++)
+    if (strlen(ZONE_CONFIG[i].name) == len && !strncmp(ZONE_CONFIG[i].name, key, len))
+      return i;
+  return -1;
+}
+
+// "/zones/<zone>[/<sub>]" → index zone, sub = phần sau ("" nếu không có)
+int parseZonePath(const char *url, const char *&sub)
+{
+  const char *p = url + strlen("/zones");
+  sub = "";
+  if (*p == '/')
+    p++;
+  if (!*p)
+    return ZONE_PATH_NONE;
+  const char *slash = strchr(p, '/');
+  size_t len = slash ? slash - p : strlen(p);
+  if (slash)
+    sub = slash + 1;
+  int zone = findZone(p, len);
+  return zone < 0 ? ZONE_PATH_BAD : zone;
+}
 
 // ============ BIẾN AI ============
-bool aiEnabled = false;
-bool aiProcessing = false;
+// Số lời gọi voice API đang chạy (tối đa VOICE_MAX_CONCURRENT worker), > 0 thì
+// aiTask nhường zone 0. Tăng/giảm cùng voiceCommands/voiceErrors dưới voiceMux.
+volatile uint8_t voiceInFlight = 0;
+portMUX_TYPE voiceMux = portMUX_INITIALIZER_UNLOCKED;
 String lastAIResponse = "";
-unsigned long lastAIOptimization = 0;
-const unsigned long AI_COOLDOWN = 5000; // GIẢM XUỐNG 5 GIÂY
 
 // ============ LCD DISPLAY MODES ============
 enum DisplayMode
@@ -93,308 +327,381 @@ DisplayMode currentDisplayMode = DISP_BASIC;
 unsigned long lastDisplayChange = 0;
 
 // ============ LOG SYSTEM ============
-struct LogEntry
-{
-  unsigned long timestamp;
-  String level;
-  String message;
-};
+// Log nhị phân trong arena cố định (logring.h), format trễ khi đọc
+#define LOG_SERIAL_TX_BUFFER 1024
+#define LOG_DRAIN_INTERVAL 50
+#define LOG_DRAIN_MAX_LINES 8
 
-#define MAX_LOGS 50
-LogEntry logBuffer[MAX_LOGS];
-int logIndex = 0;
-int logCount = 0;
+LogRing logRing;
+LogCursor serialLogCursor = {0, 0, 0};
+StallProfiler stallProfiler;
 
-void addLog(String level, String message)
+// In log ra Serial chỉ khi buffer TX còn chỗ, không để Serial chặn loop()
+void logDrainTask()
 {
-  logBuffer[logIndex] = {millis(), level, message};
-  logIndex = (logIndex + 1) % MAX_LOGS;
-  if (logCount < MAX_LOGS)
-    logCount++;
-  Serial.printf("[%s] %s\n", level.c_str(), message.c_str());
+  static LogRecord rec;
+  static char line[LOG_LINE_MAX];
+  for (int i = 0; i < LOG_DRAIN_MAX_LINES; i++)
+  {
+    if (Serial.availableForWrite() < LOG_LINE_MAX + 16)
+      return;
+    if (!logRing.next(serialLogCursor, rec))
+      return;
+    logRing.format(rec, line, sizeof(line));
+    PROF_SCOPE("serial", STALL_IO_BUDGET_US);
+    Serial.printf("[%s] %s\n", logLevelToString(rec.level), line);
+  }
 }
 
 // ============ THỐNG KÊ ============
 unsigned long totalRequests = 0;
 unsigned long voiceCommands = 0;
 unsigned long irCommands = 0;
-unsigned long autoOptimizations = 0;
-unsigned long lastSensorRead = 0;
 const long sensorInterval = 2000;
 
-// ============ KHAI BÁO PROTOTYPE ============
-void updateLCD();
-void sendDaikinCommand(String commandName);
-String callVoiceAPI(String voiceText);
-void processAIDecision(String aiResponse);
-void mockLLMOptimize();
+// ============ METRICS ============
+// Bộ đếm cố định cho /metrics: độ trễ loop, từng route HTTP, voice API
+enum HttpRoute : uint8_t
+{
+  ROUTE_ROOT,
+  ROUTE_SENSORS,
+  ROUTE_AC_COMMAND,
+  ROUTE_AC_STATUS,
+  ROUTE_AI_TOGGLE,
+  ROUTE_VOICE_COMMAND,
+  ROUTE_VOICE_RESULT,
+  ROUTE_VOICE_JOBS,
+  ROUTE_RULES_GET,
+  ROUTE_RULES_POST,
+  ROUTE_HISTORY,
+  ROUTE_LOGS,
+  ROUTE_STATS,
+  ROUTE_METRICS,
+  ROUTE_STALLS,
+  ROUTE_TRACE,
+  ROUTE_MODEL_GET,
+  ROUTE_MODEL_POST,
+  ROUTE_SCHEDULES_GET,
+  ROUTE_SCHEDULES_POST,
+  ROUTE_SCHEDULES_DELETE,
+  ROUTE_ZONES_GET,
+  ROUTE_ZONES_POST,
+  ROUTE_OTHER, // 404 + OPTIONS
+  ROUTE_COUNT
+};
 
-// ============ HÀM CHUYỂN ĐỔI FAN SPEED ============
-String fanSpeedToString(FanSpeed speed)
+// Label Prometheus của từng route, cùng thứ tự với HttpRoute
+const char *const HTTP_ROUTE_LABELS[ROUTE_COUNT] = {
+    "route=\"/\",method=\"GET\"",
+    "route=\"/sensors\",method=\"GET\"",
+    "route=\"/ac/command\",method=\"POST\"",
+    "route=\"/ac/status\",method=\"GET\"",
+    "route=\"/ai/toggle\",method=\"POST\"",
+    "route=\"/voice/command\",method=\"POST\"",
+    "route=\"/voice/result\",method=\"GET\"",
+    "route=\"/voice/jobs\",method=\"GET\"",
+    "route=\"/rules\",method=\"GET\"",
+    "route=\"/rules\",method=\"POST\"",
+    "route=\"/history\",method=\"GET\"",
+    "route=\"/logs\",method=\"GET\"",
+    "route=\"/stats\",method=\"GET\"",
+    "route=\"/metrics\",method=\"GET\"",
+    "route=\"/stalls\",method=\"GET\"",
+    "route=\"/trace\",method=\"GET\"",
+    "route=\"/model\",method=\"GET\"",
+    "route=\"/model\",method=\"POST\"",
+    "route=\"/schedules\",method=\"GET\"",
+    "route=\"/schedules\",method=\"POST\"",
+    "route=\"/schedules\",method=\"DELETE\"",
+    "route=\"/zones\",method=\"GET\"",
+    "route=\"/zones\",method=\"POST\"",
+    "route=\"other\",method=\"ANY\""};
+
+LatencyHistogram routeLatency[ROUTE_COUNT];
+LatencyHistogram loopLatency;
+LatencyHistogram voiceRtt;       // cả lời gọi
+LatencyHistogram voiceConnect;   // bắt tay TCP (chỉ kết nối mới)
+LatencyHistogram voiceFirstByte; // gửi xong request → byte đầu
+volatile uint32_t voiceErrors = 0;
+CircuitBreaker voiceBreaker;
+volatile uint32_t wifiDisconnects = 0;
+volatile uint32_t wifiReconnects = 0;
+volatile bool wifiEverConnected = false;
+TaskHandle_t loopTaskHandle = NULL;
+
+// Đặt ở đầu handler: đo thời gian xử lý route trên async_tcp
+#define TIME_ROUTE(route) ScopedLatency _routeLatency(routeLatency[route])
+
+// Chạy trên task sự kiện WiFi; DISCONNECTED lặp lại ở mỗi lần thử kết nối
+void onWiFiEvent(WiFiEvent_t event)
 {
-  switch (speed)
+  if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED)
+  {
+    wifiDisconnects++;
+  }
+  else if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
   {
-  case FAN_QUIET:
-    return "QUIET";
-  case FAN_LOW:
-    return "LOW";
-  case FAN_MEDIUM:
-    return "MED";
-  case FAN_HIGH:
-    return "HIGH";
-  case FAN_AUTO:
-    return "AUTO";
-  default:
-    return "MED";
+    if (wifiEverConnected)
+      wifiReconnects++;
+    wifiEverConnected = true;
   }
 }
 
-FanSpeed stringToFanSpeed(String speedStr)
+// ============ SENSOR TRACE ============
+// Đầu vào của core mỗi lần sensorTask() chạy; PIR là mức thô vừa đọc
+SensorTraceRing sensorTrace;
+
+void recordTraceSample()
 {
-  speedStr.toUpperCase();
-  if (speedStr == "QUIET" || speedStr == "1")
-    return FAN_QUIET;
-  if (speedStr == "LOW" || speedStr == "2")
-    return FAN_LOW;
-  if (speedStr == "MEDIUM" || speedStr == "MED" || speedStr == "3")
-    return FAN_MEDIUM;
-  if (speedStr == "HIGH" || speedStr == "4")
-    return FAN_HIGH;
-  if (speedStr == "AUTO" || speedStr == "5")
-    return FAN_AUTO;
-  return FAN_MEDIUM;
+  const SensorState &s = core.ctrl.sensors;
+  TraceSample ts = {deviceClock.unixTime(), core.climateValid(), s.temperature, s.humidity,
+                    s.light, digitalRead(PIR_PIN) == HIGH, true, s.distance};
+  sensorTrace.push(ts);
 }
 
+// ============ SCHEDULER ============
+// Chu kỳ các task (ms)
+#define LCD_REFRESH_INTERVAL 1000 // vẽ lại định kỳ dù không ai yêu cầu
+#define LCD_POLL_INTERVAL 20
+#define LCD_MIN_REDRAW_MS 100 // gộp các yêu cầu vẽ lại dồn dập
+#define BUTTON_SCAN_INTERVAL 20
+#define IR_RECV_INTERVAL 10
+#define AI_TASK_INTERVAL 1000
+#define HISTORY_SAMPLE_INTERVAL 1000 // tầng 1s của time-series
+#define AC_COMMAND_INTERVAL 10
+#define IR_TX_INTERVAL 10
+#define SSE_TICK_INTERVAL 250 // gom mọi thay đổi trong 1 tick thành 1 event
+#define SCHEDULE_TICK_INTERVAL 500 // RTC đọc tối đa 1 lần/giây (DeviceClock)
+#define SETTINGS_SAVE_INTERVAL 500 // lưu NVS thay đổi từ handler HTTP
+
+CoopScheduler scheduler;
+int buzzerTaskId = -1;
+int splashTaskId = -1;
+
+// ============ LỊCH SỬ CẢM BIẾN ============
+TimeSeriesStore history;
+
+// ============ KHAI BÁO PROTOTYPE ============
+void requestLcdRedraw();
+String callVoiceAPI(VoiceHttpConnection &conn, String voiceText, const ControllerState &st);
+void applyVoiceDecision(const VoiceDecision &d);
+
+// ============ HÀM CHUYỂN ĐỔI FAN SPEED ============
 int fanSpeedToInt(FanSpeed speed)
 {
   return static_cast<int>(speed);
 }
 
-FanSpeed intToFanSpeed(int speed)
+// ============ HÀM TIỆN ÍCH ============
+// Buzzer chạy như state machine trên scheduler: beep() chỉ nạp pattern,
+// buzzerTask() tự hẹn lại ở mỗi lần đổi trạng thái chân BUZZER_PIN.
+struct BuzzerPattern
 {
-  if (speed < 1)
-    speed = 1;
-  if (speed > 5)
-    speed = 5;
-  return static_cast<FanSpeed>(speed);
-}
+  uint16_t onMs;
+  uint8_t remaining;
+  bool pinHigh;
+};
+BuzzerPattern buzzer = {0, 0, false};
 
-// ============ HÀM TIỆN ÍCH ============
-void beep(int duration = 100, int times = 1)
+void buzzerTask()
 {
-  for (int i = 0; i < times; i++)
+  if (buzzer.pinHigh)
   {
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(duration);
     digitalWrite(BUZZER_PIN, LOW);
-    if (times > 1)
-      delay(100);
+    buzzer.pinHigh = false;
+    if (--buzzer.remaining > 0)
+      scheduler.runAfter(buzzerTaskId, 100);
+    return;
   }
-}
 
-void reportError(String errorMsg, int blinkCount = 3)
-{
-  addLog("ERROR", errorMsg);
-  beep(200, blinkCount);
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("ERROR!");
-  lcd.setCursor(0, 1);
-  lcd.print(errorMsg.substring(0, 16));
-  delay(2000);
-  updateLCD();
+  if (buzzer.remaining == 0)
+    return;
+
+  digitalWrite(BUZZER_PIN, HIGH);
+  buzzer.pinHigh = true;
+  scheduler.runAfter(buzzerTaskId, buzzer.onMs);
 }
 
-// ============ ĐỌC CẢM BIẾN============
-void readSensors()
+// Pattern mới thay thế pattern đang kêu (không xếp hàng)
+void beep(int duration = 100, int times = 1)
 {
-  float h = dht.readHumidity();
-  float t = dht.readTemperature();
-
-  if (isnan(h) || isnan(t))
-  {
-    reportError("DHT22 read fail", 4);
+  if (times <= 0)
     return;
-  }
+  if (buzzer.pinHigh)
+    digitalWrite(BUZZER_PIN, LOW);
+  buzzer.onMs = duration;
+  buzzer.remaining = times;
+  buzzer.pinHigh = false;
+  scheduler.runAfter(buzzerTaskId, 0);
+}
 
-  temperature = t;
-  humidity = h;
-  lightLevel = analogRead(LDR_PIN);
+// ============ LCD SPLASH (MÀN HÌNH TẠM) ============
+// Màn hình lỗi / trạng thái giữ trong durationMs rồi tự trả về màn hình chính,
+// thay cho delay(1500)/delay(2000) trước đây.
+bool splashActive = false;
 
-  // XỬ LÝ TEST PRESENCE MODE - VẪN CẬP NHẬT PRESENCE
-  if (testPresenceMode)
+void showSplash(const String &line1, const String &line2, uint32_t durationMs)
+{
+  splashActive = true;
+  lcdFrame.clear();
+  lcdFrame.print(line1);
+  if (line2.length() > 0)
   {
-    presenceDetected = true; // BẮT BUỘC TRUE KHI TEST
-    motionDetected = true;
-    presenceDistance = 50.0;
-    lastPresenceTime = millis();
-    lastMotionTime = millis();
-    now = rtc.now();
-    addLog("INFO", "T=" + String(temperature, 1) + "C H=" + String(humidity, 0) + "% TEST_MODE:ON PRESENCE:FORCED");
-    return; // Không đọc cảm biến thật
+    lcdFrame.setCursor(0, 1);
+    lcdFrame.print(line2);
   }
+  requestLcdRedraw();
+  scheduler.runAfter(splashTaskId, durationMs);
+}
 
-  // ĐỌC CẢM BIẾN THẬT KHI KHÔNG TEST
-  if (digitalRead(PIR_PIN) == HIGH)
-  {
-    motionDetected = true;
-    lastMotionTime = millis();
-  }
-  else if (millis() - lastMotionTime > 5000)
-  {
-    motionDetected = false;
-  }
+void splashEndTask()
+{
+  splashActive = false;
+  requestLcdRedraw();
+}
 
-  digitalWrite(RADAR_TRIG_PIN, LOW);
-  delayMicroseconds(2);
-  digitalWrite(RADAR_TRIG_PIN, HIGH);
-  delayMicroseconds(10);
-  digitalWrite(RADAR_TRIG_PIN, LOW);
-  long duration = pulseIn(RADAR_ECHO_PIN, HIGH, 30000);
+void reportError(const char *errorMsg, int blinkCount = 3)
+{
+  LOG_ERROR("%s", errorMsg);
+  beep(200, blinkCount);
+  showSplash("ERROR!", errorMsg, 2000);
+}
 
-  presenceDistance = (duration * 0.0343) / 2.0;
+// ============ ĐỌC CẢM BIẾN============
+// ============ DHT22 (KHÔNG CHẶN) ============
+// dhtStartTask() kéo bus, dhtStepTask() tự hẹn lại cho tới khi giải mã xong.
+// DHT của mọi zone đọc cùng lúc (mỗi cái 1 chân, ISR riêng) nên đi cùng nhịp.
+int dhtStepTaskId = -1;
 
-  if (presenceDistance > 1.0 && presenceDistance < 150.0)
+void dhtStepTask()
+{
+  uint32_t next = 0;
+  for (Zone &z : zones)
   {
-    presenceDetected = true;
-    lastPresenceTime = millis();
+    uint32_t n = z.dht.step(millis());
+    if (n > next)
+      next = n;
   }
-  else if (millis() - lastPresenceTime > 10000)
+  if (next > 0)
+    scheduler.runAfter(dhtStepTaskId, next);
+}
+
+void dhtStartTask()
+{
+  uint32_t next = 0;
+  for (Zone &z : zones)
   {
-    presenceDetected = false;
+    uint32_t n = z.dht.startRead();
+    if (n > next)
+      next = n;
   }
-
-  now = rtc.now();
-  addLog("INFO", "T=" + String(temperature, 1) + "C H=" + String(humidity, 0) +
-                     "% Motion:" + String(motionDetected) + " Presence:" + String(presenceDetected) +
-                     " Dist=" + String(presenceDistance, 0) + "cm");
+  if (next > 0)
+    scheduler.runAfter(dhtStepTaskId, next);
 }
 
-// ============ CẬP NHẬT LCD (HIỂN THỊ LUÂN PHIÊN) ============
-void updateLCD()
+// Chỉ báo lỗi khi đổi mức sức khỏe, không báo mỗi lần đọc hỏng.
+// Zone 0 báo lên LCD + còi, zone khác chỉ ghi log.
+void checkDhtHealth(Zone &z)
 {
-  lcd.clear();
-
-  //  DÒNG 1: Luôn hiển thị nhiệt độ + độ ẩm
-  lcd.setCursor(0, 0);
-  lcd.print("T:");
-  lcd.print(temperature, 1);
-  lcd.print("C ");
-  lcd.print("H:");
-  lcd.print((int)humidity);
-  lcd.print("%");
+  DhtHealth health = z.dht.health();
+  if (health == z.lastHealth)
+    return;
 
-  // Hiển thị chỉ báo presence/test ở góc phải
-  if (presenceDetected)
+  if (health == DHT_FAILING && &z == &zones[0])
   {
-    lcd.setCursor(14, 0);
-    lcd.print(testPresenceMode ? "T" : "P");
+    reportError("DHT22 read fail", 4);
   }
-
-  if (aiEnabled)
+  else if (health == DHT_FAILING)
   {
-    lcd.setCursor(15, 0);
-    lcd.print("*");
+    LOG_ERROR("DHT22 [%s] read fail", z.cfg->name);
   }
-
-  // DÒNG 2: Luân phiên hiển thị thông tin
-  lcd.setCursor(0, 1);
-
-  if (acStatus)
+  else if (health == DHT_DEGRADED && z.lastHealth == DHT_OK)
   {
-    // KHI AC BẬT: Hiển thị nhiệt độ + mode + fan speed CHUẨN
-    // Format: "AC:24C C QUI" hoặc "AC:24C C HI" (16 ký tự)
-    lcd.print("AC:");
-    lcd.print(acTemp);
-    lcd.print("C ");
-
-    // Mode: 1 ký tự
-    lcd.print(acMode.substring(0, 1));
-    lcd.print(" ");
-
-    // FAN SPEED: Hiển thị tên rút gọn chuẩn
-    String fanDisplay = "";
-    switch (acFan)
-    {
-    case FAN_QUIET:
-      fanDisplay = "QUI"; // QUIET
-      break;
-    case FAN_LOW:
-      fanDisplay = "LOW";
-      break;
-    case FAN_MEDIUM:
-      fanDisplay = "MED";
-      break;
-    case FAN_HIGH:
-      fanDisplay = "HI ";
-      break;
-    case FAN_AUTO:
-      fanDisplay = "AUT"; // AUTO
-      break;
-    default:
-      fanDisplay = "MED";
-    }
-    lcd.print(fanDisplay);
+    LOG_WARN("DHT22 [%s] degraded: fail %.0f%%", z.cfg->name, z.dht.failureRate() * 100);
   }
-  else
+  else if (z.lastHealth == DHT_FAILING)
   {
-    // Khi AC tắt: luân phiên thông tin
-    unsigned long now_ms = millis();
-    int cycle = (now_ms / 3000) % 3; // Đổi mỗi 3 giây
+    LOG_SUCCESS("DHT22 [%s] recovered", z.cfg->name);
+  }
+  z.lastHealth = health;
+}
 
-    switch (cycle)
-    {
-    case 0: // Giờ + presence
-      lcd.printf("%02d:%02d", now.hour(), now.minute());
-      lcd.print(presenceDetected ? " PRESENT" : " EMPTY  ");
-      break;
+// ============ RADAR (KHÔNG CHẶN) ============
+// Gom kết quả ping trước (đo bằng ngắt) rồi bắn ping kế tiếp; core publish
+// khi khoảng cách / trạng thái có người đổi.
+void radarTask()
+{
+  core.samplePresence(millis());
+  radar.ping();
+}
 
-    case 1: // Khoảng cách
-      if (presenceDetected)
-      {
-        lcd.print("Dist: ");
-        lcd.print((int)presenceDistance);
-        lcd.print("cm   ");
-      }
-      else
-      {
-        lcd.print("No presence    ");
-      }
-      break;
+// ============ CẬP NHẬT LCD (HIỂN THỊ LUÂN PHIÊN) ============
+// core vẽ màn hình chính vào lcdFrame; lcdTask() mới gửi phần thay đổi ra LCD
+// Ghi nhận yêu cầu vẽ lại; nhiều yêu cầu trong cùng khoảng được gộp làm một.
+// An toàn khi gọi từ handler HTTP (chỉ bật cờ, không chạm I2C).
+void requestLcdRedraw()
+{
+  lcdRedrawRequests++;
+  lcdRedrawPending = true;
+}
 
-    case 2: // Ánh sáng
-      lcd.print("Light: ");
-      lcd.print(lightLevel);
-      lcd.print("   ");
-      break;
-    }
+// Task duy nhất chạm I2C của LCD: tối đa 1 lần vẽ mỗi LCD_MIN_REDRAW_MS
+void lcdTask()
+{
+  static uint32_t renderedAcVersion = 0;
+  uint32_t now = millis();
+  if (now - lastLcdRenderMs >= LCD_REFRESH_INTERVAL)
+    lcdRedrawPending = true; // nội dung cảm biến / luân phiên đổi theo thời gian
+  if (core.ctrl.acVersion != renderedAcVersion)
+  {
+    renderedAcVersion = core.ctrl.acVersion;
+    requestLcdRedraw(); // lệnh AC mới hiện ngay
   }
+  if (!lcdRedrawPending || now - lastLcdRenderMs < LCD_MIN_REDRAW_MS)
+    return;
+
+  lcdRedrawPending = false;
+  lastLcdRenderMs = now;
+  // Đang hiện splash → back buffer đã có sẵn nội dung splash
+  if (!splashActive)
+    core.composeScreen(lcdFrame, now);
+  PROF_SCOPE("lcd_i2c", STALL_IO_BUDGET_US);
+  lcdFrame.flush(deviceDisplay);
 }
 
 // ============ GỬI LỆNH DAIKIN ============
-void sendDaikinCommand(String commandName)
+// core.apply() chỉ ghi nhận yêu cầu; irTxTask() phát trạng thái mới nhất
+void loadDaikinState(const AcState &ac)
 {
-  if (!acStatus)
+  if (!ac.power)
   {
     irsend.off();
   }
   else
   {
     irsend.on();
-    irsend.setTemp(acTemp);
+    irsend.setTemp(ac.temp);
 
-    if (acMode == "COOL")
+    switch (ac.mode)
+    {
+    case AC_MODE_COOL:
       irsend.setMode(kDaikinCool);
-    else if (acMode == "HEAT")
+      break;
+    case AC_MODE_HEAT:
       irsend.setMode(kDaikinHeat);
-    else if (acMode == "DRY")
+      break;
+    case AC_MODE_DRY:
       irsend.setMode(kDaikinDry);
-    else if (acMode == "FAN")
+      break;
+    case AC_MODE_FAN:
       irsend.setMode(kDaikinFan);
-    else if (acMode == "AUTO")
+      break;
+    case AC_MODE_AUTO:
       irsend.setMode(kDaikinAuto);
+      break;
+    }
 
-    switch (acFan)
+    switch (ac.fan)
     {
     case FAN_QUIET:
       irsend.setFan(kDaikinFanQuiet);
@@ -413,334 +720,365 @@ void sendDaikinCommand(String commandName)
       break;
     }
   }
-
-  irsend.send();
-  irCommands++;
-
-  addLog("INFO", "DAIKIN→ " + commandName + " | PWR:" + String(acStatus ? "ON" : "OFF") +
-                     " T:" + String(acTemp) + "C M:" + acMode + " F:" + fanSpeedToString(acFan));
-
-  beep(acStatus ? 100 : 50, acStatus ? 1 : 2);
-  updateLCD();
 }
 
-// ============ MOCK LLM - TỰ ĐỘNG TỐI ƯU  ============
-void mockLLMOptimize()
+void irTxTask()
 {
-  static unsigned long lastCheck = 0;
-  static float lastTemp = 0;
-  static bool lastPresence = false;
-
-  // Kiểm tra cooldown
-  if (millis() - lastCheck < AI_COOLDOWN)
-    return;
-
-  // Kiểm tra AI có được bật không
-  if (!aiEnabled)
+  for (Zone &z : zones)
   {
-    lastCheck = millis();
-    return;
+    if (!z.core.transmitTick(millis()))
+      continue;
+    irCommands++;
+    beep(z.core.ctrl.ac.power ? 100 : 50, z.core.ctrl.ac.power ? 1 : 2);
   }
+}
 
-  if (aiProcessing)
-    return;
-
-  // BỎ KIỂM TRA TEST MODE - CHO AI CHẠY LUÔN
-  // Test mode CHỈ giả lập cảm biến, không chặn AI
-
-  bool trigger = false;
-  String triggerReason = "";
-  String action = "maintain";
-  int targetTemp = acTemp;
-  FanSpeed targetFan = acFan;
-  String targetMode = acMode;
-  String reason = "";
+// Phần tử hàng đợi lệnh: lệnh AC + zone đích
+struct ZoneCommand
+{
+  uint8_t zone;
+  AcCommand cmd;
+};
 
-  addLog("AI", "[MOCK LLM] Analyzing... T=" + String(temperature, 1) + "C Presence:" + String(presenceDetected));
+// Gọi từ task khác loop() (handler HTTP...). false nếu hàng đợi đầy.
+bool submitAcCommand(const AcCommand &cmd, uint8_t zone = 0)
+{
+  ZoneCommand item = {zone, cmd};
+  return xQueueSend(acCommandQueue, &item, 0) == pdTRUE;
+}
 
-  // ===== RULE 1: Không có người - Tắt AC =====
-  if (!presenceDetected && !motionDetected && acStatus)
-  {
-    if (millis() - lastPresenceTime > 10000) // GIẢM XUỐNG 10 GIÂY
-    {
-      trigger = true;
-      action = "turn_off";
-      reason = "No presence 1min";
-      addLog("AI", "✓ Rule 1: No presence → Turn OFF");
-    }
-  }
+void acCommandTask()
+{
+  ZoneCommand item;
+  while (xQueueReceive(acCommandQueue, &item, 0) == pdTRUE)
+    zones[item.zone].core.apply(item.cmd);
+}
 
-  // ===== RULE 2: Quá nóng + Có người - Bật AC =====
-  if (!trigger && temperature >= 29 && (presenceDetected || motionDetected) && !acStatus)
-  {
-    trigger = true;
-    action = "turn_on";
-    targetTemp = (temperature >= 31) ? 22 : 24;
-    targetFan = (temperature >= 31) ? FAN_HIGH : FAN_MEDIUM;
-    targetMode = "COOL";
-    reason = "Very hot (" + String(temperature, 1) + "C)";
-    addLog("AI", "✓ Rule 2: Too hot → Turn ON at " + String(targetTemp) + "C");
-  }
+// ============ RULE ENGINE - TỰ ĐỘNG TỐI ƯU ============
+// Bảng luật mặc định ở default_rules.h; override ngưỡng lưu NVS. Handler
+// /rules chỉ sửa bảng, settingsTask() trên loop() lưu khi bảng đổi.
+Preferences rulePrefs;
 
-  // ===== RULE 3: Hơi nóng + Có người - Bật AC =====
-  if (!trigger && temperature >= 27 && (presenceDetected || motionDetected) && !acStatus)
-  {
-    trigger = true;
-    action = "turn_on";
-    targetTemp = 25;
-    targetFan = FAN_MEDIUM;
-    targetMode = "COOL";
-    reason = "Hot (" + String(temperature, 1) + "C)";
-    addLog("AI", "✓ Rule 3: Hot → Turn ON");
-  }
+// Override ngưỡng lưu trong NVS, áp dụng lại khi khởi động
+void loadRuleOverrides()
+{
+  RuleOverride saved[RULE_MAX_OVERRIDES];
+  rulePrefs.begin("rules", true);
+  size_t bytes = rulePrefs.getBytes("ovr", saved, sizeof(saved));
+  rulePrefs.end();
+  core.rules.loadOverrides(saved, bytes / sizeof(RuleOverride));
+  if (bytes > 0)
+    LOG_INFO("Rules: %u overrides loaded", (unsigned)(bytes / sizeof(RuleOverride)));
+}
 
-  // ===== RULE 4: Quá lạnh - Tắt AC =====
-  if (!trigger && temperature <= 22 && acStatus)
-  {
-    trigger = true;
-    action = "turn_off";
-    reason = "Too cold (" + String(temperature, 1) + "C)";
-    addLog("AI", "✓ Rule 4: Too cold → Turn OFF");
-  }
+void saveRuleOverrides()
+{
+  RuleOverride current[RULE_MAX_OVERRIDES];
+  uint8_t n = core.rules.copyOverrides(current);
+  rulePrefs.begin("rules", false);
+  if (n == 0)
+    rulePrefs.remove("ovr");
+  else
+    rulePrefs.putBytes("ovr", current, n * sizeof(RuleOverride));
+  rulePrefs.end();
+}
 
-  // ===== RULE 5: Độ ẩm cao - Dùng DRY mode =====
-  if (!trigger && humidity >= 75 && temperature >= 24 && temperature <= 28 && acStatus)
-  {
-    if (acMode != "DRY")
-    {
-      trigger = true;
-      action = "adjust";
-      targetTemp = 26;
-      targetFan = FAN_MEDIUM;
-      targetMode = "DRY";
-      reason = "High humidity (" + String(humidity, 0) + "%)";
-      addLog("AI", "✓ Rule 5: High humidity → DRY mode");
-    }
-  }
+// Chế độ dự báo (room_model.h): cờ bật + cấu hình lưu cùng namespace luật.
+// Tham số mô hình không lưu, học lại sau mỗi lần khởi động. Handler /model
+// chỉ gửi yêu cầu, settingsTask() áp dụng và lưu.
+void loadPredictSettings()
+{
+  PredictConfig cfg = PREDICT_DEFAULT;
+  rulePrefs.begin("rules", true);
+  core.predictive = rulePrefs.getBool("predict", false);
+  size_t bytes = rulePrefs.getBytes("pcfg", &cfg, sizeof(cfg));
+  rulePrefs.end();
+  if (bytes == sizeof(cfg))
+    core.model.setConfig(cfg);
+  if (core.predictive)
+    LOG_INFO("Predictive mode: ON (rules until model ready)");
+}
 
-  // ===== RULE 6: Điều chỉnh nhiệt độ khi AC đang bật =====
-  if (!trigger && acStatus && (presenceDetected || motionDetected))
-  {
-    // Quá nóng so với setting
-    if (temperature > acTemp + 3)
-    {
-      trigger = true;
-      action = "adjust";
-      targetTemp = max(16, acTemp - 2);
-      targetFan = FAN_HIGH;
-      targetMode = acMode;
-      reason = "Still warm, lowering";
-      addLog("AI", "✓ Rule 6a: Too hot vs setting → Lower to " + String(targetTemp) + "C");
-    }
-    // Gần đạt nhiệt độ mục tiêu
-    else if (abs(temperature - acTemp) <= 1 && acFan != FAN_LOW)
-    {
-      trigger = true;
-      action = "adjust";
-      targetTemp = acTemp;
-      targetFan = FAN_LOW;
-      targetMode = acMode;
-      reason = "Near target, reduce";
-      addLog("AI", "✓ Rule 6b: Near target → Reduce fan");
-    }
-  }
+void savePredictSettings()
+{
+  PredictConfig cfg = core.model.config();
+  rulePrefs.begin("rules", false);
+  rulePrefs.putBool("predict", core.predictive);
+  rulePrefs.putBytes("pcfg", &cfg, sizeof(cfg));
+  rulePrefs.end();
+}
 
-  // ===== RULE 7: Ban đêm → Chế độ QUIET =====
-  if (!trigger && acStatus && (presenceDetected || motionDetected))
+// Ghi NVS (chậm, khóa flash) chỉ trên loop(), không trên async_tcp
+void settingsTask()
+{
+  if (core.rules.takeDirty())
+    saveRuleOverrides();
+  if (core.applyModelSettings())
   {
-    if ((now.hour() >= 22 || now.hour() <= 6) && acFan != FAN_QUIET && lightLevel > 2500)
-    {
-      trigger = true;
-      action = "adjust";
-      targetTemp = acTemp;
-      targetFan = FAN_QUIET;
-      targetMode = acMode;
-      reason = "Night mode";
-      addLog("AI", "✓ Rule 7: Night → QUIET mode");
-    }
+    savePredictSettings();
+    LOG_INFO("Predictive mode: %s", core.predictive ? "ON" : "OFF");
   }
+}
 
-  // ===== Thực hiện action =====
-  if (trigger)
-  {
-    addLog("AI", "⚡ MOCK LLM → " + action + ": " + reason);
+// ============ LỊCH HẸN GIỜ ============
+// Bảng + timer wheel ở schedules.h. Handler /schedules chỉ sửa bảng; loop()
+// tick theo giờ RTC, áp dụng lệnh đến hạn bằng core.apply() như lệnh khác
+// và lưu NVS khi bảng đổi (kể cả lịch once/timer vừa chạy xong).
+ScheduleTable schedules;
+Preferences schedulePrefs;
+Schedule scheduleBuf[SCHEDULE_MAX]; // chỉ dùng trên loop(): nạp / lưu NVS
 
-    if (action == "turn_off")
-    {
-      acStatus = false;
-      sendDaikinCommand("AI_OFF");
-      lastAIResponse = reason;
-      autoOptimizations++;
-    }
-    else if (action == "turn_on")
-    {
-      acStatus = true;
-      acTemp = targetTemp;
-      acFan = targetFan;
-      acMode = targetMode;
-      sendDaikinCommand("AI_ON");
-      lastAIResponse = reason;
-      autoOptimizations++;
-    }
-    else if (action == "adjust")
-    {
-      acTemp = targetTemp;
-      acFan = targetFan;
-      acMode = targetMode;
-      sendDaikinCommand("AI_ADJUST");
-      lastAIResponse = reason;
-      autoOptimizations++;
-    }
+void loadSchedules()
+{
+  schedulePrefs.begin("sched", true);
+  size_t bytes = schedulePrefs.getBytes("list", scheduleBuf, sizeof(scheduleBuf));
+  schedulePrefs.end();
+  schedules.load(scheduleBuf, bytes / sizeof(Schedule));
+  if (bytes > 0)
+    LOG_INFO("Schedules: %u loaded", (unsigned)(bytes / sizeof(Schedule)));
+}
 
-    lastTemp = temperature;
-    lastPresence = presenceDetected;
-  }
+void saveSchedules()
+{
+  uint16_t n = schedules.copyAll(scheduleBuf);
+  schedulePrefs.begin("sched", false);
+  if (n == 0)
+    schedulePrefs.remove("list");
   else
+    schedulePrefs.putBytes("list", scheduleBuf, n * sizeof(Schedule));
+  schedulePrefs.end();
+}
+
+void scheduleTask()
+{
+  Schedule due[SCHEDULE_DUE_BATCH];
+  uint8_t n = schedules.tick(deviceClock.unixTime(), due, SCHEDULE_DUE_BATCH);
+  for (uint8_t i = 0; i < n; i++)
   {
-    addLog("AI", "⏸ MOCK LLM: Maintain - All OK");
+    AcCommand cmd = {due[i].fields, due[i].value, "SCHEDULE"};
+    core.apply(cmd);
+    LOG_INFO("Schedule #%u (%s) fired", due[i].id, scheduleKindToString(due[i].kind));
   }
-
-  lastCheck = millis();
+  if (schedules.takeDirty())
+    saveSchedules();
 }
 
 // ============ GỌI VOICE API (GEMINI) ============
-String callVoiceAPI(String voiceText)
+// conn: kết nối keep-alive của worker đang gọi (voice_http.h)
+String callVoiceAPI(VoiceHttpConnection &conn, String voiceText, const ControllerState &st)
 {
   if (WiFi.status() != WL_CONNECTED)
   {
-    addLog("ERROR", "WiFi not connected");
+    LOG_ERROR("WiFi not connected");
+    voiceBreaker.failure(millis()); // probe HALF_OPEN phải kết thúc
     return "";
   }
 
-  HTTPClient http;
-  http.begin(VOICE_API_URL);
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Authorization", "Bearer " + String(API_KEY));
-  // http.setTimeout(65000);
-
+  // Chạy trên worker task → chỉ đọc snapshot (worker dùng lại làm khóa cache)
   DynamicJsonDocument doc(1024);
   doc["text"] = voiceText;
-  doc["temperature"] = temperature;
-  doc["humidity"] = humidity;
-  doc["ac_status"] = acStatus;
-  doc["ac_temp"] = acTemp;
-  doc["ac_mode"] = acMode;
-  doc["ac_fan"] = fanSpeedToString(acFan);
+  doc["temperature"] = st.sensors.temperature;
+  doc["humidity"] = st.sensors.humidity;
+  doc["ac_status"] = st.ac.power;
+  doc["ac_temp"] = st.ac.temp;
+  doc["ac_mode"] = acModeToString(st.ac.mode);
+  doc["ac_fan"] = fanSpeedToString((FanSpeed)st.ac.fan);
 
   String payload;
   serializeJson(doc, payload);
 
-  addLog("INFO", "→ VOICE API: " + voiceText);
+  LOG_INFO("→ VOICE API: %s", voiceText);
 
-  aiProcessing = true;
-  int httpCode = http.POST(payload);
-  aiProcessing = false;
+  portENTER_CRITICAL(&voiceMux);
+  voiceInFlight++;
+  portEXIT_CRITICAL(&voiceMux);
+  VoiceHttpTiming t;
+  String response;
+  int httpCode = conn.post(payload.c_str(), "Bearer " API_KEY, response, t);
+  portENTER_CRITICAL(&voiceMux);
+  voiceInFlight--;
   voiceCommands++;
-
-  String response = "";
+  if (httpCode <= 0)
+    voiceErrors++;
+  portEXIT_CRITICAL(&voiceMux);
 
   if (httpCode > 0)
   {
-    response = http.getString();
-    addLog("SUCCESS", "← VOICE HTTP " + String(httpCode));
+    voiceRtt.observe(t.totalUs);
+    voiceFirstByte.observe(t.firstByteUs);
+    if (!t.reused)
+      voiceConnect.observe(t.connectUs);
+    LOG_SUCCESS("← VOICE HTTP %d %lums%s", httpCode, (unsigned long)(t.totalUs / 1000), t.reused ? " (reused)" : "");
   }
   else
   {
-    addLog("ERROR", "VOICE failed: " + String(httpCode));
+    LOG_ERROR("VOICE failed: %s", voiceHttpErrorToString(httpCode));
   }
 
-  http.end();
+  // 4xx là lỗi phía thiết bị (sai key, thiếu text), server vẫn sống
+  if (httpCode > 0 && httpCode < 500)
+    voiceBreaker.success();
+  else
+    voiceBreaker.failure(millis());
   return response;
 }
 
 // ============ XỬ LÝ QUYẾT ĐỊNH AI ============
-void processAIDecision(String aiResponse)
+// Chạy trên loop(); d đã parse sẵn (worker, parser local hoặc cache)
+void applyVoiceDecision(const VoiceDecision &d)
 {
-  addLog("INFO", "Process AI Decision...");
-
-  if (aiResponse.length() == 0 || aiResponse.indexOf("\"error\"") != -1)
-  {
-    addLog("ERROR", "Invalid AI response");
-    return;
-  }
+  LOG_INFO("Action: %s", voiceActionToString(d.action));
 
-  int jsonStart = aiResponse.indexOf('{');
-  int jsonEnd = aiResponse.lastIndexOf('}');
-  if (jsonStart == -1 || jsonEnd == -1)
+  if (d.action == VA_TURN_ON)
   {
-    addLog("ERROR", "No JSON in response");
-    return;
+    AcCommand cmd = {AC_SET_POWER | AC_SET_TEMP | AC_SET_MODE, core.ctrl.ac, "VOICE_ON"};
+    cmd.value.power = true;
+    cmd.value.temp = d.temp ? d.temp : 25;
+    if (d.fan != VOICE_KEEP)
+    {
+      cmd.fields |= AC_SET_FAN;
+      cmd.value.fan = d.fan;
+    }
+    cmd.value.mode = d.mode != VOICE_KEEP ? d.mode : (uint8_t)AC_MODE_COOL;
+    core.apply(cmd);
+    LOG_SUCCESS("AC ON %dC %s", core.ctrl.ac.temp, fanSpeedToString((FanSpeed)core.ctrl.ac.fan));
   }
-
-  String jsonStr = aiResponse.substring(jsonStart, jsonEnd + 1);
-  DynamicJsonDocument doc(768);
-  DeserializationError error = deserializeJson(doc, jsonStr);
-
-  if (error)
+  else if (d.action == VA_TURN_OFF)
   {
-    addLog("ERROR", "Parse: " + String(error.c_str()));
-    return;
+    AcCommand cmd = {AC_SET_POWER, core.ctrl.ac, "VOICE_OFF"};
+    cmd.value.power = false;
+    core.apply(cmd);
+    LOG_SUCCESS("AC OFF");
   }
-
-  String action = doc["action"] | "maintain";
-  addLog("INFO", "Action: " + action);
-
-  if (action == "turn_on")
+  else if (d.action == VA_ADJUST)
   {
-    acStatus = true;
-    acTemp = constrain(doc["temperature"] | 25, 16, 30);
-
-    if (doc.containsKey("fan_speed"))
+    if (core.ctrl.ac.power)
     {
-      if (doc["fan_speed"].is<String>())
+      AcCommand cmd = {AC_SET_TEMP, core.ctrl.ac, "VOICE_ADJUST"};
+      if (d.temp)
+        cmd.value.temp = d.temp;
+      if (d.fan != VOICE_KEEP)
       {
-        acFan = stringToFanSpeed(doc["fan_speed"].as<String>());
+        cmd.fields |= AC_SET_FAN;
+        cmd.value.fan = d.fan;
       }
-      else
+      if (d.mode != VOICE_KEEP)
       {
-        int fanInt = doc["fan_speed"] | 3;
-        acFan = intToFanSpeed(fanInt);
+        cmd.fields |= AC_SET_MODE;
+        cmd.value.mode = d.mode;
       }
+      core.apply(cmd);
+      LOG_SUCCESS("AC adj %dC %s", core.ctrl.ac.temp, fanSpeedToString((FanSpeed)core.ctrl.ac.fan));
     }
-
-    acMode = doc["mode"] | "COOL";
-    sendDaikinCommand("VOICE_ON");
-    addLog("SUCCESS", "AC ON " + String(acTemp) + "C " + fanSpeedToString(acFan));
   }
-  else if (action == "turn_off")
+
+  LOG_INFO("Why: %.30s", d.reason);
+  lastAIResponse = d.reason;
+}
+
+// ============ VOICE PIPELINE (WORKER TASK) ============
+// async_tcp chỉ submit job; VOICE_MAX_CONCURRENT worker gọi Gemini;
+// voiceApplyTask() trên loop() áp dụng quyết định để trạng thái AC chỉ bị
+// ghi từ một nơi.
+#define VOICE_MAX_CONCURRENT 2
+#define VOICE_WORKER_STACK 8192
+#define VOICE_APPLY_INTERVAL 50
+
+VoiceJobTable voiceJobs;
+VoiceIntentParser voiceIntents; // chỉ dùng trên async_tcp (handler /voice/*)
+VoiceDecisionCache voiceCache;
+VoiceHttpConnection voiceConns[VOICE_MAX_CONCURRENT]; // 1 kết nối keep-alive / worker
+QueueHandle_t voiceQueue = NULL;
+TaskHandle_t voiceWorkers[VOICE_MAX_CONCURRENT];
+
+uint32_t submitVoiceJob(const String &voiceText)
+{
+  uint32_t jobId = voiceJobs.submit(voiceText.c_str(), millis());
+  if (jobId == 0)
   {
-    acStatus = false;
-    sendDaikinCommand("VOICE_OFF");
-    addLog("SUCCESS", "AC OFF");
+    LOG_WARN("Voice queue full");
+    return 0;
   }
-  else if (action == "adjust")
+  if (xQueueSend(voiceQueue, &jobId, 0) != pdTRUE)
   {
-    if (acStatus)
-    {
-      acTemp = constrain(doc["temperature"] | acTemp, 16, 30);
+    voiceJobs.fail(jobId, "Voice queue full", "Hàng đợi lệnh giọng nói đang đầy", millis());
+    return 0;
+  }
+  return jobId;
+}
 
-      if (doc.containsKey("fan_speed"))
-      {
-        if (doc["fan_speed"].is<String>())
-        {
-          acFan = stringToFanSpeed(doc["fan_speed"].as<String>());
-        }
-        else
-        {
-          int fanInt = doc["fan_speed"] | fanSpeedToInt(acFan);
-          acFan = intToFanSpeed(fanInt);
-        }
-      }
+void voiceWorkerTask(void *param)
+{
+  VoiceHttpConnection &conn = voiceConns[(uintptr_t)param];
+  char text[VOICE_TEXT_MAX];
+  uint32_t jobId;
+
+  for (;;)
+  {
+    if (xQueueReceive(voiceQueue, &jobId, portMAX_DELAY) != pdTRUE)
+      continue;
+    if (!voiceJobs.start(jobId, millis(), text, sizeof(text)))
+      continue;
+
+    // Server đang chết: trả lỗi ngay thay vì chờ hết deadline
+    VoiceDecision d;
+    if (!voiceBreaker.allow(millis()))
+    {
+      clearVoiceDecision(d);
+      copyUtf8(d.reason, "Gemini server đang không phản hồi, thử lại sau ít phút", sizeof(d.reason));
+      voiceJobs.respond(jobId, d);
+      continue;
+    }
 
-      acMode = doc["mode"] | acMode;
-      sendDaikinCommand("VOICE_ADJUST");
-      addLog("SUCCESS", "AC adj " + String(acTemp) + "C " + fanSpeedToString(acFan));
+    // Parse 1 lần ở đây; loop() chỉ nhận struct. Lỗi → VA_NONE
+    ControllerState st = core.read();
+    String apiResponse = callVoiceAPI(conn, String(text), st);
+    if (parseVoiceDecision(apiResponse.c_str(), d))
+    {
+      VoiceCacheKey key;
+      if (makeVoiceCacheKey(text, st, key))
+        voiceCache.insert(key, d, millis());
     }
+    voiceJobs.respond(jobId, d);
+  }
+}
+
+void startVoiceWorkers()
+{
+  voiceQueue = xQueueCreate(VOICE_QUEUE_DEPTH, sizeof(uint32_t));
+  for (int i = 0; i < VOICE_MAX_CONCURRENT; i++)
+  {
+    if (!voiceConns[i].begin(VOICE_API_URL))
+      LOG_ERROR("Bad VOICE_API_URL");
+    xTaskCreate(voiceWorkerTask, "voice_worker", VOICE_WORKER_STACK, (void *)(uintptr_t)i, 1, &voiceWorkers[i]);
+  }
+}
+
+// Áp dụng 1 job đã có quyết định mỗi lần chạy
+void voiceApplyTask()
+{
+  static VoiceDecision decision;
+  uint32_t jobId = voiceJobs.takeResponded(decision);
+  if (jobId == 0)
+    return;
+
+  if (decision.action == VA_NONE)
+  {
+    voiceJobs.fail(jobId, "Voice API failed",
+                   decision.reason[0] ? decision.reason : "Không kết nối được Gemini server", millis());
+    return;
   }
 
-  String reason = doc["reason"] | "No reason";
-  addLog("INFO", "Why: " + reason.substring(0, 30));
-  lastAIResponse = reason;
+  applyVoiceDecision(decision);
+
+  // Trường Gemini không nói → trả giá trị AC thực tế cho client
+  if (!decision.temp)
+    decision.temp = core.ctrl.ac.temp;
+  if (decision.fan == VOICE_KEEP)
+    decision.fan = core.ctrl.ac.fan;
+  if (decision.mode == VOICE_KEEP)
+    decision.mode = core.ctrl.ac.mode;
+  voiceJobs.finish(jobId, decision, millis());
 }
 
 // ============ XỬ LÝ NÚT BẤM ============
@@ -761,54 +1099,41 @@ void handleButtons()
   if (lastPowerBtn == HIGH && currentPowerBtn == LOW)
   {
     lastPressTime = millis();
-    acStatus = !acStatus;
-    addLog("INFO", acStatus ? "BTN: AC ON" : "BTN: AC OFF");
-    beep(acStatus ? 100 : 50, acStatus ? 1 : 2);
-    sendDaikinCommand("BTN_POWER");
-    updateLCD();
+    AcCommand cmd = {AC_SET_POWER, core.ctrl.ac, "BTN_POWER"};
+    cmd.value.power = !core.ctrl.ac.power;
+    LOG_INFO("BTN: AC %s", cmd.value.power ? "ON" : "OFF");
+    core.apply(cmd);
   }
 
   if (lastAIBtn == HIGH && currentAIBtn == LOW)
   {
     lastPressTime = millis();
-    aiEnabled = !aiEnabled;
-    addLog("INFO", aiEnabled ? "BTN: AI ON" : "BTN: AI OFF");
-    beep(100, aiEnabled ? 2 : 3);
-    lcd.clear();
-    lcd.print(aiEnabled ? "AI Mode: ON" : "AI Mode: OFF");
-    delay(1500);
-    updateLCD();
+    core.aiEnabled = !core.aiEnabled;
+    LOG_INFO("BTN: AI %s", core.aiEnabled ? "ON" : "OFF");
+    beep(100, core.aiEnabled ? 2 : 3);
+    showSplash(core.aiEnabled ? "AI Mode: ON" : "AI Mode: OFF", "", 1500);
   }
 
   if (lastTestPresenceBtn == HIGH && currentTestPresenceBtn == LOW)
   {
     lastPressTime = millis();
-    testPresenceMode = !testPresenceMode;
+    bool testMode = !core.ctrl.sensors.testMode;
+    core.setTestMode(testMode, millis());
 
-    if (testPresenceMode)
+    if (testMode)
     {
       // Khi BẬT test mode - giả lập có người
-      presenceDetected = true;
-      motionDetected = true;
-      presenceDistance = 50.0;
-      lastPresenceTime = millis();
-      lastMotionTime = millis();
-      addLog("INFO", "✓ TEST MODE: PRESENCE FORCED ON");
+      LOG_INFO("✓ TEST MODE: PRESENCE FORCED ON");
       beep(100, 3);
     }
     else
     {
       // Khi TẮT test mode - reset về thực tế
-      addLog("INFO", "✓ TEST MODE: OFF - REAL SENSORS");
+      LOG_INFO("✓ TEST MODE: OFF - REAL SENSORS");
       beep(50, 3);
     }
 
-    lcd.clear();
-    lcd.print("TEST: PRESENCE");
-    lcd.setCursor(0, 1);
-    lcd.print(testPresenceMode ? "Status: ON" : "Status: OFF");
-    delay(1500);
-    updateLCD();
+    showSplash("TEST: PRESENCE", testMode ? "Status: ON" : "Status: OFF", 1500);
   }
 
   lastPowerBtn = currentPowerBtn;
@@ -824,7 +1149,7 @@ void receiveIR()
     uint32_t irCode = results.value;
     if (irCode != 0xFFFFFFFF)
     {
-      addLog("INFO", "IR RECV: 0x" + String(irCode, HEX));
+      LOG_INFO("IR RECV: 0x%x", irCode);
       irCommands++;
       beep(80, 1);
     }
@@ -851,12 +1176,869 @@ bool authenticateRequest(AsyncWebServerRequest *request)
   return false;
 }
 
+// ============ BODY POST ============
+BodyAssembler requestBodies;
+
+// Đặt đầu body handler: chỉ cho handler chạy khi body đủ (đúng 1 lần), tự
+// trả 413/503/400/408, trả slot arena khi handler xong. text trỏ vào data của
+// thư viện hoặc arena, không có '\0' → luôn dùng kèm length.
+class RequestBody
+{
+public:
+  RequestBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+      : owner(request)
+  {
+    BodyStatus st = requestBodies.feed(request, data, len, index, total, millis(), text, length);
+    ready = st == BODY_READY;
+    if (st == BODY_PENDING && index == 0)
+    {
+      // Client ngắt giữa chừng → trả slot
+      request->onDisconnect([request]() { requestBodies.release(request, true); });
+    }
+    else if (st == BODY_TOO_LARGE && !request->_tempObject)
+    {
+      AsyncWebServerResponse *resp = request->beginResponse(413, "application/json", "{\"error\":\"Body too large\"}");
+      request->send(resp);
+    }
+    else if (st == BODY_BUSY && !request->_tempObject)
+    {
+      AsyncWebServerResponse *resp = request->beginResponse(503, "application/json", "{\"error\":\"Too many uploads\"}");
+      resp->addHeader("Retry-After", "1");
+      request->send(resp);
+    }
+    else if (st == BODY_OUT_OF_ORDER && !request->_tempObject)
+    {
+      AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Body chunk out of order\"}");
+      request->send(resp);
+    }
+    else if (st == BODY_EXPIRED && !request->_tempObject)
+    {
+      AsyncWebServerResponse *resp = request->beginResponse(408, "application/json", "{\"error\":\"Body upload timed out\"}");
+      request->send(resp);
+    }
+  }
+
+  ~RequestBody()
+  {
+    if (ready)
+      requestBodies.release(owner);
+  }
+
+  bool ready;
+  char *text = nullptr;
+  size_t length = 0;
+
+private:
+  const void *owner;
+};
+
+// onRequest của route POST: chạy sau khi body đã xử lý. Body rỗng thì body
+// handler không được gọi → trả lỗi thay vì để client chờ timeout.
+void rejectEmptyBody(AsyncWebServerRequest *request)
+{
+  if (!request || request->_tempObject || request->contentLength() > 0)
+    return;
+  AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Missing body\"}");
+  request->send(resp);
+}
+
 // ============ SETUP WEBSERVER ============
 // ============ TRONG HÀM setupWebServer() - THÊM VÀO ĐẦU ============
 
 // ============ SETUP WEBSERVER ============
 // ============ TRONG HÀM setupWebServer() - THÊM VÀO ĐẦU ============
 
+// ============ RESPONSE JSON CÓ CACHE ============
+JsonCache sensorsCache(768);
+JsonCache acStatusCache(512);
+JsonCache statsCache(4096);
+
+// Trả JSON từ cache theo key; If-None-Match khớp ETag → 304, không build JSON
+template <typename Fill>
+void sendCachedJson(AsyncWebServerRequest *request, JsonCache &cache, uint64_t key, Fill fill)
+{
+  char etag[JSON_ETAG_SIZE];
+  JsonCache::etagFor(key, etag, sizeof(etag));
+
+  if (request->hasHeader("If-None-Match") &&
+      cache.notModified(request->getHeader("If-None-Match")->value(), key))
+  {
+    if (!request->_tempObject)
+    {
+      AsyncWebServerResponse *resp = request->beginResponse(304);
+      resp->addHeader("ETag", etag);
+      request->send(resp);
+    }
+    return;
+  }
+
+  // Response giữ shared_ptr → body không đổi cho đến khi gửi xong
+  std::shared_ptr<const String> body = cache.get(key, fill);
+  if (!request->_tempObject)
+  {
+    AsyncWebServerResponse *resp = request->beginResponse("application/json", body->length(),
+                                                          [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                          {
+                                                            size_t n = body->length() - index;
+                                                            if (n > maxLen)
+                                                              n = maxLen;
+                                                            memcpy(buffer, body->c_str() + index, n);
+                                                            return n;
+                                                          });
+    resp->addHeader("ETag", etag);
+    resp->addHeader("Cache-Control", "no-cache");
+    request->send(resp);
+  }
+}
+
+void addCacheStats(JsonObject parent, const char *name, const JsonCache &cache, uint32_t uptimeS)
+{
+  const JsonCacheStats &cs = cache.getStats();
+  JsonObject obj = parent.createNestedObject(name);
+  obj["requests"] = cs.requests;
+  obj["requests_per_s"] = uptimeS ? (float)cs.requests / uptimeS : 0;
+  obj["not_modified"] = cs.notModified;
+  obj["cache_hits"] = cs.hits;
+  obj["rebuilds"] = cs.rebuilds;
+  obj["heap_bytes"] = cs.heapBytes;
+  obj["uncached_heap_bytes"] = cache.uncachedHeapBytes();
+}
+
+// Key cache: version trạng thái + cờ AI (đổi qua /ai/toggle, không qua ctrl)
+uint64_t stateCacheKey(uint32_t version)
+{
+  return ((uint64_t)version << 1) | (core.aiEnabled ? 1 : 0);
+}
+
+// ============ PUSH TRẠNG THÁI (SSE /events) ============
+// Dashboard giữ 1 kết nối /events thay vì poll /sensors. Mỗi tick, loop so
+// snapshot hiện tại với snapshot đã push lần trước và gửi 1 event "delta"
+// chỉ chứa trường đổi; JSON được build 1 lần cho mọi client. Client mới
+// nhận "state" đầy đủ (cùng dạng /sensors), định kỳ có keyframe để client
+// bị thư viện bỏ message vẫn tự đồng bộ lại.
+#define SSE_KEYFRAME_INTERVAL 30000
+#define SSE_RECONNECT_MS 2000
+#define SSE_MAX_AVG_WAITING 4 // quá ngưỡng → hoãn, delta dồn sang tick sau
+#define SSE_DELTA_BUFFER 256
+
+struct SseStats
+{
+  uint32_t connects;
+  uint32_t deltas;
+  uint32_t keyframes;
+  uint32_t coalesced; // số lần publish bị gộp vào event khác
+  uint32_t deferred;  // tick bị hoãn vì client chậm
+  uint32_t bytes;     // payload đã gửi (trước khi nhân số client)
+};
+
+SseStats sseStats = {};
+ControllerState ssePushed = {};
+bool ssePushedAi = false;
+bool sseHasPushed = false;
+uint32_t sseLastKeyframeMs = 0;
+
+// So sánh theo độ phân giải hiển thị để nhiễu cảm biến không sinh event
+bool sseChanged(float a, float b, float step)
+{
+  return lroundf(a / step) != lroundf(b / step);
+}
+
+// Ghi các trường đổi (cùng tên với /sensors); trả về số trường
+size_t buildStateDelta(JsonDocument &doc, const ControllerState &prev, const ControllerState &cur, bool prevAi, bool curAi)
+{
+  if (sseChanged(prev.sensors.temperature, cur.sensors.temperature, 0.1f))
+    doc["temperature"] = cur.sensors.temperature;
+  if (sseChanged(prev.sensors.humidity, cur.sensors.humidity, 0.1f))
+    doc["humidity"] = cur.sensors.humidity;
+  if (prev.sensors.light != cur.sensors.light)
+    doc["light"] = cur.sensors.light;
+  if (prev.sensors.motion != cur.sensors.motion)
+    doc["motion"] = cur.sensors.motion;
+  if (prev.sensors.presence != cur.sensors.presence)
+    doc["presence"] = cur.sensors.presence;
+  if (sseChanged(prev.sensors.distance, cur.sensors.distance, 1.0f))
+    doc["presence_distance"] = cur.sensors.distance;
+  if (prev.sensors.testMode != cur.sensors.testMode)
+    doc["test_mode"] = cur.sensors.testMode;
+  if (prev.ac.power != cur.ac.power)
+    doc["ac_status"] = cur.ac.power;
+  if (prev.ac.temp != cur.ac.temp)
+    doc["ac_temp"] = cur.ac.temp;
+  if (prev.ac.mode != cur.ac.mode)
+    doc["ac_mode"] = acModeToString(cur.ac.mode);
+  if (prev.ac.fan != cur.ac.fan)
+  {
+    doc["ac_fan"] = fanSpeedToString((FanSpeed)cur.ac.fan);
+    doc["ac_fan_level"] = cur.ac.fan;
+  }
+  if (prevAi != curAi)
+    doc["llm_enabled"] = curAi;
+  return doc.size();
+}
+
+void sendStateKeyframe(AsyncEventSourceClient *client)
+{
+  ControllerState st = core.read();
+  DynamicJsonDocument doc(768);
+  buildSensorsJson(doc, st, core.aiEnabled);
+  String payload;
+  serializeJson(doc, payload);
+
+  if (client)
+  {
+    // Kèm thời gian chờ reconnect cho EventSource phía trình duyệt
+    client->send(payload.c_str(), "state", st.version, SSE_RECONNECT_MS);
+    return;
+  }
+  {
+    PROF_SCOPE("sse_send", STALL_IO_BUDGET_US);
+    events.send(payload.c_str(), "state", st.version);
+  }
+  sseStats.keyframes++;
+  sseStats.bytes += payload.length();
+  ssePushed = st;
+  ssePushedAi = core.aiEnabled;
+  sseHasPushed = true;
+  sseLastKeyframeMs = millis();
+}
+
+// Chạy trong loop mỗi SSE_TICK_INTERVAL
+void eventsTask()
+{
+  ControllerState st = core.read();
+  bool ai = core.aiEnabled;
+  if (events.count() == 0)
+  {
+    // Chỉ theo dõi; client mới nhận keyframe qua onConnect
+    ssePushed = st;
+    ssePushedAi = ai;
+    sseHasPushed = true;
+    return;
+  }
+
+  if (sseHasPushed && st.version == ssePushed.version && ai == ssePushedAi)
+    return;
+
+  if (events.avgPacketsWaiting() > SSE_MAX_AVG_WAITING)
+  {
+    sseStats.deferred++;
+    return;
+  }
+
+  if (!sseHasPushed || millis() - sseLastKeyframeMs >= SSE_KEYFRAME_INTERVAL)
+  {
+    sendStateKeyframe(nullptr);
+    return;
+  }
+
+  StaticJsonDocument<384> doc;
+  size_t fields = buildStateDelta(doc, ssePushed, st, ssePushedAi, ai);
+  uint32_t publishes = st.version - ssePushed.version;
+  ssePushed = st;
+  ssePushedAi = ai;
+  if (fields == 0)
+  {
+    sseStats.coalesced += publishes; // chỉ nhiễu dưới độ phân giải
+    return;
+  }
+
+  doc["version"] = st.version;
+  char payload[SSE_DELTA_BUFFER];
+  size_t len = serializeJson(doc, payload, sizeof(payload));
+  {
+    PROF_SCOPE("sse_send", STALL_IO_BUDGET_US);
+    events.send(payload, "delta", st.version);
+  }
+  sseStats.deltas++;
+  sseStats.bytes += len;
+  if (publishes > 1)
+    sseStats.coalesced += publishes - 1;
+}
+
+void buildStatsJson(DynamicJsonDocument &doc)
+{
+  doc["uptime"] = millis() / 1000;
+  doc["model"] = "Daikin";
+  doc["ir_commands"] = irCommands;
+  doc["voice_commands"] = voiceCommands;
+  doc["auto_optimizations"] = core.autoOptimizations;
+
+  // Độ trễ loop + thời gian chạy từng task của scheduler
+  JsonObject loopStats = doc.createNestedObject("loop");
+  loopStats["count"] = scheduler.loopCount;
+  loopStats["last_us"] = scheduler.loopLastUs;
+  loopStats["max_us"] = scheduler.loopMaxUs;
+
+  const RangerStats &rs = radar.getStats();
+  JsonObject radarStats = doc.createNestedObject("radar");
+  radarStats["pings"] = rs.pings;
+  radarStats["echoes"] = rs.echoes;
+  radarStats["timeouts"] = rs.timeouts;
+  radarStats["skipped"] = rs.skipped;
+
+  const DhtStats &ds = dht.getStats();
+  JsonObject dhtStats = doc.createNestedObject("dht");
+  dhtStats["health"] = dhtHealthToString(dht.health());
+  dhtStats["reads"] = ds.reads;
+  dhtStats["ok"] = ds.ok;
+  dhtStats["no_response"] = ds.noResponse;
+  dhtStats["frame_errors"] = ds.frameErrors;
+  dhtStats["checksum_errors"] = ds.checksumErrors;
+  dhtStats["failure_rate"] = dht.failureRate();
+  dhtStats["last_latency_us"] = ds.lastLatencyUs;
+  dhtStats["avg_latency_us"] = ds.ok ? (uint32_t)(ds.totalLatencyUs / ds.ok) : 0;
+  dhtStats["max_latency_us"] = ds.maxLatencyUs;
+
+  // I2C LCD: thực tế (diff) so với ước tính vẽ lại toàn màn hình như trước
+  const LcdFrameStats &ls = lcdFrame.getStats();
+  uint32_t uptimeS = millis() / 1000;
+  JsonObject lcdStats = doc.createNestedObject("lcd");
+  lcdStats["redraw_requests"] = lcdRedrawRequests;
+  lcdStats["flushes"] = ls.flushes;
+  lcdStats["unchanged_flushes"] = ls.unchangedFlushes;
+  lcdStats["runs"] = ls.runs;
+  lcdStats["cells_changed"] = ls.cellsChanged;
+  lcdStats["i2c_bytes"] = ls.lcdBytes * LCD_I2C_BYTES_PER_LCD_BYTE;
+  lcdStats["i2c_bytes_per_s"] = uptimeS ? ls.lcdBytes * LCD_I2C_BYTES_PER_LCD_BYTE / uptimeS : 0;
+  lcdStats["full_redraw_i2c_bytes_per_s"] = uptimeS ? ls.fullRedrawBytes * LCD_I2C_BYTES_PER_LCD_BYTE / uptimeS : 0;
+
+  RuleEvalStats es = core.rules.getStats();
+  JsonObject ruleStats = doc.createNestedObject("rules");
+  ruleStats["evals"] = es.evals;
+  ruleStats["fired"] = es.fired;
+  ruleStats["last_us"] = es.lastUs;
+  ruleStats["max_us"] = es.maxUs;
+  ruleStats["avg_us"] = es.evals ? (uint32_t)(es.totalUs / es.evals) : 0;
+
+  // IR: yêu cầu so với khung thực sự phát
+  const IrTxStats &ts = core.irTx.getStats();
+  JsonObject irStats = doc.createNestedObject("ir_tx");
+  irStats["requested"] = ts.requested;
+  irStats["emitted"] = ts.emitted;
+  irStats["coalesced"] = ts.coalesced;
+  irStats["duplicates"] = ts.duplicates;
+  irStats["pending"] = core.irTx.isPending();
+  irStats["last_latency_ms"] = ts.lastLatencyMs;
+  irStats["max_latency_ms"] = ts.maxLatencyMs;
+  // RMT: enqueue → phát xong
+  IrRmtStats rms = irRmt.getStats();
+  irStats["rmt"] = zones[0].rmtReady;
+  irStats["last_ticket"] = zones[0].lastIrTicket;
+  irStats["last_ticket_status"] = irTxStatusToString(irRmt.status(zones[0].lastIrTicket));
+  irStats["rmt_sent"] = rms.sent;
+  irStats["rmt_failed"] = rms.failed;
+  irStats["rmt_rejected"] = rms.rejected;
+  irStats["last_queue_us"] = rms.lastQueueUs;
+  irStats["last_air_us"] = rms.lastAirUs;
+  irStats["last_total_us"] = rms.lastTotalUs;
+  irStats["avg_total_us"] = rms.sent + rms.failed ? (uint32_t)(rms.totalUs / (rms.sent + rms.failed)) : 0;
+  irStats["max_total_us"] = rms.maxTotalUs;
+
+  JsonObject historyStats = doc.createNestedObject("history");
+  historyStats["samples"] = history.sampleCount();
+  historyStats["memory_bytes"] = TimeSeriesStore::memoryBytes();
+
+  JsonObject logStats = doc.createNestedObject("log");
+  logStats["first_seq"] = logRing.firstSequence();
+  logStats["next_seq"] = logRing.nextSequence();
+  logStats["evicted"] = logRing.evictedCount();
+  logStats["bytes_used"] = logRing.bytesUsed();
+  logStats["arena_size"] = LOG_ARENA_SIZE;
+  logStats["formats"] = logRing.formatsUsed();
+
+  JsonArray tasks = doc.createNestedArray("tasks");
+  for (int i = 0; i < scheduler.count(); i++)
+  {
+    const SchedTask &t = scheduler.task(i);
+    JsonObject task = tasks.createNestedObject();
+    task["name"] = t.name;
+    task["period_ms"] = t.periodMs;
+    task["runs"] = t.runs;
+    task["last_us"] = t.lastUs;
+    task["max_us"] = t.maxUs;
+    task["avg_us"] = t.runs ? (uint32_t)(t.totalUs / t.runs) : 0;
+  }
+
+  // Cache JSON: requests/s và heap thực tế so với build lại mỗi request
+  JsonObject cacheStats = doc.createNestedObject("http_cache");
+  addCacheStats(cacheStats, "sensors", sensorsCache, uptimeS);
+  addCacheStats(cacheStats, "ac_status", acStatusCache, uptimeS);
+  addCacheStats(cacheStats, "stats", statsCache, uptimeS);
+
+  JsonObject sse = doc.createNestedObject("sse");
+  sse["clients"] = events.count();
+  sse["avg_packets_waiting"] = events.avgPacketsWaiting();
+  sse["connects"] = sseStats.connects;
+  sse["deltas"] = sseStats.deltas;
+  sse["keyframes"] = sseStats.keyframes;
+  sse["coalesced"] = sseStats.coalesced;
+  sse["deferred"] = sseStats.deferred;
+  sse["bytes"] = sseStats.bytes;
+}
+
+// /stalls: đoạn loop vượt budget gần nhất, mới nhất trước
+void buildStallsJson(DynamicJsonDocument &doc)
+{
+  StallStats ss = stallProfiler.getStats();
+  doc["scopes"] = ss.scopes;
+  doc["stalls"] = ss.stalls;
+  doc["overflows"] = ss.overflows;
+  doc["max_stall_us"] = ss.maxStallUs;
+  doc["max_stall_section"] = ss.maxStallSection;
+  JsonObject budgets = doc.createNestedObject("budget_us");
+  budgets["loop"] = STALL_LOOP_BUDGET_US;
+  budgets["task"] = STALL_TASK_BUDGET_US;
+  budgets["io"] = STALL_IO_BUDGET_US;
+
+  StallRecord recs[STALL_RING_SIZE];
+  uint8_t n = stallProfiler.copyStalls(recs, STALL_RING_SIZE);
+  JsonArray list = doc.createNestedArray("recent");
+  for (uint8_t i = 0; i < n; i++)
+  {
+    JsonObject r = list.createNestedObject();
+    r["seq"] = recs[i].seq;
+    r["section"] = recs[i].section;
+    r["depth"] = recs[i].depth;
+    r["at_ms"] = (uint32_t)(recs[i].startUs / 1000);
+    r["duration_us"] = recs[i].durUs;
+    r["budget_us"] = recs[i].budgetUs;
+    r["blame"] = recs[i].blame;
+    r["blame_us"] = recs[i].blameUs;
+  }
+}
+
+// /stalls?format=trace: Chrome trace-event (chrome://tracing, Perfetto).
+// Mỗi stall là 1 event "X"; đoạn con bị blame là event lồng bên trong.
+void buildStallTraceJson(DynamicJsonDocument &doc)
+{
+  StallRecord recs[STALL_RING_SIZE];
+  uint8_t n = stallProfiler.copyStalls(recs, STALL_RING_SIZE);
+  JsonArray events = doc.createNestedArray("traceEvents");
+  for (uint8_t i = n; i-- > 0;)
+  {
+    const StallRecord &r = recs[i];
+    JsonObject e = events.createNestedObject();
+    e["name"] = r.section;
+    e["cat"] = "stall";
+    e["ph"] = "X";
+    e["ts"] = r.startUs;
+    e["dur"] = r.durUs;
+    e["pid"] = 1;
+    e["tid"] = 1;
+    JsonObject args = e.createNestedObject("args");
+    args["seq"] = r.seq;
+    args["budget_us"] = r.budgetUs;
+
+    // Đoạn con đã có bản ghi stall riêng thì không vẽ lại
+    bool recorded = r.blameUs == 0;
+    for (uint8_t j = 0; j < n && !recorded; j++)
+      recorded = recs[j].startUs == r.blameStartUs && recs[j].depth == r.depth + 1;
+    if (recorded)
+      continue;
+    JsonObject b = events.createNestedObject();
+    b["name"] = r.blame;
+    b["cat"] = "blame";
+    b["ph"] = "X";
+    b["ts"] = r.blameStartUs;
+    b["dur"] = r.blameUs;
+    b["pid"] = 1;
+    b["tid"] = 1;
+  }
+  doc["displayTimeUnit"] = "ms";
+}
+
+// Stream log dạng JSON theo cursor: mỗi lần filler chỉ format 1 bản ghi,
+// bộ nhớ cố định bất kể số log trả về
+#define LOG_HTTP_DEFAULT_LIMIT 100
+#define LOG_HTTP_MAX_LIMIT 500
+
+class LogJsonStream
+{
+public:
+  LogJsonStream(uint32_t since, uint16_t limit)
+      : cursor(logRing.cursorAt(since)), remaining(limit) {}
+
+  size_t fill(uint8_t *buffer, size_t maxLen)
+  {
+    size_t written = 0;
+    while (written < maxLen)
+    {
+      if (pendingOff >= pendingLen && !refill())
+        break;
+      size_t n = pendingLen - pendingOff;
+      if (n > maxLen - written)
+        n = maxLen - written;
+      memcpy(buffer + written, pending + pendingOff, n);
+      pendingOff += n;
+      written += n;
+    }
+    return written;
+  }
+
+private:
+  bool refill()
+  {
+    if (phase == 2)
+      return false;
+    pendingOff = 0;
+    int len;
+    if (phase == 0)
+    {
+      len = snprintf(pending, sizeof(pending), "{\"first_seq\":%u,\"logs\":[",
+                     (unsigned)logRing.firstSequence());
+      phase = 1;
+    }
+    else
+    {
+      if (remaining == 0 || !logRing.next(cursor, rec))
+      {
+        len = snprintf(pending, sizeof(pending), "],\"next\":%u}", (unsigned)cursor.seq);
+        phase = 2;
+      }
+      else
+      {
+        remaining--;
+        len = appendRecord();
+      }
+    }
+    pendingLen = len < 0 ? 0 : (len >= (int)sizeof(pending) ? sizeof(pending) - 1 : len);
+    return true;
+  }
+
+  int appendRecord()
+  {
+    char line[LOG_LINE_MAX];
+    logRing.format(rec, line, sizeof(line));
+    int len = snprintf(pending, sizeof(pending), "%s{\"seq\":%u,\"timestamp\":%u,\"level\":\"%s\",\"message\":\"",
+                       sentAny ? "," : "", (unsigned)rec.seq, (unsigned)rec.timestampMs,
+                       logLevelToString(rec.level));
+    // Escape JSON; UTF-8 đi thẳng
+    for (const char *p = line; *p && len < (int)sizeof(pending) - 8; p++)
+    {
+      char c = *p;
+      if (c == '"' || c == '\\')
+      {
+        pending[len++] = '\\';
+        pending[len++] = c;
+      }
+      else if ((uint8_t)c < 0x20)
+      {
+        len += snprintf(pending + len, sizeof(pending) - len, "\\u%04x", (uint8_t)c);
+      }
+      else
+      {
+        pending[len++] = c;
+      }
+    }
+    pending[len++] = '"';
+    pending[len++] = '}';
+    pending[len] = '\0';
+    sentAny = true;
+    return len;
+  }
+
+  LogCursor cursor;
+  uint16_t remaining;
+  uint8_t phase = 0; // 0 = header, 1 = bản ghi, 2 = xong
+  bool sentAny = false;
+  uint16_t pendingLen = 0;
+  uint16_t pendingOff = 0;
+  LogRecord rec;
+  char pending[LOG_LINE_MAX * 2 + 96]; // escape có thể nhân đôi độ dài
+};
+
+// Stream /history: 1 điểm [t, min, max, avg] mỗi lần refill. Điểm cuối có
+// thể là bucket đang mở (chưa đủ 1 chu kỳ).
+class TsJsonStream
+{
+public:
+  TsJsonStream(uint8_t metricId, uint8_t tierId, uint32_t fromS)
+      : metric(metricId), tier(tierId)
+  {
+    uint32_t res = history.resolution(tier);
+    uint32_t oldest;
+    hasClosed = history.range(tier, oldest, lastSlot);
+    slot = fromS / res;
+    if (slot < oldest)
+      slot = oldest;
+  }
+
+  size_t fill(uint8_t *buffer, size_t maxLen)
+  {
+    size_t written = 0;
+    while (written < maxLen)
+    {
+      if (pendingOff >= pendingLen && !refill())
+        break;
+      size_t n = pendingLen - pendingOff;
+      if (n > maxLen - written)
+        n = maxLen - written;
+      memcpy(buffer + written, pending + pendingOff, n);
+      pendingOff += n;
+      written += n;
+    }
+    return written;
+  }
+
+private:
+  bool refill()
+  {
+    if (phase == 3)
+      return false;
+    pendingOff = 0;
+    pendingLen = 0;
+    int len = 0;
+    TsBucket b;
+
+    if (phase == 0)
+    {
+      len = snprintf(pending, sizeof(pending),
+                     "{\"metric\":\"%s\",\"tier\":\"%s\",\"resolution_s\":%u,\"now\":%u,\"points\":[",
+                     tsMetricToString(metric), tsTierToString(tier),
+                     (unsigned)history.resolution(tier), (unsigned)(millis() / 1000));
+      phase = 1;
+    }
+    else if (phase == 1)
+    {
+      // Bucket đã đóng; bỏ qua bucket trống hoặc đã bị ghi đè
+      while (hasClosed && slot <= lastSlot)
+      {
+        uint32_t s = slot++;
+        if (history.read(tier, s, b) && b.avg[metric] != TS_EMPTY)
+        {
+          len = appendPoint(s, b);
+          break;
+        }
+      }
+      if (len == 0)
+      {
+        uint32_t openSlot;
+        if (history.readOpen(tier, openSlot, b) && openSlot >= slot && b.avg[metric] != TS_EMPTY)
+          len = appendPoint(openSlot, b);
+        phase = 2;
+      }
+    }
+    else
+    {
+      len = snprintf(pending, sizeof(pending), "]}");
+      phase = 3;
+    }
+
+    pendingLen = len < 0 ? 0 : len;
+    return true;
+  }
+
+  int appendPoint(uint32_t s, const TsBucket &b)
+  {
+    float scale = tsMetricScale(metric);
+    int len = snprintf(pending, sizeof(pending), "%s[%u,%.1f,%.1f,%.1f]",
+                       sentAny ? "," : "", (unsigned)(s * history.resolution(tier)),
+                       b.min[metric] / scale, b.max[metric] / scale, b.avg[metric] / scale);
+    sentAny = true;
+    return len;
+  }
+
+  uint8_t metric;
+  uint8_t tier;
+  uint32_t slot = 0;
+  uint32_t lastSlot = 0;
+  bool hasClosed = false;
+  uint8_t phase = 0; // 0 = header, 1 = điểm, 2 = footer, 3 = xong
+  bool sentAny = false;
+  uint16_t pendingLen = 0;
+  uint16_t pendingOff = 0;
+  char pending[128];
+};
+
+// /trace: 1 chunk (header + bản ghi) copy khỏi ring lúc nhận request nên
+// bản ghi mới không làm lệch count trong header
+#define TRACE_HTTP_MAX_RECORDS 256
+
+class TraceStream
+{
+public:
+  explicit TraceStream(uint32_t since)
+  {
+    uint32_t firstSeq;
+    uint32_t n = sensorTrace.copy(since, data + TRACE_HEADER_SIZE, TRACE_HTTP_MAX_RECORDS, firstSeq);
+    traceEncodeHeader(firstSeq, n, data);
+    len = TRACE_HEADER_SIZE + n * TRACE_RECORD_SIZE;
+    nextSeq = firstSeq + n;
+  }
+
+  size_t fill(uint8_t *buffer, size_t maxLen)
+  {
+    size_t n = len - off;
+    if (n > maxLen)
+      n = maxLen;
+    memcpy(buffer, data + off, n);
+    off += n;
+    return n;
+  }
+
+  uint32_t nextSeq;
+
+private:
+  uint8_t data[TRACE_HEADER_SIZE + TRACE_HTTP_MAX_RECORDS * TRACE_RECORD_SIZE];
+  size_t len;
+  size_t off = 0;
+};
+
+// Stream /metrics: mỗi refill in 1 nhóm (gauge hoặc 1 histogram), bộ nhớ
+// cố định bất kể số route
+class MetricsTextStream
+{
+public:
+  // Tạo trong handler (async_tcp) để đo stack của chính task đó
+  MetricsTextStream() : asyncTcpStackFree(uxTaskGetStackHighWaterMark(NULL)) {}
+
+  size_t fill(uint8_t *buffer, size_t maxLen)
+  {
+    size_t written = 0;
+    while (written < maxLen)
+    {
+      if (pendingOff >= pendingLen && !refill())
+        break;
+      size_t n = pendingLen - pendingOff;
+      if (n > maxLen - written)
+        n = maxLen - written;
+      memcpy(buffer + written, pending + pendingOff, n);
+      pendingOff += n;
+      written += n;
+    }
+    return written;
+  }
+
+private:
+  // Phase: 0 gauge, 1 stack, 2 loop, 3..3+ROUTE_COUNT-1 route, sau đó 3 phase
+  // voice, cuối cùng body POST
+  bool refill()
+  {
+    const uint8_t voicePhase = 3 + ROUTE_COUNT;
+    if (phase > voicePhase + 3)
+      return false;
+    pendingOff = 0;
+    int len = 0;
+    size_t size = sizeof(pending);
+
+    if (phase == 0)
+    {
+      len += metricsHeader(pending + len, size - len, "uptime_seconds", "gauge", "Time since boot");
+      len += metricsValue(pending + len, size - len, "uptime_seconds", "", millis() / 1000);
+      len += metricsHeader(pending + len, size - len, "heap_free_bytes", "gauge", "Free heap");
+      len += metricsValue(pending + len, size - len, "heap_free_bytes", "", ESP.getFreeHeap());
+      len += metricsHeader(pending + len, size - len, "heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+      len += metricsValue(pending + len, size - len, "heap_min_free_bytes", "", ESP.getMinFreeHeap());
+      len += metricsHeader(pending + len, size - len, "heap_largest_free_block_bytes", "gauge", "Largest allocatable block (fragmentation)");
+      len += metricsValue(pending + len, size - len, "heap_largest_free_block_bytes", "", ESP.getMaxAllocHeap());
+      bool connected = WiFi.status() == WL_CONNECTED;
+      len += metricsHeader(pending + len, size - len, "wifi_connected", "gauge", "1 if associated to the AP");
+      len += metricsValue(pending + len, size - len, "wifi_connected", "", connected ? 1 : 0);
+      len += metricsHeader(pending + len, size - len, "wifi_rssi_dbm", "gauge", "Signal strength of the AP");
+      len += metricsValue(pending + len, size - len, "wifi_rssi_dbm", "", connected ? WiFi.RSSI() : 0);
+      len += metricsHeader(pending + len, size - len, "wifi_disconnects_total", "counter", "Station disconnect events");
+      len += metricsValue(pending + len, size - len, "wifi_disconnects_total", "", wifiDisconnects);
+      len += metricsHeader(pending + len, size - len, "wifi_reconnects_total", "counter", "IP reacquired after a disconnect");
+      len += metricsValue(pending + len, size - len, "wifi_reconnects_total", "", wifiReconnects);
+      len += metricsHeader(pending + len, size - len, "voice_api_errors_total", "counter", "Voice API calls without an HTTP response");
+      len += metricsValue(pending + len, size - len, "voice_api_errors_total", "", voiceErrors);
+      StallStats ss = stallProfiler.getStats();
+      len += metricsHeader(pending + len, size - len, "loop_stalls_total", "counter", "Loop sections over their time budget");
+      len += metricsValue(pending + len, size - len, "loop_stalls_total", "", ss.stalls);
+      len += metricsHeader(pending + len, size - len, "loop_stall_max_seconds", "gauge", "Longest loop section stall since boot");
+      len += metricsValue(pending + len, size - len, "loop_stall_max_seconds", "", ss.maxStallUs / 1e6);
+    }
+    else if (phase == 1)
+    {
+      len += metricsHeader(pending + len, size - len, "task_stack_free_min_bytes", "gauge", "Stack high-water mark (least free stack seen)");
+      len += metricsValue(pending + len, size - len, "task_stack_free_min_bytes", "task=\"loop\"",
+                          loopTaskHandle ? uxTaskGetStackHighWaterMark(loopTaskHandle) : 0);
+      len += metricsValue(pending + len, size - len, "task_stack_free_min_bytes", "task=\"async_tcp\"", asyncTcpStackFree);
+      for (const Zone &z : zones)
+      {
+        if (!z.rmtReady)
+          continue;
+        char label[48];
+        snprintf(label, sizeof(label), "task=\"ir_tx\",zone=\"%s\"", z.cfg->name);
+        len += metricsValue(pending + len, size - len, "task_stack_free_min_bytes", label,
+                            uxTaskGetStackHighWaterMark(z.rmt.task()));
+      }
+      for (uint8_t i = 0; i < VOICE_MAX_CONCURRENT; i++)
+      {
+        if (!voiceWorkers[i])
+          continue;
+        char label[32];
+        snprintf(label, sizeof(label), "task=\"voice_worker_%u\"", (unsigned)i);
+        len += metricsValue(pending + len, size - len, "task_stack_free_min_bytes", label,
+                            uxTaskGetStackHighWaterMark(voiceWorkers[i]));
+      }
+    }
+    else if (phase == 2)
+    {
+      len += metricsHeader(pending + len, size - len, "loop_duration_seconds", "histogram", "Scheduler tick duration");
+      len += metricsHistogram(pending + len, size - len, "loop_duration_seconds", "", loopLatency.snapshot());
+    }
+    else if (phase < voicePhase)
+    {
+      uint8_t route = phase - 3;
+      if (route == 0)
+        len += metricsHeader(pending + len, size - len, "http_request_duration_seconds", "histogram", "Handler time on async_tcp per route");
+      len += metricsHistogram(pending + len, size - len, "http_request_duration_seconds",
+                              HTTP_ROUTE_LABELS[route], routeLatency[route].snapshot());
+    }
+    else if (phase == voicePhase)
+    {
+      len += metricsHeader(pending + len, size - len, "voice_api_rtt_seconds", "histogram", "Voice API request to full response");
+      len += metricsHistogram(pending + len, size - len, "voice_api_rtt_seconds", "", voiceRtt.snapshot());
+    }
+    else if (phase == voicePhase + 1)
+    {
+      BreakerStats bs = voiceBreaker.getStats();
+      len += metricsHeader(pending + len, size - len, "voice_api_breaker_state", "gauge", "0 closed, 1 open, 2 half-open");
+      len += metricsValue(pending + len, size - len, "voice_api_breaker_state", "", bs.state);
+      len += metricsHeader(pending + len, size - len, "voice_api_breaker_opens_total", "counter", "Times the breaker tripped open");
+      len += metricsValue(pending + len, size - len, "voice_api_breaker_opens_total", "", bs.opens);
+      len += metricsHeader(pending + len, size - len, "voice_api_rejected_total", "counter", "Calls failed fast while the breaker was open");
+      len += metricsValue(pending + len, size - len, "voice_api_rejected_total", "", bs.rejected);
+      len += metricsHeader(pending + len, size - len, "voice_api_connect_seconds", "histogram", "TCP connect to the voice API (new connections only)");
+      len += metricsHistogram(pending + len, size - len, "voice_api_connect_seconds", "", voiceConnect.snapshot());
+    }
+    else if (phase == voicePhase + 2)
+    {
+      len += metricsHeader(pending + len, size - len, "voice_api_first_byte_seconds", "histogram", "Request sent to first response byte");
+      len += metricsHistogram(pending + len, size - len, "voice_api_first_byte_seconds", "", voiceFirstByte.snapshot());
+    }
+    else
+    {
+      // Body POST: parse tại chỗ so với gom nhiều đoạn, và lý do từ chối
+      const BodyStats &bs = requestBodies.getStats();
+      len += metricsHeader(pending + len, size - len, "http_body_total", "counter", "POST bodies handed to handlers");
+      len += metricsValue(pending + len, size - len, "http_body_total", "path=\"in_place\"", bs.inPlace);
+      len += metricsValue(pending + len, size - len, "http_body_total", "path=\"assembled\"", bs.assembled);
+      len += metricsHeader(pending + len, size - len, "http_body_rejected_total", "counter", "POST bodies not handed to handlers");
+      len += metricsValue(pending + len, size - len, "http_body_rejected_total", "reason=\"too_large\"", bs.tooLarge);
+      len += metricsValue(pending + len, size - len, "http_body_rejected_total", "reason=\"busy\"", bs.busy);
+      len += metricsValue(pending + len, size - len, "http_body_rejected_total", "reason=\"out_of_order\"", bs.outOfOrder);
+      len += metricsValue(pending + len, size - len, "http_body_rejected_total", "reason=\"expired\"", bs.expired);
+      len += metricsValue(pending + len, size - len, "http_body_rejected_total", "reason=\"abandoned\"", bs.abandoned);
+      len += metricsHeader(pending + len, size - len, "http_body_arena_slots", "gauge", "Arena slots holding a partial body");
+      len += metricsValue(pending + len, size - len, "http_body_arena_slots", "", bs.inUse);
+      len += metricsHeader(pending + len, size - len, "http_body_arena_slots_peak", "gauge", "Most arena slots in use at once");
+      len += metricsValue(pending + len, size - len, "http_body_arena_slots_peak", "", bs.peakInUse);
+    }
+
+    phase++;
+    pendingLen = len;
+    return true;
+  }
+
+  uint32_t asyncTcpStackFree;
+  uint8_t phase = 0;
+  uint16_t pendingLen = 0;
+  uint16_t pendingOff = 0;
+  char pending[2560]; // 1 histogram có nhãn ~2.1KB
+};
+
 void setupWebServer()
 {
   // BẮT BUỘC: XỬ LÝ CORS TRƯỚC KHI ĐỊNH NGHĨA ROUTES
@@ -868,49 +2050,744 @@ void setupWebServer()
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "Content-Type, Authorization, X-Requested-With");
   DefaultHeaders::Instance().addHeader("Access-Control-Max-Age", "3600");
 
-  // 2. XỬ LÝ OPTIONS PREFLIGHT CHO MỌI ENDPOINT
-  server.onNotFound([](AsyncWebServerRequest *request)
-                    {
+  // 2. XỬ LÝ OPTIONS PREFLIGHT CHO MỌI ENDPOINT
+  server.onNotFound([](AsyncWebServerRequest *request)
+                    {
+    TIME_ROUTE(ROUTE_OTHER);
+    if (!request || request->_tempObject) return;
+    
+    if (request->method() == HTTP_OPTIONS) {
+      if (!request->_tempObject) {
+        request->send(200);
+      }
+    } else {
+      if (!request->_tempObject) {
+        request->send(404, "application/json", "{\"error\":\"Not found\"}");
+      }
+    } });
+
+  // 3. OPTIONS handler tổng quát
+  server.on("/*", HTTP_OPTIONS, [](AsyncWebServerRequest *request)
+            { 
+              TIME_ROUTE(ROUTE_OTHER);
+              // Tự động áp dụng DefaultHeaders
+              request->send(200); });
+
+  // ============ CÁC ROUTES KHÁC GIỮ NGUYÊN ============
+
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_ROOT);
+    if (!request || request->_tempObject) return;
+    
+    DynamicJsonDocument doc(512);
+    doc["name"] = "Daikin AC Control";
+    doc["version"] = "7.3-PCB-Fixed";
+    doc["model"] = "Daikin";
+    doc["ai_mode"] = "Mock LLM (Embedded)";
+    doc["status"] = "ok";
+    String response;
+    serializeJson(doc, response);
+    
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      request->send(resp);
+    } });
+
+  server.on("/sensors", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_SENSORS);
+    if (!request || request->_tempObject) return;
+    
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+    
+    ControllerState st = core.read();
+    sendCachedJson(request, sensorsCache, stateCacheKey(st.version),
+                   [&st](DynamicJsonDocument &doc) { buildSensorsJson(doc, st, core.aiEnabled); }); });
+
+  // FIX: /ac/command
+  server.on("/ac/command", HTTP_POST, rejectEmptyBody, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+            {
+    // Kiểm tra request còn hợp lệ
+    TIME_ROUTE(ROUTE_AC_COMMAND);
+    if (!request || request->_tempObject) return;
+    RequestBody body(request, data, len, index, total);
+    if (!body.ready) return;
+    
+    if (!authenticateRequest(request)) {
+      if (request->_tempObject == nullptr) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+    
+    DynamicJsonDocument doc(512);
+    deserializeJson(doc, body.text, body.length);
+    
+    // Handler chạy trên async_tcp: chỉ tạo lệnh, loop() mới áp dụng
+    ControllerState st = core.read();
+    AcCommand cmd = {0, st.ac, "API_COMMAND"};
+    
+    acCommandFromJson(doc, cmd);
+    
+    if (cmd.fields != 0 && !submitAcCommand(cmd)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(503, "application/json", "{\"error\":\"AC command queue full\"}");
+        resp->addHeader("Retry-After", "1");
+        request->send(resp);
+      }
+      return;
+    }
+    
+    if (cmd.fields != 0) {
+      // Trạng thái sẽ có sau khi loop() áp dụng lệnh
+      AcState next = mergeAcCommand(st.ac, cmd);
+      DynamicJsonDocument respDoc(512);
+      respDoc["success"] = true;
+      respDoc["status"] = next.power ? "on" : "off";
+      respDoc["temperature"] = next.temp;
+      respDoc["mode"] = acModeToString(next.mode);
+      respDoc["fan_speed"] = fanSpeedToString((FanSpeed)next.fan);
+      respDoc["fan_level"] = next.fan;
+      respDoc["base_version"] = st.version;
+      
+      String response;
+      serializeJson(respDoc, response);
+      
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+        request->send(resp);
+      }
+    } else {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"No valid settings\"}");
+        request->send(resp);
+      }
+    } });
+
+  // FIX: /ai/toggle
+  server.on("/ai/toggle", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_AI_TOGGLE);
+    if (!request || request->_tempObject) return;
+    
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+    
+    core.aiEnabled = !core.aiEnabled;
+    
+    DynamicJsonDocument doc(256);
+    doc["success"] = true;
+    doc["ai_enabled"] = core.aiEnabled;
+    doc["message"] = core.aiEnabled ? "AI enabled" : "AI disabled";
+    
+    String response;
+    serializeJson(doc, response);
+    
+    LOG_INFO("AI Mode: %s", core.aiEnabled ? "ENABLED" : "DISABLED");
+    
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      request->send(resp);
+    }
+    
+    requestLcdRedraw(); });
+
+  // /voice/command: chỉ xếp hàng job rồi trả 202, không chặn async_tcp
+  server.on("/voice/command", HTTP_POST, rejectEmptyBody, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+            {
+    // Kiểm tra request còn hợp lệ
+    TIME_ROUTE(ROUTE_VOICE_COMMAND);
+    if (!request || request->_tempObject) return;
+    RequestBody body(request, data, len, index, total);
+    if (!body.ready) return;
+    
+    if (!authenticateRequest(request)) {
+      if (request->_tempObject == nullptr) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+    
+    DynamicJsonDocument doc(512);
+    deserializeJson(doc, body.text, body.length);
+    
+    String voiceText = doc["text"] | "";
+    if (voiceText.length() == 0) {
+      AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Missing text\"}");
+      request->send(resp);
+      return;
+    }
+    
+    LOG_INFO("Voice: %s", voiceText);
+
+    // Lệnh đơn giản xử lý ngay trên thiết bị, rồi tới cache, còn lại mới gọi Gemini
+    static VoiceDecision decision; // chỉ dùng trên async_tcp
+    ControllerState st = core.read();
+    VoiceSource source = VS_GEMINI;
+    VoiceIntent intent;
+    VoiceCacheKey key;
+    if (voiceIntents.parse(voiceText.c_str(), intent)) {
+      voiceIntentDecision(intent, st.ac, st.sensors.temperature, decision);
+      source = VS_LOCAL;
+      LOG_INFO("Intent %s (%u%%) local", voiceIntentToString(intent.kind), intent.confidence);
+    } else if (makeVoiceCacheKey(voiceText.c_str(), st, key) && voiceCache.lookup(key, millis(), decision)) {
+      source = VS_CACHE;
+      LOG_INFO("Voice cache hit");
+    }
+
+    uint32_t jobId = source == VS_GEMINI ? submitVoiceJob(voiceText)
+                                         : voiceJobs.submitResolved(voiceText.c_str(), decision, source, millis());
+    if (jobId == 0) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(503, "application/json",
+          "{\"error\":\"Voice queue full\",\"reason\":\"Hàng đợi lệnh giọng nói đang đầy\"}");
+        resp->addHeader("Retry-After", "2");
+        request->send(resp);
+      }
+      return;
+    }
+
+    DynamicJsonDocument respDoc(256);
+    respDoc["success"] = true;
+    respDoc["job_id"] = jobId;
+    respDoc["status"] = source == VS_GEMINI ? "queued" : "running";
+    respDoc["source"] = voiceSourceToString(source);
+    respDoc["poll"] = "/voice/result?id=" + String(jobId);
+
+    String response;
+    serializeJson(respDoc, response);
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(202, "application/json", response);
+      request->send(resp);
+    } });
+
+  // Poll kết quả job voice
+  server.on("/voice/result", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_VOICE_RESULT);
+    if (!request || request->_tempObject) return;
+    
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    uint32_t jobId = 0;
+    if (request->hasParam("id"))
+      jobId = request->getParam("id")->value().toInt();
+
+    static VoiceJob job; // chỉ dùng trên async_tcp task, tránh 700B trên stack
+    if (!voiceJobs.snapshot(jobId, job)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(404, "application/json", "{\"error\":\"Unknown job\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    DynamicJsonDocument doc(1024);
+    doc["job_id"] = job.id;
+    doc["status"] = voiceJobStateToString(job.state);
+    doc["text"] = (const char *)job.text;
+    doc["source"] = voiceSourceToString(job.source);
+    if (job.state == JOB_DONE) {
+      doc["latency_ms"] = job.finishedMs - job.submittedMs;
+      voiceDecisionToJson(job.decision, doc.createNestedObject("result"));
+    } else if (job.state == JOB_FAILED) {
+      doc["latency_ms"] = job.finishedMs - job.submittedMs;
+      JsonObject result = doc.createNestedObject("result");
+      result["error"] = job.error;
+      result["reason"] = (const char *)job.decision.reason;
+    } else {
+      doc["elapsed_ms"] = millis() - job.submittedMs;
+    }
+
+    String response;
+    serializeJson(doc, response);
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      request->send(resp);
+    } });
+
+  // Metrics hàng đợi voice
+  server.on("/voice/jobs", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_VOICE_JOBS);
+    if (!request || request->_tempObject) return;
+    
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    VoiceQueueStats st = voiceJobs.getStats();
+    DynamicJsonDocument doc(1536);
+    doc["queue_depth"] = st.queued;
+    doc["queue_depth_max"] = st.maxQueued;
+    doc["queue_capacity"] = VOICE_QUEUE_DEPTH;
+    doc["running"] = st.running;
+    doc["max_concurrent"] = VOICE_MAX_CONCURRENT;
+    doc["submitted"] = st.submitted;
+    doc["rejected"] = st.rejected;
+    doc["completed"] = st.completed;
+    doc["failed"] = st.failed;
+    uint32_t finished = st.completed + st.failed;
+    doc["avg_latency_ms"] = finished ? st.totalLatencyMs / finished : 0;
+    doc["max_latency_ms"] = st.maxLatencyMs;
+
+    // Parser local: tỉ lệ lệnh không cần gọi Gemini
+    const VoiceIntentStats &is = voiceIntents.getStats();
+    JsonObject intentObj = doc.createNestedObject("intent");
+    intentObj["parsed"] = is.parses;
+    intentObj["local_hits"] = is.localHits;
+    intentObj["local_hit_ratio"] = is.parses ? (float)is.localHits / is.parses : 0.0f;
+    intentObj["min_confidence"] = VOICE_INTENT_MIN_CONFIDENCE;
+    intentObj["last_us"] = is.lastUs;
+    intentObj["max_us"] = is.maxUs;
+    intentObj["avg_us"] = is.parses ? (uint32_t)(is.totalUs / is.parses) : 0;
+    doc["local_jobs"] = st.local;
+    doc["cached_jobs"] = st.cached;
+
+    // Cache quyết định Gemini
+    VoiceCacheStats cs = voiceCache.getStats();
+    JsonObject cacheObj = doc.createNestedObject("cache");
+    cacheObj["entries"] = cs.entries;
+    cacheObj["capacity"] = VOICE_CACHE_ENTRIES;
+    cacheObj["bytes"] = sizeof(voiceCache);
+    cacheObj["ttl_s"] = VOICE_CACHE_TTL_MS / 1000;
+    cacheObj["hits"] = cs.hits;
+    cacheObj["misses"] = cs.misses;
+    uint32_t lookups = cs.hits + cs.misses;
+    cacheObj["hit_ratio"] = lookups ? (float)cs.hits / lookups : 0.0f;
+    cacheObj["inserts"] = cs.inserts;
+    cacheObj["evictions"] = cs.evictions;
+    cacheObj["expired"] = cs.expired;
+
+    // Kết nối tới Gemini server + circuit breaker
+    BreakerStats bs = voiceBreaker.getStats();
+    JsonObject apiObj = doc.createNestedObject("api");
+    apiObj["breaker"] = breakerStateToString(bs.state);
+    apiObj["consecutive_failures"] = bs.consecutiveFailures;
+    apiObj["open_for_ms"] = bs.openForMs;
+    apiObj["opens"] = bs.opens;
+    apiObj["rejected"] = bs.rejected;
+    apiObj["probes"] = bs.probes;
+    uint32_t requests = 0, connects = 0, reused = 0, staleRetries = 0;
+    for (uint8_t i = 0; i < VOICE_MAX_CONCURRENT; i++)
+    {
+      const VoiceHttpConnection::Stats &hs = voiceConns[i].getStats();
+      requests += hs.requests;
+      connects += hs.connects;
+      reused += hs.reused;
+      staleRetries += hs.staleRetries;
+    }
+    apiObj["requests"] = requests;
+    apiObj["connects"] = connects;
+    apiObj["reused"] = reused;
+    apiObj["stale_retries"] = staleRetries;
+    HistogramSnapshot fb = voiceFirstByte.snapshot();
+    apiObj["first_byte_avg_ms"] = fb.count ? (uint32_t)(fb.sumUs / fb.count / 1000) : 0;
+    HistogramSnapshot rtt = voiceRtt.snapshot();
+    apiObj["total_avg_ms"] = rtt.count ? (uint32_t)(rtt.sumUs / rtt.count / 1000) : 0;
+
+    String response;
+    serializeJson(doc, response);
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      request->send(resp);
+    } });
+
+  // GET /zones: tóm tắt mọi zone; GET /zones/<id|name>[/status]: chi tiết 1 zone.
+  // 1 handler cho mọi zone: thêm zone không thêm route phải so khớp mỗi request.
+  server.on("/zones", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_ZONES_GET);
+    if (!request || request->_tempObject) return;
+    
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    const char *sub;
+    int zone = parseZonePath(request->url().c_str(), sub);
+    if (zone == ZONE_PATH_BAD || (zone >= 0 && sub[0] && strcmp(sub, "status"))) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(404, "application/json", "{\"error\":\"Unknown zone\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    DynamicJsonDocument doc(zone >= 0 ? 1024 : 128 + ZONE_COUNT * 320);
+    if (zone >= 0) {
+      Zone &z = zones[zone];
+      ControllerState st = z.core.read();
+      buildSensorsJson(doc, st, z.core.aiEnabled);
+      doc["zone"] = zone;
+      doc["name"] = z.cfg->name;
+      doc["dht_health"] = dhtHealthToString(z.dht.health());
+      doc["ir_rmt"] = z.rmtReady;
+      doc["has_pir"] = z.cfg->pirPin >= 0;
+      doc["has_ldr"] = z.cfg->ldrPin >= 0;
+      // Luật không bao giờ chạy được ở zone này vì thiếu cảm biến
+      RuleSnapshot fixed;
+      uint32_t mask = zoneFixedFields(z, fixed);
+      JsonArray inactive = doc.createNestedArray("inactive_rules");
+      for (uint8_t r = 0; mask && r < z.core.rules.count(); r++)
+        if (!z.core.rules.applicable(r, mask, fixed))
+          inactive.add(z.core.rules.rule(r).name);
+    } else {
+      JsonArray list = doc.createNestedArray("zones");
+      for (uint8_t i = 0; i < ZONE_COUNT; i++) {
+        ControllerState st = zones[i].core.read();
+        JsonObject item = list.createNestedObject();
+        item["id"] = i;
+        item["name"] = ZONE_CONFIG[i].name;
+        item["temperature"] = st.sensors.temperature;
+        item["humidity"] = st.sensors.humidity;
+        item["presence"] = st.sensors.presence || st.sensors.motion;
+        item["ac_status"] = st.ac.power;
+        item["ac_temp"] = st.ac.temp;
+        item["ac_mode"] = acModeToString(st.ac.mode);
+        item["ac_fan"] = fanSpeedToString((FanSpeed)st.ac.fan);
+        item["ai_enabled"] = zones[i].core.aiEnabled;
+      }
+    }
+
+    String response;
+    serializeJson(doc, response);
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      request->send(resp);
+    } });
+
+  // POST /zones/<id|name>/command: body như /ac/command
+  // POST /zones/<id|name>/ai: {"enabled":true|false}
+  server.on("/zones", HTTP_POST, rejectEmptyBody, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+            {
+    TIME_ROUTE(ROUTE_ZONES_POST);
+    if (!request || request->_tempObject) return;
+    RequestBody body(request, data, len, index, total);
+    if (!body.ready) return;
+    
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    const char *sub;
+    int zone = parseZonePath(request->url().c_str(), sub);
+    bool isCommand = zone >= 0 && !strcmp(sub, "command");
+    bool isAi = zone >= 0 && !strcmp(sub, "ai");
+    if (!isCommand && !isAi) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(404, "application/json", "{\"error\":\"Unknown zone\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    DynamicJsonDocument doc(512);
+    DeserializationError error = deserializeJson(doc, body.text, body.length);
+    DynamicJsonDocument respDoc(512);
+    respDoc["success"] = true;
+    respDoc["zone"] = zone;
+
+    if (isAi) {
+      if (error || !doc.containsKey("enabled")) {
+        if (!request->_tempObject) {
+          AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Missing enabled\"}");
+          request->send(resp);
+        }
+        return;
+      }
+      zones[zone].core.aiEnabled = doc["enabled"].as<bool>();
+      respDoc["ai_enabled"] = zones[zone].core.aiEnabled;
+      LOG_INFO("AI Mode [%s]: %s", ZONE_CONFIG[zone].name, zones[zone].core.aiEnabled ? "ENABLED" : "DISABLED");
+      if (zone == 0)
+        requestLcdRedraw();
+    } else {
+      // Như /ac/command: chỉ xếp lệnh, loop() áp dụng cho zone đích
+      ControllerState st = zones[zone].core.read();
+      AcCommand cmd = {0, st.ac, "API_COMMAND"};
+      if (!error)
+        acCommandFromJson(doc, cmd);
+
+      if (cmd.fields == 0) {
+        if (!request->_tempObject) {
+          AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"No valid settings\"}");
+          request->send(resp);
+        }
+        return;
+      }
+      if (!submitAcCommand(cmd, zone)) {
+        if (!request->_tempObject) {
+          AsyncWebServerResponse *resp = request->beginResponse(503, "application/json", "{\"error\":\"AC command queue full\"}");
+          resp->addHeader("Retry-After", "1");
+          request->send(resp);
+        }
+        return;
+      }
+
+      AcState next = mergeAcCommand(st.ac, cmd);
+      respDoc["status"] = next.power ? "on" : "off";
+      respDoc["temperature"] = next.temp;
+      respDoc["mode"] = acModeToString(next.mode);
+      respDoc["fan_speed"] = fanSpeedToString((FanSpeed)next.fan);
+      respDoc["base_version"] = st.version;
+    }
+
+    String response;
+    serializeJson(respDoc, response);
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      request->send(resp);
+    } });
+
+  // ============ CÁC ENDPOINT KHÁC - ĐÃ XÓA CORS HEADERS ============
+
+  // Bảng luật đang áp dụng (đã tính override) + số lần kích hoạt từng luật
+  server.on("/rules", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_RULES_GET);
+    if (!request || request->_tempObject) return;
+    
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    DynamicJsonDocument doc(6144);
+    RuleEvalStats es = core.rules.getStats();
+    doc["evals"] = es.evals;
+    doc["last_us"] = es.lastUs;
+    doc["max_us"] = es.maxUs;
+    doc["avg_us"] = es.evals ? (uint32_t)(es.totalUs / es.evals) : 0;
+    doc["cooldown_ms"] = RULE_COOLDOWN_MS;
+
+    JsonArray list = doc.createNestedArray("rules");
+    for (uint8_t r = 0; r < core.rules.count(); r++) {
+      const RuleDef &def = core.rules.rule(r);
+      RuleCondition conds[RULE_MAX_CONDS];
+      bool enabled;
+      RuleStats rs;
+      core.rules.activeConditions(r, conds, enabled, rs);
+
+      JsonObject item = list.createNestedObject();
+      item["name"] = def.name;
+      item["enabled"] = enabled;
+      item["action"] = ruleActionToString(def.action.kind);
+      item["reason"] = def.reason;
+      item["hits"] = rs.hits;
+      item["last_fired_ms"] = rs.lastFiredMs;
+      JsonArray condArr = item.createNestedArray("conditions");
+      for (uint8_t c = 0; c < def.condCount; c++) {
+        JsonObject cond = condArr.createNestedObject();
+        cond["field"] = ruleFieldToString(conds[c].field);
+        cond["op"] = ruleOpToString(conds[c].op);
+        cond["value"] = conds[c].a;
+        if (conds[c].op == RO_IN)
+          cond["value2"] = conds[c].b;
+      }
+    }
+
+    String response;
+    serializeJson(doc, response);
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      request->send(resp);
+    } });
+
+  // Override ngưỡng: {"rule":"hot_on","cond":0,"value":280} | {"rule":"night_quiet","enabled":false} | {"reset":true}
+  server.on("/rules", HTTP_POST, rejectEmptyBody, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+            {
+    TIME_ROUTE(ROUTE_RULES_POST);
+    if (!request || request->_tempObject) return;
+    RequestBody body(request, data, len, index, total);
+    if (!body.ready) return;
+    
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    DynamicJsonDocument doc(256);
+    DeserializationError error = deserializeJson(doc, body.text, body.length);
+    bool ok = !error;
+
+    if (ok && (doc["reset"] | false)) {
+      core.rules.clearOverrides();
+    } else if (ok) {
+      // Kiểm tra mọi trường trước, rồi áp dụng cùng lúc (không để override dở dang)
+      const char *name = doc["rule"];
+      int r = name ? core.rules.findRule(name) : -1;
+      bool hasEnabled = doc.containsKey("enabled");
+      bool hasValue = doc.containsKey("value");
+      ok = r >= 0;
+      if (ok && hasEnabled)
+        ok = doc["enabled"].is<bool>();
+      if (ok && hasValue)
+        ok = doc["value"].is<int32_t>() &&
+             (!doc.containsKey("value2") || doc["value2"].is<int32_t>()) &&
+             (!doc.containsKey("cond") || doc["cond"].is<uint8_t>());
+      if (ok) {
+        RuleOverride o;
+        o.rule = r;
+        o.cond = doc["cond"] | 0;
+        o.flags = RULE_OVR_VALUE;
+        o.a = doc["value"];
+        o.b = doc["value2"] | (int32_t)0;
+        int8_t enable = hasEnabled ? (doc["enabled"].as<bool>() ? 1 : 0) : -1;
+        ok = core.rules.update(r, enable, hasValue ? &o : nullptr);
+      }
+    }
+
+    if (!ok) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Invalid rule override\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true}");
+      request->send(resp);
+    } });
+
+  // /history?metric=temperature|humidity|light|distance&tier=1s|1m|1h&from=<uptime s>
+  server.on("/history", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_HISTORY);
+    if (!request || request->_tempObject) return;
+    
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    uint8_t metric = TS_TEMPERATURE;
+    if (request->hasParam("metric"))
+      metric = tsMetricFromString(request->getParam("metric")->value());
+    uint8_t tier = TS_TIER_MIN;
+    if (request->hasParam("tier"))
+      tier = tsTierFromString(request->getParam("tier")->value());
+    if (metric >= TS_METRIC_COUNT || tier >= TS_TIER_COUNT) {
+      AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Invalid metric or tier\"}");
+      request->send(resp);
+      return;
+    }
+    uint32_t from = 0;
+    if (request->hasParam("from"))
+      from = (uint32_t)request->getParam("from")->value().toInt();
+
+    std::shared_ptr<TsJsonStream> state(new TsJsonStream(metric, tier, from));
+    AsyncWebServerResponse *resp = request->beginChunkedResponse("application/json",
+      [state](uint8_t *buffer, size_t maxLen, size_t /*index*/) -> size_t {
+        return state->fill(buffer, maxLen);
+      });
+    request->send(resp); });
+
+  // /logs?since=<seq>&limit=<n>: log cũ nhất trước, dùng "next" làm since cho lần sau
+  server.on("/logs", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_LOGS);
     if (!request || request->_tempObject) return;
     
-    if (request->method() == HTTP_OPTIONS) {
+    if (!authenticateRequest(request)) {
       if (!request->_tempObject) {
-        request->send(200);
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
       }
+      return;
+    }
+
+    long limit = LOG_HTTP_DEFAULT_LIMIT;
+    if (request->hasParam("limit"))
+      limit = request->getParam("limit")->value().toInt();
+    if (limit <= 0 || limit > LOG_HTTP_MAX_LIMIT)
+      limit = LOG_HTTP_MAX_LIMIT;
+    // Có since: phân trang từ cũ tới mới. Không có: limit bản ghi mới nhất
+    uint32_t since;
+    if (request->hasParam("since")) {
+      since = (uint32_t)request->getParam("since")->value().toInt();
     } else {
-      if (!request->_tempObject) {
-        request->send(404, "application/json", "{\"error\":\"Not found\"}");
-      }
-    } });
+      uint32_t first = logRing.firstSequence();
+      uint32_t next = logRing.nextSequence();
+      since = next - first > (uint32_t)limit ? next - limit : first;
+    }
 
-  // 3. OPTIONS handler tổng quát
-  server.on("/*", HTTP_OPTIONS, [](AsyncWebServerRequest *request)
-            { 
-              // Tự động áp dụng DefaultHeaders
-              request->send(200); });
+    std::shared_ptr<LogJsonStream> state(new LogJsonStream(since, (uint16_t)limit));
 
-  // ============ CÁC ROUTES KHÁC GIỮ NGUYÊN ============
+    AsyncWebServerResponse *resp = request->beginChunkedResponse("application/json",
+      [state](uint8_t *buffer, size_t maxLen, size_t /*index*/) -> size_t {
+        return state->fill(buffer, maxLen);
+      });
+    request->send(resp); });
 
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
+  server.on("/ac/status", HTTP_GET, [](AsyncWebServerRequest *request)
             {
+    TIME_ROUTE(ROUTE_AC_STATUS);
     if (!request || request->_tempObject) return;
     
-    DynamicJsonDocument doc(512);
-    doc["name"] = "Daikin AC Control";
-    doc["version"] = "7.3-PCB-Fixed";
-    doc["model"] = "Daikin";
-    doc["ai_mode"] = "Mock LLM (Embedded)";
-    doc["status"] = "ok";
-    String response;
-    serializeJson(doc, response);
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
     
-    if (!request->_tempObject) {
-      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
-      request->send(resp);
-    } });
+    // Chỉ đổi khi có lệnh AC, không đổi theo cảm biến
+    ControllerState st = core.read();
+    sendCachedJson(request, acStatusCache, stateCacheKey(st.acVersion),
+                   [&st](DynamicJsonDocument &doc) { buildAcStatusJson(doc, st, core.aiEnabled); }); });
 
-  server.on("/sensors", HTTP_GET, [](AsyncWebServerRequest *request)
+  server.on("/stats", HTTP_GET, [](AsyncWebServerRequest *request)
             {
+    TIME_ROUTE(ROUTE_STATS);
     if (!request || request->_tempObject) return;
     
     if (!authenticateRequest(request)) {
@@ -921,22 +2798,29 @@ void setupWebServer()
       return;
     }
     
-    DynamicJsonDocument doc(768);
-    doc["temperature"] = temperature;
-    doc["humidity"] = humidity;
-    doc["light"] = lightLevel;
-    doc["motion"] = motionDetected;
-    doc["presence"] = presenceDetected;
-    doc["presence_distance"] = presenceDistance;
-    doc["test_mode"] = testPresenceMode;
-    doc["ac_status"] = acStatus;
-    doc["ac_temp"] = acTemp;
-    doc["ac_mode"] = acMode;
-    doc["ac_fan"] = fanSpeedToString(acFan);
-    doc["ac_fan_level"] = fanSpeedToInt(acFan);
-    doc["llm_enabled"] = aiEnabled;
-    doc["model"] = "Daikin";
+    // Số liệu đổi liên tục → build lại tối đa 1 lần/giây
+    sendCachedJson(request, statsCache, millis() / 1000, buildStatsJson); });
+
+  // /stalls hoặc /stalls?format=trace (Chrome trace-event JSON)
+  server.on("/stalls", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_STALLS);
+    if (!request || request->_tempObject) return;
     
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
+    bool trace = request->hasParam("format") && request->getParam("format")->value() == "trace";
+    DynamicJsonDocument doc(trace ? 8192 : 4096);
+    if (trace)
+      buildStallTraceJson(doc);
+    else
+      buildStallsJson(doc);
     String response;
     serializeJson(doc, response);
     
@@ -945,86 +2829,103 @@ void setupWebServer()
       request->send(resp);
     } });
 
-  // FIX: /ac/command
-  server.on("/ac/command", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+  // /trace?since=<seq>: trace cảm biến nhị phân (sensor_trace.h). Header
+  // X-Trace-Next = since cho lần sau; nối các response vào 1 file rồi
+  // phát lại bằng env:native --replay.
+  server.on("/trace", HTTP_GET, [](AsyncWebServerRequest *request)
             {
-    // Kiểm tra request còn hợp lệ
+    TIME_ROUTE(ROUTE_TRACE);
     if (!request || request->_tempObject) return;
     
     if (!authenticateRequest(request)) {
-      if (request->_tempObject == nullptr) {
+      if (!request->_tempObject) {
         AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
         request->send(resp);
       }
       return;
     }
+
+    uint32_t since = 0;
+    if (request->hasParam("since"))
+      since = (uint32_t)request->getParam("since")->value().toInt();
+    std::shared_ptr<TraceStream> state(new TraceStream(since));
+
+    AsyncWebServerResponse *resp = request->beginChunkedResponse("application/octet-stream",
+      [state](uint8_t *buffer, size_t maxLen, size_t /*index*/) -> size_t {
+        return state->fill(buffer, maxLen);
+      });
+    resp->addHeader("X-Trace-Next", String(state->nextSeq));
+    request->send(resp); });
+
+  // Mô hình phòng đã học + kế hoạch gần nhất của chế độ dự báo
+  server.on("/model", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+    TIME_ROUTE(ROUTE_MODEL_GET);
+    if (!request || request->_tempObject) return;
     
-    DynamicJsonDocument doc(512);
-    deserializeJson(doc, (const char*)data);
-    
-    bool changed = false;
-    
-    if (doc.containsKey("status")) {
-      acStatus = doc["status"].as<bool>();
-      changed = true;
-    }
-    
-    if (doc.containsKey("temperature")) {
-      int temp = doc["temperature"];
-      if (temp >= 16 && temp <= 30) {
-        acTemp = temp;
-        changed = true;
-      }
-    }
-    
-    if (doc.containsKey("mode")) {
-      String mode = doc["mode"].as<String>();
-      mode.toUpperCase();
-      if (mode == "COOL" || mode == "HEAT" || mode == "DRY" || 
-          mode == "FAN" || mode == "AUTO") {
-        acMode = mode;
-        changed = true;
-      }
-    }
-    
-    if (doc.containsKey("fan_speed")) {
-      if (doc["fan_speed"].is<String>()) {
-        acFan = stringToFanSpeed(doc["fan_speed"].as<String>());
-      } else {
-        int fan = doc["fan_speed"];
-        acFan = intToFanSpeed(fan);
+    if (!authenticateRequest(request)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
+        request->send(resp);
       }
-      changed = true;
+      return;
     }
+
+    RoomModelSnapshot m = core.model.snapshot();
+    DynamicJsonDocument doc(1024);
+    buildModelJson(doc, m, core.predictive, core.predictive && m.ready);
+
+    String response;
+    serializeJson(doc, response);
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      request->send(resp);
+    } });
+
+  // {"predictive":true} | {"reset":true} | {"comfort_low":23,"comfort_high":26.5,"set_min":24,...}
+  server.on("/model", HTTP_POST, rejectEmptyBody, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+            {
+    TIME_ROUTE(ROUTE_MODEL_POST);
+    if (!request || request->_tempObject) return;
+    RequestBody body(request, data, len, index, total);
+    if (!body.ready) return;
     
-    if (changed) {
-      sendDaikinCommand("API_COMMAND");
-      
-      DynamicJsonDocument respDoc(512);
-      respDoc["success"] = true;
-      respDoc["status"] = acStatus ? "on" : "off";
-      respDoc["temperature"] = acTemp;
-      respDoc["mode"] = acMode;
-      respDoc["fan_speed"] = fanSpeedToString(acFan);
-      respDoc["fan_level"] = fanSpeedToInt(acFan);
-      
-      String response;
-      serializeJson(respDoc, response);
-      
+    if (!authenticateRequest(request)) {
       if (!request->_tempObject) {
-        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+        AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
         request->send(resp);
       }
-    } else {
+      return;
+    }
+
+    DynamicJsonDocument doc(384);
+    DeserializationError error = deserializeJson(doc, body.text, body.length);
+    PredictConfig cfg = core.model.config();
+    bool ok = !error && predictConfigFromJson(doc, cfg);
+
+    if (!ok) {
       if (!request->_tempObject) {
-        AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"No valid settings\"}");
+        AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Invalid model config\"}");
         request->send(resp);
       }
+      return;
+    }
+
+    int8_t predictive = doc.containsKey("predictive") ? (doc["predictive"].as<bool>() ? 1 : 0) : -1;
+    core.model.requestSettings(cfg, predictive);
+    if (doc["reset"] | false)
+      core.model.requestReset();
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true}");
+      request->send(resp);
     } });
 
-  // FIX: /ai/toggle
-  server.on("/ai/toggle", HTTP_POST, [](AsyncWebServerRequest *request)
+  // Lịch hẹn giờ: ?offset=&limit= (tối đa SCHEDULE_PAGE_MAX / trang)
+  server.on("/schedules", HTTP_GET, [](AsyncWebServerRequest *request)
             {
+    TIME_ROUTE(ROUTE_SCHEDULES_GET);
     if (!request || request->_tempObject) return;
     
     if (!authenticateRequest(request)) {
@@ -1034,109 +2935,115 @@ void setupWebServer()
       }
       return;
     }
-    
-    aiEnabled = !aiEnabled;
-    
-    DynamicJsonDocument doc(256);
-    doc["success"] = true;
-    doc["ai_enabled"] = aiEnabled;
-    doc["message"] = aiEnabled ? "AI enabled" : "AI disabled";
-    
+
+    uint16_t offset = 0, limit = SCHEDULE_PAGE_MAX;
+    if (request->hasParam("offset"))
+      offset = constrain(request->getParam("offset")->value().toInt(), 0, SCHEDULE_MAX);
+    if (request->hasParam("limit"))
+      limit = constrain(request->getParam("limit")->value().toInt(), 1, SCHEDULE_PAGE_MAX);
+
+    // Chỉ dùng trên async_tcp task, tránh 320B trên stack
+    static Schedule page[SCHEDULE_PAGE_MAX];
+    static uint32_t nextFire[SCHEDULE_PAGE_MAX];
+    uint16_t n = schedules.page(offset, limit, page, nextFire);
+    uint32_t nowS = schedules.now();
+    ScheduleStats ss = schedules.getStats();
+
+    DynamicJsonDocument doc(6144);
+    doc["clock_set"] = nowS != 0; // false: RTC chưa đặt giờ → lịch tạm dừng
+    if (nowS) {
+      char buf[32];
+      formatScheduleTime(nowS, buf, sizeof(buf));
+      doc["now"] = (const char *)buf;
+    }
+    doc["total"] = ss.count;
+    doc["armed"] = ss.armed;
+    doc["capacity"] = SCHEDULE_MAX;
+    doc["fired"] = ss.fired;
+    doc["missed"] = ss.missed;
+    doc["offset"] = offset;
+    JsonArray list = doc.createNestedArray("schedules");
+    for (uint16_t i = 0; i < n; i++)
+      scheduleToJson(page[i], nextFire[i], nowS, list.createNestedObject());
+
     String response;
     serializeJson(doc, response);
-    
-    addLog("INFO", aiEnabled ? "AI Mode: ENABLED" : "AI Mode: DISABLED");
-    
+
     if (!request->_tempObject) {
       AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
       request->send(resp);
-    }
-    
-    updateLCD(); });
+    } });
 
-  // FIX: /voice/command
-  server.on("/voice/command", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+  // Tạo lịch, hoặc thay lịch có "id" (xem scheduleFromJson)
+  server.on("/schedules", HTTP_POST, rejectEmptyBody, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
             {
-    // Kiểm tra request còn hợp lệ
+    TIME_ROUTE(ROUTE_SCHEDULES_POST);
     if (!request || request->_tempObject) return;
+    RequestBody body(request, data, len, index, total);
+    if (!body.ready) return;
     
     if (!authenticateRequest(request)) {
-      if (request->_tempObject == nullptr) {
+      if (!request->_tempObject) {
         AsyncWebServerResponse *resp = request->beginResponse(401, "application/json", "{\"error\":\"Unauthorized\"}");
         request->send(resp);
       }
       return;
     }
-    
-    DynamicJsonDocument doc(512);
-    deserializeJson(doc, (const char*)data);
-    
-    String voiceText = doc["text"] | "";
-    if (voiceText.length() == 0) {
-      AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Missing text\"}");
-      request->send(resp);
+
+    uint32_t nowS = schedules.now();
+    if (!nowS) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(503, "application/json", "{\"error\":\"Clock not set\"}");
+        request->send(resp);
+      }
       return;
     }
-    
-    addLog("INFO", "Voice: " + voiceText);
 
-    // Forward đến Flask Gemini Server
-    String apiResponse = callVoiceAPI(voiceText);
-    
-    if (apiResponse.length() > 0 && apiResponse.indexOf("error") == -1) {
-      processAIDecision(apiResponse);
-      
-      // Parse response để lấy đầy đủ thông tin
-      DynamicJsonDocument respDoc(768);
-      int jsonStart = apiResponse.indexOf('{');
-      int jsonEnd = apiResponse.lastIndexOf('}');
-      
-      if (jsonStart != -1 && jsonEnd != -1) {
-        String jsonStr = apiResponse.substring(jsonStart, jsonEnd + 1);
-        DynamicJsonDocument geminiDoc(512);
-        DeserializationError error = deserializeJson(geminiDoc, jsonStr);
-        
-        if (!error) {
-          respDoc["success"] = true;
-          respDoc["action"] = geminiDoc["action"] | "unknown";
-          respDoc["temperature"] = geminiDoc["temperature"] | acTemp;
-          respDoc["fan_speed"] = geminiDoc["fan_speed"] | fanSpeedToString(acFan);
-          respDoc["mode"] = geminiDoc["mode"] | acMode;
-          respDoc["reason"] = geminiDoc["reason"] | lastAIResponse;
-          
-          //Thêm audio_url nếu có
-          if (geminiDoc.containsKey("audio_url")) {
-            respDoc["audio_url"] = geminiDoc["audio_url"].as<String>();
-          }
-        } else {
-          respDoc["success"] = true;
-          respDoc["reason"] = lastAIResponse;
-        }
-      } else {
-        respDoc["success"] = true;
-        respDoc["reason"] = lastAIResponse;
-      }
-      
+    DynamicJsonDocument doc(512);
+    DeserializationError error = deserializeJson(doc, body.text, body.length);
+    Schedule s;
+    const char *invalid = error ? "Invalid JSON" : scheduleFromJson(doc, nowS, s);
+    if (invalid) {
+      DynamicJsonDocument errDoc(256);
+      errDoc["error"] = invalid;
       String response;
-      serializeJson(respDoc, response);
-      
+      serializeJson(errDoc, response);
       if (!request->_tempObject) {
-        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+        AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", response);
         request->send(resp);
       }
-      
-    } else {
+      return;
+    }
+
+    uint16_t id = doc["id"] | 0;
+    bool ok = id ? schedules.update(id, s) : (id = schedules.add(s)) != 0;
+    if (!ok) {
       if (!request->_tempObject) {
-        AsyncWebServerResponse *resp = request->beginResponse(500, "application/json", 
-          "{\"error\":\"Voice API failed\",\"reason\":\"Không kết nối được Gemini server\"}");
+        AsyncWebServerResponse *resp = doc.containsKey("id")
+          ? request->beginResponse(404, "application/json", "{\"error\":\"Unknown schedule\"}")
+          : request->beginResponse(507, "application/json", "{\"error\":\"Schedule table full\"}");
         request->send(resp);
       }
-    } });
+      return;
+    }
 
-  // ============ CÁC ENDPOINT KHÁC - ĐÃ XÓA CORS HEADERS ============
+    DynamicJsonDocument respDoc(512);
+    respDoc["success"] = true;
+    s.id = id;
+    uint32_t fire = s.kind == SK_WEEKLY ? nextWeeklyFire(s.days, s.minute, nowS - 1) : s.at;
+    scheduleToJson(s, s.enabled ? fire : 0, nowS, respDoc.createNestedObject("schedule"));
 
-  server.on("/ac/status", HTTP_GET, [](AsyncWebServerRequest *request)
+    String response;
+    serializeJson(respDoc, response);
+
+    if (!request->_tempObject) {
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      request->send(resp);
+    } });
+
+  server.on("/schedules", HTTP_DELETE, [](AsyncWebServerRequest *request)
             {
+    TIME_ROUTE(ROUTE_SCHEDULES_DELETE);
     if (!request || request->_tempObject) return;
     
     if (!authenticateRequest(request)) {
@@ -1146,26 +3053,28 @@ void setupWebServer()
       }
       return;
     }
-    
-    DynamicJsonDocument doc(768);
-    doc["status"] = acStatus ? "on" : "off";
-    doc["temperature"] = acTemp;
-    doc["mode"] = acMode;
-    doc["fan_speed"] = fanSpeedToString(acFan);
-    doc["fan_level"] = fanSpeedToInt(acFan);
-    doc["llm_enabled"] = aiEnabled;
-    doc["model"] = "Daikin";
-    
-    String response;
-    serializeJson(doc, response);
-    
+
+    uint16_t id = 0;
+    if (request->hasParam("id"))
+      id = request->getParam("id")->value().toInt();
+
+    if (!schedules.remove(id)) {
+      if (!request->_tempObject) {
+        AsyncWebServerResponse *resp = request->beginResponse(404, "application/json", "{\"error\":\"Unknown schedule\"}");
+        request->send(resp);
+      }
+      return;
+    }
+
     if (!request->_tempObject) {
-      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
+      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true}");
       request->send(resp);
     } });
 
-  server.on("/stats", HTTP_GET, [](AsyncWebServerRequest *request)
+  // Prometheus text; header Authorization hoặc ?api_key= như các route khác
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request)
             {
+    TIME_ROUTE(ROUTE_METRICS);
     if (!request || request->_tempObject) return;
     
     if (!authenticateRequest(request)) {
@@ -1175,29 +3084,122 @@ void setupWebServer()
       }
       return;
     }
-    
-    DynamicJsonDocument doc(768);
-    doc["uptime"] = millis() / 1000;
-    doc["model"] = "Daikin";
-    doc["ir_commands"] = irCommands;
-    doc["voice_commands"] = voiceCommands;
-    doc["auto_optimizations"] = autoOptimizations;
-    
-    String response;
-    serializeJson(doc, response);
-    
-    if (!request->_tempObject) {
-      AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", response);
-      request->send(resp);
-    } });
+
+    std::shared_ptr<MetricsTextStream> state(new MetricsTextStream());
+    AsyncWebServerResponse *resp = request->beginChunkedResponse("text/plain; version=0.0.4",
+      [state](uint8_t *buffer, size_t maxLen, size_t /*index*/) -> size_t {
+        return state->fill(buffer, maxLen);
+      });
+    request->send(resp); });
+
+  // EventSource không gửi được header → dùng ?api_key=
+  events.setFilter(authenticateRequest);
+  events.onConnect([](AsyncEventSourceClient *client)
+                   {
+    sseStats.connects++;
+    sendStateKeyframe(client); });
+  server.addHandler(&events);
 
   server.begin();
-  addLog("SUCCESS", "WebServer OK (v7.3 - PCB NULL Fixed)");
+  LOG_SUCCESS("WebServer OK (v7.3 - PCB NULL Fixed)");
+}
+
+// ============ TASKS ============
+void sensorTask()
+{
+  for (Zone &z : zones)
+  {
+    z.core.sampleSensors(millis());
+    checkDhtHealth(z);
+    z.core.publish();
+  }
+  recordTraceSample();
+}
+
+// 1 mẫu/giây vào time-series; nhiệt độ/độ ẩm trống cho đến khi DHT có mẫu đầu
+void historyTask()
+{
+  const SensorState &s = core.ctrl.sensors;
+  int16_t values[TS_METRIC_COUNT];
+  bool dhtValid = core.climateValid();
+  values[TS_TEMPERATURE] = dhtValid ? tsToFixed(s.temperature, tsMetricScale(TS_TEMPERATURE)) : TS_EMPTY;
+  values[TS_HUMIDITY] = dhtValid ? tsToFixed(s.humidity, tsMetricScale(TS_HUMIDITY)) : TS_EMPTY;
+  values[TS_LIGHT] = tsToFixed(s.light, tsMetricScale(TS_LIGHT));
+  values[TS_DISTANCE] = tsToFixed(s.distance, tsMetricScale(TS_DISTANCE));
+  history.record(millis() / 1000, values);
+}
+
+void aiTask()
+{
+  // AI luôn chạy khi được bật, không quan tâm test mode; zone 0 nhường voice đang chạy
+  for (uint8_t i = 0; i < ZONE_COUNT; i++)
+  {
+    if (i == 0 && voiceInFlight > 0)
+      continue;
+    if (zones[i].core.runAuto(millis()) && i == 0)
+      lastAIResponse = core.lastRuleReason;
+  }
+}
+
+// Task one-shot phải có trước mọi beep()/showSplash(); log drain và LCD chạy cả trong setup()
+void setupTasks()
+{
+  buzzerTaskId = scheduler.addOneShot("buzzer", buzzerTask);
+  splashTaskId = scheduler.addOneShot("splash", splashEndTask);
+  dhtStepTaskId = scheduler.addOneShot("dht_step", dhtStepTask);
+  scheduler.addPeriodic("log_drain", logDrainTask, LOG_DRAIN_INTERVAL);
+  scheduler.addPeriodic("lcd", lcdTask, LCD_POLL_INTERVAL);
+}
+
+void startPeriodicTasks()
+{
+  scheduler.addPeriodic("dht", dhtStartTask, sensorInterval);
+  scheduler.addPeriodic("sensors", sensorTask, sensorInterval, 50); // sau khi khung DHT22 giải mã xong
+  scheduler.addPeriodic("radar", radarTask, RADAR_PING_INTERVAL_MS);
+  scheduler.addPeriodic("buttons", handleButtons, BUTTON_SCAN_INTERVAL);
+  scheduler.addPeriodic("ir_recv", receiveIR, IR_RECV_INTERVAL);
+  scheduler.addPeriodic("ai", aiTask, AI_TASK_INTERVAL);
+  scheduler.addPeriodic("history", historyTask, HISTORY_SAMPLE_INTERVAL);
+  scheduler.addPeriodic("voice_apply", voiceApplyTask, VOICE_APPLY_INTERVAL);
+  scheduler.addPeriodic("ac_cmd", acCommandTask, AC_COMMAND_INTERVAL);
+  scheduler.addPeriodic("ir_tx", irTxTask, IR_TX_INTERVAL);
+  scheduler.addPeriodic("events", eventsTask, SSE_TICK_INTERVAL);
+  scheduler.addPeriodic("schedules", scheduleTask, SCHEDULE_TICK_INTERVAL);
+  scheduler.addPeriodic("settings", settingsTask, SETTINGS_SAVE_INTERVAL);
+}
+
+// Cấu hình + bảng luật mặc định cho mọi zone; override NVS (/rules) chỉ áp cho zone 0
+void setupZones()
+{
+  for (uint8_t i = 0; i < ZONE_COUNT; i++)
+  {
+    Zone &z = zones[i];
+    z.cfg = &ZONE_CONFIG[i];
+    z.core.rules.begin(DEFAULT_RULES, sizeof(DEFAULT_RULES) / sizeof(DEFAULT_RULES[0]));
+    RuleSnapshot fixed;
+    uint32_t mask = zoneFixedFields(z, fixed);
+    for (uint8_t r = 0; mask && r < z.core.rules.count(); r++)
+      if (!z.core.rules.applicable(r, mask, fixed))
+        LOG_WARN("Zone %s: rule %s inactive (missing sensor)", z.cfg->name, z.core.rules.rule(r).name);
+  }
+}
+
+// Chờ trong setup() nhưng buzzer vẫn chạy
+void idleFor(uint32_t ms)
+{
+  uint32_t start = millis();
+  while (millis() - start < ms)
+  {
+    scheduler.tick();
+    delay(1);
+  }
 }
 
 // ============ SETUP ============
 void setup()
 {
+  loopTaskHandle = xTaskGetCurrentTaskHandle(); // setup() và loop() chung task
+  Serial.setTxBufferSize(LOG_SERIAL_TX_BUFFER);
   Serial.begin(115200);
   delay(1000);
 
@@ -1212,86 +3214,94 @@ void setup()
   pinMode(BTN_AI, INPUT_PULLUP);
   pinMode(BTN_TEST_PRESENCE, INPUT_PULLUP);
   pinMode(BUZZER_PIN, OUTPUT);
-  pinMode(PIR_PIN, INPUT);
-  pinMode(RADAR_TRIG_PIN, OUTPUT);
-  pinMode(RADAR_ECHO_PIN, INPUT);
+  radar.begin(RADAR_TRIG_PIN, RADAR_ECHO_PIN);
+
+  setupTasks();
+  setupZones();
+  loadRuleOverrides();
+  loadPredictSettings();
+  loadSchedules();
 
   lcd.init();
   lcd.backlight();
   lcd.clear();
-  lcd.print("Daikin AC v7.3");
-  lcd.setCursor(0, 1);
-  lcd.print("PCB NULL Fixed");
+  lcdFrame.reset();
+  showSplash("Daikin AC v7.3", "PCB NULL Fixed", 30000); // giữ đến màn hình kế tiếp
   beep(100, 1);
 
   if (!rtc.begin())
   {
-    addLog("ERROR", "RTC fail");
+    LOG_ERROR("RTC fail");
   }
   else if (!rtc.isrunning())
   {
     rtc.adjust(DateTime(F(__DATE__), F(__TIME__)));
   }
 
-  dht.begin();
-  delay(2000);
+  for (Zone &z : zones)
+  {
+    z.dht.begin(z.cfg->dhtPin);
+    if (z.cfg->pirPin >= 0)
+      pinMode(z.cfg->pirPin, INPUT);
+  }
+  idleFor(2000);
 
   irrecv.enableIRIn();
-  irsend.begin();
-  addLog("SUCCESS", "Daikin IR OK");
+  for (uint8_t i = 0; i < ZONE_COUNT; i++)
+    zones[i].rmtReady = zones[i].rmt.begin(ZONE_CONFIG[i].irPin, (rmt_channel_t)i);
+  if (zones[0].rmtReady)
+  {
+    LOG_SUCCESS("Daikin IR OK (RMT)");
+  }
+  else
+  {
+    irsend.begin();
+    LOG_WARN("Daikin IR: RMT lỗi, dùng bit-bang");
+  }
+  for (uint8_t i = 1; i < ZONE_COUNT; i++)
+    if (!zones[i].rmtReady)
+      LOG_ERROR("Daikin IR [%s]: RMT lỗi", ZONE_CONFIG[i].name);
 
+  WiFi.onEvent(onWiFiEvent);
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
   int attempts = 0;
   while (WiFi.status() != WL_CONNECTED && attempts < 30)
   {
-    delay(500);
+    idleFor(500);
     Serial.print(".");
     attempts++;
   }
 
   if (WiFi.status() == WL_CONNECTED)
   {
-    addLog("SUCCESS", "WiFi: " + WiFi.localIP().toString());
-    lcd.clear();
-    lcd.print("WiFi OK!");
-    lcd.setCursor(0, 1);
-    lcd.print(WiFi.localIP());
+    LOG_SUCCESS("WiFi: %s", WiFi.localIP().toString());
+    showSplash("WiFi OK!", WiFi.localIP().toString(), 30000);
     beep(100, 2);
-    delay(2000);
+    idleFor(2000);
   }
   else
   {
-    addLog("WARN", "WiFi failed - Voice disabled");
+    LOG_WARN("WiFi failed - Voice disabled");
   }
 
+  acCommandQueue = xQueueCreate(AC_COMMAND_QUEUE_DEPTH, sizeof(ZoneCommand));
+  core.publish();
+  startVoiceWorkers();
+  // WiFi đã bật → esp_random() lấy entropy từ RF
+  JsonCache::setBootNonce(esp_random());
   setupWebServer();
 
-  lcd.clear();
-  lcd.print("Daikin Ready!");
-  lcd.setCursor(0, 1);
-  lcd.print("AI:MockLLM ✓");
+  showSplash("Daikin Ready!", "AI:Rules ✓", 2000);
   beep(200, 1);
-  delay(2000);
+  idleFor(2000);
+
+  startPeriodicTasks();
 }
 
 // ============ LOOP ============
 void loop()
 {
-  if (millis() - lastSensorRead > sensorInterval)
-  {
-    lastSensorRead = millis();
-    readSensors();
-    updateLCD();
-  }
-
-  handleButtons();
-  receiveIR();
-
-  // AI luôn chạy khi được bật, không quan tâm test mode
-  if (aiEnabled)
-  {
-    mockLLMOptimize();
-  }
-
-  delay(10);
-}
\ No newline at end of file
+  scheduler.tick();
+  loopLatency.observe(scheduler.loopLastUs);
+  delay(1); // nhường CPU cho idle task (watchdog)
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ METRICS (PROMETHEUS TEXT) ============
+// Histogram độ trễ với bucket cố định (µs), chỉ là mảng đếm: observe() không
+// cấp phát, gọi được từ loop, async_tcp và worker task. /metrics đọc snapshot
+// rồi in dạng text exposition của Prometheus (đơn vị giây).
+
+#define METRICS_BUCKET_COUNT 16
+#define METRICS_PREFIX "daikin_"
+
+// Cận trên của bucket thứ i (µs), từ 50µs tới 10s
+inline uint32_t metricsBucketUs(uint8_t i)
+{
+  static const uint32_t bounds[METRICS_BUCKET_COUNT] = {
+      50, 100, 250, 500, 1000, 2500, 5000, 10000,
+      25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 10000000};
+  return bounds[i];
+}
+
+struct HistogramSnapshot
+{
+  uint32_t buckets[METRICS_BUCKET_COUNT + 1]; // không cộng dồn, phần tử cuối = +Inf
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+};
+
+class LatencyHistogram
+{
+public:
+  void observe(uint32_t us)
+  {
+    uint8_t i = 0;
+    while (i < METRICS_BUCKET_COUNT && us > metricsBucketUs(i))
+      i++;
+    portENTER_CRITICAL(&mux);
+    data.buckets[i]++;
+    data.count++;
+    data.sumUs += us;
+    if (us > data.maxUs)
+      data.maxUs = us;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  HistogramSnapshot snapshot()
+  {
+    portENTER_CRITICAL(&mux);
+    HistogramSnapshot copy = data;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+  }
+
+private:
+  HistogramSnapshot data = {};
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+// Đo thời gian từ lúc tạo tới khi ra khỏi scope (handler HTTP)
+class ScopedLatency
+{
+public:
+  explicit ScopedLatency(LatencyHistogram &h) : hist(h), startUs(micros()) {}
+  ~ScopedLatency() { hist.observe(micros() - startUs); }
+
+private:
+  LatencyHistogram &hist;
+  uint32_t startUs;
+};
+
+// ============ ĐỊNH DẠNG TEXT ============
+// Các hàm dưới ghi vào out, trả về số byte (cắt nếu thiếu chỗ)
+inline int metricsClamp(int len, size_t size)
+{
+  if (len < 0)
+    return 0;
+  return len >= (int)size ? (int)size - 1 : len;
+}
+
+inline int metricsHeader(char *out, size_t size, const char *name, const char *type, const char *help)
+{
+  int len = snprintf(out, size, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s %s\n",
+                     name, help, name, type);
+  return metricsClamp(len, size);
+}
+
+// labels dạng `route="/x",method="GET"` hoặc "" nếu không có
+inline int metricsValue(char *out, size_t size, const char *name, const char *labels, double value)
+{
+  int len = *labels
+                ? snprintf(out, size, METRICS_PREFIX "%s{%s} %.9g\n", name, labels, value)
+                : snprintf(out, size, METRICS_PREFIX "%s %.9g\n", name, value);
+  return metricsClamp(len, size);
+}
+
+// Các dòng _bucket (cộng dồn), _sum, _count của 1 histogram
+inline int metricsHistogram(char *out, size_t size, const char *name, const char *labels,
+                            const HistogramSnapshot &h)
+{
+  int len = 0;
+  uint32_t cumulative = 0;
+  const char *sep = *labels ? "," : "";
+  for (uint8_t i = 0; i <= METRICS_BUCKET_COUNT; i++)
+  {
+    cumulative += h.buckets[i];
+    char le[16];
+    if (i < METRICS_BUCKET_COUNT)
+      snprintf(le, sizeof(le), "%g", metricsBucketUs(i) / 1e6);
+    else
+      snprintf(le, sizeof(le), "+Inf");
+    len += metricsClamp(snprintf(out + len, size - len, METRICS_PREFIX "%s_bucket{%s%sle=\"%s\"} %u\n",
+                                 name, labels, sep, le, (unsigned)cumulative),
+                        size - len);
+  }
+  len += metricsClamp(*labels
+                          ? snprintf(out + len, size - len, METRICS_PREFIX "%s_sum{%s} %.6f\n" METRICS_PREFIX "%s_count{%s} %u\n",
+                                     name, labels, h.sumUs / 1e6, name, labels, (unsigned)h.count)
+                          : snprintf(out + len, size - len, METRICS_PREFIX "%s_sum %.6f\n" METRICS_PREFIX "%s_count %u\n",
+                                     name, h.sumUs / 1e6, name, (unsigned)h.count),
+                      size - len);
+  return len;
+}
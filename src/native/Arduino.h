@@ -0,0 +1,97 @@
+#pragma once
+
+// ============ ARDUINO SHIM CHO env:native ============
+// Chỉ đủ cho phần lõi (controller.h, rule_engine.h, logring.h, lcd_frame.h,
+// scheduler.h...). Thời gian là đồng hồ mô phỏng: harness tự tiến simNowUs()
+// nên 1 ngày mô phỏng chạy trong vài giây và kết quả lặp lại được.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+
+// ===== Thời gian mô phỏng =====
+inline uint64_t &simNowUs()
+{
+  static uint64_t now = 0;
+  return now;
+}
+
+inline uint32_t millis() { return (uint32_t)(simNowUs() / 1000); }
+inline uint32_t micros() { return (uint32_t)simNowUs(); }
+inline int64_t esp_timer_get_time() { return (int64_t)simNowUs(); }
+inline void delay(uint32_t ms) { simNowUs() += (uint64_t)ms * 1000; }
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// ===== FreeRTOS: host chạy 1 luồng, critical section là no-op =====
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define IRAM_ATTR
+
+// ===== String tối thiểu =====
+class String
+{
+public:
+  String() {}
+  String(const char *s) : str(s ? s : "") {}
+  String(const std::string &s) : str(s) {}
+
+  const char *c_str() const { return str.c_str(); }
+  unsigned int length() const { return (unsigned int)str.size(); }
+  bool operator==(const char *s) const { return str == (s ? s : ""); }
+  bool operator!=(const char *s) const { return !(*this == s); }
+  bool operator==(const String &s) const { return str == s.str; }
+  String &operator+=(const char *s)
+  {
+    str += s;
+    return *this;
+  }
+
+private:
+  std::string str;
+};
+
+// ===== Print (đích của LcdFrame) =====
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t ch) = 0;
+
+  virtual size_t write(const uint8_t *buf, size_t len)
+  {
+    size_t n = 0;
+    while (len--)
+      n += write(*buf++);
+    return n;
+  }
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v) { return printf("%d", v); }
+  size_t print(unsigned int v) { return printf("%u", v); }
+  size_t print(long v) { return printf("%ld", v); }
+  size_t print(unsigned long v) { return printf("%lu", v); }
+  size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char buf[64];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n <= 0)
+      return 0;
+    return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+  }
+};
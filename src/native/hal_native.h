@@ -0,0 +1,171 @@
+#pragma once
+
+#include <Arduino.h>
+#include "hal.h"
+
+// ============ HAL GIẢ LẬP (env:native) ============
+// Đồng hồ mô phỏng, cảm biến do harness đặt giá trị, IR ghi lại thay vì
+// phát, LCD ảo 16x2. Không có gì ngẫu nhiên: cùng tham số → cùng kết quả.
+
+#define SIM_IR_AIR_MS 450 // thời gian phát 1 khung Daikin (giống RMT thật)
+#define SIM_IR_LOG_SIZE 256
+
+class SimClock : public HalClock
+{
+public:
+  // startUnix: giờ RTC lúc millis() = 0 (--start-hour h → h * 3600)
+  explicit SimClock(uint32_t startUnix = 0) : startUnix(startUnix) {}
+
+  void advanceMs(uint32_t ms) { simNowUs() += (uint64_t)ms * 1000; }
+  // ms theo millis() (có thể đã tràn 32 bit như trên ESP32)
+  void advanceToMs(uint32_t ms)
+  {
+    int32_t delta = (int32_t)(ms - millis());
+    if (delta > 0)
+      simNowUs() += (uint64_t)delta * 1000;
+  }
+
+  uint32_t nowMs() override { return millis(); }
+  uint8_t hour() override { return (uint8_t)(minuteOfDay() / 60); }
+  uint8_t minute() override { return (uint8_t)(minuteOfDay() % 60); }
+  uint32_t unixTime() override { return startUnix + (uint32_t)(simNowUs() / 1000000ULL); }
+
+  uint32_t minuteOfDay() { return unixTime() / 60 % (24 * 60); }
+
+private:
+  uint32_t startUnix;
+};
+
+class FakeSensors : public HalSensors
+{
+public:
+  // Harness gọi mỗi lần "đo"; cảm biến chỉ báo mẫu mới sau lần đặt tiếp theo
+  void setClimate(float t, float h)
+  {
+    temperature = t;
+    humidity = h;
+    climateFresh = true;
+  }
+  void setDistance(float cm)
+  {
+    distance = cm;
+    distanceFresh = true;
+  }
+
+  bool readClimate(float &t, float &h) override
+  {
+    if (!climateFresh)
+      return false;
+    climateFresh = false;
+    t = temperature;
+    h = humidity;
+    return true;
+  }
+  int16_t readLight() override { return light; }
+  bool readMotion() override { return motion; }
+  bool readDistance(float &cm) override
+  {
+    if (!distanceFresh)
+      return false;
+    distanceFresh = false;
+    cm = distance;
+    return true;
+  }
+
+  float temperature = 0;
+  float humidity = 0;
+  int16_t light = 0;
+  bool motion = false;
+  float distance = 0;
+
+private:
+  bool climateFresh = false;
+  bool distanceFresh = false;
+};
+
+struct SimIrFrame
+{
+  uint32_t ms;
+  AcState ac;
+};
+
+// "Mã hóa" = chép AcState; khung bận SIM_IR_AIR_MS như khi RMT đang phát
+class RecordingIrSink : public HalIrSink
+{
+public:
+  uint16_t encode(const AcState &ac, uint8_t *frame, uint16_t maxLen) override
+  {
+    uint16_t len = sizeof(AcState) < maxLen ? sizeof(AcState) : maxLen;
+    AcState packed = {};
+    packed.power = ac.power;
+    packed.temp = ac.temp;
+    packed.mode = ac.mode;
+    packed.fan = ac.fan;
+    memcpy(frame, &packed, len);
+    return len;
+  }
+
+  bool transmit(const uint8_t *frame, uint16_t len) override
+  {
+    if (busy())
+      return false;
+    SimIrFrame &rec = log[sent % SIM_IR_LOG_SIZE];
+    rec.ms = millis();
+    memset(&rec.ac, 0, sizeof(rec.ac));
+    memcpy(&rec.ac, frame, len < sizeof(rec.ac) ? len : sizeof(rec.ac));
+    sent++;
+    busyUntilMs = millis() + SIM_IR_AIR_MS;
+    return true;
+  }
+
+  bool busy() override { return sent > 0 && (int32_t)(millis() - busyUntilMs) < 0; }
+
+  // Trạng thái máy lạnh "thật" = khung cuối đã nhận
+  bool hasFrame() const { return sent > 0; }
+  const AcState &lastState() const { return log[(sent - 1) % SIM_IR_LOG_SIZE].ac; }
+
+  uint32_t sent = 0;
+  SimIrFrame log[SIM_IR_LOG_SIZE];
+
+private:
+  uint32_t busyUntilMs = 0;
+};
+
+class VirtualLcd : public HalDisplay
+{
+public:
+  VirtualLcd() { memset(cells, ' ', sizeof(cells)); }
+
+  void setCursor(uint8_t c, uint8_t r) override
+  {
+    col = c;
+    row = r < 2 ? r : 1;
+    cursorMoves++;
+  }
+
+  size_t write(uint8_t ch) override
+  {
+    if (col >= 16)
+      return 0;
+    cells[row][col++] = (char)ch;
+    bytesWritten++;
+    return 1;
+  }
+
+  // Dòng r, kết thúc bằng '\0'
+  const char *line(uint8_t r)
+  {
+    memcpy(text, cells[r < 2 ? r : 1], 16);
+    text[16] = '\0';
+    return text;
+  }
+
+  uint32_t cursorMoves = 0;
+  uint32_t bytesWritten = 0;
+
+private:
+  char cells[2][16];
+  char text[17];
+  uint8_t col = 0;
+  uint8_t row = 0;
+};
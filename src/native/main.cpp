@@ -0,0 +1,498 @@
+// ============ HARNESS env:native ============
+// Chạy ClimateController thật (luật, lệnh AC, gom IR, LCD, JSON endpoint)
+// trên Linux với HAL giả lập và mô hình phòng đơn giản. Đồng hồ nhảy thẳng
+// tới deadline kế tiếp của scheduler nên 24h mô phỏng chỉ mất vài giây;
+// không có gì ngẫu nhiên nên 2 lần chạy cùng tham số cho cùng kết quả.
+//
+//   pio run -e native && .pio/build/native/program --hours 24 --start-hour 6
+//
+// --replay <trace>: bỏ mô hình phòng, cảm biến lấy từ trace ghi trên thiết bị
+// (GET /trace, xem sensor_trace.h). --record <trace> ghi cảm biến giả lập ra
+// cùng định dạng. --ir-out / --timeline-out ghi CSV khung IR và trạng thái
+// để diff giữa 2 phiên bản luật.
+//
+// --bench: chạy vòng kín từng chính sách (policies.h) với RoomPlant trong
+// --days ngày theo lịch --schedule, xếp hạng theo phút máy nén, phút khó
+// chịu và số lệnh IR mỗi ngày (xem plant_bench.h). --policy chọn chính sách
+// (lặp lại được; ngoài --bench thì chọn bảng luật cho lần chạy thường).
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include "hal_native.h"
+#include "controller.h"
+#include "scheduler.h"
+#include "trace_file.h"
+#include "plant_bench.h"
+
+#define SIM_SENSOR_INTERVAL 2000 // giống sensorInterval trên ESP32
+#define SIM_AI_INTERVAL 1000
+#define SIM_IR_TX_INTERVAL 10
+#define SIM_LCD_INTERVAL 1000
+#define SIM_COMMAND_INTERVAL 60000
+#define SIM_TIMELINE_DEFAULT_S 300
+#define SIM_BENCH_DEFAULT_DAYS 30
+
+LogRing logRing;
+StallProfiler stallProfiler;
+CoopScheduler scheduler;
+
+SimClock simClock;
+FakeSensors fakeSensors;
+RecordingIrSink irSink;
+VirtualLcd virtualLcd;
+Hal simHal = {simClock, fakeSensors, irSink, virtualLcd};
+
+ClimateController core(simHal);
+LcdFrame lcdFrame;
+
+bool verbose = false;
+LogCursor logCursor = {};
+uint32_t rulesFired = 0;
+uint32_t apiCommands = 0;
+
+TraceReader replay;
+TraceWriter recorder;
+bool replaying = false;
+bool recording = false;
+bool traceDone = false;
+TraceSample nextSample;
+uint32_t traceStartRtc = 0;
+int traceTaskId = -1;
+
+FILE *irOut = nullptr;
+FILE *timelineOut = nullptr;
+uint32_t timelineEveryS = SIM_TIMELINE_DEFAULT_S;
+
+// ============ OUTPUT CSV ============
+void writeIrFrame(const AcState &ac, const char *source)
+{
+  if (!irOut)
+    return;
+  char when[40];
+  formatRtc(simClock.unixTime(), when, sizeof(when));
+  fprintf(irOut, "%s,%s,%d,%s,%s,%s\n", when, ac.power ? "ON" : "OFF", ac.temp,
+          acModeToString(ac.mode), fanSpeedToString((FanSpeed)ac.fan), source);
+}
+
+// 1 dòng mỗi khi AC đổi / có sự kiện, và định kỳ mỗi timelineEveryS
+void writeTimeline(const char *event)
+{
+  static uint32_t lastRowS = 0;
+  static bool hasRow = false;
+  static AcState lastAc = {};
+  if (!timelineOut)
+    return;
+  const ControllerState &c = core.ctrl;
+  uint32_t nowS = simClock.unixTime();
+  bool acChanged = memcmp(&lastAc, &c.ac, sizeof(AcState)) != 0;
+  if (hasRow && !*event && !acChanged && nowS - lastRowS < timelineEveryS)
+    return;
+
+  char when[40];
+  formatRtc(nowS, when, sizeof(when));
+  fprintf(timelineOut, "%s,%.1f,%.0f,%d,%d,%s,%d,%s,%s,%s\n", when, c.sensors.temperature,
+          c.sensors.humidity, c.sensors.light, c.sensors.presence || c.sensors.motion ? 1 : 0,
+          c.ac.power ? "ON" : "OFF", c.ac.temp, acModeToString(c.ac.mode),
+          fanSpeedToString((FanSpeed)c.ac.fan), event);
+  lastRowS = nowS;
+  lastAc = c.ac;
+  hasRow = true;
+}
+
+// ============ PHÒNG ============
+// Mô hình phòng và lịch có người ở room_plant.h; máy lạnh "thật" = khung IR
+// cuối cùng RecordingIrSink nhận được.
+RoomPlant plant;
+const OccupancySchedule *schedule = &OCCUPANCY_SCHEDULES[0];
+
+// ============ TASKS ============
+void sensorTask()
+{
+  static uint32_t lastMs = millis();
+  uint32_t now = millis();
+  uint32_t rtc = simClock.unixTime();
+  bool home = scheduleHome(*schedule, rtc);
+  plant.step((now - lastMs) / 1000.0f, (rtc % 86400) / 3600.0f, home,
+             irSink.hasFrame() ? &irSink.lastState() : nullptr);
+  lastMs = now;
+  benchFeedSensors(fakeSensors, plant, home, scheduleAsleep(*schedule, rtc), rtc);
+
+  core.sampleSensors(now);
+  core.samplePresence(now);
+  core.publish();
+  writeTimeline("");
+
+  if (recording)
+  {
+    TraceSample ts = {simClock.unixTime(), true, fakeSensors.temperature, fakeSensors.humidity,
+                      fakeSensors.light, fakeSensors.motion, true, fakeSensors.distance};
+    recorder.write(ts);
+  }
+}
+
+// Replay: nạp bản ghi đến hạn vào cảm biến giả, hẹn bản ghi kế tiếp
+void traceTask()
+{
+  uint32_t now = millis();
+  const TraceSample &ts = nextSample;
+  if (ts.climateValid)
+    fakeSensors.setClimate(ts.temperature, ts.humidity);
+  fakeSensors.light = ts.light;
+  fakeSensors.motion = ts.pir;
+  if (ts.hasDistance)
+    fakeSensors.setDistance(ts.distanceCm);
+
+  core.sampleSensors(now);
+  core.samplePresence(now);
+  core.publish();
+  writeTimeline("");
+
+  if (!replay.next(nextSample))
+  {
+    traceDone = true;
+    return;
+  }
+  // Bản ghi lùi giờ (RTC bị chỉnh) → chạy ngay
+  int64_t dueMs = ((int64_t)nextSample.rtc - traceStartRtc) * 1000 - (int64_t)(simNowUs() / 1000);
+  scheduler.runAfter(traceTaskId, dueMs > 0 ? (uint32_t)dueMs : 0);
+}
+
+void aiTask()
+{
+  if (!core.runAuto(millis()))
+    return;
+  rulesFired++;
+  writeTimeline(core.lastActionName);
+}
+
+void irTxTask()
+{
+  if (core.transmitTick(millis()))
+    writeIrFrame(core.ctrl.ac, core.irTx.source());
+}
+
+void lcdTask()
+{
+  core.composeScreen(lcdFrame, millis());
+  lcdFrame.flush(simHal.display);
+}
+
+// Người dùng chỉnh nhiệt độ qua POST /ac/command mỗi lúc 20:00 (đi qua đúng
+// đường parse JSON của firmware)
+void commandTask()
+{
+  if (simClock.minuteOfDay() != 20 * 60)
+    return;
+  DynamicJsonDocument doc(512);
+  if (deserializeJson(doc, "{\"status\":true,\"temperature\":26,\"mode\":\"cool\",\"fan_speed\":\"LOW\"}"))
+    return;
+  AcCommand cmd = {0, core.ctrl.ac, "API_COMMAND"};
+  acCommandFromJson(doc, cmd);
+  core.apply(cmd);
+  apiCommands++;
+  writeTimeline("api");
+}
+
+void logDrainTask()
+{
+  LogRecord rec;
+  char line[LOG_LINE_MAX];
+  while (logRing.next(logCursor, rec))
+  {
+    if (!verbose)
+      continue;
+    logRing.format(rec, line, sizeof(line));
+    printf("[%7lu.%03lu] %-7s %s\n", (unsigned long)(rec.timestampMs / 1000),
+           (unsigned long)(rec.timestampMs % 1000), logLevelToString(rec.level), line);
+  }
+}
+
+// ============ VÒNG LẶP MÔ PHỎNG ============
+// Nhảy đồng hồ tới deadline gần nhất rồi tick() như loop() trên ESP32
+uint32_t nextDeadline()
+{
+  uint32_t now = millis();
+  uint32_t best = now + 60000;
+  for (int i = 0; i < scheduler.count(); i++)
+  {
+    const SchedTask &t = scheduler.task(i);
+    if (t.armed && (int32_t)(t.nextRunMs - best) < 0)
+      best = (int32_t)(t.nextRunMs - now) > 0 ? t.nextRunMs : now;
+  }
+  return best;
+}
+
+void printJson(const char *path, JsonDocument &doc)
+{
+  std::string body;
+  serializeJson(doc, body);
+  printf("GET %s\n  %s\n", path, body.c_str());
+}
+
+// Xếp hạng chính sách, điểm thấp nhất trước
+int runBenchmarks(const PolicyDef **list, int count, uint32_t days, uint8_t startHour,
+                  const ComfortBand &band, const BenchWeights &weights)
+{
+  BenchResult results[POLICY_COUNT];
+  auto wallStart = std::chrono::steady_clock::now();
+  for (int i = 0; i < count; i++)
+  {
+    results[i] = runBench(*list[i], *schedule, DEFAULT_PLANT, band, (uint32_t)startHour * 3600, days * 24);
+    scoreBench(results[i], weights);
+  }
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  for (int i = 1; i < count; i++)
+    for (int j = i; j > 0 && results[j].cost < results[j - 1].cost; j--)
+    {
+      BenchResult t = results[j];
+      results[j] = results[j - 1];
+      results[j - 1] = t;
+    }
+
+  printf("=== env:native: bench %u ngày, lịch %s, %d chính sách ===\n", (unsigned)days, schedule->name, count);
+  printf("wall %.3fs → %.0f giờ mô phỏng / giây\n", wallS,
+         wallS > 0 ? count * days * 24.0 / wallS : 0.0);
+  printf("thoải mái: %.1f..%.1fC, ẩm <= %.0f%% khi có người; điểm = máy nén + %.1f x khó chịu + %.1f x IR\n",
+         band.lowC, band.highC, band.humidityMax, weights.comfort, weights.ir);
+  printf("%-4s %-10s %10s %8s %10s %10s %9s %9s %10s %8s\n", "hạng", "chính sách", "khó chịu",
+         "(do ẩm)", "máy nén", "AC bật", "IR", "luật", "T có người", "điểm");
+  printf("%-4s %-10s %10s %8s %10s %10s %9s %9s %10s %8s\n", "", "", "phút/ngày", "",
+         "phút/ngày", "phút/ngày", "lệnh/ngày", "lần/ngày", "C", "");
+  for (int i = 0; i < count; i++)
+  {
+    const BenchResult &r = results[i];
+    printf("%-4d %-10s %10.1f %8.1f %10.1f %10.1f %9.1f %9.1f %10.2f %8.1f\n", i + 1, r.policy->name,
+           r.perDay(r.violationMin), r.perDay(r.humidMin), r.perDay(r.compressorMin), r.perDay(r.acOnMin),
+           r.perDay(r.irFrames), r.perDay(r.ruleFirings), r.meanOccupiedTemp(), r.cost);
+  }
+  return 0;
+}
+
+FILE *openOutput(const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if (!f)
+    fprintf(stderr, "không mở được %s\n", path);
+  return f;
+}
+
+void printUsage(FILE *out, const char *prog)
+{
+  fprintf(out,
+          "cách dùng: %s [tùy chọn]\n"
+          "  --hours N              số giờ mô phỏng (mặc định 24)\n"
+          "  --start-hour H         giờ bắt đầu 0-23 (mặc định 6)\n"
+          "  --replay <trace>       cảm biến lấy từ trace thay cho mô hình phòng\n"
+          "  --record <trace>       ghi cảm biến giả lập ra trace\n"
+          "  --ir-out <csv>         ghi các khung IR\n"
+          "  --timeline-out <csv>   ghi trạng thái theo thời gian\n"
+          "  --timeline-every S     chu kỳ ghi timeline (giây)\n"
+          "  --bench                xếp hạng các chính sách (policies.h)\n"
+          "  --days N               số ngày cho --bench\n"
+          "  --policy <tên>         chọn chính sách (lặp lại được)\n"
+          "  --schedule <tên>       lịch có người (room_plant.h)\n"
+          "  --band lo,hi,rh        dải dễ chịu cho --bench\n"
+          "  --comfort-weight W     trọng số phút khó chịu\n"
+          "  --ir-weight W          trọng số lệnh IR\n"
+          "  -v                     in log chi tiết\n"
+          "  -h, --help             in hướng dẫn này\n",
+          prog);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t hours = 24;
+  uint8_t startHour = 6;
+  const char *replayPath = nullptr;
+  const char *recordPath = nullptr;
+  bool bench = false;
+  uint32_t benchDays = SIM_BENCH_DEFAULT_DAYS;
+  const PolicyDef *policies[POLICY_COUNT];
+  int policyCount = 0;
+  ComfortBand band = COMFORT_DEFAULT;
+  BenchWeights weights = BENCH_WEIGHTS_DEFAULT;
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--hours") && i + 1 < argc)
+      hours = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--start-hour") && i + 1 < argc)
+      startHour = (uint8_t)(atoi(argv[++i]) % 24);
+    else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+      replayPath = argv[++i];
+    else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+      recordPath = argv[++i];
+    else if (!strcmp(argv[i], "--ir-out") && i + 1 < argc)
+      irOut = openOutput(argv[++i]);
+    else if (!strcmp(argv[i], "--timeline-out") && i + 1 < argc)
+      timelineOut = openOutput(argv[++i]);
+    else if (!strcmp(argv[i], "--timeline-every") && i + 1 < argc)
+      timelineEveryS = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--bench"))
+      bench = true;
+    else if (!strcmp(argv[i], "--days") && i + 1 < argc)
+      benchDays = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--policy") && i + 1 < argc)
+    {
+      const PolicyDef *p = findPolicy(argv[++i]);
+      if (!p)
+      {
+        fprintf(stderr, "không có chính sách %s (xem policies.h)\n", argv[i]);
+        return 1;
+      }
+      if (policyCount < (int)POLICY_COUNT)
+        policies[policyCount++] = p;
+    }
+    else if (!strcmp(argv[i], "--schedule") && i + 1 < argc)
+    {
+      schedule = findSchedule(argv[++i]);
+      if (!schedule)
+      {
+        fprintf(stderr, "không có lịch %s (xem room_plant.h)\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[i], "--band") && i + 1 < argc)
+      sscanf(argv[++i], "%f,%f,%f", &band.lowC, &band.highC, &band.humidityMax);
+    else if (!strcmp(argv[i], "--comfort-weight") && i + 1 < argc)
+      weights.comfort = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "--ir-weight") && i + 1 < argc)
+      weights.ir = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "-v"))
+      verbose = true;
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+    {
+      printUsage(stdout, argv[0]);
+      return 0;
+    }
+    else
+    {
+      fprintf(stderr, "tùy chọn không hợp lệ hoặc thiếu giá trị: %s\n", argv[i]);
+      printUsage(stderr, argv[0]);
+      return 2;
+    }
+  }
+
+  if (bench)
+  {
+    if (policyCount == 0)
+      for (const PolicyDef &p : POLICIES)
+        policies[policyCount++] = &p;
+    return runBenchmarks(policies, policyCount, benchDays, startHour, band, weights);
+  }
+
+  if (replayPath)
+  {
+    if (!replay.open(replayPath) || !replay.next(nextSample))
+    {
+      fprintf(stderr, "trace rỗng hoặc không đọc được: %s\n", replayPath);
+      return 1;
+    }
+    replaying = true;
+    traceStartRtc = nextSample.rtc;
+    simClock = SimClock(traceStartRtc);
+  }
+  else
+  {
+    simClock = SimClock((uint32_t)startHour * 3600);
+  }
+  if (recordPath && !replaying)
+    recording = recorder.open(recordPath);
+  if (irOut)
+    fprintf(irOut, "time,power,temp,mode,fan,source\n");
+  if (timelineOut)
+    fprintf(timelineOut, "time,temp,humidity,light,presence,power,set_temp,mode,fan,event\n");
+
+  const PolicyDef &policy = policyCount > 0 ? *policies[0] : POLICIES[0];
+  core.begin(policy.table, policy.count);
+  core.predictive = policy.predictive;
+  core.aiEnabled = true;
+  lcdFrame.reset();
+
+  if (replaying)
+  {
+    traceTaskId = scheduler.addOneShot("trace", traceTask);
+    scheduler.runAfter(traceTaskId, 0);
+  }
+  else
+  {
+    scheduler.addPeriodic("sensors", sensorTask, SIM_SENSOR_INTERVAL);
+    scheduler.addPeriodic("command", commandTask, SIM_COMMAND_INTERVAL);
+  }
+  scheduler.addPeriodic("ai", aiTask, SIM_AI_INTERVAL, 500);
+  scheduler.addPeriodic("ir_tx", irTxTask, SIM_IR_TX_INTERVAL);
+  scheduler.addPeriodic("lcd", lcdTask, SIM_LCD_INTERVAL);
+  scheduler.addPeriodic("log_drain", logDrainTask, 100);
+
+  uint64_t endUs = simNowUs() + (uint64_t)hours * 3600 * 1000000ULL;
+  auto wallStart = std::chrono::steady_clock::now();
+  while (replaying ? !traceDone : simNowUs() < endUs)
+  {
+    simClock.advanceToMs(nextDeadline());
+    scheduler.tick();
+  }
+  // Phát nốt khung IR đang gom
+  for (uint32_t t = 0; t < IR_TX_MAX_DELAY_MS + SIM_IR_AIR_MS && core.irTx.isPending(); t += SIM_IR_TX_INTERVAL)
+  {
+    simClock.advanceMs(SIM_IR_TX_INTERVAL);
+    irTxTask();
+  }
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double simS = simNowUs() / 1e6;
+  if (recording)
+    recorder.close();
+  if (irOut)
+    fclose(irOut);
+  if (timelineOut)
+    fclose(timelineOut);
+
+  if (replaying)
+  {
+    char from[40], to[40];
+    formatRtc(traceStartRtc, from, sizeof(from));
+    formatRtc(simClock.unixTime(), to, sizeof(to));
+    printf("=== env:native: replay %s → %s ===\n", from, to);
+    printf("trace: %u bản ghi, %u trùng đã bỏ, %u mất (ring bị ghi đè)%s\n",
+           (unsigned)replay.records, (unsigned)replay.duplicates, (unsigned)replay.gapRecords,
+           replay.error() ? ", FILE HỎNG ở cuối" : "");
+  }
+  else
+  {
+    printf("=== env:native: %uh mô phỏng từ %02u:00, lịch %s, luật %s ===\n", (unsigned)hours,
+           (unsigned)startHour, schedule->name, policy.name);
+    if (recording)
+      printf("trace: ghi %u bản ghi vào %s\n", (unsigned)recorder.count, recordPath);
+  }
+  printf("wall %.3fs, sim %.0fs → x%.0f thời gian thực, %u tick\n",
+         wallS, simS, wallS > 0 ? simS / wallS : 0.0, (unsigned)scheduler.loopCount);
+  const IrTxStats &ir = core.irTx.getStats();
+  printf("IR: %u yêu cầu → %u khung phát (gộp %u, trùng %u), max trễ %ums\n",
+         (unsigned)ir.requested, (unsigned)ir.emitted, (unsigned)ir.coalesced,
+         (unsigned)ir.duplicates, (unsigned)ir.maxLatencyMs);
+  printf("Luật: %u lần áp dụng, lệnh API: %u\n", (unsigned)rulesFired, (unsigned)apiCommands);
+  if (!replaying)
+    printf("Phòng cuối: %.1fC %.0f%%, máy nén chạy %.0f phút\n", plant.temperature, plant.humidity,
+           plant.compressorS / 60);
+  for (int i = 0; i < scheduler.count(); i++)
+  {
+    const SchedTask &t = scheduler.task(i);
+    printf("  task %-10s %8u lần\n", t.name, (unsigned)t.runs);
+  }
+  printf("LCD: %u lần setCursor, %u byte\n  |%s|\n", (unsigned)virtualLcd.cursorMoves,
+         (unsigned)virtualLcd.bytesWritten, virtualLcd.line(0));
+  printf("  |%s|\n", virtualLcd.line(1));
+
+  ControllerState st = core.read();
+  DynamicJsonDocument sensors(768);
+  buildSensorsJson(sensors, st, core.aiEnabled);
+  printJson("/sensors", sensors);
+  DynamicJsonDocument acStatus(512);
+  buildAcStatusJson(acStatus, st, core.aiEnabled);
+  printJson("/ac/status", acStatus);
+  DynamicJsonDocument model(1024);
+  RoomModelSnapshot m = core.model.snapshot();
+  buildModelJson(model, m, core.predictive, core.predictive && m.ready);
+  printJson("/model", model);
+  return 0;
+}
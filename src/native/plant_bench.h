@@ -0,0 +1,143 @@
+#pragma once
+
+#include <Arduino.h>
+#include "hal_native.h"
+#include "controller.h"
+#include "room_plant.h"
+#include "policies.h"
+
+// ============ BENCH VÒNG KÍN (--bench) ============
+// Mỗi chính sách chạy trên 1 ClimateController mới, nối vòng kín với
+// RoomPlant: cảm biến đọc phòng, khung IR đổi trạng thái máy lạnh thật,
+// máy lạnh đổi phòng. Bước cố định 1s (không qua CoopScheduler): mỗi giây
+// phát khung IR đã gom và chạy luật như aiTask, mỗi 2s lấy mẫu như
+// sensorTask. Khung IR phát ở bước sau yêu cầu (>= IR_TX_WINDOW_MS) nên số
+// khung và nội dung giống firmware, chỉ trễ hơn tối đa 1s.
+
+#define BENCH_STEP_MS 1000
+#define BENCH_SENSOR_EVERY 2 // bước
+
+struct ComfortBand
+{
+  float lowC;
+  float highC;
+  float humidityMax;
+};
+
+#define COMFORT_DEFAULT {23.0f, 27.0f, 70.0f}
+
+struct BenchResult
+{
+  const PolicyDef *policy;
+  double days;
+  double violationMin;  // có người và ngoài ComfortBand
+  double humidMin;      // phần trong violationMin chỉ do độ ẩm
+  double compressorMin;
+  double acOnMin;       // máy lạnh bật (kể cả lúc máy nén nghỉ)
+  uint32_t irFrames;
+  uint32_t ruleFirings;
+  double occupiedTempSum;
+  uint32_t occupiedSamples;
+  double cost;
+
+  double perDay(double v) const { return days > 0 ? v / days : 0; }
+  double meanOccupiedTemp() const { return occupiedSamples ? occupiedTempSum / occupiedSamples : 0; }
+};
+
+// Điểm để xếp hạng (thấp = tốt): phút máy nén + comfortWeight * phút khó
+// chịu + irWeight * lệnh IR (mỗi lệnh = 1 tiếng bíp của máy lạnh), tính/ngày
+struct BenchWeights
+{
+  float comfort;
+  float ir;
+};
+
+#define BENCH_WEIGHTS_DEFAULT {2.0f, 1.0f}
+
+// Đặt cảm biến giả từ phòng + lịch (giống sensorTask của harness)
+inline void benchFeedSensors(FakeSensors &sensors, const RoomPlant &plant, bool home, bool asleep, uint32_t rtc)
+{
+  uint32_t h = rtc / 3600 % 24;
+  // Cảm biến đọc lệch 0.1°C như DHT22
+  sensors.setClimate(roundf(plant.temperature * 10) / 10, roundf(plant.humidity));
+  sensors.light = (h >= 6 && h < 18) ? 3000 : (home && !asleep ? 900 : 50);
+  sensors.motion = home && !asleep; // ngủ: có người nhưng PIR im
+  sensors.setDistance(home ? 80.0f : 400.0f);
+}
+
+inline BenchResult runBench(const PolicyDef &policy, const OccupancySchedule &schedule,
+                            const PlantParams &params, const ComfortBand &band,
+                            uint32_t startUnix, uint32_t hours)
+{
+  struct Rig
+  {
+    explicit Rig(uint32_t start) : clock(start), hal{clock, sensors, ir, lcd}, core(hal) {}
+    SimClock clock;
+    FakeSensors sensors;
+    RecordingIrSink ir;
+    VirtualLcd lcd;
+    Hal hal;
+    ClimateController core;
+  };
+
+  simNowUs() = 0;
+  Rig rig(startUnix);
+  ClimateController &core = rig.core;
+  core.begin(policy.table, policy.count);
+  core.aiEnabled = true;
+  core.predictive = policy.predictive;
+
+  RoomPlant plant(params);
+  plant.reset(params.outdoorMeanC, params.outdoorHumidity);
+
+  BenchResult r = {};
+  r.policy = &policy;
+  uint32_t steps = hours * 3600 * (1000 / BENCH_STEP_MS);
+  for (uint32_t i = 0; i < steps; i++)
+  {
+    rig.clock.advanceMs(BENCH_STEP_MS);
+    uint32_t now = millis();
+    uint32_t rtc = rig.clock.unixTime();
+    bool home = scheduleHome(schedule, rtc);
+    float hour = (rtc % 86400) / 3600.0f;
+
+    const AcState *actual = rig.ir.hasFrame() ? &rig.ir.lastState() : nullptr;
+    plant.step(BENCH_STEP_MS / 1000.0f, hour, home, actual);
+
+    if (i % BENCH_SENSOR_EVERY == 0)
+    {
+      benchFeedSensors(rig.sensors, plant, home, scheduleAsleep(schedule, rtc), rtc);
+      core.sampleSensors(now);
+      core.samplePresence(now);
+      core.publish();
+    }
+
+    core.transmitTick(now);
+    if (core.runAuto(now))
+      r.ruleFirings++;
+
+    float stepMin = BENCH_STEP_MS / 60000.0f;
+    if (actual && actual->power)
+      r.acOnMin += stepMin;
+    if (home)
+    {
+      r.occupiedTempSum += plant.temperature;
+      r.occupiedSamples++;
+      bool tempOk = plant.temperature >= band.lowC && plant.temperature <= band.highC;
+      if (!tempOk || plant.humidity > band.humidityMax)
+        r.violationMin += stepMin;
+      if (tempOk && plant.humidity > band.humidityMax)
+        r.humidMin += stepMin;
+    }
+  }
+
+  r.days = hours / 24.0;
+  r.compressorMin = plant.compressorS / 60.0;
+  r.irFrames = rig.ir.sent;
+  return r;
+}
+
+inline void scoreBench(BenchResult &r, const BenchWeights &w)
+{
+  r.cost = r.perDay(r.compressorMin) + w.comfort * r.perDay(r.violationMin) + w.ir * r.perDay(r.irFrames);
+}
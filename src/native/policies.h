@@ -0,0 +1,102 @@
+#pragma once
+
+#include "default_rules.h"
+
+// ============ CHÍNH SÁCH ỨNG VIÊN CHO --bench ============
+// Mỗi chính sách = 1 bảng luật cùng định dạng với DEFAULT_RULES, chạy qua
+// đúng RuleEngine / ClimateController của firmware. Thêm bảng mới ở đây rồi
+// xếp hạng bằng --bench trước khi chép vào default_rules.h.
+
+// Setpoint cao, quạt thấp, chờ vắng 5 phút mới tắt
+constexpr RuleDef ECO_RULES[] = {
+    {"absent_off", "No presence", 3,
+     {{RF_PRESENCE, RO_EQ, 0, 0}, {RF_AC_ON, RO_EQ, 1, 0}, {RF_ABSENT_S, RO_GE, 300, 0}},
+     {RA_TURN_OFF, RT_KEEP, 0, RULE_KEEP, RULE_KEEP}},
+    {"hot_on", "Hot", 3,
+     {{RF_TEMP, RO_GE, 280, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_AC_ON, RO_EQ, 0, 0}},
+     {RA_TURN_ON, RT_SET, 27, FAN_LOW, AC_MODE_COOL}},
+    {"cold_off", "Too cold", 2,
+     {{RF_TEMP, RO_LE, 235, 0}, {RF_AC_ON, RO_EQ, 1, 0}},
+     {RA_TURN_OFF, RT_KEEP, 0, RULE_KEEP, RULE_KEEP}},
+    {"humid_dry", "High humidity", 4,
+     {{RF_HUMIDITY, RO_GE, 750, 0}, {RF_TEMP, RO_IN, 240, 280}, {RF_AC_ON, RO_EQ, 1, 0}, {RF_AC_MODE, RO_NE, AC_MODE_DRY, 0}},
+     {RA_ADJUST, RT_SET, 27, FAN_MEDIUM, AC_MODE_DRY}},
+    {"night_quiet", "Night mode", 4,
+     {{RF_AC_ON, RO_EQ, 1, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_HOUR, RO_IN, 22, 6}, {RF_AC_FAN, RO_NE, FAN_QUIET, 0}},
+     {RA_ADJUST, RT_KEEP, 0, FAN_QUIET, RULE_KEEP}},
+};
+
+// Bật sớm, setpoint thấp, hạ dần tới 23°C
+constexpr RuleDef COMFORT_RULES[] = {
+    {"absent_off", "No presence", 3,
+     {{RF_PRESENCE, RO_EQ, 0, 0}, {RF_AC_ON, RO_EQ, 1, 0}, {RF_ABSENT_S, RO_GE, 60, 0}},
+     {RA_TURN_OFF, RT_KEEP, 0, RULE_KEEP, RULE_KEEP}},
+    {"hot_on", "Hot", 3,
+     {{RF_TEMP, RO_GE, 260, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_AC_ON, RO_EQ, 0, 0}},
+     {RA_TURN_ON, RT_SET, 24, FAN_HIGH, AC_MODE_COOL}},
+    {"cold_off", "Too cold", 2,
+     {{RF_TEMP, RO_LE, 220, 0}, {RF_AC_ON, RO_EQ, 1, 0}},
+     {RA_TURN_OFF, RT_KEEP, 0, RULE_KEEP, RULE_KEEP}},
+    {"warm_lower", "Still warm, lowering", 4,
+     {{RF_AC_ON, RO_EQ, 1, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_TEMP_OVER_SET, RO_GT, 20, 0}, {RF_AC_TEMP, RO_GT, 23, 0}},
+     {RA_ADJUST, RT_DELTA, -1, FAN_HIGH, RULE_KEEP}},
+    {"near_target", "Near target, reduce", 4,
+     {{RF_AC_ON, RO_EQ, 1, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_TEMP_ERR_ABS, RO_LE, 5, 0}, {RF_AC_FAN, RO_EQ, FAN_HIGH, 0}},
+     {RA_ADJUST, RT_KEEP, 0, FAN_MEDIUM, RULE_KEEP}},
+};
+
+// Bảng mặc định, bỏ các cặp luật đá nhau: warm_lower dừng ở 24°C,
+// near_target chỉ hạ quạt từ HIGH, tắt sau 2 phút vắng
+constexpr RuleDef STEADY_RULES[] = {
+    {"absent_off", "No presence", 3,
+     {{RF_PRESENCE, RO_EQ, 0, 0}, {RF_AC_ON, RO_EQ, 1, 0}, {RF_ABSENT_S, RO_GE, 120, 0}},
+     {RA_TURN_OFF, RT_KEEP, 0, RULE_KEEP, RULE_KEEP}},
+    {"very_hot_on", "Very hot", 3,
+     {{RF_TEMP, RO_GE, 310, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_AC_ON, RO_EQ, 0, 0}},
+     {RA_TURN_ON, RT_SET, 24, FAN_HIGH, AC_MODE_COOL}},
+    {"hot_on", "Hot", 3,
+     {{RF_TEMP, RO_GE, 270, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_AC_ON, RO_EQ, 0, 0}},
+     {RA_TURN_ON, RT_SET, 25, FAN_MEDIUM, AC_MODE_COOL}},
+    {"cold_off", "Too cold", 2,
+     {{RF_TEMP, RO_LE, 220, 0}, {RF_AC_ON, RO_EQ, 1, 0}},
+     {RA_TURN_OFF, RT_KEEP, 0, RULE_KEEP, RULE_KEEP}},
+    {"humid_dry", "High humidity", 4,
+     {{RF_HUMIDITY, RO_GE, 750, 0}, {RF_TEMP, RO_IN, 240, 280}, {RF_AC_ON, RO_EQ, 1, 0}, {RF_AC_MODE, RO_NE, AC_MODE_DRY, 0}},
+     {RA_ADJUST, RT_SET, 26, FAN_MEDIUM, AC_MODE_DRY}},
+    {"warm_lower", "Still warm, lowering", 4,
+     {{RF_AC_ON, RO_EQ, 1, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_TEMP_OVER_SET, RO_GT, 30, 0}, {RF_AC_TEMP, RO_GT, 24, 0}},
+     {RA_ADJUST, RT_DELTA, -1, FAN_HIGH, RULE_KEEP}},
+    {"near_target", "Near target, reduce", 4,
+     {{RF_AC_ON, RO_EQ, 1, 0}, {RF_PRESENCE, RO_EQ, 1, 0}, {RF_TEMP_ERR_ABS, RO_LE, 10, 0}, {RF_AC_FAN, RO_EQ, FAN_HIGH, 0}},
+     {RA_ADJUST, RT_KEEP, 0, FAN_LOW, RULE_KEEP}},
+};
+
+struct PolicyDef
+{
+  const char *name;
+  const RuleDef *table;
+  uint8_t count;
+  bool predictive; // RoomModel thay bảng luật khi đã học xong (room_model.h)
+};
+
+#define POLICY(name, table) {name, table, sizeof(table) / sizeof(table[0]), false}
+#define PREDICTIVE_POLICY(name, table) {name, table, sizeof(table) / sizeof(table[0]), true}
+
+constexpr PolicyDef POLICIES[] = {
+    POLICY("default", DEFAULT_RULES),
+    POLICY("eco", ECO_RULES),
+    POLICY("comfort", COMFORT_RULES),
+    POLICY("steady", STEADY_RULES),
+    // Luật steady trong ~3h đầu, sau đó mô hình phòng học online
+    PREDICTIVE_POLICY("predictive", STEADY_RULES),
+};
+
+#define POLICY_COUNT (sizeof(POLICIES) / sizeof(POLICIES[0]))
+
+inline const PolicyDef *findPolicy(const char *name)
+{
+  for (const PolicyDef &p : POLICIES)
+    if (!strcmp(p.name, name))
+      return &p;
+  return nullptr;
+}
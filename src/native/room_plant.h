@@ -0,0 +1,172 @@
+#pragma once
+
+#include <Arduino.h>
+#include "controller_state.h"
+
+// ============ MÔ HÌNH PHÒNG (PLANT) CHO env:native ============
+// Phòng bậc 1: nhiệt độ trôi về nhiệt độ ngoài trời với hằng số thời gian
+// tauS, cộng nhiệt do người và nắng, trừ công suất máy lạnh. Máy lạnh
+// (trạng thái = khung IR cuối cùng nhận được) có thermostat riêng: máy nén
+// chạy khi phòng lệch setpoint quá thermostatBandC và nghỉ khi đã vượt qua
+// setpoint cùng biên đó. Độ ẩm cũng bậc 1: về độ ẩm ngoài trời, người thở
+// thêm hơi nước, máy nén chạy thì hút ẩm (DRY hút mạnh hơn).
+// Mọi đơn vị công suất là °C/h (hoặc %/h) để dễ chỉnh tay.
+
+#define PLANT_HUMIDITY_MIN 20.0f
+#define PLANT_HUMIDITY_MAX 99.0f
+
+struct PlantParams
+{
+  float tauS;                 // hằng số thời gian vỏ phòng
+  float occupantGainCPerH;    // nhiệt người trong phòng
+  float solarGainCPerH;       // nắng lúc 13h, 0 ngoài 7h..19h
+  float capacityCPerH[6];     // công suất máy nén theo FanSpeed (index 1..5)
+  float thermostatBandC;      // trễ bật/tắt máy nén quanh setpoint
+  float humidityTauS;
+  float occupantMoisturePerH; // %RH/h
+  float coolDryPerH;          // hút ẩm khi máy nén chạy ở COOL, %RH/h
+  float dryModeDryPerH;       // hút ẩm ở DRY
+  float outdoorMeanC;
+  float outdoorSwingC;        // biên độ dao động ngày, đỉnh 15h
+  float outdoorHumidity;
+};
+
+// Phòng ngủ ~15m2, tường gạch, máy 1HP, mùa nóng miền Nam
+constexpr PlantParams DEFAULT_PLANT = {
+    7200.0f, 0.5f, 0.8f,
+    {0.0f, 2.0f, 3.0f, 4.0f, 5.5f, 4.5f},
+    0.5f,
+    7200.0f, 1.0f, 10.0f, 15.0f,
+    29.0f, 5.0f, 75.0f};
+
+// ============ LỊCH CÓ NGƯỜI ============
+// Bit h = giờ h (giờ RTC) có người / đang ngủ (có người nhưng PIR im).
+struct OccupancySchedule
+{
+  const char *name;
+  uint32_t weekdayHome;
+  uint32_t weekendHome;
+  uint32_t sleep;
+};
+
+#define HOURS_MASK(from, to) ((((uint32_t)1 << (to)) - 1) & ~(((uint32_t)1 << (from)) - 1))
+
+constexpr OccupancySchedule OCCUPANCY_SCHEDULES[] = {
+    // Đi làm 7h..18h, về nhà buổi trưa; cuối tuần ở nhà cả ngày
+    {"workday", HOURS_MASK(0, 7) | HOURS_MASK(12, 13) | HOURS_MASK(18, 24), HOURS_MASK(0, 24),
+     HOURS_MASK(0, 6) | HOURS_MASK(23, 24)},
+    // Làm việc ở nhà
+    {"home", HOURS_MASK(0, 24), HOURS_MASK(0, 24), HOURS_MASK(0, 6) | HOURS_MASK(23, 24)},
+    // Làm ca đêm: ngủ ban ngày, vắng nhà 21h..7h
+    {"night_shift", HOURS_MASK(7, 21), HOURS_MASK(7, 21), HOURS_MASK(8, 15)},
+};
+
+inline const OccupancySchedule *findSchedule(const char *name)
+{
+  for (const OccupancySchedule &s : OCCUPANCY_SCHEDULES)
+    if (!strcmp(s.name, name))
+      return &s;
+  return nullptr;
+}
+
+// 1/1/1970 là thứ Năm; 0 = Chủ nhật
+inline uint8_t dayOfWeek(uint32_t rtc) { return (uint8_t)((rtc / 86400 + 4) % 7); }
+
+inline bool scheduleHome(const OccupancySchedule &s, uint32_t rtc)
+{
+  uint8_t dow = dayOfWeek(rtc);
+  uint32_t mask = (dow == 0 || dow == 6) ? s.weekendHome : s.weekdayHome;
+  return (mask >> (rtc / 3600 % 24)) & 1;
+}
+
+inline bool scheduleAsleep(const OccupancySchedule &s, uint32_t rtc)
+{
+  return scheduleHome(s, rtc) && ((s.sleep >> (rtc / 3600 % 24)) & 1);
+}
+
+// ============ PHÒNG ============
+class RoomPlant
+{
+public:
+  explicit RoomPlant(const PlantParams &p = DEFAULT_PLANT) : params(p) {}
+
+  void reset(float t, float h)
+  {
+    temperature = t;
+    humidity = h;
+    compressorOn = false;
+  }
+
+  float outdoorTemp(float hour) const
+  {
+    return params.outdoorMeanC + params.outdoorSwingC * sinf((hour - 9.0f) / 24.0f * 2 * (float)M_PI);
+  }
+
+  // Tiến dtS giây; ac = trạng thái máy lạnh thật (nullptr nếu chưa nhận khung nào)
+  void step(float dtS, float hour, bool occupied, const AcState *ac)
+  {
+    float gain = (outdoorTemp(hour) - temperature) / params.tauS;
+    if (occupied)
+      gain += params.occupantGainCPerH / 3600.0f;
+    if (hour > 7.0f && hour < 19.0f)
+      gain += params.solarGainCPerH / 3600.0f * sinf((hour - 7.0f) / 12.0f * (float)M_PI);
+
+    float moisture = (params.outdoorHumidity - humidity) / params.humidityTauS;
+    if (occupied)
+      moisture += params.occupantMoisturePerH / 3600.0f;
+
+    float cooling = 0;
+    updateCompressor(ac);
+    if (compressorOn)
+    {
+      uint8_t fan = ac->fan < 6 ? ac->fan : (uint8_t)FAN_MEDIUM;
+      float capacity = params.capacityCPerH[fan] / 3600.0f;
+      if (ac->mode == AC_MODE_DRY)
+      {
+        cooling = capacity * 0.5f;
+        moisture -= params.dryModeDryPerH / 3600.0f;
+      }
+      else
+      {
+        cooling = heating ? -capacity : capacity;
+        if (!heating)
+          moisture -= params.coolDryPerH / 3600.0f * params.capacityCPerH[fan] / params.capacityCPerH[FAN_MEDIUM];
+      }
+      compressorS += dtS;
+    }
+
+    temperature += (gain - cooling) * dtS;
+    humidity = constrain(humidity + moisture * dtS, PLANT_HUMIDITY_MIN, PLANT_HUMIDITY_MAX);
+  }
+
+  float temperature = 28.0f;
+  float humidity = 65.0f;
+  bool compressorOn = false;
+  double compressorS = 0; // tổng thời gian máy nén chạy
+
+private:
+  // Thermostat trong dàn lạnh: trễ ±band quanh setpoint
+  void updateCompressor(const AcState *ac)
+  {
+    if (!ac || !ac->power || ac->mode == AC_MODE_FAN)
+    {
+      compressorOn = false;
+      return;
+    }
+    if (ac->mode == AC_MODE_AUTO)
+      heating = temperature < ac->temp - params.thermostatBandC ? true
+                : temperature > ac->temp + params.thermostatBandC ? false
+                                                                   : heating;
+    else
+      heating = ac->mode == AC_MODE_HEAT;
+
+    float err = heating ? ac->temp - temperature : temperature - ac->temp;
+    if (err > params.thermostatBandC)
+      compressorOn = true;
+    else if (err < -params.thermostatBandC)
+      compressorOn = false;
+  }
+
+  PlantParams params;
+  bool heating = false;
+};
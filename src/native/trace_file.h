@@ -0,0 +1,140 @@
+#pragma once
+
+#include <Arduino.h>
+#include "sensor_trace.h"
+
+// ============ FILE TRACE TRÊN HOST ============
+// Đọc file gồm nhiều chunk (các response /trace nối nhau): chunk trùng seq
+// với phần đã đọc bị bỏ, khoảng hở seq được đếm lại để báo cáo.
+class TraceReader
+{
+public:
+  bool open(const char *path)
+  {
+    file = fopen(path, "rb");
+    return file != nullptr;
+  }
+
+  ~TraceReader()
+  {
+    if (file)
+      fclose(file);
+  }
+
+  // false khi hết file hoặc file hỏng (xem error())
+  bool next(TraceSample &s)
+  {
+    uint8_t rec[TRACE_RECORD_SIZE];
+    for (;;)
+    {
+      if (remaining == 0)
+      {
+        uint8_t hdr[TRACE_HEADER_SIZE];
+        size_t n = fread(hdr, 1, sizeof(hdr), file);
+        if (n == 0)
+          return false;
+        if (n != sizeof(hdr) || !traceDecodeHeader(hdr, seq, remaining))
+        {
+          bad = true;
+          return false;
+        }
+        if (records > 0 && seq > expectedSeq)
+          gapRecords += seq - expectedSeq;
+        continue;
+      }
+
+      if (fread(rec, 1, sizeof(rec), file) != sizeof(rec))
+      {
+        bad = true;
+        return false;
+      }
+      remaining--;
+      uint32_t recSeq = seq++;
+      if (records > 0 && recSeq < expectedSeq)
+      {
+        duplicates++;
+        continue;
+      }
+      expectedSeq = recSeq + 1;
+      records++;
+      traceDecode(rec, s);
+      return true;
+    }
+  }
+
+  bool error() const { return bad; }
+
+  uint32_t records = 0;
+  uint32_t duplicates = 0; // trùng giữa các chunk, đã bỏ
+  uint32_t gapRecords = 0; // ring trên thiết bị đã ghi đè trước khi kéo về
+
+private:
+  FILE *file = nullptr;
+  uint32_t seq = 0;
+  uint32_t remaining = 0;
+  uint32_t expectedSeq = 0;
+  bool bad = false;
+};
+
+// Ghi 1 chunk duy nhất; count trong header được sửa lúc close()
+class TraceWriter
+{
+public:
+  bool open(const char *path)
+  {
+    file = fopen(path, "wb");
+    if (!file)
+      return false;
+    uint8_t hdr[TRACE_HEADER_SIZE];
+    traceEncodeHeader(0, 0, hdr);
+    return fwrite(hdr, 1, sizeof(hdr), file) == sizeof(hdr);
+  }
+
+  void write(const TraceSample &s)
+  {
+    if (!file)
+      return;
+    uint8_t rec[TRACE_RECORD_SIZE];
+    traceEncode(s, rec);
+    fwrite(rec, 1, sizeof(rec), file);
+    count++;
+  }
+
+  void close()
+  {
+    if (!file)
+      return;
+    uint8_t hdr[TRACE_HEADER_SIZE];
+    traceEncodeHeader(0, count, hdr);
+    fseek(file, 0, SEEK_SET);
+    fwrite(hdr, 1, sizeof(hdr), file);
+    fclose(file);
+    file = nullptr;
+  }
+
+  uint32_t count = 0;
+
+private:
+  FILE *file = nullptr;
+};
+
+// "YYYY-MM-DD HH:MM:SS" từ epoch giây (lịch Gregory, không múi giờ)
+inline void formatRtc(uint32_t t, char *out, size_t size)
+{
+  int32_t days = (int32_t)(t / 86400);
+  uint32_t sec = t % 86400;
+  // Đổi số ngày → ngày/tháng/năm (thuật toán civil_from_days)
+  int32_t z = days + 719468;
+  int32_t era = z / 146097;
+  uint32_t doe = (uint32_t)(z - era * 146097);
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int32_t y = (int32_t)yoe + era * 400;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  uint32_t d = doy - (153 * mp + 2) / 5 + 1;
+  uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+  if (m <= 2)
+    y++;
+  snprintf(out, size, "%04d-%02u-%02u %02u:%02u:%02u", (int)y, (unsigned)m, (unsigned)d,
+           (unsigned)(sec / 3600), (unsigned)(sec / 60 % 60), (unsigned)(sec % 60));
+}
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <Arduino.h>
+#include "controller_state.h"
+
+// ============ MÔ HÌNH PHÒNG HỌC ONLINE + ĐIỀU KHIỂN DỰ BÁO ============
+// Phòng xấp xỉ bậc 1 (°C/h):
+//   dT/dt = θ0 + θ1·(T - 25) + θ2·u + θ3·sin(2πh/24) + θ4·cos(2πh/24)
+//   τ = -1/θ1            hằng số thời gian của phòng
+//   -θ2                  công suất làm lạnh ở quạt MED
+//   θ0, θ3, θ4           nhiệt ngoài trời + nắng theo giờ h trong ngày (không
+//                        có cảm biến ngoài trời nên học dạng điều hòa bậc 1);
+//                        25 - (θ0 + θ3·sin + θ4·cos)/θ1 = nhiệt độ phòng tự
+//                        về lúc h khi máy lạnh tắt
+// u = lực kéo của máy nén (hệ số quạt, 0 khi tắt). Không đo được máy nén
+// nên chỉ học từ mẫu biết chắc u: máy lạnh tắt, hoặc phòng còn lệch
+// setpoint quá RM_BAND_C (máy nén chạy hết công suất). Lúc thermostat của
+// máy đang giữ nhiệt (bật tắt liên tục) u và T gần như tỉ lệ, không tách
+// được nên bỏ. Vì vậy τ chỉ học được khi máy lạnh có lúc tắt.
+//
+// observe() chạy mỗi mẫu DHT22, chỉ cộng dồn. Hết mỗi cửa sổ RM_WINDOW_MS,
+// hiệu trung bình 2 cửa sổ liền nhau (đỡ nhiễu lượng tử 0.1°C) thành 1 quan
+// sát cho RLS RM_PARAMS tham số có hệ số quên. Bộ nhớ cố định, ~100 phép
+// nhân / cửa sổ. plan() mô phỏng vài chục phút tới cho từng (setpoint,
+// quạt): kéo hết công suất tới setpoint rồi chỉ bù phần nhiệt lọt vào; chọn
+// phương án rẻ nhất theo phút máy nén, độ-phút ngoài vùng thoải mái và phạt
+// mỗi lần đổi trạng thái (= 1 khung IR).
+
+#define RM_PARAMS 5
+#define RM_T_REF 25.0f
+#define RM_WINDOW_MS 300000   // 5 phút / quan sát
+#define RM_MAX_GAP_MS 30000   // mất mẫu lâu hơn → bỏ cửa sổ đang gom
+#define RM_FORGET 0.995f      // nhớ ~200 quan sát (~17h)
+#define RM_P_INIT 100.0f
+#define RM_P_MAX_TRACE 1000.0f // chống phình P khi tín hiệu không đổi
+#define RM_MIN_UPDATES 36     // 3h dữ liệu trước khi tin mô hình
+#define RM_TAU_MIN_H 0.2f
+#define RM_TAU_MAX_H 48.0f
+#define RM_GAIN_MIN 0.3f      // °C/h; nhỏ hơn = chưa thấy máy lạnh có tác dụng
+#define RM_BAND_C 0.5f
+
+#define PREDICT_STEP_MIN 1
+
+struct PredictConfig
+{
+  float comfortLowC;
+  float comfortHighC;
+  int8_t setMin;        // setpoint được phép chọn
+  int8_t setMax;
+  uint8_t horizonMin;
+  float comfortWeight;  // chi phí / độ-phút ngoài vùng thoải mái
+  float changeCost;     // chi phí 1 lần đổi trạng thái (1 khung IR)
+};
+
+constexpr PredictConfig PREDICT_DEFAULT = {23.0f, 27.0f, 24, 27, 30, 4.0f, 5.0f};
+
+struct PredictPlan
+{
+  bool change;       // true nếu phải gửi target
+  AcState target;
+  float keepCost;
+  float bestCost;
+  float predictedC;  // nhiệt độ cuối horizon với target
+  float dutyMin;     // phút máy nén (quy về quạt MED) trong horizon
+  uint32_t atMs;
+};
+
+struct RoomModelSnapshot
+{
+  bool ready;
+  uint32_t updates;
+  float theta[RM_PARAMS];
+  float tauH;
+  float ambientC; // nhiệt độ phòng tự về lúc này nếu tắt máy lạnh
+  float gainCPerH;
+  float rmsCPerH;
+  PredictConfig config;
+  PredictPlan lastPlan;
+  uint32_t plans;
+  uint32_t changes;
+};
+
+inline float fanDriveFactor(uint8_t fan)
+{
+  switch (fan)
+  {
+  case FAN_QUIET:
+    return 0.5f;
+  case FAN_LOW:
+    return 0.75f;
+  case FAN_HIGH:
+    return 1.35f;
+  case FAN_AUTO:
+    return 1.1f;
+  default:
+    return 1.0f;
+  }
+}
+
+// Máy lạnh đang làm lạnh (+1), sưởi (-1) hay không (0)
+inline int8_t acDirection(const AcState &ac)
+{
+  if (!ac.power || ac.mode == AC_MODE_FAN)
+    return 0;
+  return ac.mode == AC_MODE_HEAT ? -1 : 1;
+}
+
+// Lực kéo tối đa của máy nén: hệ số quạt, DRY chạy nửa công suất
+inline float acFullDrive(const AcState &ac)
+{
+  float f = fanDriveFactor(ac.fan);
+  return ac.mode == AC_MODE_DRY ? f * 0.5f : f;
+}
+
+// u khi biết chắc trạng thái máy nén; false nếu thermostat đang giữ nhiệt
+inline bool acKnownDrive(const AcState &ac, float temp, float &u)
+{
+  int8_t dir = acDirection(ac);
+  u = 0;
+  if (dir == 0)
+    return true;
+  if (dir * (temp - ac.temp) <= RM_BAND_C)
+    return false;
+  u = dir * acFullDrive(ac);
+  return true;
+}
+
+class RoomModel
+{
+public:
+  RoomModel() { reset(); }
+
+  void reset()
+  {
+    portENTER_CRITICAL(&mux);
+    for (uint8_t i = 0; i < RM_PARAMS; i++)
+    {
+      theta[i] = 0;
+      for (uint8_t j = 0; j < RM_PARAMS; j++)
+        P[i][j] = i == j ? RM_P_INIT : 0;
+    }
+    updates = 0;
+    errSq = 0;
+    portEXIT_CRITICAL(&mux);
+    n = 0;
+    hasPrev = false;
+  }
+
+  // Handler HTTP chỉ đánh dấu; loop() reset ở mẫu kế tiếp
+  void requestReset() { resetPending = true; }
+
+  // Gọi mỗi khi có mẫu nhiệt độ mới; ac = trạng thái máy lạnh đang đặt,
+  // minuteOfDay = giờ RTC
+  void observe(uint32_t nowMs, uint16_t minuteOfDay, float temp, const AcState &ac)
+  {
+    if (resetPending)
+    {
+      resetPending = false;
+      reset();
+    }
+    if (n > 0 && nowMs - lastMs > RM_MAX_GAP_MS)
+    {
+      n = 0;
+      hasPrev = false;
+    }
+    if (n == 0)
+    {
+      startMs = nowMs;
+      sumT = 0;
+      sumU = 0;
+      known = true;
+    }
+    float u;
+    known = acKnownDrive(ac, temp, u) && known;
+    sumT += temp;
+    sumU += u;
+    n++;
+    lastMs = nowMs;
+    lastMinuteOfDay = minuteOfDay;
+    if (nowMs - startMs < RM_WINDOW_MS)
+      return;
+
+    float meanT = sumT / n;
+    float meanU = sumU / n;
+    uint32_t midMs = startMs + (nowMs - startMs) / 2;
+    if (hasPrev && known && prevKnown)
+    {
+      float dtH = (midMs - prevMidMs) / 3600000.0f;
+      float x[RM_PARAMS];
+      regressors(x, (meanT + prevT) / 2, (meanU + prevU) / 2, minuteOfDay);
+      update(x, (meanT - prevT) / dtH);
+    }
+    prevT = meanT;
+    prevU = meanU;
+    prevMidMs = midMs;
+    prevKnown = known;
+    hasPrev = true;
+    n = 0;
+  }
+
+  // Chỉ loop() gọi (loop là writer duy nhất của theta)
+  bool ready() const
+  {
+    if (updates < RM_MIN_UPDATES || theta[1] >= 0)
+      return false;
+    float tauH = -1.0f / theta[1];
+    return tauH >= RM_TAU_MIN_H && tauH <= RM_TAU_MAX_H && -theta[2] >= RM_GAIN_MIN;
+  }
+
+  static void regressors(float *x, float temp, float u, uint16_t minuteOfDay)
+  {
+    float phase = minuteOfDay * (2 * (float)M_PI / 1440.0f);
+    x[0] = 1.0f;
+    x[1] = temp - RM_T_REF;
+    x[2] = u;
+    x[3] = sinf(phase);
+    x[4] = cosf(phase);
+  }
+
+  // Tốc độ đổi nhiệt độ (°C/h) theo mô hình
+  float rate(float temp, float u, uint16_t minuteOfDay) const
+  {
+    float x[RM_PARAMS];
+    regressors(x, temp, u, minuteOfDay);
+    float r = 0;
+    for (uint8_t i = 0; i < RM_PARAMS; i++)
+      r += theta[i] * x[i];
+    return r;
+  }
+
+  // Mô phỏng horizon phút; trả về chi phí, cuối kỳ ra nhiệt độ và phút máy
+  // nén quy về quạt MED. Chưa tới setpoint: chạy hết công suất; đã tới:
+  // chỉ chạy phần cần để bù nhiệt trôi (thermostat giữ nhiệt).
+  float simulate(float temp, uint16_t minuteOfDay, const AcState &ac, bool occupied,
+                 const PredictConfig &cfg, float &endC, float &dutyMin) const
+  {
+    float cost = 0;
+    float gain = -theta[2];
+    int8_t dir = acDirection(ac);
+    float full = dir * acFullDrive(ac);
+    dutyMin = 0;
+    for (uint8_t m = 0; m < cfg.horizonMin; m += PREDICT_STEP_MIN)
+    {
+      float drift = rate(temp, 0, (minuteOfDay + m) % 1440);
+      float u = 0;
+      if (dir != 0 && gain > 0)
+        u = dir * (temp - ac.temp) > 0 ? full : constrain(drift / gain, dir < 0 ? full : 0.0f, dir > 0 ? full : 0.0f);
+      temp += (drift - gain * u) * PREDICT_STEP_MIN / 60.0f;
+      dutyMin += (u < 0 ? -u : u) * PREDICT_STEP_MIN;
+      if (occupied)
+      {
+        float out = temp > cfg.comfortHighC ? temp - cfg.comfortHighC
+                    : temp < cfg.comfortLowC ? cfg.comfortLowC - temp
+                                             : 0;
+        cost += cfg.comfortWeight * out * PREDICT_STEP_MIN;
+      }
+    }
+    endC = temp;
+    return cost + dutyMin;
+  }
+
+  // Chọn trạng thái máy lạnh cho horizon tới; plan.change = false nếu giữ nguyên
+  void plan(float temp, uint16_t minuteOfDay, const AcState &current, bool occupied, uint32_t nowMs,
+            PredictPlan &out)
+  {
+    PredictConfig cfg = config();
+    float endC, duty;
+    out.change = false;
+    out.target = current;
+    out.keepCost = simulate(temp, minuteOfDay, current, occupied, cfg, endC, duty);
+    out.bestCost = out.keepCost;
+    out.predictedC = endC;
+    out.dutyMin = duty;
+    out.atMs = nowMs;
+
+    AcState off = current;
+    off.power = false;
+    consider(off, temp, minuteOfDay, current, occupied, cfg, out);
+
+    static const uint8_t fans[] = {FAN_LOW, FAN_MEDIUM, FAN_HIGH};
+    for (int8_t t = cfg.setMin; t <= cfg.setMax; t++)
+      for (uint8_t f : fans)
+        consider({true, t, AC_MODE_COOL, f}, temp, minuteOfDay, current, occupied, cfg, out);
+
+    portENTER_CRITICAL(&mux);
+    lastPlan = out;
+    plans++;
+    if (out.change)
+      changes++;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  PredictConfig config()
+  {
+    portENTER_CRITICAL(&mux);
+    PredictConfig copy = cfg;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+  }
+
+  // Gọi được từ handler HTTP
+  void setConfig(const PredictConfig &c)
+  {
+    portENTER_CRITICAL(&mux);
+    cfg = c;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // POST /model: handler HTTP đặt cấu hình và gửi yêu cầu bật/tắt chế độ dự
+  // báo (predictive: -1 giữ nguyên, 0 tắt, 1 bật); loop() nhận bằng
+  // takeSettingsRequest() rồi lưu NVS
+  void requestSettings(const PredictConfig &c, int8_t predictive)
+  {
+    portENTER_CRITICAL(&mux);
+    cfg = c;
+    if (predictive >= 0)
+      predictivePending = predictive;
+    settingsPending = true;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // true nếu có yêu cầu từ lần trước; predictive = bật/tắt đang chờ hoặc -1
+  bool takeSettingsRequest(int8_t &predictive)
+  {
+    portENTER_CRITICAL(&mux);
+    bool pending = settingsPending;
+    predictive = predictivePending;
+    settingsPending = false;
+    predictivePending = -1;
+    portEXIT_CRITICAL(&mux);
+    return pending;
+  }
+
+  RoomModelSnapshot snapshot()
+  {
+    RoomModelSnapshot s;
+    portENTER_CRITICAL(&mux);
+    s.ready = ready();
+    s.updates = updates;
+    memcpy(s.theta, theta, sizeof(theta));
+    s.rmsCPerH = sqrtf(errSq);
+    s.config = cfg;
+    s.lastPlan = lastPlan;
+    s.plans = plans;
+    s.changes = changes;
+    uint16_t minuteOfDay = lastMinuteOfDay;
+    portEXIT_CRITICAL(&mux);
+    s.tauH = s.theta[1] < 0 ? -1.0f / s.theta[1] : 0;
+    float x[RM_PARAMS];
+    regressors(x, RM_T_REF, 0, minuteOfDay);
+    float drift = s.theta[0] + s.theta[3] * x[3] + s.theta[4] * x[4];
+    s.ambientC = s.theta[1] < 0 ? RM_T_REF - drift / s.theta[1] : 0;
+    s.gainCPerH = -s.theta[2];
+    return s;
+  }
+
+private:
+  static bool sameState(const AcState &a, const AcState &b)
+  {
+    if (!a.power && !b.power)
+      return true;
+    return a.power == b.power && a.temp == b.temp && a.mode == b.mode && a.fan == b.fan;
+  }
+
+  void consider(const AcState &cand, float temp, uint16_t minuteOfDay, const AcState &current,
+                bool occupied, const PredictConfig &cfg, PredictPlan &out) const
+  {
+    if (sameState(cand, current))
+      return;
+    float endC, duty;
+    float cost = simulate(temp, minuteOfDay, cand, occupied, cfg, endC, duty) + cfg.changeCost;
+    if (cost >= out.bestCost)
+      return;
+    out.change = true;
+    out.target = cand;
+    out.bestCost = cost;
+    out.predictedC = endC;
+    out.dutyMin = duty;
+  }
+
+  // RLS có hệ số quên: θ += k·e, P = (P - k·(Px)ᵀ) / λ
+  void update(const float *x, float y)
+  {
+    float Px[RM_PARAMS];
+    float denom = RM_FORGET;
+    float err = y;
+    float trace = 0;
+    for (uint8_t i = 0; i < RM_PARAMS; i++)
+    {
+      Px[i] = 0;
+      for (uint8_t j = 0; j < RM_PARAMS; j++)
+        Px[i] += P[i][j] * x[j];
+      denom += x[i] * Px[i];
+      err -= theta[i] * x[i];
+      trace += P[i][i];
+    }
+    float lambda = trace > RM_P_MAX_TRACE ? 1.0f : RM_FORGET;
+
+    portENTER_CRITICAL(&mux);
+    for (uint8_t i = 0; i < RM_PARAMS; i++)
+    {
+      float k = Px[i] / denom;
+      theta[i] += k * err;
+      for (uint8_t j = 0; j < RM_PARAMS; j++)
+        P[i][j] = (P[i][j] - k * Px[j]) / lambda;
+    }
+    updates++;
+    errSq = updates == 1 ? err * err : errSq + (err * err - errSq) * 0.05f;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  float theta[RM_PARAMS];
+  float P[RM_PARAMS][RM_PARAMS];
+  uint32_t updates;
+  float errSq; // EMA của sai số dự báo bình phương, (°C/h)²
+  PredictConfig cfg = PREDICT_DEFAULT;
+  PredictPlan lastPlan = {};
+  uint32_t plans = 0;
+  uint32_t changes = 0;
+  volatile bool resetPending = false;
+  bool settingsPending = false; // requestSettings() chưa được loop() nhận
+  int8_t predictivePending = -1;
+  uint16_t lastMinuteOfDay = 0; // giờ RTC của mẫu cuối, cho ambientC
+
+  // Cửa sổ đang gom (chỉ loop)
+  uint32_t n;
+  uint32_t startMs = 0;
+  uint32_t lastMs = 0;
+  float sumT = 0;
+  float sumU = 0;
+  bool known = true; // mọi mẫu trong cửa sổ đều biết chắc u
+  bool hasPrev;
+  bool prevKnown = false;
+  float prevT = 0;
+  float prevU = 0;
+  uint32_t prevMidMs = 0;
+
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
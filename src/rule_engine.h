@@ -0,0 +1,446 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ RULE ENGINE (BẢNG LUẬT KHAI BÁO) ============
+// Luật = danh sách điều kiện (field op value) trên snapshot POD + 1 action.
+// Bảng mặc định là constexpr (nằm trong flash); ngưỡng có thể bị ghi đè lúc
+// chạy bằng bảng override (lưu NVS). Luật đầu tiên thỏa mãn sẽ thắng.
+// evaluate() không cấp phát, không tạo String.
+
+#define RULE_MAX_RULES 16
+#define RULE_MAX_CONDS 5
+#define RULE_MAX_OVERRIDES 16
+#define RULE_KEEP 0xFF // giữ nguyên fan / mode hiện tại
+
+enum RuleField : uint8_t
+{
+  RF_TEMP,         // 0.1°C
+  RF_HUMIDITY,     // 0.1%
+  RF_LIGHT,        // ADC thô
+  RF_PRESENCE,     // 1 = có người hoặc có chuyển động
+  RF_ABSENT_S,     // số giây kể từ lần cuối thấy người
+  RF_AC_ON,
+  RF_AC_TEMP,      // °C đang đặt
+  RF_AC_MODE,
+  RF_AC_FAN,
+  RF_HOUR,
+  RF_TEMP_OVER_SET, // (nhiệt độ phòng - nhiệt độ đặt), 0.1°C
+  RF_TEMP_ERR_ABS,  // |nhiệt độ phòng - nhiệt độ đặt|, 0.1°C
+  RF_FIELD_COUNT
+};
+
+enum RuleOp : uint8_t
+{
+  RO_EQ,
+  RO_NE,
+  RO_LT,
+  RO_LE,
+  RO_GT,
+  RO_GE,
+  RO_IN, // a <= x <= b; nếu a > b thì khoảng vòng qua 0 (vd giờ 22..6)
+  RO_OP_COUNT
+};
+
+enum RuleActionKind : uint8_t
+{
+  RA_TURN_OFF,
+  RA_TURN_ON,
+  RA_ADJUST
+};
+
+enum RuleTempMode : uint8_t
+{
+  RT_KEEP,
+  RT_SET,  // đặt đúng temp
+  RT_DELTA // cộng temp vào nhiệt độ đang đặt
+};
+
+struct RuleSnapshot
+{
+  int32_t field[RF_FIELD_COUNT];
+};
+
+struct RuleCondition
+{
+  uint8_t field;
+  uint8_t op;
+  int32_t a;
+  int32_t b; // chỉ dùng cho RO_IN
+};
+
+struct RuleAction
+{
+  uint8_t kind;
+  uint8_t tempMode;
+  int8_t temp;
+  uint8_t fan;  // hoặc RULE_KEEP
+  uint8_t mode; // hoặc RULE_KEEP
+};
+
+struct RuleDef
+{
+  const char *name;
+  const char *reason;
+  uint8_t condCount;
+  RuleCondition conds[RULE_MAX_CONDS];
+  RuleAction action;
+};
+
+#define RULE_OVR_VALUE 0x01   // thay a/b của điều kiện cond
+#define RULE_OVR_DISABLE 0x02 // tắt cả luật
+
+struct RuleOverride
+{
+  uint8_t rule;
+  uint8_t cond;
+  uint8_t flags;
+  int32_t a;
+  int32_t b;
+};
+
+struct RuleStats
+{
+  uint32_t hits;
+  uint32_t lastFiredMs;
+};
+
+struct RuleEvalStats
+{
+  uint32_t evals;
+  uint32_t fired;
+  uint32_t lastUs;
+  uint32_t maxUs;
+  uint64_t totalUs;
+};
+
+inline const char *ruleFieldToString(uint8_t field)
+{
+  static const char *const names[RF_FIELD_COUNT] = {
+      "temp_x10", "humidity_x10", "light", "presence", "absent_s", "ac_on",
+      "ac_temp", "ac_mode", "ac_fan", "hour", "temp_over_set_x10", "temp_err_abs_x10"};
+  return field < RF_FIELD_COUNT ? names[field] : "unknown";
+}
+
+inline const char *ruleOpToString(uint8_t op)
+{
+  static const char *const names[RO_OP_COUNT] = {"==", "!=", "<", "<=", ">", ">=", "in"};
+  return op < RO_OP_COUNT ? names[op] : "?";
+}
+
+inline const char *ruleActionToString(uint8_t kind)
+{
+  switch (kind)
+  {
+  case RA_TURN_OFF:
+    return "turn_off";
+  case RA_TURN_ON:
+    return "turn_on";
+  default:
+    return "adjust";
+  }
+}
+
+class RuleEngine
+{
+public:
+  void begin(const RuleDef *table, uint8_t count)
+  {
+    defs = table;
+    ruleCount = count > RULE_MAX_RULES ? RULE_MAX_RULES : count;
+    rebuild();
+  }
+
+  // Trả về index luật đầu tiên thỏa mãn, -1 nếu không có
+  int evaluate(const RuleSnapshot &snap, uint32_t nowMs)
+  {
+    uint32_t startUs = (uint32_t)esp_timer_get_time();
+    int fired = -1;
+
+    portENTER_CRITICAL(&mux);
+    for (uint8_t r = 0; r < ruleCount && fired < 0; r++)
+    {
+      if (!enabled[r])
+        continue;
+      const RuleCondition *conds = active[r];
+      uint8_t n = defs[r].condCount;
+      uint8_t i = 0;
+      while (i < n && test(conds[i], snap.field[conds[i].field]))
+        i++;
+      if (i == n)
+        fired = r;
+    }
+    if (fired >= 0)
+    {
+      ruleStats[fired].hits++;
+      ruleStats[fired].lastFiredMs = nowMs;
+      stats.fired++;
+    }
+
+    uint32_t elapsed = (uint32_t)esp_timer_get_time() - startUs;
+    stats.evals++;
+    stats.lastUs = elapsed;
+    stats.totalUs += elapsed;
+    if (elapsed > stats.maxUs)
+      stats.maxUs = elapsed;
+    portEXIT_CRITICAL(&mux);
+    return fired;
+  }
+
+  // Thêm/thay override. false nếu rule/cond không hợp lệ hoặc bảng đầy.
+  bool setOverride(const RuleOverride &o)
+  {
+    if (!validOverride(o))
+      return false;
+
+    portENTER_CRITICAL(&mux);
+    bool ok = putLocked(o);
+    if (ok)
+    {
+      rebuildLocked();
+      dirty = true;
+    }
+    portEXIT_CRITICAL(&mux);
+    return ok;
+  }
+
+  // Bật lại luật = xóa override DISABLE của nó
+  bool setEnabled(uint8_t rule, bool on)
+  {
+    if (!on)
+    {
+      RuleOverride o = {rule, 0, RULE_OVR_DISABLE, 0, 0};
+      return setOverride(o);
+    }
+    if (rule >= ruleCount)
+      return false;
+    portENTER_CRITICAL(&mux);
+    removeDisableLocked(rule);
+    rebuildLocked();
+    dirty = true;
+    portEXIT_CRITICAL(&mux);
+    return true;
+  }
+
+  // Đổi bật/tắt và giá trị 1 điều kiện của cùng 1 luật trong 1 lần: lỗi ở
+  // bất kỳ phần nào (kể cả bảng đầy) thì không đổi gì.
+  // enable: -1 giữ nguyên, 0 tắt, 1 bật; value = nullptr nếu không đổi giá trị.
+  bool update(uint8_t rule, int8_t enable, const RuleOverride *value)
+  {
+    if (rule >= ruleCount || (value && (value->rule != rule || !validOverride(*value))))
+      return false;
+
+    portENTER_CRITICAL(&mux);
+    RuleOverride saved[RULE_MAX_OVERRIDES];
+    uint8_t savedCount = overrideCount;
+    memcpy(saved, overrides, sizeof(saved));
+    bool ok = true;
+    if (enable == 1)
+      removeDisableLocked(rule);
+    else if (enable == 0)
+    {
+      RuleOverride o = {rule, 0, RULE_OVR_DISABLE, 0, 0};
+      ok = putLocked(o);
+    }
+    if (ok && value)
+      ok = putLocked(*value);
+    if (!ok)
+    {
+      memcpy(overrides, saved, sizeof(saved));
+      overrideCount = savedCount;
+    }
+    else
+      dirty = true;
+    rebuildLocked();
+    portEXIT_CRITICAL(&mux);
+    return ok;
+  }
+
+  // Nạp bảng override đã lưu; bỏ qua entry không hợp lệ (bảng luật đã đổi).
+  // Không đánh dấu dirty: bảng vừa nạp trùng với NVS.
+  void loadOverrides(const RuleOverride *list, uint8_t count)
+  {
+    clearOverrides();
+    for (uint8_t i = 0; i < count; i++)
+      setOverride(list[i]);
+    takeDirty();
+  }
+
+  void clearOverrides()
+  {
+    portENTER_CRITICAL(&mux);
+    overrideCount = 0;
+    rebuildLocked();
+    dirty = true;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // true nếu bảng override đổi từ lần lưu trước; handler HTTP chỉ đổi bảng,
+  // loop() lưu NVS
+  bool takeDirty()
+  {
+    portENTER_CRITICAL(&mux);
+    bool d = dirty;
+    dirty = false;
+    portEXIT_CRITICAL(&mux);
+    return d;
+  }
+
+  int findRule(const char *name) const
+  {
+    for (uint8_t r = 0; r < ruleCount; r++)
+    {
+      if (strcmp(defs[r].name, name) == 0)
+        return r;
+    }
+    return -1;
+  }
+
+  // Bản sao điều kiện đang áp dụng (đã tính override) cho endpoint /rules
+  void activeConditions(uint8_t rule, RuleCondition *out, bool &isEnabled, RuleStats &rs)
+  {
+    portENTER_CRITICAL(&mux);
+    memcpy(out, active[rule], sizeof(active[rule]));
+    isEnabled = enabled[rule];
+    rs = ruleStats[rule];
+    portEXIT_CRITICAL(&mux);
+  }
+
+  uint8_t copyOverrides(RuleOverride *out)
+  {
+    portENTER_CRITICAL(&mux);
+    uint8_t n = overrideCount;
+    memcpy(out, overrides, n * sizeof(RuleOverride));
+    portEXIT_CRITICAL(&mux);
+    return n;
+  }
+
+  RuleEvalStats getStats()
+  {
+    portENTER_CRITICAL(&mux);
+    RuleEvalStats copy = stats;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+  }
+
+  const RuleDef &rule(uint8_t i) const { return defs[i]; }
+  uint8_t count() const { return ruleCount; }
+
+  // Luật còn có thể chạy không khi các field có bit trong fixedMask luôn
+  // bằng fixed.field[...] (vd zone không lắp LDR/PIR)? Tính theo ngưỡng
+  // đang áp dụng; false = điều kiện trên field cố định không bao giờ thỏa.
+  bool applicable(uint8_t rule, uint32_t fixedMask, const RuleSnapshot &fixed)
+  {
+    if (rule >= ruleCount)
+      return false;
+    bool ok = true;
+    portENTER_CRITICAL(&mux);
+    for (uint8_t i = 0; i < defs[rule].condCount && ok; i++)
+    {
+      const RuleCondition &c = active[rule][i];
+      if (fixedMask & (1UL << c.field))
+        ok = test(c, fixed.field[c.field]);
+    }
+    portEXIT_CRITICAL(&mux);
+    return ok;
+  }
+
+private:
+  static bool test(const RuleCondition &c, int32_t v)
+  {
+    switch (c.op)
+    {
+    case RO_EQ:
+      return v == c.a;
+    case RO_NE:
+      return v != c.a;
+    case RO_LT:
+      return v < c.a;
+    case RO_LE:
+      return v <= c.a;
+    case RO_GT:
+      return v > c.a;
+    case RO_GE:
+      return v >= c.a;
+    case RO_IN:
+      return c.a <= c.b ? (v >= c.a && v <= c.b) : (v >= c.a || v <= c.b);
+    default:
+      return false;
+    }
+  }
+
+  void rebuild()
+  {
+    portENTER_CRITICAL(&mux);
+    rebuildLocked();
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void rebuildLocked()
+  {
+    for (uint8_t r = 0; r < ruleCount; r++)
+    {
+      memcpy(active[r], defs[r].conds, sizeof(active[r]));
+      enabled[r] = true;
+    }
+    for (uint8_t i = 0; i < overrideCount; i++)
+    {
+      const RuleOverride &o = overrides[i];
+      if (o.flags & RULE_OVR_DISABLE)
+        enabled[o.rule] = false;
+      if (o.flags & RULE_OVR_VALUE)
+      {
+        active[o.rule][o.cond].a = o.a;
+        active[o.rule][o.cond].b = o.b;
+      }
+    }
+  }
+
+  bool validOverride(const RuleOverride &o) const
+  {
+    return o.rule < ruleCount && !(o.flags & RULE_OVR_VALUE && o.cond >= defs[o.rule].condCount);
+  }
+
+  // Ghi đè override cùng đích hoặc thêm mới; false nếu bảng đầy. Giữ mux.
+  bool putLocked(const RuleOverride &o)
+  {
+    int slot = -1;
+    for (uint8_t i = 0; i < overrideCount; i++)
+    {
+      const RuleOverride &cur = overrides[i];
+      bool sameTarget = cur.rule == o.rule &&
+                        ((o.flags & RULE_OVR_VALUE) ? (cur.flags & RULE_OVR_VALUE) && cur.cond == o.cond
+                                                     : (cur.flags & RULE_OVR_DISABLE));
+      if (sameTarget)
+        slot = i;
+    }
+    if (slot < 0 && overrideCount < RULE_MAX_OVERRIDES)
+      slot = overrideCount++;
+    if (slot >= 0)
+      overrides[slot] = o;
+    return slot >= 0;
+  }
+
+  void removeDisableLocked(uint8_t rule)
+  {
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < overrideCount; i++)
+    {
+      if (overrides[i].rule == rule && (overrides[i].flags & RULE_OVR_DISABLE))
+        continue;
+      overrides[kept++] = overrides[i];
+    }
+    overrideCount = kept;
+  }
+
+  const RuleDef *defs = nullptr;
+  uint8_t ruleCount = 0;
+  RuleCondition active[RULE_MAX_RULES][RULE_MAX_CONDS];
+  bool enabled[RULE_MAX_RULES];
+  RuleOverride overrides[RULE_MAX_OVERRIDES];
+  uint8_t overrideCount = 0;
+  bool dirty = false;
+  RuleStats ruleStats[RULE_MAX_RULES] = {};
+  RuleEvalStats stats = {};
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
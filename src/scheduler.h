@@ -0,0 +1,135 @@
+#pragma once
+
+#include <Arduino.h>
+#include "stall_profiler.h"
+
+// ============ BỘ LẬP LỊCH HỢP TÁC (COOPERATIVE SCHEDULER) ============
+// Mỗi task có deadline riêng. loop() chỉ gọi tick(), không task nào được
+// delay() dài - việc cần chờ thì tự hẹn lại bằng runAfter().
+
+#define SCHED_MAX_TASKS 20
+
+typedef void (*SchedTaskFn)();
+
+struct SchedTask
+{
+  const char *name;
+  SchedTaskFn fn;
+  uint32_t periodMs;  // 0 = one-shot
+  uint32_t nextRunMs; // deadline kế tiếp (millis)
+  bool armed;
+
+  // Bộ đếm thời gian chạy
+  uint32_t runs;
+  uint32_t lastUs;
+  uint32_t maxUs;
+  uint64_t totalUs;
+};
+
+class CoopScheduler
+{
+public:
+  // Task định kỳ, chạy lần đầu sau firstDelayMs
+  int addPeriodic(const char *name, SchedTaskFn fn, uint32_t periodMs, uint32_t firstDelayMs = 0)
+  {
+    int id = add(name, fn, periodMs);
+    if (id >= 0)
+      runAfter(id, firstDelayMs);
+    return id;
+  }
+
+  // Task one-shot, chỉ chạy khi được runAfter()
+  int addOneShot(const char *name, SchedTaskFn fn)
+  {
+    return add(name, fn, 0);
+  }
+
+  // Hẹn (lại) deadline cho task: dùng cho one-shot hoặc dời task định kỳ
+  void runAfter(int id, uint32_t delayMs)
+  {
+    if (id < 0 || id >= taskCount)
+      return;
+    tasks[id].nextRunMs = millis() + delayMs;
+    tasks[id].armed = true;
+  }
+
+  void cancel(int id)
+  {
+    if (id >= 0 && id < taskCount)
+      tasks[id].armed = false;
+  }
+
+  bool isArmed(int id) const
+  {
+    return id >= 0 && id < taskCount && tasks[id].armed;
+  }
+
+  // Chạy mọi task đến hạn, mỗi task tối đa 1 lần / tick
+  void tick()
+  {
+    PROF_SCOPE("loop", STALL_LOOP_BUDGET_US);
+    uint32_t tickStart = micros();
+
+    for (int i = 0; i < taskCount; i++)
+    {
+      SchedTask &t = tasks[i];
+      if (!t.armed || (int32_t)(millis() - t.nextRunMs) < 0)
+        continue;
+
+      if (t.periodMs == 0)
+      {
+        t.armed = false; // task có thể tự runAfter() lại trong fn()
+      }
+      else
+      {
+        t.nextRunMs += t.periodMs;
+        // Bị trễ quá 1 chu kỳ → bỏ các lần lỡ, không chạy dồn
+        if ((int32_t)(millis() - t.nextRunMs) >= 0)
+          t.nextRunMs = millis() + t.periodMs;
+      }
+
+      uint32_t start = micros();
+      {
+        PROF_SCOPE(t.name, STALL_TASK_BUDGET_US);
+        t.fn();
+      }
+      uint32_t elapsed = micros() - start;
+
+      t.runs++;
+      t.lastUs = elapsed;
+      t.totalUs += elapsed;
+      if (elapsed > t.maxUs)
+        t.maxUs = elapsed;
+    }
+
+    uint32_t tickUs = micros() - tickStart;
+    loopCount++;
+    loopLastUs = tickUs;
+    if (tickUs > loopMaxUs)
+      loopMaxUs = tickUs;
+  }
+
+  int count() const { return taskCount; }
+  const SchedTask &task(int id) const { return tasks[id]; }
+
+  uint32_t loopCount = 0;
+  uint32_t loopLastUs = 0;
+  uint32_t loopMaxUs = 0;
+
+private:
+  int add(const char *name, SchedTaskFn fn, uint32_t periodMs)
+  {
+    if (taskCount >= SCHED_MAX_TASKS)
+      return -1;
+    SchedTask &t = tasks[taskCount];
+    t = SchedTask();
+    t.name = name;
+    t.fn = fn;
+    t.periodMs = periodMs;
+    t.armed = false;
+    return taskCount++;
+  }
+
+  SchedTask tasks[SCHED_MAX_TASKS];
+  int taskCount = 0;
+};
@@ -0,0 +1,509 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "controller.h"
+#include "timer_wheel.h"
+
+// ============ LỊCH HẸN GIỜ AC ============
+// 3 loại lịch, mỗi lịch mang 1 lệnh AC (các trường AC_SET_* như /ac/command):
+//   once    chạy 1 lần lúc "at"                 vd bật 24°C lúc 06:30 mai
+//   weekly  lặp theo thứ trong tuần + giờ:phút  vd tắt 23:00 T2-T6
+//   timer   đếm ngược, lưu thành "at" tuyệt đối vd tắt sau 2 giờ
+// Thời gian là giây theo giờ địa phương lấy từ RTC (RTC giữ giờ VN, không
+// có múi giờ), nên "06:30" luôn là 06:30 trên LCD. Mỗi lịch có 1 timer trong
+// TimerWheel theo index slot: thêm/xóa O(1), mỗi giây loop() chỉ xử lý slot
+// tới hạn thay vì quét cả bảng. Bảng chỉ quét toàn bộ khi khởi động hoặc
+// đồng hồ nhảy (chỉnh giờ RTC), lúc đó lịch trễ quá SCHEDULE_GRACE_S bị bỏ
+// (once/timer) hoặc dời sang lần kế (weekly). Handler HTTP sửa bảng trên
+// async_tcp → khóa portMUX; loop() lưu NVS khi bảng đổi (takeDirty()).
+
+#define SCHEDULE_MAX 256
+#define SCHEDULE_GRACE_S 120       // khởi động / chỉnh giờ trễ hơn thì bỏ lần đó
+#define SCHEDULE_CATCHUP_S 300     // đồng hồ nhảy xa hơn → dựng lại wheel
+#define SCHEDULE_MIN_TIME 1704067200UL // 2024-01-01: RTC chưa đặt giờ → tạm dừng
+#define SCHEDULE_DUE_BATCH 8       // lịch áp dụng tối đa / tick, phần còn lại tick sau
+#define SCHEDULE_PAGE_MAX 16
+
+enum ScheduleKind : uint8_t
+{
+  SK_ONCE,
+  SK_WEEKLY,
+  SK_TIMER
+};
+
+// Lưu NVS nguyên struct → chỉ thêm trường vào cuối
+struct Schedule
+{
+  uint16_t id;     // 0 = slot trống
+  uint8_t kind;    // ScheduleKind
+  uint8_t days;    // SK_WEEKLY: bit 0 = CN ... bit 6 = T7
+  uint16_t minute; // SK_WEEKLY: phút trong ngày
+  uint8_t fields;  // AC_SET_*
+  bool enabled;
+  AcState value;
+  uint32_t at; // SK_ONCE / SK_TIMER: thời điểm chạy
+};
+
+struct ScheduleStats
+{
+  uint16_t count;
+  uint16_t armed;
+  uint32_t fired;
+  uint32_t missed;   // bỏ vì trễ quá SCHEDULE_GRACE_S
+  uint32_t rebuilds; // khởi động + đồng hồ nhảy
+};
+
+static_assert(sizeof(Schedule) == 16, "Schedule lưu NVS: đổi layout sẽ hỏng dữ liệu cũ");
+
+// ===== Lịch dương (Howard Hinnant, days_from_civil) =====
+inline uint32_t scheduleDaysFromCivil(int y, unsigned m, unsigned d)
+{
+  y -= m <= 2;
+  int era = y / 400;
+  unsigned yoe = y - era * 400;
+  unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// "YYYY-MM-DD HH:MM:SS"
+inline void formatScheduleTime(uint32_t t, char *out, size_t size)
+{
+  uint32_t z = t / 86400 + 719468;
+  uint32_t era = z / 146097;
+  uint32_t doe = z - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  unsigned d = doy - (153 * mp + 2) / 5 + 1;
+  unsigned m = mp < 10 ? mp + 3 : mp - 9;
+  unsigned y = yoe + era * 400 + (m <= 2);
+  uint32_t s = t % 86400;
+  snprintf(out, size, "%04u-%02u-%02u %02u:%02u:%02u", y, m, d,
+           (unsigned)(s / 3600), (unsigned)(s / 60 % 60), (unsigned)(s % 60));
+}
+
+// 0 = CN (1970-01-01 là thứ Năm)
+inline uint8_t scheduleWeekday(uint32_t t)
+{
+  return (t / 86400 + 4) % 7;
+}
+
+// Lần chạy đầu tiên > after; 0 nếu days rỗng
+inline uint32_t nextWeeklyFire(uint8_t days, uint16_t minute, uint32_t after)
+{
+  uint32_t day = after / 86400;
+  for (uint8_t i = 0; i <= 7; i++)
+  {
+    uint32_t fire = (day + i) * 86400 + minute * 60UL;
+    if (fire > after && (days & (1 << scheduleWeekday(fire))))
+      return fire;
+  }
+  return 0;
+}
+
+// "HH:MM" → phút trong ngày, -1 nếu sai
+inline int parseScheduleClock(const char *text)
+{
+  unsigned h, m;
+  char tail;
+  if (!text || sscanf(text, "%u:%u%c", &h, &m, &tail) != 2 || h > 23 || m > 59)
+    return -1;
+  return h * 60 + m;
+}
+
+// "YYYY-MM-DD" → số ngày từ 1970, -1 nếu sai
+inline int32_t parseScheduleDate(const char *text)
+{
+  unsigned y, m, d;
+  char tail;
+  if (!text || sscanf(text, "%u-%u-%u%c", &y, &m, &d, &tail) != 3 || y < 2024 || y > 2099 || m < 1 || m > 12 || d < 1)
+    return -1;
+  static const uint8_t MONTH_DAYS[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  bool leap = y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+  if (d > MONTH_DAYS[m - 1] || (m == 2 && d == 29 && !leap))
+    return -1;
+  return scheduleDaysFromCivil(y, m, d);
+}
+
+static const char *const SCHEDULE_DAY_NAMES[7] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+// "daily" | "weekdays" | "weekend" | "mon,wed,fri" → bitmask, 0 nếu sai
+inline uint8_t parseScheduleDays(const char *text)
+{
+  if (!text)
+    return 0;
+  if (!strcmp(text, "daily"))
+    return 0x7F;
+  if (!strcmp(text, "weekdays"))
+    return 0x3E;
+  if (!strcmp(text, "weekend"))
+    return 0x41;
+
+  uint8_t mask = 0;
+  const char *p = text;
+  while (*p)
+  {
+    int day = -1;
+    for (uint8_t i = 0; i < 7; i++)
+      if (!strncmp(p, SCHEDULE_DAY_NAMES[i], 3))
+        day = i;
+    if (day < 0 || (p[3] != ',' && p[3] != '\0'))
+      return 0;
+    mask |= 1 << day;
+    p += p[3] ? 4 : 3;
+  }
+  return mask;
+}
+
+inline void scheduleDaysToString(uint8_t days, char *out, size_t size)
+{
+  size_t len = 0;
+  out[0] = '\0';
+  for (uint8_t i = 0; i < 7 && len + 4 < size; i++)
+    if (days & (1 << i))
+      len += snprintf(out + len, size - len, len ? ",%s" : "%s", SCHEDULE_DAY_NAMES[i]);
+}
+
+inline const char *scheduleKindToString(uint8_t kind)
+{
+  switch (kind)
+  {
+  case SK_WEEKLY:
+    return "weekly";
+  case SK_TIMER:
+    return "timer";
+  default:
+    return "once";
+  }
+}
+
+// Lịch mới/sửa từ JSON. nowS = giờ RTC hiện tại. nullptr nếu hợp lệ, ngược
+// lại là thông báo lỗi (chuỗi hằng).
+//   {"type":"once","time":"06:30","date":"2026-10-17","status":true,"temperature":24}
+//   {"type":"weekly","days":"weekdays","time":"23:00","status":false}
+//   {"type":"timer","after_min":120,"status":false}
+inline const char *scheduleFromJson(const JsonDocument &doc, uint32_t nowS, Schedule &s)
+{
+  memset(&s, 0, sizeof(s));
+  AcCommand cmd = {0, {false, 0, 0, 0}, "SCHEDULE"};
+  acCommandFromJson(doc, cmd);
+  if (cmd.fields == 0)
+    return "No valid settings";
+  s.fields = cmd.fields;
+  s.value = cmd.value;
+  s.enabled = doc.containsKey("enabled") ? doc["enabled"].as<bool>() : true;
+
+  const char *type = doc["type"].as<const char *>();
+  int minute = parseScheduleClock(doc["time"].as<const char *>());
+  if (!type || !strcmp(type, "once"))
+  {
+    s.kind = SK_ONCE;
+    if (doc.containsKey("at"))
+    {
+      s.at = doc["at"].as<uint32_t>();
+    }
+    else if (minute < 0)
+    {
+      return "Missing time (HH:MM)";
+    }
+    else if (doc.containsKey("date"))
+    {
+      int32_t day = parseScheduleDate(doc["date"].as<const char *>());
+      if (day < 0)
+        return "Invalid date (YYYY-MM-DD)";
+      s.at = day * 86400UL + minute * 60UL;
+    }
+    else
+    {
+      s.at = nextWeeklyFire(0x7F, minute, nowS); // lần tới của giờ đó
+    }
+    if (s.at <= nowS)
+      return "Time is in the past";
+  }
+  else if (!strcmp(type, "weekly"))
+  {
+    s.kind = SK_WEEKLY;
+    s.days = parseScheduleDays(doc["days"].as<const char *>());
+    if (!s.days)
+      return "Invalid days (daily|weekdays|weekend|mon,tue,...)";
+    if (minute < 0)
+      return "Missing time (HH:MM)";
+    s.minute = minute;
+  }
+  else if (!strcmp(type, "timer"))
+  {
+    s.kind = SK_TIMER;
+    uint32_t after = doc.containsKey("after_s") ? doc["after_s"].as<uint32_t>() : doc["after_min"].as<uint32_t>() * 60UL;
+    if (after == 0 || after > TW_HORIZON_S)
+      return "Invalid after_s / after_min";
+    s.at = nowS + after;
+  }
+  else
+  {
+    return "Invalid type (once|weekly|timer)";
+  }
+  return nullptr;
+}
+
+// nextFire = 0: lịch đang tắt
+inline void scheduleToJson(const Schedule &s, uint32_t nextFire, uint32_t nowS, JsonObject out)
+{
+  char buf[32];
+  out["id"] = s.id;
+  out["type"] = scheduleKindToString(s.kind);
+  out["enabled"] = s.enabled;
+  if (s.kind == SK_WEEKLY)
+  {
+    scheduleDaysToString(s.days, buf, sizeof(buf));
+    out["days"] = (const char *)buf; // ArduinoJson chép chuỗi
+    snprintf(buf, sizeof(buf), "%02u:%02u", s.minute / 60, s.minute % 60);
+    out["time"] = (const char *)buf;
+  }
+  else
+  {
+    formatScheduleTime(s.at, buf, sizeof(buf));
+    out["at"] = (const char *)buf;
+  }
+  if (nextFire)
+  {
+    formatScheduleTime(nextFire, buf, sizeof(buf));
+    out["next_fire"] = (const char *)buf;
+    out["in_s"] = nextFire > nowS ? nextFire - nowS : 0;
+  }
+
+  if (s.fields & AC_SET_POWER)
+    out["status"] = s.value.power;
+  if (s.fields & AC_SET_TEMP)
+    out["temperature"] = s.value.temp;
+  if (s.fields & AC_SET_MODE)
+    out["mode"] = acModeToString(s.value.mode);
+  if (s.fields & AC_SET_FAN)
+    out["fan_speed"] = fanSpeedToString((FanSpeed)s.value.fan);
+}
+
+class ScheduleTable
+{
+public:
+  // setup(): lịch đã lưu; wheel dựng ở tick() đầu tiên có giờ hợp lệ
+  void load(const Schedule *saved, uint16_t count)
+  {
+    portENTER_CRITICAL(&mux);
+    memset(slots, 0, sizeof(slots));
+    nextId = 1;
+    for (uint16_t i = 0; i < count && i < SCHEDULE_MAX; i++)
+    {
+      slots[i] = saved[i];
+      if (slots[i].id >= nextId)
+        nextId = slots[i].id + 1;
+    }
+    started = false;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Giờ RTC loop() thấy gần nhất, 0 nếu RTC chưa đặt giờ
+  uint32_t now()
+  {
+    portENTER_CRITICAL(&mux);
+    uint32_t t = started ? lastNowS : 0;
+    portEXIT_CRITICAL(&mux);
+    return t;
+  }
+
+  // id mới, 0 nếu bảng đầy hoặc chưa có giờ
+  uint16_t add(const Schedule &s)
+  {
+    portENTER_CRITICAL(&mux);
+    uint16_t id = 0;
+    int16_t i = started ? findSlot(0) : -1;
+    if (i >= 0)
+    {
+      id = allocId();
+      slots[i] = s;
+      slots[i].id = id;
+      arm(i, lastNowS, 0);
+      dirty = true;
+    }
+    portEXIT_CRITICAL(&mux);
+    return id;
+  }
+
+  bool update(uint16_t id, const Schedule &s)
+  {
+    portENTER_CRITICAL(&mux);
+    int16_t i = id && started ? findSlot(id) : -1;
+    if (i >= 0)
+    {
+      slots[i] = s;
+      slots[i].id = id;
+      arm(i, lastNowS, 0);
+      dirty = true;
+    }
+    portEXIT_CRITICAL(&mux);
+    return i >= 0;
+  }
+
+  bool remove(uint16_t id)
+  {
+    portENTER_CRITICAL(&mux);
+    int16_t i = id ? findSlot(id) : -1;
+    if (i >= 0)
+    {
+      wheel.remove(i);
+      slots[i].id = 0;
+      dirty = true;
+    }
+    portEXIT_CRITICAL(&mux);
+    return i >= 0;
+  }
+
+  // Trang [offset, offset + limit) theo thứ tự slot; nextFire[i] = 0 nếu không hẹn
+  uint16_t page(uint16_t offset, uint16_t limit, Schedule *out, uint32_t *nextFire)
+  {
+    uint16_t n = 0, seen = 0;
+    portENTER_CRITICAL(&mux);
+    for (uint16_t i = 0; i < SCHEDULE_MAX && n < limit; i++)
+    {
+      if (!slots[i].id || seen++ < offset)
+        continue;
+      out[n] = slots[i];
+      nextFire[n] = wheel.armed(i) ? wheel.expiresAt(i) : 0;
+      n++;
+    }
+    portEXIT_CRITICAL(&mux);
+    return n;
+  }
+
+  // Bản gọn để lưu NVS
+  uint16_t copyAll(Schedule *out)
+  {
+    uint16_t n = 0;
+    portENTER_CRITICAL(&mux);
+    for (const Schedule &s : slots)
+      if (s.id)
+        out[n++] = s;
+    portEXIT_CRITICAL(&mux);
+    return n;
+  }
+
+  // loop(), mỗi giây: chép tối đa maxDue lịch tới hạn vào due
+  uint8_t tick(uint32_t nowS, Schedule *due, uint8_t maxDue)
+  {
+    if (nowS < SCHEDULE_MIN_TIME)
+      return 0;
+
+    portENTER_CRITICAL(&mux);
+    int32_t ahead = nowS - wheel.now();
+    if (!started || ahead < -1 || ahead > SCHEDULE_CATCHUP_S)
+      rebuild(nowS);
+    lastNowS = nowS;
+    wheel.advance(nowS);
+
+    uint8_t n = 0;
+    int16_t i;
+    while (n < maxDue && (i = wheel.popDue()) != TW_NONE)
+    {
+      Schedule &s = slots[i];
+      due[n++] = s;
+      stats.fired++;
+      if (s.kind == SK_WEEKLY)
+      {
+        wheel.insert(i, nextWeeklyFire(s.days, s.minute, wheel.expiresAt(i)));
+      }
+      else
+      {
+        s.id = 0;
+        dirty = true;
+      }
+    }
+    portEXIT_CRITICAL(&mux);
+    return n;
+  }
+
+  // true nếu bảng đổi từ lần lưu trước
+  bool takeDirty()
+  {
+    portENTER_CRITICAL(&mux);
+    bool d = dirty;
+    dirty = false;
+    portEXIT_CRITICAL(&mux);
+    return d;
+  }
+
+  ScheduleStats getStats()
+  {
+    portENTER_CRITICAL(&mux);
+    ScheduleStats copy = stats;
+    copy.count = 0;
+    copy.armed = 0;
+    for (uint16_t i = 0; i < SCHEDULE_MAX; i++)
+    {
+      copy.count += slots[i].id != 0;
+      copy.armed += wheel.armed(i);
+    }
+    portEXIT_CRITICAL(&mux);
+    return copy;
+  }
+
+private:
+  int16_t findSlot(uint16_t id)
+  {
+    for (uint16_t i = 0; i < SCHEDULE_MAX; i++)
+      if (slots[i].id == id)
+        return i;
+    return -1;
+  }
+
+  // Tăng dần, bỏ qua 0 và id còn dùng (sau khi tràn uint16_t)
+  uint16_t allocId()
+  {
+    uint16_t id = nextId;
+    while (id == 0 || findSlot(id) >= 0)
+      id++;
+    nextId = id + 1;
+    return id;
+  }
+
+  // Hẹn timer cho slot i. graceS > 0 (khởi động, đồng hồ nhảy): lịch trễ
+  // trong graceS vẫn chạy, trễ hơn thì once/timer bị bỏ
+  void arm(uint16_t i, uint32_t nowS, uint32_t graceS)
+  {
+    Schedule &s = slots[i];
+    wheel.remove(i);
+    if (!s.id || !s.enabled)
+      return;
+    if (s.kind == SK_WEEKLY)
+    {
+      wheel.insert(i, nextWeeklyFire(s.days, s.minute, nowS - graceS - 1));
+    }
+    else if (s.at + graceS < nowS)
+    {
+      s.id = 0;
+      stats.missed++;
+      dirty = true;
+    }
+    else
+    {
+      wheel.insert(i, s.at);
+    }
+  }
+
+  void rebuild(uint32_t nowS)
+  {
+    wheel.reset(nowS);
+    for (uint16_t i = 0; i < SCHEDULE_MAX; i++)
+      arm(i, nowS, SCHEDULE_GRACE_S);
+    started = true;
+    stats.rebuilds++;
+  }
+
+  Schedule slots[SCHEDULE_MAX] = {};
+  TimerWheel<SCHEDULE_MAX> wheel;
+  ScheduleStats stats = {};
+  uint32_t lastNowS = 0;
+  uint16_t nextId = 1;
+  bool started = false;
+  bool dirty = false;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
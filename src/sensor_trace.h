@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ SENSOR TRACE (GHI / PHÁT LẠI) ============
+// Mỗi lần sensorTask() chạy, đầu vào của bộ điều khiển được ghi thành 1 bản
+// ghi 12 byte vào ring RAM. Host kéo về qua GET /trace?since=<seq> (nối
+// thẳng các response vào 1 file) rồi phát lại bằng env:native --replay.
+//
+// Response / file = chuỗi các chunk, little-endian:
+//   header 16 byte: "DKTR" | version u8 | recordSize u8 | 0 u16 | firstSeq u32 | count u32
+//   count bản ghi 12 byte:
+//     rtc u32        giờ RTC (giờ địa phương) dạng epoch giây
+//     tempX10 i16    TRACE_NO_CLIMATE nếu DHT22 chưa có mẫu
+//     humX10 u16
+//     light u16      bit 15 = PIR, bit 0..11 = LDR (ADC 12 bit)
+//     distanceCm u16 TRACE_NO_DISTANCE nếu radar không có echo
+
+#define TRACE_MAGIC "DKTR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+#define TRACE_RECORD_SIZE 12
+#define TRACE_NO_CLIMATE -32768
+#define TRACE_NO_DISTANCE 0xFFFF
+#define TRACE_PIR_BIT 0x8000
+#define TRACE_LIGHT_MASK 0x0FFF
+
+#ifndef TRACE_RING_RECORDS
+#define TRACE_RING_RECORDS 1024 // ~34 phút ở 1 mẫu / 2s, 12KB
+#endif
+
+struct TraceSample
+{
+  uint32_t rtc;
+  bool climateValid;
+  float temperature;
+  float humidity;
+  int16_t light;
+  bool pir;
+  bool hasDistance;
+  float distanceCm;
+};
+
+inline void tracePut16(uint8_t *p, uint16_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+inline void tracePut32(uint8_t *p, uint32_t v)
+{
+  tracePut16(p, (uint16_t)v);
+  tracePut16(p + 2, (uint16_t)(v >> 16));
+}
+
+inline uint16_t traceGet16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+inline uint32_t traceGet32(const uint8_t *p) { return traceGet16(p) | ((uint32_t)traceGet16(p + 2) << 16); }
+
+inline void traceEncode(const TraceSample &s, uint8_t *out)
+{
+  tracePut32(out, s.rtc);
+  tracePut16(out + 4, (uint16_t)(s.climateValid ? (int16_t)lroundf(s.temperature * 10) : TRACE_NO_CLIMATE));
+  tracePut16(out + 6, (uint16_t)(s.climateValid ? lroundf(s.humidity * 10) : 0));
+  tracePut16(out + 8, (uint16_t)((s.light & TRACE_LIGHT_MASK) | (s.pir ? TRACE_PIR_BIT : 0)));
+  long cm = TRACE_NO_DISTANCE;
+  if (s.hasDistance)
+    cm = constrain(lroundf(s.distanceCm), 0L, (long)TRACE_NO_DISTANCE - 1);
+  tracePut16(out + 10, (uint16_t)cm);
+}
+
+inline void traceDecode(const uint8_t *in, TraceSample &s)
+{
+  s.rtc = traceGet32(in);
+  int16_t t = (int16_t)traceGet16(in + 4);
+  s.climateValid = t != TRACE_NO_CLIMATE;
+  s.temperature = s.climateValid ? t / 10.0f : 0;
+  s.humidity = traceGet16(in + 6) / 10.0f;
+  uint16_t light = traceGet16(in + 8);
+  s.light = light & TRACE_LIGHT_MASK;
+  s.pir = (light & TRACE_PIR_BIT) != 0;
+  uint16_t cm = traceGet16(in + 10);
+  s.hasDistance = cm != TRACE_NO_DISTANCE;
+  s.distanceCm = s.hasDistance ? cm : 0;
+}
+
+inline void traceEncodeHeader(uint32_t firstSeq, uint32_t count, uint8_t *out)
+{
+  memcpy(out, TRACE_MAGIC, 4);
+  out[4] = TRACE_VERSION;
+  out[5] = TRACE_RECORD_SIZE;
+  tracePut16(out + 6, 0);
+  tracePut32(out + 8, firstSeq);
+  tracePut32(out + 12, count);
+}
+
+// false nếu không phải header hợp lệ
+inline bool traceDecodeHeader(const uint8_t *in, uint32_t &firstSeq, uint32_t &count)
+{
+  if (memcmp(in, TRACE_MAGIC, 4) != 0 || in[4] != TRACE_VERSION || in[5] != TRACE_RECORD_SIZE)
+    return false;
+  firstSeq = traceGet32(in + 8);
+  count = traceGet32(in + 12);
+  return true;
+}
+
+// Ring bản ghi đã mã hóa: loop ghi, async_tcp đọc
+class SensorTraceRing
+{
+public:
+  void push(const TraceSample &s)
+  {
+    uint8_t rec[TRACE_RECORD_SIZE];
+    traceEncode(s, rec);
+    portENTER_CRITICAL(&mux);
+    memcpy(buf[nextSeq % TRACE_RING_RECORDS], rec, TRACE_RECORD_SIZE);
+    nextSeq++;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Copy tối đa max bản ghi từ seq >= since (hoặc cũ nhất còn giữ);
+  // firstSeq = seq của bản ghi đầu tiên được copy
+  uint32_t copy(uint32_t since, uint8_t *out, uint32_t max, uint32_t &firstSeq)
+  {
+    portENTER_CRITICAL(&mux);
+    uint32_t oldest = nextSeq > TRACE_RING_RECORDS ? nextSeq - TRACE_RING_RECORDS : 0;
+    uint32_t seq = since < oldest ? oldest : since;
+    firstSeq = seq;
+    uint32_t n = 0;
+    for (; seq < nextSeq && n < max; seq++, n++)
+      memcpy(out + n * TRACE_RECORD_SIZE, buf[seq % TRACE_RING_RECORDS], TRACE_RECORD_SIZE);
+    portEXIT_CRITICAL(&mux);
+    return n;
+  }
+
+  uint32_t nextSequence() const { return nextSeq; }
+
+private:
+  uint8_t buf[TRACE_RING_RECORDS][TRACE_RECORD_SIZE];
+  uint32_t nextSeq = 0;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// ============ SEQLOCK SLOT (1 WRITER, NHIỀU READER) ============
+// Reader không khóa: đọc bản sao rồi kiểm tra lại số thứ tự, nếu writer đang
+// ghi giữa chừng thì đọc lại. Writer ghi trong critical section ngắn để task
+// reader ưu tiên cao hơn trên cùng core không thể chen vào giữa lúc ghi
+// (nếu không reader sẽ quay vòng mãi).
+
+template <typename T>
+class SeqSlot
+{
+public:
+  void publish(const T &value)
+  {
+    portENTER_CRITICAL(&writerMux);
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    data = value;
+    seq.store(s + 2, std::memory_order_release);
+    portEXIT_CRITICAL(&writerMux);
+  }
+
+  T read() const
+  {
+    for (;;)
+    {
+      uint32_t s1 = seq.load(std::memory_order_acquire);
+      if (s1 & 1)
+        continue;
+      T copy = data;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq.load(std::memory_order_relaxed) == s1)
+        return copy;
+    }
+  }
+
+  // Số lần publish (tăng đơn điệu)
+  uint32_t version() const
+  {
+    return seq.load(std::memory_order_acquire) >> 1;
+  }
+
+private:
+  T data = T();
+  std::atomic<uint32_t> seq{0};
+  portMUX_TYPE writerMux = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ PHÁT HIỆN LOOP BỊ ĐỨNG (STALL PROFILER) ============
+// PROF_SCOPE("tên", budgetUs) đánh dấu 1 đoạn trong loop(); các đoạn lồng
+// nhau tạo thành stack. Khi ra khỏi scope mà thời gian vượt budget, 1 bản
+// ghi stall vào ring: đoạn nào, lúc nào, bao lâu, và đoạn con tốn nhiều
+// nhất bên trong ("blame"). Đoạn không vượt budget chỉ tốn 2 lần đọc timer.
+// Chỉ loop task tạo scope; task khác (HTTP) chỉ đọc ring qua copyStalls().
+
+#define STALL_RING_SIZE 16
+#define STALL_MAX_DEPTH 8
+#define STALL_LOOP_BUDGET_US 50000 // 1 tick scheduler
+#define STALL_TASK_BUDGET_US 20000 // 1 task của scheduler
+#define STALL_IO_BUDGET_US 5000    // 1 thao tác I2C / Serial / flash
+
+struct StallRecord
+{
+  uint32_t seq;
+  const char *section; // chuỗi hằng
+  const char *blame;   // đoạn con lâu nhất, "" nếu không có
+  uint8_t depth;
+  int64_t startUs; // esp_timer_get_time()
+  uint32_t durUs;
+  uint32_t budgetUs;
+  int64_t blameStartUs;
+  uint32_t blameUs;
+};
+
+struct StallStats
+{
+  uint32_t scopes;
+  uint32_t stalls;
+  uint32_t overflows; // scope lồng sâu hơn STALL_MAX_DEPTH, không đo
+  uint32_t maxStallUs;
+  const char *maxStallSection;
+};
+
+class StallProfiler
+{
+public:
+  // Trả về false nếu quá sâu (scope đó không được đo)
+  bool enter(const char *name, uint32_t budgetUs)
+  {
+    if (depth >= STALL_MAX_DEPTH)
+    {
+      stats.overflows++;
+      return false;
+    }
+    Frame &f = stack[depth++];
+    f.name = name;
+    f.budgetUs = budgetUs;
+    f.childName = "";
+    f.childStartUs = 0;
+    f.childUs = 0;
+    f.startUs = esp_timer_get_time();
+    return true;
+  }
+
+  void exit()
+  {
+    int64_t endUs = esp_timer_get_time();
+    Frame &f = stack[--depth];
+    uint32_t dur = (uint32_t)(endUs - f.startUs);
+    stats.scopes++;
+
+    if (dur > f.budgetUs)
+      record(f, dur);
+
+    // Báo lên đoạn cha: đoạn con lâu nhất
+    if (depth > 0)
+    {
+      Frame &parent = stack[depth - 1];
+      if (dur > parent.childUs)
+      {
+        parent.childName = f.name;
+        parent.childStartUs = f.startUs;
+        parent.childUs = dur;
+      }
+    }
+  }
+
+  // Copy tối đa max bản ghi, mới nhất trước
+  uint8_t copyStalls(StallRecord *out, uint8_t max)
+  {
+    portENTER_CRITICAL(&mux);
+    uint8_t n = count < max ? count : max;
+    for (uint8_t i = 0; i < n; i++)
+      out[i] = ring[(head + STALL_RING_SIZE - 1 - i) % STALL_RING_SIZE];
+    portEXIT_CRITICAL(&mux);
+    return n;
+  }
+
+  StallStats getStats()
+  {
+    portENTER_CRITICAL(&mux);
+    StallStats copy = stats;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+  }
+
+private:
+  struct Frame
+  {
+    const char *name;
+    uint32_t budgetUs;
+    int64_t startUs;
+    const char *childName;
+    int64_t childStartUs;
+    uint32_t childUs;
+  };
+
+  void record(const Frame &f, uint32_t dur)
+  {
+    portENTER_CRITICAL(&mux);
+    StallRecord &r = ring[head];
+    r.seq = stats.stalls++;
+    r.section = f.name;
+    r.blame = f.childName;
+    r.depth = depth;
+    r.startUs = f.startUs;
+    r.durUs = dur;
+    r.budgetUs = f.budgetUs;
+    r.blameStartUs = f.childStartUs;
+    r.blameUs = f.childUs;
+    head = (head + 1) % STALL_RING_SIZE;
+    if (count < STALL_RING_SIZE)
+      count++;
+    if (dur > stats.maxStallUs)
+    {
+      stats.maxStallUs = dur;
+      stats.maxStallSection = f.name;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  Frame stack[STALL_MAX_DEPTH];
+  uint8_t depth = 0;
+  StallRecord ring[STALL_RING_SIZE];
+  uint8_t head = 0;
+  uint8_t count = 0;
+  StallStats stats = {0, 0, 0, 0, ""};
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+extern StallProfiler stallProfiler;
+
+class StallScope
+{
+public:
+  StallScope(const char *name, uint32_t budgetUs) : active(stallProfiler.enter(name, budgetUs)) {}
+  ~StallScope()
+  {
+    if (active)
+      stallProfiler.exit();
+  }
+
+private:
+  bool active;
+};
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+// PROF_SCOPE("lcd_i2c", STALL_IO_BUDGET_US); name phải là chuỗi hằng
+#define PROF_SCOPE(name, budgetUs) StallScope PROF_CONCAT(_profScope, __LINE__)(name, budgetUs)
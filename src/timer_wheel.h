@@ -0,0 +1,187 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ TIMER WHEEL PHÂN CẤP ============
+// 4 tầng x 64 slot, đơn vị 1 giây: tầng 0 chứa timer hết hạn trong 64 s tới,
+// tầng 1 trong 64² s (~68 phút), tầng 2 ~3 ngày, tầng 3 ~194 ngày. Mỗi slot
+// là danh sách liên kết đôi theo index (không cấp phát) nên thêm/xóa O(1).
+// Mỗi giây chỉ xử lý 1 slot tầng 0; khi tầng dưới quay hết vòng thì slot kế
+// của tầng trên được đổ xuống (cascade), mỗi timer bị đổ tối đa 3 lần.
+// Timer hết hạn chuyển sang danh sách "due", người dùng lấy dần bằng popDue().
+// Không tự khóa: người gọi giữ mutex nếu dùng từ nhiều task.
+
+#define TW_LEVELS 4
+#define TW_BITS 6
+#define TW_SLOTS (1 << TW_BITS)
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_HORIZON_S ((1UL << (TW_LEVELS * TW_BITS)) - 1)
+#define TW_NONE -1
+
+template <uint16_t N>
+class TimerWheel
+{
+  static_assert(N < 0x7FFF, "TimerWheel: id phải vừa int16_t");
+
+public:
+  TimerWheel() { reset(0); }
+
+  // Xóa mọi timer, giây kế tiếp cần xử lý = nowS
+  void reset(uint32_t nowS)
+  {
+    current = nowS;
+    for (int16_t &h : heads)
+      h = TW_NONE;
+    for (Node &n : nodes)
+      n.bucket = TW_NONE;
+  }
+
+  // Hẹn (lại) timer id hết hạn ở giây expiresS; quá khứ → vào due ngay
+  void insert(uint16_t id, uint32_t expiresS)
+  {
+    if (id >= N)
+      return;
+    remove(id);
+    nodes[id].expires = expiresS;
+    place(id);
+  }
+
+  void remove(uint16_t id)
+  {
+    if (id < N && nodes[id].bucket != TW_NONE)
+      unlink(id);
+  }
+
+  bool armed(uint16_t id) const { return id < N && nodes[id].bucket != TW_NONE; }
+  uint32_t expiresAt(uint16_t id) const { return nodes[id].expires; }
+  uint32_t now() const { return current; }
+
+  // Xử lý mọi giây < nowS + 1. Chi phí tỉ lệ với số giây trôi qua, người gọi
+  // tự reset() khi đồng hồ nhảy xa.
+  void advance(uint32_t nowS)
+  {
+    while ((int32_t)(nowS - current) >= 0)
+      step();
+  }
+
+  // Timer đã hết hạn (theo thứ tự hết hạn), TW_NONE nếu hết
+  int16_t popDue()
+  {
+    int16_t id = heads[DUE];
+    if (id != TW_NONE)
+      unlink(id);
+    return id;
+  }
+
+private:
+  static const int16_t DUE = TW_LEVELS * TW_SLOTS;
+
+  struct Node
+  {
+    uint32_t expires;
+    int16_t next;
+    int16_t prev;
+    int16_t bucket; // index vào heads, TW_NONE = không hẹn
+  };
+
+  void step()
+  {
+    uint8_t idx = current & TW_MASK;
+    if (idx == 0)
+      cascade(1);
+    // Nối cả slot vào cuối due
+    while (heads[idx] != TW_NONE)
+    {
+      int16_t id = heads[idx];
+      unlink(id);
+      link(id, DUE);
+    }
+    current++;
+  }
+
+  // Đổ slot hiện tại của tầng level xuống các tầng dưới
+  void cascade(uint8_t level)
+  {
+    uint8_t idx = (current >> (level * TW_BITS)) & TW_MASK;
+    int16_t bucket = level * TW_SLOTS + idx;
+    int16_t id = heads[bucket];
+    heads[bucket] = TW_NONE;
+    while (id != TW_NONE)
+    {
+      int16_t next = nodes[id].next;
+      nodes[id].bucket = TW_NONE;
+      place(id);
+      id = next;
+    }
+    if (idx == 0 && level + 1 < TW_LEVELS)
+      cascade(level + 1);
+  }
+
+  void place(uint16_t id)
+  {
+    uint32_t expires = nodes[id].expires;
+    if ((int32_t)(expires - current) < 0)
+    {
+      link(id, DUE);
+      return;
+    }
+    uint32_t delta = expires - current;
+    if (delta > TW_HORIZON_S)
+    {
+      // Xa hơn tầm wheel: đặt ở mép, lần cascade sau tính lại
+      delta = TW_HORIZON_S;
+      expires = current + TW_HORIZON_S;
+    }
+    uint8_t level = 0;
+    while (level + 1 < TW_LEVELS && delta >= (1UL << ((level + 1) * TW_BITS)))
+      level++;
+    link(id, level * TW_SLOTS + ((expires >> (level * TW_BITS)) & TW_MASK));
+  }
+
+  // Thêm vào cuối danh sách (giữ thứ tự cho due)
+  void link(uint16_t id, int16_t bucket)
+  {
+    Node &n = nodes[id];
+    n.bucket = bucket;
+    n.next = TW_NONE;
+    int16_t head = heads[bucket];
+    if (head == TW_NONE)
+    {
+      n.prev = id;
+      heads[bucket] = id;
+    }
+    else
+    {
+      // prev của head trỏ tới phần tử cuối
+      int16_t tail = nodes[head].prev;
+      nodes[tail].next = id;
+      n.prev = tail;
+      nodes[head].prev = id;
+    }
+  }
+
+  void unlink(uint16_t id)
+  {
+    Node &n = nodes[id];
+    int16_t &head = heads[n.bucket];
+    if (head == (int16_t)id)
+    {
+      head = n.next;
+      if (n.next != TW_NONE)
+        nodes[n.next].prev = n.prev;
+    }
+    else
+    {
+      nodes[n.prev].next = n.next;
+      if (n.next != TW_NONE)
+        nodes[n.next].prev = n.prev;
+      else
+        nodes[head].prev = n.prev;
+    }
+    n.bucket = TW_NONE;
+  }
+
+  Node nodes[N];
+  int16_t heads[TW_LEVELS * TW_SLOTS + 1]; // + danh sách due
+  uint32_t current = 0;
+};
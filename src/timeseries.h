@@ -0,0 +1,336 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ TIME-SERIES CẢM BIẾN ĐA ĐỘ PHÂN GIẢI ============
+// Mỗi giây ghi 1 mẫu fixed-point vào tầng 1s. Khi một bucket đóng, tổng
+// min/max/sum/count của nó được cộng dồn lên tầng kế tiếp (1s → 1 phút →
+// 1 giờ), nên không bao giờ phải quét lại dữ liệu cũ. Thời gian tính bằng
+// giây uptime. Bucket của slot s nằm ở index s % capacity.
+
+#define TS_SEC_SLOTS 120  // 2 phút
+#define TS_MIN_SLOTS 360  // 6 giờ
+#define TS_HOUR_SLOTS 168 // 7 ngày
+#define TS_EMPTY INT16_MIN // không có mẫu (cảm biến lỗi / khoảng trống)
+
+enum TsMetric : uint8_t
+{
+  TS_TEMPERATURE, // 0.1°C
+  TS_HUMIDITY,    // 0.1%
+  TS_LIGHT,       // giá trị ADC thô
+  TS_DISTANCE,    // 0.1cm
+  TS_METRIC_COUNT
+};
+
+enum TsTierId : uint8_t
+{
+  TS_TIER_SEC,
+  TS_TIER_MIN,
+  TS_TIER_HOUR,
+  TS_TIER_COUNT
+};
+
+struct TsBucket
+{
+  int16_t min[TS_METRIC_COUNT];
+  int16_t max[TS_METRIC_COUNT];
+  int16_t avg[TS_METRIC_COUNT];
+};
+
+// Bucket đang mở: giữ tổng để avg của tầng trên vẫn đúng trọng số
+struct TsAccumulator
+{
+  int32_t sum[TS_METRIC_COUNT];
+  int16_t min[TS_METRIC_COUNT];
+  int16_t max[TS_METRIC_COUNT];
+  uint16_t count[TS_METRIC_COUNT];
+};
+
+inline const char *tsMetricToString(uint8_t metric)
+{
+  switch (metric)
+  {
+  case TS_TEMPERATURE:
+    return "temperature";
+  case TS_HUMIDITY:
+    return "humidity";
+  case TS_LIGHT:
+    return "light";
+  case TS_DISTANCE:
+    return "distance";
+  default:
+    return "unknown";
+  }
+}
+
+// Trả về TS_METRIC_COUNT nếu không khớp
+inline uint8_t tsMetricFromString(const String &name)
+{
+  for (uint8_t m = 0; m < TS_METRIC_COUNT; m++)
+  {
+    if (name == tsMetricToString(m))
+      return m;
+  }
+  return TS_METRIC_COUNT;
+}
+
+inline const char *tsTierToString(uint8_t tier)
+{
+  switch (tier)
+  {
+  case TS_TIER_SEC:
+    return "1s";
+  case TS_TIER_MIN:
+    return "1m";
+  default:
+    return "1h";
+  }
+}
+
+inline uint8_t tsTierFromString(const String &name)
+{
+  for (uint8_t t = 0; t < TS_TIER_COUNT; t++)
+  {
+    if (name == tsTierToString(t))
+      return t;
+  }
+  return TS_TIER_COUNT;
+}
+
+// Hệ số fixed-point của từng metric (giá trị thật = raw / scale)
+inline int16_t tsMetricScale(uint8_t metric)
+{
+  return (metric == TS_LIGHT) ? 1 : 10;
+}
+
+// float → fixed-point, chặn trong khoảng int16 (chừa TS_EMPTY)
+inline int16_t tsToFixed(float value, int16_t scale)
+{
+  if (isnan(value))
+    return TS_EMPTY;
+  float v = value * scale;
+  if (v > INT16_MAX)
+    return INT16_MAX;
+  if (v < INT16_MIN + 1)
+    return INT16_MIN + 1;
+  return (int16_t)lroundf(v);
+}
+
+class TsTier
+{
+public:
+  TsTier(TsBucket *storage, uint16_t slots, uint32_t resolution)
+      : buckets(storage), capacity(slots), resolutionS(resolution)
+  {
+    resetAcc();
+  }
+
+  // Cộng dồn 1 mẫu (hoặc 1 bucket đã đóng của tầng dưới) tại thời điểm tS.
+  // Nếu slot đổi, bucket cũ được đóng và copy ra closed; trả về true.
+  bool accumulate(uint32_t tS, const TsAccumulator &in, TsAccumulator &closed, uint32_t &closedStartS)
+  {
+    uint32_t slot = tS / resolutionS;
+    bool didClose = false;
+
+    if (!accOpen)
+    {
+      accSlot = slot;
+      accOpen = true;
+    }
+    else if (slot != accSlot)
+    {
+      closed = acc;
+      closedStartS = accSlot * resolutionS;
+      store(accSlot, acc);
+      // Slot bị bỏ qua (loop bị trễ, mất mẫu) → đánh dấu trống
+      for (uint32_t s = accSlot + 1; s < slot && s - accSlot <= capacity; s++)
+        storeEmpty(s);
+      resetAcc();
+      accSlot = slot;
+      didClose = true;
+    }
+
+    for (uint8_t m = 0; m < TS_METRIC_COUNT; m++)
+    {
+      if (in.count[m] == 0)
+        continue;
+      acc.sum[m] += in.sum[m];
+      acc.count[m] += in.count[m];
+      if (in.min[m] < acc.min[m])
+        acc.min[m] = in.min[m];
+      if (in.max[m] > acc.max[m])
+        acc.max[m] = in.max[m];
+    }
+    return didClose;
+  }
+
+  // Bucket đã đóng của slot, false nếu đã bị ghi đè hoặc chưa có
+  bool read(uint32_t slot, TsBucket &out) const
+  {
+    if (!hasData || slot > newestSlot || newestSlot - slot >= filled)
+      return false;
+    out = buckets[slot % capacity];
+    return true;
+  }
+
+  // Bucket đang mở (dữ liệu chưa đủ 1 chu kỳ)
+  bool readOpen(uint32_t &slot, TsBucket &out) const
+  {
+    if (!accOpen)
+      return false;
+    slot = accSlot;
+    toBucket(acc, out);
+    return true;
+  }
+
+  uint32_t oldest() const { return hasData ? newestSlot + 1 - filled : 0; }
+  uint32_t newest() const { return newestSlot; }
+  bool empty() const { return !hasData; }
+  uint32_t resolution() const { return resolutionS; }
+  uint16_t slots() const { return capacity; }
+
+private:
+  static void toBucket(const TsAccumulator &a, TsBucket &b)
+  {
+    for (uint8_t m = 0; m < TS_METRIC_COUNT; m++)
+    {
+      if (a.count[m] == 0)
+      {
+        b.min[m] = b.max[m] = b.avg[m] = TS_EMPTY;
+        continue;
+      }
+      b.min[m] = a.min[m];
+      b.max[m] = a.max[m];
+      b.avg[m] = (int16_t)(a.sum[m] / a.count[m]);
+    }
+  }
+
+  void store(uint32_t slot, const TsAccumulator &a)
+  {
+    toBucket(a, buckets[slot % capacity]);
+    advance(slot);
+  }
+
+  void storeEmpty(uint32_t slot)
+  {
+    TsBucket &b = buckets[slot % capacity];
+    for (uint8_t m = 0; m < TS_METRIC_COUNT; m++)
+      b.min[m] = b.max[m] = b.avg[m] = TS_EMPTY;
+    advance(slot);
+  }
+
+  void advance(uint32_t slot)
+  {
+    if (!hasData)
+    {
+      hasData = true;
+      filled = 1;
+    }
+    else
+    {
+      uint32_t gap = slot - newestSlot;
+      filled = (filled + gap > capacity) ? capacity : filled + gap;
+    }
+    newestSlot = slot;
+  }
+
+  void resetAcc()
+  {
+    for (uint8_t m = 0; m < TS_METRIC_COUNT; m++)
+    {
+      acc.sum[m] = 0;
+      acc.count[m] = 0;
+      acc.min[m] = INT16_MAX;
+      acc.max[m] = INT16_MIN;
+    }
+  }
+
+  TsBucket *buckets;
+  uint16_t capacity;
+  uint32_t resolutionS;
+  uint32_t newestSlot = 0;
+  uint16_t filled = 0;
+  bool hasData = false;
+  TsAccumulator acc;
+  uint32_t accSlot = 0;
+  bool accOpen = false;
+};
+
+class TimeSeriesStore
+{
+public:
+  TimeSeriesStore()
+      : tiers{TsTier(secBuckets, TS_SEC_SLOTS, 1),
+              TsTier(minBuckets, TS_MIN_SLOTS, 60),
+              TsTier(hourBuckets, TS_HOUR_SLOTS, 3600)} {}
+
+  // Ghi 1 mẫu; giá trị TS_EMPTY được bỏ qua khi tính min/max/avg
+  void record(uint32_t nowS, const int16_t *values)
+  {
+    TsAccumulator sample;
+    for (uint8_t m = 0; m < TS_METRIC_COUNT; m++)
+    {
+      bool valid = values[m] != TS_EMPTY;
+      sample.sum[m] = valid ? values[m] : 0;
+      sample.min[m] = valid ? values[m] : INT16_MAX;
+      sample.max[m] = valid ? values[m] : INT16_MIN;
+      sample.count[m] = valid ? 1 : 0;
+    }
+
+    portENTER_CRITICAL(&mux);
+    TsAccumulator in = sample;
+    TsAccumulator closed;
+    uint32_t t = nowS;
+    for (uint8_t i = 0; i < TS_TIER_COUNT; i++)
+    {
+      uint32_t closedStartS;
+      if (!tiers[i].accumulate(t, in, closed, closedStartS))
+        break;
+      // Bucket vừa đóng được đẩy lên tầng trên với thời điểm bắt đầu của nó
+      in = closed;
+      t = closedStartS;
+    }
+    samples++;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  bool read(uint8_t tier, uint32_t slot, TsBucket &out)
+  {
+    portENTER_CRITICAL(&mux);
+    bool ok = tiers[tier].read(slot, out);
+    portEXIT_CRITICAL(&mux);
+    return ok;
+  }
+
+  bool readOpen(uint8_t tier, uint32_t &slot, TsBucket &out)
+  {
+    portENTER_CRITICAL(&mux);
+    bool ok = tiers[tier].readOpen(slot, out);
+    portEXIT_CRITICAL(&mux);
+    return ok;
+  }
+
+  // Phạm vi slot đã đóng [oldest, newest]; false nếu tầng chưa có bucket nào
+  bool range(uint8_t tier, uint32_t &oldest, uint32_t &newest)
+  {
+    portENTER_CRITICAL(&mux);
+    bool ok = !tiers[tier].empty();
+    oldest = tiers[tier].oldest();
+    newest = tiers[tier].newest();
+    portEXIT_CRITICAL(&mux);
+    return ok;
+  }
+
+  uint32_t resolution(uint8_t tier) const { return tiers[tier].resolution(); }
+  uint16_t slots(uint8_t tier) const { return tiers[tier].slots(); }
+  uint32_t sampleCount() const { return samples; }
+  static size_t memoryBytes() { return sizeof(TsBucket) * (TS_SEC_SLOTS + TS_MIN_SLOTS + TS_HOUR_SLOTS); }
+
+private:
+  TsBucket secBuckets[TS_SEC_SLOTS];
+  TsBucket minBuckets[TS_MIN_SLOTS];
+  TsBucket hourBuckets[TS_HOUR_SLOTS];
+  TsTier tiers[TS_TIER_COUNT];
+  uint32_t samples = 0;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ============ RADAR SIÊU ÂM HC-SR04 (NGẮT + TIMER) ============
+// Độ rộng xung echo được đo bằng ngắt CHANGE trên chân ECHO, timestamp lấy
+// từ esp_timer (timer phần cứng 64-bit, µs). loop() không bao giờ chờ chân
+// echo: mỗi chu kỳ chỉ gom kết quả của ping trước rồi bắn ping kế tiếp.
+
+#ifndef RADAR_PING_INTERVAL_MS
+#define RADAR_PING_INTERVAL_MS 60 // HC-SR04 cần >= 60ms giữa 2 ping
+#endif
+#define RADAR_ECHO_TIMEOUT_US 30000 // như pulseIn() cũ: > 30ms = không có vật
+#ifndef RADAR_MEDIAN_N
+#define RADAR_MEDIAN_N 5
+#endif
+#define RADAR_RESULT_RING 8
+#define RADAR_NO_ECHO_US (RADAR_ECHO_TIMEOUT_US + 10000) // echo dài nhất ~38ms
+
+// Lọc trung vị N mẫu gần nhất (N nhỏ → insertion sort trên bản sao)
+template <int N>
+class MedianFilter
+{
+public:
+  void add(float value)
+  {
+    samples[next] = value;
+    next = (next + 1) % N;
+    if (filled < N)
+      filled++;
+  }
+
+  float median() const
+  {
+    if (filled == 0)
+      return 0;
+    float sorted[N];
+    for (int i = 0; i < filled; i++)
+    {
+      float v = samples[i];
+      int j = i - 1;
+      while (j >= 0 && sorted[j] > v)
+      {
+        sorted[j + 1] = sorted[j];
+        j--;
+      }
+      sorted[j + 1] = v;
+    }
+    return sorted[filled / 2];
+  }
+
+  int count() const { return filled; }
+
+private:
+  float samples[N] = {};
+  int next = 0;
+  int filled = 0;
+};
+
+struct RangerStats
+{
+  uint32_t pings;
+  uint32_t echoes;
+  uint32_t timeouts;
+  uint32_t skipped; // chân echo còn HIGH lúc cần ping
+};
+
+class UltrasonicRanger
+{
+public:
+  void begin(uint8_t trig, uint8_t echo)
+  {
+    trigPin = trig;
+    echoPin = echo;
+    pinMode(trigPin, OUTPUT);
+    pinMode(echoPin, INPUT);
+    digitalWrite(trigPin, LOW);
+    attachInterruptArg(digitalPinToInterrupt(echoPin), onEchoEdge, this, CHANGE);
+  }
+
+  // Gom kết quả ping trước. Trả về true nếu có mẫu mới vào bộ lọc.
+  bool service()
+  {
+    bool gotSample = false;
+
+    while (tail != head)
+    {
+      uint32_t widthUs = ring[tail];
+      tail = (tail + 1) % RADAR_RESULT_RING;
+      stats.echoes++;
+      filter.add(widthToCm(widthUs));
+      pingOutstanding = false;
+      gotSample = true;
+    }
+
+    // Ping không có cạnh xuống trong hạn → coi như không có vật (0cm)
+    if (pingOutstanding && (uint32_t)(esp_timer_get_time() - pingAtUs) > RADAR_NO_ECHO_US)
+    {
+      stats.timeouts++;
+      filter.add(0);
+      pingOutstanding = false;
+      gotSample = true;
+    }
+
+    return gotSample;
+  }
+
+  // Bắn xung trigger 10µs, kết quả về qua ngắt
+  void ping()
+  {
+    if (digitalRead(echoPin) == HIGH)
+    {
+      stats.skipped++;
+      return;
+    }
+
+    digitalWrite(trigPin, LOW);
+    delayMicroseconds(2);
+    digitalWrite(trigPin, HIGH);
+    delayMicroseconds(10);
+    digitalWrite(trigPin, LOW);
+
+    pingAtUs = esp_timer_get_time();
+    pingOutstanding = true;
+    stats.pings++;
+  }
+
+  float distanceCm() const { return filter.median(); }
+  const RangerStats &getStats() const { return stats; }
+
+private:
+  static float widthToCm(uint32_t widthUs)
+  {
+    if (widthUs > RADAR_ECHO_TIMEOUT_US)
+      return 0;
+    return (widthUs * 0.0343f) / 2.0f;
+  }
+
+  static void IRAM_ATTR onEchoEdge(void *arg)
+  {
+    UltrasonicRanger *self = static_cast<UltrasonicRanger *>(arg);
+    int64_t nowUs = esp_timer_get_time();
+
+    if (digitalRead(self->echoPin) == HIGH)
+    {
+      self->riseUs = nowUs;
+      return;
+    }
+
+    if (self->riseUs == 0)
+      return;
+
+    uint8_t nextHead = (self->head + 1) % RADAR_RESULT_RING;
+    if (nextHead != self->tail) // ring đầy → bỏ mẫu mới nhất
+    {
+      self->ring[self->head] = (uint32_t)(nowUs - self->riseUs);
+      self->head = nextHead;
+    }
+    self->riseUs = 0;
+  }
+
+  uint8_t trigPin = 0;
+  uint8_t echoPin = 0;
+
+  // Ghi bởi ISR (producer), đọc bởi service() (consumer)
+  volatile int64_t riseUs = 0;
+  volatile uint32_t ring[RADAR_RESULT_RING] = {};
+  volatile uint8_t head = 0;
+  volatile uint8_t tail = 0;
+
+  int64_t pingAtUs = 0;
+  bool pingOutstanding = false;
+  MedianFilter<RADAR_MEDIAN_N> filter;
+  RangerStats stats = {};
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <Arduino.h>
+#include "controller_state.h"
+#include "voice_decision.h"
+#include "voice_intent.h"
+
+// ============ CACHE QUYẾT ĐỊNH VOICE (LRU + TTL) ============
+// Cùng một câu trong cùng hoàn cảnh phòng thì Gemini trả cùng quyết định,
+// nên lưu VoiceDecision đã parse theo khóa = câu đã gấp dấu (foldVietnamese)
+// + ngữ cảnh lượng tử hóa: nhiệt độ phòng theo bucket, AC bật/tắt, mode,
+// nhiệt độ đặt (quyết định "giảm 2 độ" phụ thuộc nhiệt độ đặt). Mảng cố
+// định VOICE_CACHE_ENTRIES slot, quét tuyến tính (so hash trước), hết chỗ
+// thì bỏ slot dùng lâu nhất. Khóa bằng portMUX: handler /voice/command tra
+// cứu trên async_tcp, worker thêm sau khi Gemini trả lời.
+//
+// Không cache "maintain": Gemini hay dùng nó cho câu hỏi ("phòng bao nhiêu
+// độ?"), reason chứa số đo lúc đó nên sẽ cũ.
+
+#define VOICE_CACHE_ENTRIES 16
+#define VOICE_CACHE_TEXT_MAX 64          // câu dài hơn không cache
+#define VOICE_CACHE_TTL_MS (30UL * 60000) // 30 phút
+#define VOICE_CACHE_TEMP_BUCKET_C 1.0f
+#define VOICE_CACHE_BUDGET_BYTES 6144
+
+struct VoiceCacheKey
+{
+  uint32_t hash; // FNV-1a của text + ngữ cảnh
+  int8_t tempBucket;
+  bool acPower;
+  uint8_t acMode;
+  int8_t acTemp; // 0 khi AC tắt (không ảnh hưởng quyết định)
+  bool question; // "bật rồi?" khác "bật rồi"
+  char text[VOICE_CACHE_TEXT_MAX];
+};
+
+struct VoiceCacheStats
+{
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t inserts;
+  uint32_t evictions; // bỏ slot còn hạn để lấy chỗ
+  uint32_t expired;
+  uint16_t entries;
+};
+
+inline uint32_t fnv1a(const void *data, size_t len, uint32_t hash = 2166136261u)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < len; i++)
+    hash = (hash ^ p[i]) * 16777619u;
+  return hash;
+}
+
+// false nếu câu rỗng hoặc quá dài để cache
+inline bool makeVoiceCacheKey(const char *text, const ControllerState &st, VoiceCacheKey &key)
+{
+  memset(&key, 0, sizeof(key));
+  char folded[VOICE_FOLD_MAX];
+  bool question;
+  size_t len = foldVietnamese(text, folded, sizeof(folded), question);
+  if (len == 0 || len >= VOICE_CACHE_TEXT_MAX)
+    return false;
+  memcpy(key.text, folded, len);
+
+  key.tempBucket = (int8_t)constrain((int)floorf(st.sensors.temperature / VOICE_CACHE_TEMP_BUCKET_C), -100, 100);
+  key.acPower = st.ac.power;
+  key.acMode = st.ac.power ? st.ac.mode : 0;
+  key.acTemp = st.ac.power ? st.ac.temp : 0;
+  key.question = question;
+  uint8_t ctx[5] = {(uint8_t)key.tempBucket, key.acPower, key.acMode, (uint8_t)key.acTemp, question};
+  key.hash = fnv1a(ctx, sizeof(ctx), fnv1a(key.text, len));
+  return true;
+}
+
+class VoiceDecisionCache
+{
+public:
+  bool lookup(const VoiceCacheKey &key, uint32_t nowMs, VoiceDecision &out)
+  {
+    portENTER_CRITICAL(&mux);
+    Entry *e = find(key);
+    bool hit = false;
+    if (e && nowMs - e->storedMs >= VOICE_CACHE_TTL_MS)
+    {
+      e->used = false;
+      stats.expired++;
+      stats.entries--;
+    }
+    else if (e)
+    {
+      e->lastUse = ++tick;
+      out = e->decision;
+      hit = true;
+    }
+    if (hit)
+      stats.hits++;
+    else
+      stats.misses++;
+    portEXIT_CRITICAL(&mux);
+    return hit;
+  }
+
+  void insert(const VoiceCacheKey &key, const VoiceDecision &decision, uint32_t nowMs)
+  {
+    if (decision.action == VA_NONE || decision.action == VA_MAINTAIN)
+      return;
+
+    portENTER_CRITICAL(&mux);
+    Entry *slot = find(key);
+    if (!slot)
+      slot = victim(nowMs);
+    if (!slot->used)
+      stats.entries++;
+    slot->used = true;
+    slot->key = key;
+    slot->decision = decision;
+    slot->storedMs = nowMs;
+    slot->lastUse = ++tick;
+    stats.inserts++;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void clear()
+  {
+    portENTER_CRITICAL(&mux);
+    for (Entry &e : entries)
+      e.used = false;
+    stats.entries = 0;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  VoiceCacheStats getStats()
+  {
+    portENTER_CRITICAL(&mux);
+    VoiceCacheStats copy = stats;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+  }
+
+private:
+  struct Entry
+  {
+    VoiceCacheKey key;
+    VoiceDecision decision;
+    uint32_t storedMs;
+    uint32_t lastUse; // tick, không dùng millis() để khỏi lo tràn
+    bool used;
+  };
+
+  Entry *find(const VoiceCacheKey &key)
+  {
+    for (Entry &e : entries)
+      if (e.used && e.key.hash == key.hash && sameKey(e.key, key))
+        return &e;
+    return nullptr;
+  }
+
+  static bool sameKey(const VoiceCacheKey &a, const VoiceCacheKey &b)
+  {
+    return a.tempBucket == b.tempBucket && a.acPower == b.acPower && a.acMode == b.acMode &&
+           a.acTemp == b.acTemp && a.question == b.question && !strcmp(a.text, b.text);
+  }
+
+  // Slot trống → slot hết hạn → slot dùng lâu nhất
+  Entry *victim(uint32_t nowMs)
+  {
+    Entry *lru = &entries[0];
+    for (Entry &e : entries)
+    {
+      if (!e.used)
+        return &e;
+      if (nowMs - e.storedMs >= VOICE_CACHE_TTL_MS)
+      {
+        stats.expired++;
+        stats.entries--;
+        e.used = false;
+        return &e;
+      }
+      if ((int32_t)(e.lastUse - lru->lastUse) < 0)
+        lru = &e;
+    }
+    stats.evictions++;
+    stats.entries--;
+    lru->used = false;
+    return lru;
+  }
+
+  Entry entries[VOICE_CACHE_ENTRIES] = {};
+  VoiceCacheStats stats = {};
+  uint32_t tick = 0;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+static_assert(sizeof(VoiceDecisionCache) <= VOICE_CACHE_BUDGET_BYTES, "VoiceDecisionCache vượt VOICE_CACHE_BUDGET_BYTES");
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "controller_state.h"
+
+// ============ QUYẾT ĐỊNH VOICE (ĐÃ PARSE) ============
+// Response Gemini chỉ parse 1 lần trên worker thành VoiceDecision; job,
+// cache và loop() đều dùng struct này. Trường thiếu trong JSON giữ dạng
+// "không nói" (temp 0, VOICE_KEEP) để loop() áp dụng đúng như trước:
+// turn_on thiếu nhiệt độ → 25°C, adjust thiếu trường nào giữ trường đó.
+
+#define VOICE_REASON_MAX 192   // prompt yêu cầu 50-100 ký tự, UTF-8 ~2B/ký tự
+#define VOICE_AUDIO_URL_MAX 64 // "/tts/audio/<md5>.mp3"
+#define VOICE_PARSE_DOC 768
+#define VOICE_KEEP 0xFF
+
+enum VoiceAction : uint8_t
+{
+  VA_NONE, // không có quyết định (lỗi gọi API / parse)
+  VA_MAINTAIN,
+  VA_TURN_ON,
+  VA_TURN_OFF,
+  VA_ADJUST
+};
+
+enum VoiceSource : uint8_t
+{
+  VS_GEMINI,
+  VS_LOCAL, // parser trên thiết bị (voice_intent.h)
+  VS_CACHE  // VoiceDecisionCache (voice_cache.h)
+};
+
+struct VoiceDecision
+{
+  VoiceAction action;
+  int8_t temp;  // 0 = không nói
+  uint8_t fan;  // FanSpeed, VOICE_KEEP = không nói
+  uint8_t mode; // AcMode, VOICE_KEEP = không nói
+  char reason[VOICE_REASON_MAX];
+  char audioUrl[VOICE_AUDIO_URL_MAX];
+};
+
+inline const char *voiceActionToString(VoiceAction action)
+{
+  switch (action)
+  {
+  case VA_MAINTAIN:
+    return "maintain";
+  case VA_TURN_ON:
+    return "turn_on";
+  case VA_TURN_OFF:
+    return "turn_off";
+  case VA_ADJUST:
+    return "adjust";
+  default:
+    return "unknown";
+  }
+}
+
+// Tên lạ → maintain
+inline VoiceAction voiceActionFromString(const char *name)
+{
+  if (name && !strcmp(name, "turn_on"))
+    return VA_TURN_ON;
+  if (name && !strcmp(name, "turn_off"))
+    return VA_TURN_OFF;
+  if (name && !strcmp(name, "adjust"))
+    return VA_ADJUST;
+  return VA_MAINTAIN;
+}
+
+inline const char *voiceSourceToString(VoiceSource source)
+{
+  switch (source)
+  {
+  case VS_LOCAL:
+    return "local";
+  case VS_CACHE:
+    return "cache";
+  default:
+    return "gemini";
+  }
+}
+
+inline void clearVoiceDecision(VoiceDecision &d)
+{
+  d.action = VA_NONE;
+  d.temp = 0;
+  d.fan = VOICE_KEEP;
+  d.mode = VOICE_KEEP;
+  d.reason[0] = '\0';
+  d.audioUrl[0] = '\0';
+}
+
+// strncpy nhưng không cắt giữa 1 ký tự UTF-8
+inline void copyUtf8(char *dst, const char *src, size_t size)
+{
+  if (!src)
+    src = "";
+  size_t n = strlen(src);
+  if (n >= size)
+  {
+    n = size - 1;
+    while (n > 0 && ((uint8_t)src[n] & 0xC0) == 0x80)
+      n--;
+  }
+  memcpy(dst, src, n);
+  dst[n] = '\0';
+}
+
+// Parse response Gemini ({...} có thể nằm giữa text). false nếu lỗi.
+inline bool parseVoiceDecision(const char *body, VoiceDecision &out)
+{
+  clearVoiceDecision(out);
+  if (!body || strstr(body, "\"error\""))
+    return false;
+  const char *start = strchr(body, '{');
+  const char *end = strrchr(body, '}');
+  if (!start || !end || end < start)
+    return false;
+
+  DynamicJsonDocument doc(VOICE_PARSE_DOC);
+  if (deserializeJson(doc, start, end - start + 1))
+    return false;
+
+  out.action = voiceActionFromString(doc["action"].as<const char *>());
+  if (doc["temperature"].is<float>()) // số nguyên hoặc thực
+    out.temp = constrain(doc["temperature"].as<int>(), AC_TEMP_MIN, AC_TEMP_MAX);
+  if (doc["fan_speed"].is<const char *>())
+    out.fan = stringToFanSpeed(doc["fan_speed"].as<const char *>());
+  else if (doc["fan_speed"].is<int>())
+    out.fan = intToFanSpeed(doc["fan_speed"].as<int>());
+  uint8_t mode;
+  if (parseAcMode(doc["mode"].as<const char *>(), mode))
+    out.mode = mode;
+  const char *reason = doc["reason"].as<const char *>();
+  copyUtf8(out.reason, reason ? reason : "No reason", sizeof(out.reason));
+  copyUtf8(out.audioUrl, doc["audio_url"].as<const char *>(), sizeof(out.audioUrl));
+  return true;
+}
+
+// Kết quả trả cho client (/voice/result)
+inline void voiceDecisionToJson(const VoiceDecision &d, JsonObject out)
+{
+  out["success"] = true;
+  out["action"] = voiceActionToString(d.action);
+  if (d.temp)
+    out["temperature"] = d.temp;
+  if (d.fan != VOICE_KEEP)
+    out["fan_speed"] = fanSpeedToString((FanSpeed)d.fan);
+  if (d.mode != VOICE_KEEP)
+    out["mode"] = acModeToString(d.mode);
+  out["reason"] = (const char *)d.reason;
+  if (d.audioUrl[0])
+    out["audio_url"] = (const char *)d.audioUrl;
+}
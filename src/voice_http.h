@@ -0,0 +1,414 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+// ============ HTTP KEEP-ALIVE CHO VOICE API ============
+// Mỗi voice worker giữ 1 VoiceHttpConnection (1 WiFiClient sống lâu) tới
+// VOICE_API_URL, gửi HTTP/1.1 "Connection: keep-alive" nên các lệnh sau
+// không phải bắt tay TCP lại. Tự viết request/response thay HTTPClient để
+// có deadline riêng cho từng pha và đo được:
+//   connect    bắt tay TCP (0 nếu dùng lại kết nối)
+//   firstByte  gửi xong request → byte đầu của response (thời gian server nghĩ)
+//   total      toàn bộ lời gọi, kể cả connect và đọc body
+// Server đóng kết nối lúc đang rảnh thì lần gửi sau đọc được EOF trước byte
+// đầu: server chưa nhận request nên kết nối lại và gửi thêm 1 lần.
+//
+// CircuitBreaker: VOICE_CB_FAILURES lỗi liên tiếp (không kết nối được, quá
+// hạn, HTTP 5xx) → OPEN, mọi lời gọi trả lỗi ngay trong VOICE_CB_OPEN_MS.
+// Hết hạn → HALF_OPEN, cho đúng 1 lời gọi thử; thành công thì CLOSED, thất
+// bại thì OPEN lại với thời gian gấp đôi (tối đa VOICE_CB_OPEN_MAX_MS).
+
+#define VOICE_HTTP_CONNECT_TIMEOUT_MS 3000
+#define VOICE_HTTP_FIRST_BYTE_TIMEOUT_MS 45000 // server: Gemini 20s x2 (retry) + TTS
+#define VOICE_HTTP_TOTAL_TIMEOUT_MS 50000
+#define VOICE_HTTP_IDLE_MS 60000 // kết nối rảnh lâu hơn → mở mới (NAT/AP hay cắt)
+#define VOICE_HTTP_RESPONSE_MAX 2048
+#define VOICE_HTTP_HOST_MAX 48
+#define VOICE_HTTP_PATH_MAX 64
+
+// Mã lỗi (âm) của VoiceHttpConnection::post(), dương là HTTP status
+#define VOICE_HTTP_ERR_URL -1
+#define VOICE_HTTP_ERR_CONNECT -2
+#define VOICE_HTTP_ERR_WRITE -3
+#define VOICE_HTTP_ERR_TIMEOUT -4
+#define VOICE_HTTP_ERR_PROTOCOL -5
+
+#define VOICE_CB_FAILURES 3
+#define VOICE_CB_OPEN_MS 15000
+#define VOICE_CB_OPEN_MAX_MS 300000
+
+struct VoiceHttpTiming
+{
+  uint32_t connectUs;
+  uint32_t firstByteUs;
+  uint32_t totalUs;
+  bool reused; // không bắt tay TCP
+};
+
+inline const char *voiceHttpErrorToString(int code)
+{
+  switch (code)
+  {
+  case VOICE_HTTP_ERR_URL:
+    return "bad url";
+  case VOICE_HTTP_ERR_CONNECT:
+    return "connect failed";
+  case VOICE_HTTP_ERR_WRITE:
+    return "write failed";
+  case VOICE_HTTP_ERR_TIMEOUT:
+    return "timeout";
+  case VOICE_HTTP_ERR_PROTOCOL:
+    return "bad response";
+  default:
+    return "ok";
+  }
+}
+
+class VoiceHttpConnection
+{
+public:
+  // url dạng "http://host[:port]/path"; false nếu sai
+  bool begin(const char *url)
+  {
+    const char *p = strncmp(url, "http://", 7) ? nullptr : url + 7;
+    if (!p)
+      return false;
+    const char *slash = strchr(p, '/');
+    const char *hostEnd = slash ? slash : p + strlen(p);
+    const char *colon = (const char *)memchr(p, ':', hostEnd - p);
+    size_t hostLen = (colon ? colon : hostEnd) - p;
+    if (hostLen == 0 || hostLen >= sizeof(host))
+      return false;
+    memcpy(host, p, hostLen);
+    host[hostLen] = '\0';
+    port = colon ? atoi(colon + 1) : 80;
+    copyPath(slash ? slash : "/");
+    return port > 0;
+  }
+
+  // Trả về HTTP status hoặc VOICE_HTTP_ERR_*. response = body (cắt ở
+  // VOICE_HTTP_RESPONSE_MAX).
+  int post(const char *body, const char *authHeader, String &response, VoiceHttpTiming &t)
+  {
+    t = {0, 0, 0, false};
+    response = "";
+    if (!host[0])
+      return VOICE_HTTP_ERR_URL;
+
+    uint32_t startUs = micros();
+    uint32_t startMs = millis();
+    int code = attempt(body, authHeader, response, t, startMs);
+    if ((code == VOICE_HTTP_ERR_PROTOCOL || code == VOICE_HTTP_ERR_WRITE) && t.reused && !gotBytes)
+    {
+      // Kết nối keep-alive đã bị server đóng: gửi lại trên kết nối mới
+      stats.staleRetries++;
+      client.stop();
+      code = attempt(body, authHeader, response, t, startMs);
+    }
+    t.totalUs = micros() - startUs;
+    if (code < 0)
+      client.stop();
+    else
+      lastUsedMs = millis();
+    return code;
+  }
+
+  void close() { client.stop(); }
+
+  struct Stats
+  {
+    uint32_t requests;
+    uint32_t connects; // bắt tay TCP mới
+    uint32_t reused;
+    uint32_t staleRetries;
+  };
+  const Stats &getStats() const { return stats; }
+
+private:
+  int attempt(const char *body, const char *authHeader, String &response, VoiceHttpTiming &t, uint32_t startMs)
+  {
+    gotBytes = false;
+    stats.requests++;
+    t.reused = client.connected() && millis() - lastUsedMs < VOICE_HTTP_IDLE_MS;
+    if (t.reused)
+    {
+      stats.reused++;
+    }
+    else
+    {
+      client.stop();
+      uint32_t connectStart = micros();
+      if (!client.connect(host, port, VOICE_HTTP_CONNECT_TIMEOUT_MS))
+        return VOICE_HTTP_ERR_CONNECT;
+      client.setNoDelay(true);
+      t.connectUs = micros() - connectStart;
+      stats.connects++;
+    }
+
+    char header[256 + VOICE_HTTP_HOST_MAX + VOICE_HTTP_PATH_MAX];
+    size_t bodyLen = strlen(body);
+    int len = snprintf(header, sizeof(header),
+                       "POST %s HTTP/1.1\r\nHost: %s:%u\r\nContent-Type: application/json\r\n"
+                       "%s%s%sConnection: keep-alive\r\nContent-Length: %u\r\n\r\n",
+                       path, host, (unsigned)port,
+                       authHeader ? "Authorization: " : "", authHeader ? authHeader : "", authHeader ? "\r\n" : "",
+                       (unsigned)bodyLen);
+    if (len <= 0 || len >= (int)sizeof(header) ||
+        client.write((const uint8_t *)header, len) != (size_t)len ||
+        client.write((const uint8_t *)body, bodyLen) != bodyLen)
+      return VOICE_HTTP_ERR_WRITE;
+
+    uint32_t sentUs = micros();
+    int wait = waitAvailable(startMs, VOICE_HTTP_FIRST_BYTE_TIMEOUT_MS);
+    if (wait < 0)
+      return wait;
+    t.firstByteUs = micros() - sentUs;
+    return readResponse(response, startMs);
+  }
+
+  // 0 khi có dữ liệu, VOICE_HTTP_ERR_PROTOCOL khi server đóng, ERR_TIMEOUT
+  // khi quá limitMs (tính từ startMs) hoặc quá tổng deadline
+  int waitAvailable(uint32_t startMs, uint32_t limitMs)
+  {
+    if (limitMs > VOICE_HTTP_TOTAL_TIMEOUT_MS)
+      limitMs = VOICE_HTTP_TOTAL_TIMEOUT_MS;
+    while (!client.available())
+    {
+      if (!client.connected())
+        return VOICE_HTTP_ERR_PROTOCOL;
+      if (millis() - startMs >= limitMs)
+        return VOICE_HTTP_ERR_TIMEOUT;
+      delay(1);
+    }
+    gotBytes = true;
+    return 0;
+  }
+
+  // 1 dòng header (bỏ \r\n). false nếu lỗi/hết hạn
+  bool readLine(char *out, size_t size, uint32_t startMs, int &err)
+  {
+    size_t n = 0;
+    for (;;)
+    {
+      err = waitAvailable(startMs, VOICE_HTTP_TOTAL_TIMEOUT_MS);
+      if (err)
+        return false;
+      int c = client.read();
+      if (c == '\n')
+        break;
+      if (c != '\r' && n + 1 < size)
+        out[n++] = (char)c;
+    }
+    out[n] = '\0';
+    return true;
+  }
+
+  // Đọc đúng n byte body vào response (phần vượt VOICE_HTTP_RESPONSE_MAX bỏ)
+  int readBody(String &response, size_t n, uint32_t startMs)
+  {
+    uint8_t buf[128];
+    while (n > 0)
+    {
+      int err = waitAvailable(startMs, VOICE_HTTP_TOTAL_TIMEOUT_MS);
+      if (err)
+        return err;
+      int got = client.read(buf, n < sizeof(buf) ? n : sizeof(buf));
+      if (got <= 0)
+        continue;
+      size_t room = VOICE_HTTP_RESPONSE_MAX > response.length() ? VOICE_HTTP_RESPONSE_MAX - response.length() : 0;
+      if (room)
+        response.concat((const char *)buf, (size_t)got < room ? got : room);
+      n -= got;
+    }
+    return 0;
+  }
+
+  int readResponse(String &response, uint32_t startMs)
+  {
+    char line[128];
+    int err = 0;
+    if (!readLine(line, sizeof(line), startMs, err))
+      return err;
+    int status = 0;
+    int minor = 0;
+    if (sscanf(line, "HTTP/1.%d %d", &minor, &status) != 2 || status < 100)
+      return VOICE_HTTP_ERR_PROTOCOL;
+
+    bool keepAlive = minor >= 1;
+    bool chunked = false;
+    long contentLength = -1;
+    for (;;)
+    {
+      if (!readLine(line, sizeof(line), startMs, err))
+        return err;
+      if (!line[0])
+        break;
+      char *colon = strchr(line, ':');
+      if (!colon)
+        continue;
+      *colon = '\0';
+      const char *value = colon + 1;
+      while (*value == ' ')
+        value++;
+      if (!strcasecmp(line, "Content-Length"))
+        contentLength = atol(value);
+      else if (!strcasecmp(line, "Transfer-Encoding"))
+        chunked = strcasestr(value, "chunked") != nullptr;
+      else if (!strcasecmp(line, "Connection"))
+        keepAlive = strcasestr(value, "keep-alive") != nullptr ||
+                    (minor >= 1 && strcasestr(value, "close") == nullptr);
+    }
+
+    if (chunked)
+    {
+      for (;;)
+      {
+        if (!readLine(line, sizeof(line), startMs, err))
+          return err;
+        size_t size = strtoul(line, nullptr, 16);
+        if (size == 0)
+        {
+          readLine(line, sizeof(line), startMs, err); // dòng trống cuối
+          break;
+        }
+        if ((err = readBody(response, size, startMs)))
+          return err;
+        if (!readLine(line, sizeof(line), startMs, err)) // \r\n sau mỗi chunk
+          return err;
+      }
+    }
+    else if (contentLength >= 0)
+    {
+      if ((err = readBody(response, contentLength, startMs)))
+        return err;
+    }
+    else
+    {
+      // Không có độ dài: đọc tới khi server đóng
+      keepAlive = false;
+      while (waitAvailable(startMs, VOICE_HTTP_TOTAL_TIMEOUT_MS) == 0)
+        readBody(response, client.available(), startMs);
+    }
+
+    if (!keepAlive)
+      client.stop();
+    return status;
+  }
+
+  void copyPath(const char *p)
+  {
+    strncpy(path, p, sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+  }
+
+  WiFiClient client;
+  char host[VOICE_HTTP_HOST_MAX] = "";
+  char path[VOICE_HTTP_PATH_MAX] = "/";
+  uint16_t port = 80;
+  uint32_t lastUsedMs = 0;
+  bool gotBytes = false;
+  Stats stats = {};
+};
+
+// ============ CIRCUIT BREAKER ============
+enum BreakerState : uint8_t
+{
+  CB_CLOSED,
+  CB_OPEN,
+  CB_HALF_OPEN
+};
+
+inline const char *breakerStateToString(BreakerState state)
+{
+  switch (state)
+  {
+  case CB_OPEN:
+    return "open";
+  case CB_HALF_OPEN:
+    return "half_open";
+  default:
+    return "closed";
+  }
+}
+
+struct BreakerStats
+{
+  BreakerState state;
+  uint8_t consecutiveFailures;
+  uint32_t openForMs; // thời gian OPEN hiện tại (tăng gấp đôi mỗi lần thử lỗi)
+  uint32_t opens;
+  uint32_t rejected; // lời gọi bị chặn lúc OPEN
+  uint32_t probes;
+};
+
+class CircuitBreaker
+{
+public:
+  // true nếu được phép gọi. HALF_OPEN: chỉ lời gọi đầu tiên (probe) qua
+  bool allow(uint32_t nowMs)
+  {
+    portENTER_CRITICAL(&mux);
+    bool ok = false;
+    if (stats.state == CB_CLOSED)
+    {
+      ok = true;
+    }
+    else if (stats.state == CB_OPEN && nowMs - openedMs >= stats.openForMs)
+    {
+      stats.state = CB_HALF_OPEN;
+      stats.probes++;
+      ok = true;
+    }
+    if (!ok)
+      stats.rejected++;
+    portEXIT_CRITICAL(&mux);
+    return ok;
+  }
+
+  void success()
+  {
+    portENTER_CRITICAL(&mux);
+    stats.state = CB_CLOSED;
+    stats.consecutiveFailures = 0;
+    stats.openForMs = VOICE_CB_OPEN_MS;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void failure(uint32_t nowMs)
+  {
+    portENTER_CRITICAL(&mux);
+    if (stats.consecutiveFailures < 255)
+      stats.consecutiveFailures++;
+    if (stats.state == CB_HALF_OPEN)
+    {
+      stats.openForMs = stats.openForMs < VOICE_CB_OPEN_MAX_MS / 2 ? stats.openForMs * 2 : VOICE_CB_OPEN_MAX_MS;
+      open(nowMs);
+    }
+    else if (stats.state == CB_CLOSED && stats.consecutiveFailures >= VOICE_CB_FAILURES)
+    {
+      open(nowMs);
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  BreakerStats getStats()
+  {
+    portENTER_CRITICAL(&mux);
+    BreakerStats copy = stats;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+  }
+
+private:
+  void open(uint32_t nowMs)
+  {
+    stats.state = CB_OPEN;
+    stats.opens++;
+    openedMs = nowMs;
+  }
+
+  BreakerStats stats = {CB_CLOSED, 0, VOICE_CB_OPEN_MS, 0, 0, 0};
+  uint32_t openedMs = 0;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
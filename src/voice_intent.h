@@ -0,0 +1,639 @@
+#pragma once
+
+#include <Arduino.h>
+#include "controller_state.h"
+#include "voice_decision.h"
+
+// ============ PHÂN TÍCH Ý ĐỊNH VOICE TRÊN THIẾT BỊ ============
+// Lệnh đơn giản ("bật điều hòa 24 độ", "tắt máy lạnh", "lạnh quá") không
+// cần gọi Gemini. Câu được gấp về ASCII thường không dấu (UTF-8 dựng sẵn
+// hoặc tổ hợp NFD), rồi quét từng từ: trie ký tự chứa VOICE_KEYWORDS, luôn
+// lấy cụm dài nhất kết thúc ở ranh giới từ ("may lanh" thắng "lanh", "tat
+// ca" thắng "tat"). Số đọc từ chữ số hoặc chữ ("hai mươi bốn", "twenty
+// four"). Bỏ dấu làm một số từ trùng nhau (ấm/ẩm, mấy/máy) nên cụm dễ nhầm
+// được đưa vào VK_BLOCK; câu phủ định, câu hỏi, hẹn giờ cũng vậy.
+//
+// Điểm tin cậy bắt đầu từ 100, trừ cho mỗi từ lạ và khi thiếu ngữ cảnh
+// (bật/tắt mà không nhắc máy lạnh, số không có "độ"). Dưới
+// VOICE_INTENT_MIN_CONFIDENCE → gửi Gemini như cũ. Từ khóa lấy theo
+// analyze_voice_fallback() của gemini_server.py, cách chọn nhiệt độ/quạt
+// cũng giống để kết quả local và fallback của server khớp nhau.
+
+#define VOICE_INTENT_MIN_CONFIDENCE 60
+#define VOICE_UNKNOWN_PENALTY 20   // mỗi từ không có trong bảng
+#define VOICE_NO_DEVICE_PENALTY 30 // bật/tắt mà không nhắc máy lạnh
+#define VOICE_NO_UNIT_PENALTY 30   // chỉ có số, không có "độ"/"nhiệt độ"
+#define VOICE_DEFAULT_DELTA 2      // "mát hơn" không kèm số
+#define VOICE_MAX_DELTA 5
+#define VOICE_FOLD_MAX 192
+#define VOICE_TRIE_MAX_NODES 768 // bảng hiện tại dùng ~640
+
+enum VoiceIntentKind : uint8_t
+{
+  VI_NONE,
+  VI_TURN_ON,
+  VI_TURN_OFF,
+  VI_COOLER,
+  VI_WARMER,
+  VI_SET_TEMP,
+  VI_SETTINGS // chỉ đổi quạt / mode
+};
+
+struct VoiceIntent
+{
+  VoiceIntentKind kind;
+  uint8_t confidence; // 0..100
+  int8_t temp;        // 0 = không nói nhiệt độ
+  int8_t delta;       // COOLER/WARMER: số độ tăng giảm
+  uint8_t fan;        // FanSpeed, VOICE_KEEP = giữ
+  uint8_t mode;       // AcMode, VOICE_KEEP = giữ
+};
+
+inline const char *voiceIntentToString(VoiceIntentKind kind)
+{
+  switch (kind)
+  {
+  case VI_TURN_ON:
+    return "turn_on";
+  case VI_TURN_OFF:
+    return "turn_off";
+  case VI_COOLER:
+    return "cooler";
+  case VI_WARMER:
+    return "warmer";
+  case VI_SET_TEMP:
+    return "set_temp";
+  case VI_SETTINGS:
+    return "settings";
+  default:
+    return "none";
+  }
+}
+
+// ============ GẤP DẤU TIẾNG VIỆT ============
+// U+1EA0..U+1EF9 xếp từng cặp hoa/thường theo thứ tự a e i o u y
+inline char foldCodepoint(uint32_t cp)
+{
+  static const char LATIN1[] = "aaaaaaaceeeeiiiidnooooo ouuuuy s"; // U+C0..DF, U+E0..FF giống
+  static const char VI_EXT[] = "aaaaaaaaaaaaeeeeeeeeiioooooooooooouuuuuuuyyyy";
+  if (cp == 0xFF)
+    return 'y';
+  if (cp >= 0xC0 && cp <= 0xFF)
+    return LATIN1[cp & 0x1F];
+  if (cp >= 0x1EA0 && cp <= 0x1EF9)
+    return VI_EXT[(cp - 0x1EA0) >> 1];
+  if (cp >= 0x300 && cp <= 0x36F)
+    return 0; // dấu tổ hợp (NFD) → bỏ
+  switch (cp)
+  {
+  case 0x102: // Ă ă
+  case 0x103:
+    return 'a';
+  case 0x110: // Đ đ
+  case 0x111:
+    return 'd';
+  case 0x128: // Ĩ ĩ
+  case 0x129:
+    return 'i';
+  case 0x168: // Ũ ũ
+  case 0x169:
+  case 0x1AF: // Ư ư
+  case 0x1B0:
+    return 'u';
+  case 0x1A0: // Ơ ơ
+  case 0x1A1:
+    return 'o';
+  default:
+    return ' ';
+  }
+}
+
+// UTF-8 → [a-z0-9 ], gộp khoảng trắng. Trả về độ dài; question = có '?'
+inline size_t foldVietnamese(const char *in, char *out, size_t outSize, bool &question)
+{
+  size_t n = 0;
+  question = false;
+  const uint8_t *p = (const uint8_t *)in;
+  while (*p && n + 1 < outSize)
+  {
+    uint32_t cp = *p++;
+    if (cp >= 0x80)
+    {
+      int extra = cp >= 0xF0 ? 3 : cp >= 0xE0 ? 2 : cp >= 0xC0 ? 1 : 0;
+      cp &= extra == 3 ? 0x07 : extra == 2 ? 0x0F : 0x1F;
+      for (; extra > 0 && (*p & 0xC0) == 0x80; extra--)
+        cp = (cp << 6) | (*p++ & 0x3F);
+      if (extra > 0)
+        cp = 0; // chuỗi UTF-8 hỏng → ranh giới từ
+    }
+
+    char c;
+    if (cp >= 'A' && cp <= 'Z')
+      c = (char)(cp + 'a' - 'A');
+    else if ((cp >= 'a' && cp <= 'z') || (cp >= '0' && cp <= '9'))
+      c = (char)cp;
+    else if (cp >= 0x80)
+      c = foldCodepoint(cp);
+    else
+    {
+      question |= cp == '?';
+      c = ' ';
+    }
+
+    if (c == 0 || (c == ' ' && (n == 0 || out[n - 1] == ' ')))
+      continue;
+    out[n++] = c;
+  }
+  if (n > 0 && out[n - 1] == ' ')
+    n--;
+  out[n] = '\0';
+  return n;
+}
+
+// ============ BẢNG TỪ KHÓA ============
+enum VoiceKeywordKind : uint8_t
+{
+  VK_ON,
+  VK_OFF,
+  VK_COOLER,
+  VK_WARMER,
+  VK_DEVICE,
+  VK_UNIT,      // "độ", "degrees"
+  VK_TEMP_WORD, // "nhiệt độ", "temperature"
+  VK_FAN,       // value = FanSpeed
+  VK_MODE,      // value = AcMode
+  VK_NUM,       // value = 1..9, 16..19
+  VK_TENS,      // value = 10 ("mươi", nhân với số trước), 20, 30
+  VK_FILLER,
+  VK_BLOCK // phủ định, câu hỏi, hẹn giờ, từ trùng nghĩa sau khi bỏ dấu
+};
+
+struct VoiceKeyword
+{
+  const char *phrase; // đã gấp dấu, các từ cách nhau 1 khoảng trắng
+  VoiceKeywordKind kind;
+  uint8_t value;
+};
+
+constexpr VoiceKeyword VOICE_KEYWORDS[] = {
+    // Bật / tắt
+    {"bat", VK_ON, 0}, {"mo", VK_ON, 0}, {"khoi dong", VK_ON, 0},
+    {"on", VK_ON, 0}, {"turn on", VK_ON, 0}, {"switch on", VK_ON, 0}, {"power on", VK_ON, 0}, {"start", VK_ON, 0},
+    {"tat", VK_OFF, 0}, {"ngat", VK_OFF, 0}, {"dung lai", VK_OFF, 0},
+    {"off", VK_OFF, 0}, {"turn off", VK_OFF, 0}, {"switch off", VK_OFF, 0}, {"power off", VK_OFF, 0},
+    {"shut down", VK_OFF, 0}, {"shutdown", VK_OFF, 0}, {"stop", VK_OFF, 0},
+    // Mát hơn (gồm "nóng": người dùng than nóng = muốn mát)
+    {"mat", VK_COOLER, 0}, {"lanh", VK_COOLER, 0}, {"giam", VK_COOLER, 0}, {"ha", VK_COOLER, 0},
+    {"nong", VK_COOLER, 0}, {"cool", VK_COOLER, 0}, {"cooler", VK_COOLER, 0}, {"cold", VK_COOLER, 0},
+    {"colder", VK_COOLER, 0}, {"hot", VK_COOLER, 0}, {"lower", VK_COOLER, 0}, {"decrease", VK_COOLER, 0},
+    {"down", VK_COOLER, 0},
+    // Ấm hơn ("lạnh quá" ngược với "lạnh")
+    {"tang", VK_WARMER, 0}, {"am", VK_WARMER, 0}, {"ret", VK_WARMER, 0}, {"lanh qua", VK_WARMER, 0},
+    {"qua lanh", VK_WARMER, 0}, {"warm", VK_WARMER, 0}, {"warmer", VK_WARMER, 0}, {"increase", VK_WARMER, 0},
+    {"raise", VK_WARMER, 0}, {"higher", VK_WARMER, 0}, {"up", VK_WARMER, 0}, {"too cold", VK_WARMER, 0},
+    {"freezing", VK_WARMER, 0},
+    // Thiết bị
+    {"dieu hoa", VK_DEVICE, 0}, {"may dieu hoa", VK_DEVICE, 0}, {"may lanh", VK_DEVICE, 0}, {"may", VK_DEVICE, 0},
+    {"ac", VK_DEVICE, 0}, {"aircon", VK_DEVICE, 0}, {"air con", VK_DEVICE, 0},
+    {"air conditioner", VK_DEVICE, 0}, {"air conditioning", VK_DEVICE, 0},
+    // Nhiệt độ
+    {"do", VK_UNIT, 0}, {"do c", VK_UNIT, 0}, {"c", VK_UNIT, 0}, {"degree", VK_UNIT, 0},
+    {"degrees", VK_UNIT, 0}, {"celsius", VK_UNIT, 0},
+    {"nhiet do", VK_TEMP_WORD, 0}, {"nhiet", VK_TEMP_WORD, 0}, {"temperature", VK_TEMP_WORD, 0}, {"temp", VK_TEMP_WORD, 0},
+    // Quạt: "quạt" đứng một mình không phải từ khóa ("bật quạt" có thể là quạt điện)
+    {"quat manh", VK_FAN, FAN_HIGH}, {"quat cao", VK_FAN, FAN_HIGH}, {"quat to", VK_FAN, FAN_HIGH},
+    {"quat lon", VK_FAN, FAN_HIGH}, {"gio manh", VK_FAN, FAN_HIGH}, {"tang quat", VK_FAN, FAN_HIGH},
+    {"tang gio", VK_FAN, FAN_HIGH}, {"fan high", VK_FAN, FAN_HIGH}, {"high fan", VK_FAN, FAN_HIGH},
+    {"quat vua", VK_FAN, FAN_MEDIUM}, {"quat trung binh", VK_FAN, FAN_MEDIUM}, {"fan medium", VK_FAN, FAN_MEDIUM},
+    {"quat nhe", VK_FAN, FAN_LOW}, {"quat nho", VK_FAN, FAN_LOW}, {"quat yeu", VK_FAN, FAN_LOW},
+    {"quat thap", VK_FAN, FAN_LOW}, {"gio nhe", VK_FAN, FAN_LOW}, {"giam quat", VK_FAN, FAN_LOW},
+    {"giam gio", VK_FAN, FAN_LOW}, {"fan low", VK_FAN, FAN_LOW}, {"low fan", VK_FAN, FAN_LOW},
+    {"quat em", VK_FAN, FAN_QUIET}, {"fan quiet", VK_FAN, FAN_QUIET},
+    {"quat tu dong", VK_FAN, FAN_AUTO}, {"fan auto", VK_FAN, FAN_AUTO},
+    // Chế độ
+    {"che do lanh", VK_MODE, AC_MODE_COOL}, {"cool mode", VK_MODE, AC_MODE_COOL},
+    {"hut am", VK_MODE, AC_MODE_DRY}, {"che do kho", VK_MODE, AC_MODE_DRY}, {"dry mode", VK_MODE, AC_MODE_DRY},
+    {"che do quat", VK_MODE, AC_MODE_FAN}, {"fan mode", VK_MODE, AC_MODE_FAN},
+    {"che do suoi", VK_MODE, AC_MODE_HEAT}, {"heat mode", VK_MODE, AC_MODE_HEAT},
+    {"che do tu dong", VK_MODE, AC_MODE_AUTO}, {"auto mode", VK_MODE, AC_MODE_AUTO},
+    // Số đọc bằng chữ
+    {"mot", VK_NUM, 1}, {"hai", VK_NUM, 2}, {"ba", VK_NUM, 3}, {"bon", VK_NUM, 4}, {"tu", VK_NUM, 4},
+    {"nam", VK_NUM, 5}, {"lam", VK_NUM, 5}, {"nham", VK_NUM, 5}, {"sau", VK_NUM, 6}, {"bay", VK_NUM, 7},
+    {"tam", VK_NUM, 8}, {"chin", VK_NUM, 9}, {"muoi", VK_TENS, 10},
+    {"one", VK_NUM, 1}, {"two", VK_NUM, 2}, {"three", VK_NUM, 3}, {"four", VK_NUM, 4}, {"five", VK_NUM, 5},
+    {"six", VK_NUM, 6}, {"seven", VK_NUM, 7}, {"eight", VK_NUM, 8}, {"nine", VK_NUM, 9},
+    {"sixteen", VK_NUM, 16}, {"seventeen", VK_NUM, 17}, {"eighteen", VK_NUM, 18}, {"nineteen", VK_NUM, 19},
+    {"twenty", VK_TENS, 20}, {"thirty", VK_TENS, 30},
+    // Từ đệm
+    {"giup", VK_FILLER, 0}, {"gium", VK_FILLER, 0}, {"ho", VK_FILLER, 0}, {"cho", VK_FILLER, 0},
+    {"toi", VK_FILLER, 0}, {"minh", VK_FILLER, 0}, {"em", VK_FILLER, 0}, {"anh", VK_FILLER, 0},
+    {"chi", VK_FILLER, 0}, {"ban", VK_FILLER, 0}, {"voi", VK_FILLER, 0}, {"nhe", VK_FILLER, 0},
+    {"nha", VK_FILLER, 0}, {"di", VK_FILLER, 0}, {"nao", VK_FILLER, 0}, {"cai", VK_FILLER, 0},
+    {"len", VK_FILLER, 0}, {"xuong", VK_FILLER, 0}, {"o", VK_FILLER, 0}, {"muc", VK_FILLER, 0},
+    {"de", VK_FILLER, 0}, {"che do", VK_FILLER, 0}, {"dat", VK_FILLER, 0}, {"chinh", VK_FILLER, 0}, {"lai", VK_FILLER, 0},
+    {"them", VK_FILLER, 0}, {"hon", VK_FILLER, 0}, {"qua", VK_FILLER, 0}, {"chut", VK_FILLER, 0},
+    {"mot chut", VK_FILLER, 0}, {"mot it", VK_FILLER, 0}, {"tat ca", VK_FILLER, 0}, {"ngay", VK_FILLER, 0},
+    {"bay gio", VK_FILLER, 0}, {"oi", VK_FILLER, 0}, {"a", VK_FILLER, 0}, {"an", VK_FILLER, 0},
+    {"the", VK_FILLER, 0}, {"to", VK_FILLER, 0}, {"set", VK_FILLER, 0}, {"turn", VK_FILLER, 0},
+    {"please", VK_FILLER, 0}, {"hey", VK_FILLER, 0}, {"ok", VK_FILLER, 0}, {"now", VK_FILLER, 0},
+    {"it", VK_FILLER, 0}, {"s", VK_FILLER, 0}, {"is", VK_FILLER, 0}, {"too", VK_FILLER, 0},
+    {"so", VK_FILLER, 0}, {"bit", VK_FILLER, 0}, {"little", VK_FILLER, 0}, {"more", VK_FILLER, 0},
+    // Để Gemini xử lý
+    {"khong", VK_BLOCK, 0}, {"ko", VK_BLOCK, 0}, {"dung", VK_BLOCK, 0}, {"chua", VK_BLOCK, 0},
+    {"dont", VK_BLOCK, 0}, {"don t", VK_BLOCK, 0}, {"not", VK_BLOCK, 0}, {"never", VK_BLOCK, 0},
+    {"bao nhieu", VK_BLOCK, 0}, {"may do", VK_BLOCK, 0}, {"the nao", VK_BLOCK, 0}, {"sao", VK_BLOCK, 0},
+    {"gi", VK_BLOCK, 0}, {"what", VK_BLOCK, 0}, {"how", VK_BLOCK, 0}, {"why", VK_BLOCK, 0},
+    {"neu", VK_BLOCK, 0}, {"khi", VK_BLOCK, 0}, {"luc", VK_BLOCK, 0}, {"gio", VK_BLOCK, 0},
+    {"h", VK_BLOCK, 0}, {"phut", VK_BLOCK, 0}, {"giay", VK_BLOCK, 0}, {"tieng", VK_BLOCK, 0},
+    {"hen gio", VK_BLOCK, 0}, {"if", VK_BLOCK, 0}, {"when", VK_BLOCK, 0}, {"at", VK_BLOCK, 0},
+    {"after", VK_BLOCK, 0}, {"minute", VK_BLOCK, 0}, {"minutes", VK_BLOCK, 0}, {"hour", VK_BLOCK, 0},
+    {"hours", VK_BLOCK, 0}, {"timer", VK_BLOCK, 0}, {"schedule", VK_BLOCK, 0},
+    {"do am", VK_BLOCK, 0},  // độ ẩm
+    {"am qua", VK_BLOCK, 0}, // ấm quá / ẩm quá
+};
+
+#define VOICE_KEYWORD_COUNT (sizeof(VOICE_KEYWORDS) / sizeof(VOICE_KEYWORDS[0]))
+
+// ============ TRIE ============
+// Con đầu / anh em kế tiếp trong 1 mảng cố định; node 0 là gốc nên chỉ số 0
+// cũng nghĩa là "không có". Xây 1 lần lúc khởi tạo (8B/node).
+class VoiceKeywordTrie
+{
+public:
+  VoiceKeywordTrie()
+  {
+    nodes[0] = {0, -1, 0, 0};
+    used = 1;
+    for (uint16_t k = 0; k < VOICE_KEYWORD_COUNT; k++)
+      insert(VOICE_KEYWORDS[k].phrase, k);
+  }
+
+  // Cụm dài nhất bắt đầu ở s và kết thúc ở ranh giới từ (khoảng trắng, chữ
+  // số hoặc hết chuỗi). -1 nếu không có.
+  int16_t match(const char *s, size_t &matchLen) const
+  {
+    int16_t best = -1;
+    uint16_t node = 0;
+    for (size_t i = 0; s[i]; i++)
+    {
+      node = findChild(node, s[i]);
+      if (!node)
+        break;
+      char next = s[i + 1];
+      if (nodes[node].keyword >= 0 && (next == '\0' || next == ' ' || (next >= '0' && next <= '9')))
+      {
+        best = nodes[node].keyword;
+        matchLen = i + 1;
+      }
+    }
+    return best;
+  }
+
+  uint16_t size() const { return used; }
+  bool complete() const { return !overflow; }
+
+private:
+  struct Node
+  {
+    char c;
+    int16_t keyword; // chỉ số VOICE_KEYWORDS, -1 = không kết thúc ở đây
+    uint16_t child;
+    uint16_t next;
+  };
+
+  uint16_t findChild(uint16_t node, char c) const
+  {
+    for (uint16_t n = nodes[node].child; n; n = nodes[n].next)
+      if (nodes[n].c == c)
+        return n;
+    return 0;
+  }
+
+  void insert(const char *phrase, uint16_t keyword)
+  {
+    uint16_t node = 0;
+    for (; *phrase; phrase++)
+    {
+      uint16_t child = findChild(node, *phrase);
+      if (!child)
+      {
+        if (used >= VOICE_TRIE_MAX_NODES)
+        {
+          overflow = true;
+          return;
+        }
+        child = used++;
+        nodes[child] = {*phrase, -1, 0, nodes[node].child};
+        nodes[node].child = child;
+      }
+      node = child;
+    }
+    nodes[node].keyword = keyword;
+  }
+
+  Node nodes[VOICE_TRIE_MAX_NODES];
+  uint16_t used;
+  bool overflow = false;
+};
+
+// ============ PARSER ============
+struct VoiceIntentStats
+{
+  uint32_t parses;
+  uint32_t localHits; // đủ tin cậy, không cần gọi Gemini
+  uint32_t lastUs;
+  uint32_t maxUs;
+  uint64_t totalUs;
+};
+
+class VoiceIntentParser
+{
+public:
+  // true nếu đủ tin cậy để xử lý local. Không khóa: chỉ gọi từ 1 task
+  // (handler /voice/command trên async_tcp), stats cũng đọc từ task đó.
+  bool parse(const char *text, VoiceIntent &out)
+  {
+    uint32_t startUs = micros();
+    char folded[VOICE_FOLD_MAX];
+    bool question;
+    foldVietnamese(text, folded, sizeof(folded), question);
+    classify(folded, question, out);
+    bool local = out.confidence >= VOICE_INTENT_MIN_CONFIDENCE;
+
+    uint32_t us = micros() - startUs;
+    stats.parses++;
+    if (local)
+      stats.localHits++;
+    stats.lastUs = us;
+    stats.totalUs += us;
+    if (us > stats.maxUs)
+      stats.maxUs = us;
+    return local;
+  }
+
+  const VoiceIntentStats &getStats() const { return stats; }
+  const VoiceKeywordTrie &keywords() const { return trie; }
+
+  // Không đụng stats, dùng cho harness native
+  void classify(const char *folded, bool question, VoiceIntent &out) const
+  {
+    out = {VI_NONE, 0, 0, 0, VOICE_KEEP, VOICE_KEEP};
+    bool on = false, off = false, cooler = false, warmer = false;
+    bool device = false, unit = false, blocked = question;
+    uint8_t unknown = 0, numbers = 0;
+    int number = 0;
+    int pendingUnit = 0, pendingTens = 0; // số đang đọc bằng chữ
+
+    const char *p = folded;
+    while (*p)
+    {
+      if (*p == ' ')
+      {
+        p++;
+        continue;
+      }
+
+      int16_t k = -1;
+      size_t len = 0;
+      if (*p >= '0' && *p <= '9')
+      {
+        int value = 0;
+        for (; *p >= '0' && *p <= '9'; p++)
+          value = value < 1000 ? value * 10 + (*p - '0') : value;
+        flushNumber(pendingUnit, pendingTens, number, numbers);
+        number = value;
+        numbers++;
+        continue;
+      }
+
+      k = trie.match(p, len);
+      if (k < 0)
+      {
+        flushNumber(pendingUnit, pendingTens, number, numbers);
+        unknown++;
+        while (*p && *p != ' ' && !(*p >= '0' && *p <= '9'))
+          p++;
+        continue;
+      }
+      p += len;
+
+      const VoiceKeyword &kw = VOICE_KEYWORDS[k];
+      if (kw.kind == VK_NUM)
+      {
+        if (pendingTens && kw.value < 10)
+        {
+          pendingUnit = kw.value;
+          flushNumber(pendingUnit, pendingTens, number, numbers);
+        }
+        else
+        {
+          flushNumber(pendingUnit, pendingTens, number, numbers);
+          pendingUnit = kw.value;
+        }
+        continue;
+      }
+      if (kw.kind == VK_TENS)
+      {
+        if (kw.value == 10 && pendingUnit > 0 && pendingUnit < 10 && !pendingTens)
+        {
+          pendingTens = pendingUnit * 10; // "hai mươi"
+          pendingUnit = 0;
+        }
+        else
+        {
+          flushNumber(pendingUnit, pendingTens, number, numbers);
+          pendingTens = kw.value;
+        }
+        continue;
+      }
+      flushNumber(pendingUnit, pendingTens, number, numbers);
+
+      switch (kw.kind)
+      {
+      case VK_ON:
+        on = true;
+        break;
+      case VK_OFF:
+        off = true;
+        break;
+      case VK_COOLER:
+        cooler = true;
+        break;
+      case VK_WARMER:
+        warmer = true;
+        break;
+      case VK_DEVICE:
+        device = true;
+        break;
+      case VK_UNIT:
+      case VK_TEMP_WORD:
+        unit = true;
+        break;
+      case VK_FAN:
+        out.fan = kw.value;
+        break;
+      case VK_MODE:
+        out.mode = kw.value;
+        break;
+      case VK_BLOCK:
+        blocked = true;
+        break;
+      default:
+        break;
+      }
+    }
+    flushNumber(pendingUnit, pendingTens, number, numbers);
+
+    // Mâu thuẫn hoặc nhiều số → để Gemini
+    if (blocked || numbers > 1 || (on && off) || (cooler && warmer) || (off && (cooler || warmer)))
+      return;
+
+    if (numbers == 1)
+    {
+      if (number >= AC_TEMP_MIN && number <= AC_TEMP_MAX)
+        out.temp = number;
+      else if ((cooler || warmer) && !on && number >= 1 && number <= VOICE_MAX_DELTA)
+        out.delta = number;
+      else
+        return;
+    }
+
+    int confidence = 100 - unknown * VOICE_UNKNOWN_PENALTY;
+    if (on)
+      out.kind = VI_TURN_ON;
+    else if (off)
+      out.kind = VI_TURN_OFF;
+    else if (cooler)
+      out.kind = VI_COOLER;
+    else if (warmer)
+      out.kind = VI_WARMER;
+    else if (out.temp)
+      out.kind = VI_SET_TEMP;
+    else if (out.fan != VOICE_KEEP || out.mode != VOICE_KEEP)
+      out.kind = VI_SETTINGS;
+    else
+      return;
+
+    // Số độ, quạt, mode cũng chỉ có nghĩa với máy lạnh
+    if ((on || off) && !device && !out.temp && out.fan == VOICE_KEEP && out.mode == VOICE_KEEP)
+      confidence -= VOICE_NO_DEVICE_PENALTY;
+    if (numbers == 1 && !unit && (out.kind == VI_SET_TEMP || out.delta))
+      confidence -= VOICE_NO_UNIT_PENALTY;
+    if ((out.kind == VI_COOLER || out.kind == VI_WARMER) && !out.temp && !out.delta)
+      out.delta = VOICE_DEFAULT_DELTA;
+    out.confidence = confidence > 0 ? confidence : 0;
+  }
+
+private:
+  static void flushNumber(int &pendingUnit, int &pendingTens, int &number, uint8_t &numbers)
+  {
+    if (!pendingUnit && !pendingTens)
+      return;
+    number = pendingTens + pendingUnit;
+    numbers++;
+    pendingUnit = pendingTens = 0;
+  }
+
+  VoiceKeywordTrie trie;
+  VoiceIntentStats stats = {};
+};
+
+// ============ Ý ĐỊNH → QUYẾT ĐỊNH ============
+// Dựng từ snapshot trạng thái AC lúc nhận lệnh, giống Gemini. Nhiệt độ và
+// quạt mặc định giống analyze_voice_fallback() của server.
+inline void voiceIntentDecision(const VoiceIntent &in, const AcState &ac, float roomTemp, VoiceDecision &out)
+{
+  clearVoiceDecision(out);
+  out.action = VA_MAINTAIN;
+  int temp = ac.temp;
+  uint8_t fan = in.fan != VOICE_KEEP ? in.fan : ac.fan;
+  uint8_t mode = in.mode != VOICE_KEEP ? in.mode : (ac.power ? ac.mode : (uint8_t)AC_MODE_COOL);
+  char *reason = out.reason;
+  const size_t size = sizeof(out.reason);
+
+  switch (in.kind)
+  {
+  case VI_TURN_ON:
+    out.action = VA_TURN_ON;
+    if (in.temp)
+    {
+      temp = in.temp;
+      if (in.fan == VOICE_KEEP)
+        fan = FAN_MEDIUM;
+    }
+    else if (roomTemp > 30)
+    {
+      temp = 22;
+      if (in.fan == VOICE_KEEP)
+        fan = FAN_HIGH;
+    }
+    else if (roomTemp > 28)
+    {
+      temp = 24;
+      if (in.fan == VOICE_KEEP)
+        fan = FAN_MEDIUM;
+    }
+    else
+    {
+      temp = 25;
+      if (in.fan == VOICE_KEEP)
+        fan = FAN_LOW;
+    }
+    snprintf(reason, size, "Mình đã bật điều hòa ở %d°C cho bạn!", temp);
+    break;
+
+  case VI_TURN_OFF:
+    out.action = VA_TURN_OFF;
+    snprintf(reason, size, "Dạ, mình đã tắt điều hòa theo yêu cầu của bạn!");
+    break;
+
+  case VI_COOLER:
+    if (!ac.power)
+    {
+      out.action = VA_TURN_ON;
+      temp = in.temp ? in.temp : 22;
+      if (in.fan == VOICE_KEEP)
+        fan = FAN_HIGH;
+      snprintf(reason, size, "Bạn muốn mát nên mình đã bật điều hòa ở %d°C!", temp);
+      break;
+    }
+    out.action = VA_ADJUST;
+    temp = in.temp ? in.temp : constrain(ac.temp - in.delta, AC_TEMP_MIN, AC_TEMP_MAX);
+    if (in.fan == VOICE_KEEP)
+      fan = FAN_HIGH;
+    snprintf(reason, size, "Mình đã giảm nhiệt độ từ %d°C xuống %d°C!", ac.temp, temp);
+    break;
+
+  case VI_WARMER:
+    if (!ac.power)
+    {
+      snprintf(reason, size, "Điều hòa đang tắt rồi, phòng đang %.1f°C.", roomTemp);
+      break;
+    }
+    out.action = VA_ADJUST;
+    temp = in.temp ? in.temp : constrain(ac.temp + in.delta, AC_TEMP_MIN, AC_TEMP_MAX);
+    snprintf(reason, size, "Mình đã tăng nhiệt độ từ %d°C lên %d°C!", ac.temp, temp);
+    break;
+
+  case VI_SET_TEMP:
+    out.action = ac.power ? VA_ADJUST : VA_TURN_ON;
+    temp = in.temp;
+    snprintf(reason, size, "Mình đã chỉnh điều hòa về %d°C!", temp);
+    break;
+
+  default: // VI_SETTINGS
+    if (!ac.power)
+    {
+      snprintf(reason, size, "Điều hòa đang tắt, bạn bật lên trước nhé!");
+      break;
+    }
+    out.action = VA_ADJUST;
+    snprintf(reason, size, "Mình đã chỉnh quạt %s, chế độ %s!",
+             fanSpeedToString((FanSpeed)fan), acModeToString(mode));
+    break;
+  }
+
+  out.temp = constrain(temp, AC_TEMP_MIN, AC_TEMP_MAX);
+  out.fan = fan;
+  out.mode = mode;
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <Arduino.h>
+#include "voice_decision.h"
+
+// ============ BẢNG JOB VOICE (HÀNG ĐỢI BẤT ĐỒNG BỘ) ============
+// Handler HTTP chỉ submit() rồi trả 202; worker task gọi Gemini và parse
+// response thành VoiceDecision; loop() áp dụng quyết định. Lệnh đã có quyết
+// định ngay (parser local, cache) vào thẳng JOB_RESPONDED qua
+// submitResolved(), không chiếm hàng đợi worker. Job đã xong được giữ lại
+// cho client poll đến khi slot bị tái sử dụng.
+
+#define VOICE_MAX_JOBS 8    // tổng số slot (đang chờ + đã xong)
+#define VOICE_QUEUE_DEPTH 4 // tối đa job QUEUED cùng lúc
+#define VOICE_TEXT_MAX 160
+
+enum VoiceJobState : uint8_t
+{
+  JOB_FREE,
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_RESPONDED, // đã có quyết định, chờ loop() áp dụng
+  JOB_DONE,
+  JOB_FAILED
+};
+
+struct VoiceJob
+{
+  uint32_t id;
+  VoiceJobState state;
+  uint32_t submittedMs;
+  uint32_t startedMs;
+  uint32_t finishedMs;
+  VoiceSource source;
+  const char *error; // JOB_FAILED: chuỗi hằng; reason nằm trong decision
+  char text[VOICE_TEXT_MAX];
+  VoiceDecision decision; // DONE: đã điền giá trị AC thực tế sau khi áp dụng
+};
+
+struct VoiceQueueStats
+{
+  uint32_t submitted;
+  uint32_t local;  // phần trong submitted không qua Gemini: parser local
+  uint32_t cached; // và cache quyết định
+  uint32_t rejected;
+  uint32_t completed;
+  uint32_t failed;
+  uint16_t queued;
+  uint16_t maxQueued;
+  uint16_t running;
+  uint32_t totalLatencyMs;
+  uint32_t maxLatencyMs;
+};
+
+inline const char *voiceJobStateToString(VoiceJobState state)
+{
+  switch (state)
+  {
+  case JOB_QUEUED:
+    return "queued";
+  case JOB_RUNNING:
+  case JOB_RESPONDED:
+    return "running";
+  case JOB_DONE:
+    return "done";
+  case JOB_FAILED:
+    return "failed";
+  default:
+    return "unknown";
+  }
+}
+
+class VoiceJobTable
+{
+public:
+  // Trả về job id, 0 nếu hàng đợi đầy
+  uint32_t submit(const char *text, uint32_t nowMs)
+  {
+    portENTER_CRITICAL(&mux);
+    VoiceJob *slot = nullptr;
+    if (stats.queued < VOICE_QUEUE_DEPTH)
+      slot = findReusableSlot();
+    if (!slot)
+    {
+      stats.rejected++;
+      portEXIT_CRITICAL(&mux);
+      return 0;
+    }
+
+    uint32_t id = claim(slot, text, nowMs, JOB_QUEUED, VS_GEMINI);
+    stats.queued++;
+    if (stats.queued > stats.maxQueued)
+      stats.maxQueued = stats.queued;
+    portEXIT_CRITICAL(&mux);
+    return id;
+  }
+
+  // Đã có quyết định (local/cache): bỏ qua worker, chờ loop() áp dụng.
+  // 0 nếu hết slot
+  uint32_t submitResolved(const char *text, const VoiceDecision &decision, VoiceSource source, uint32_t nowMs)
+  {
+    portENTER_CRITICAL(&mux);
+    VoiceJob *slot = findReusableSlot();
+    if (!slot)
+    {
+      stats.rejected++;
+      portEXIT_CRITICAL(&mux);
+      return 0;
+    }
+
+    uint32_t id = claim(slot, text, nowMs, JOB_RESPONDED, source);
+    slot->startedMs = nowMs;
+    slot->decision = decision;
+    if (source == VS_CACHE)
+      stats.cached++;
+    else
+      stats.local++;
+    stats.running++;
+    portEXIT_CRITICAL(&mux);
+    return id;
+  }
+
+  // Worker nhận job: QUEUED → RUNNING, copy text ra ngoài vùng khóa
+  bool start(uint32_t id, uint32_t nowMs, char *textOut, size_t textSize)
+  {
+    portENTER_CRITICAL(&mux);
+    VoiceJob *job = find(id);
+    bool ok = job && job->state == JOB_QUEUED;
+    if (ok)
+    {
+      job->state = JOB_RUNNING;
+      job->startedMs = nowMs;
+      strncpy(textOut, job->text, textSize - 1);
+      textOut[textSize - 1] = '\0';
+      stats.queued--;
+      stats.running++;
+    }
+    portEXIT_CRITICAL(&mux);
+    return ok;
+  }
+
+  // Worker xong HTTP: lưu quyết định để loop() áp dụng (VA_NONE = lỗi)
+  void respond(uint32_t id, const VoiceDecision &decision)
+  {
+    portENTER_CRITICAL(&mux);
+    VoiceJob *job = find(id);
+    if (job && job->state == JOB_RUNNING)
+    {
+      job->decision = decision;
+      job->state = JOB_RESPONDED;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // loop() lấy 1 job đã có quyết định (copy ra ngoài vùng khóa)
+  uint32_t takeResponded(VoiceDecision &out)
+  {
+    uint32_t id = 0;
+    portENTER_CRITICAL(&mux);
+    for (int i = 0; i < VOICE_MAX_JOBS; i++)
+    {
+      if (jobs[i].state == JOB_RESPONDED)
+      {
+        id = jobs[i].id;
+        out = jobs[i].decision;
+        break;
+      }
+    }
+    portEXIT_CRITICAL(&mux);
+    return id;
+  }
+
+  // Áp dụng xong: lưu quyết định cuối cùng cho client poll
+  void finish(uint32_t id, const VoiceDecision &decision, uint32_t nowMs)
+  {
+    portENTER_CRITICAL(&mux);
+    VoiceJob *job = find(id);
+    if (job && (job->state == JOB_RUNNING || job->state == JOB_RESPONDED))
+    {
+      job->decision = decision;
+      close(*job, JOB_DONE, nowMs);
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // error: chuỗi hằng (reason được chép). Cả job chưa tới worker (không gửi được vào queue)
+  void fail(uint32_t id, const char *error, const char *reason, uint32_t nowMs)
+  {
+    portENTER_CRITICAL(&mux);
+    VoiceJob *job = find(id);
+    if (job && (job->state == JOB_QUEUED || job->state == JOB_RUNNING || job->state == JOB_RESPONDED))
+    {
+      job->error = error;
+      copyUtf8(job->decision.reason, reason, sizeof(job->decision.reason));
+      close(*job, JOB_FAILED, nowMs);
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Bản sao job cho endpoint poll
+  bool snapshot(uint32_t id, VoiceJob &out)
+  {
+    portENTER_CRITICAL(&mux);
+    VoiceJob *job = find(id);
+    if (job)
+      out = *job;
+    portEXIT_CRITICAL(&mux);
+    return job != nullptr;
+  }
+
+  VoiceQueueStats getStats()
+  {
+    portENTER_CRITICAL(&mux);
+    VoiceQueueStats copy = stats;
+    portEXIT_CRITICAL(&mux);
+    return copy;
+  }
+
+private:
+  // Gọi trong vùng khóa
+  uint32_t claim(VoiceJob *slot, const char *text, uint32_t nowMs, VoiceJobState state, VoiceSource source)
+  {
+    slot->id = nextId++;
+    if (nextId == 0)
+      nextId = 1;
+    slot->state = state;
+    slot->submittedMs = nowMs;
+    slot->startedMs = 0;
+    slot->finishedMs = 0;
+    slot->source = source;
+    slot->error = nullptr;
+    strncpy(slot->text, text, VOICE_TEXT_MAX - 1);
+    slot->text[VOICE_TEXT_MAX - 1] = '\0';
+    clearVoiceDecision(slot->decision);
+    stats.submitted++;
+    return slot->id;
+  }
+
+  // Gọi trong vùng khóa
+  void close(VoiceJob &job, VoiceJobState state, uint32_t nowMs)
+  {
+    if (job.state == JOB_QUEUED)
+      stats.queued--;
+    else
+      stats.running--;
+    job.state = state;
+    job.finishedMs = nowMs;
+    uint32_t latency = nowMs - job.submittedMs;
+    if (state == JOB_DONE)
+      stats.completed++;
+    else
+      stats.failed++;
+    stats.totalLatencyMs += latency;
+    if (latency > stats.maxLatencyMs)
+      stats.maxLatencyMs = latency;
+  }
+
+  VoiceJob *find(uint32_t id)
+  {
+    if (id == 0)
+      return nullptr;
+    for (int i = 0; i < VOICE_MAX_JOBS; i++)
+    {
+      if (jobs[i].state != JOB_FREE && jobs[i].id == id)
+        return &jobs[i];
+    }
+    return nullptr;
+  }
+
+  // Ưu tiên slot trống, sau đó job đã xong lâu nhất
+  VoiceJob *findReusableSlot()
+  {
+    VoiceJob *oldest = nullptr;
+    for (int i = 0; i < VOICE_MAX_JOBS; i++)
+    {
+      VoiceJob &job = jobs[i];
+      if (job.state == JOB_FREE)
+        return &job;
+      if ((job.state == JOB_DONE || job.state == JOB_FAILED) &&
+          (!oldest || (int32_t)(job.finishedMs - oldest->finishedMs) < 0))
+        oldest = &job;
+    }
+    return oldest;
+  }
+
+  VoiceJob jobs[VOICE_MAX_JOBS] = {};
+  VoiceQueueStats stats = {};
+  uint32_t nextId = 1;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -0,0 +1,71 @@
+// ============ TEST env:native: LOG RING ============
+// Ghi qua macro LOG_* rồi đọc lại + format trễ như Serial drain và /logs:
+//
+//   pio test -e native
+//
+// Kiểm tra tham số có dấu (zigzag) và không dấu qua %d, %u, %x.
+
+#include <Arduino.h>
+#include <unity.h>
+#include "logring.h"
+
+LogRing logRing;
+LogCursor cursor;
+
+// Bản ghi kế tiếp đã format; "" nếu hết
+const char *nextLine()
+{
+  static LogRecord rec;
+  static char line[LOG_LINE_MAX];
+  if (!logRing.next(cursor, rec))
+    return "";
+  logRing.format(rec, line, sizeof(line));
+  return line;
+}
+
+void setUp()
+{
+  cursor = logRing.cursorAt(logRing.nextSequence());
+}
+
+void tearDown() {}
+
+void test_signed_args()
+{
+  LOG_WARN("d=%d u=%u x=%x", 5, 5, 255);
+  LOG_WARN("d=%d x=%x", -5, -1);
+  LOG_WARN("short=%d", (int16_t)-300);
+  LOG_WARN("i8=%d", (int8_t)-7);
+  TEST_ASSERT_EQUAL_STRING("d=5 u=5 x=ff", nextLine());
+  TEST_ASSERT_EQUAL_STRING("d=-5 x=ffffffff", nextLine());
+  TEST_ASSERT_EQUAL_STRING("short=-300", nextLine());
+  TEST_ASSERT_EQUAL_STRING("i8=-7", nextLine());
+}
+
+void test_unsigned_args()
+{
+  LOG_WARN("id=%u", (uint16_t)7);
+  LOG_WARN("b=%u x=%X", (uint8_t)200, (uint16_t)0xBEEF);
+  LOG_WARN("u=%u d=%d", 4000000000u, 4000000000u);
+  LOG_WARN("x=%x", (uint32_t)0xDEADBEEF);
+  TEST_ASSERT_EQUAL_STRING("id=7", nextLine());
+  TEST_ASSERT_EQUAL_STRING("b=200 x=BEEF", nextLine());
+  TEST_ASSERT_EQUAL_STRING("u=4000000000 d=-294967296", nextLine());
+  TEST_ASSERT_EQUAL_STRING("x=deadbeef", nextLine());
+}
+
+void test_mixed_args()
+{
+  LOG_WARN("Schedule #%u (%s) fired, t=%.1f", (uint16_t)3, "weekday", 24.5f);
+  TEST_ASSERT_EQUAL_STRING("Schedule #3 (weekday) fired, t=24.5", nextLine());
+  TEST_ASSERT_EQUAL_STRING("", nextLine());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_signed_args);
+  RUN_TEST(test_unsigned_args);
+  RUN_TEST(test_mixed_args);
+  return UNITY_END();
+}
@@ -0,0 +1,164 @@
+// ============ TEST env:native: 2 ZONE ============
+// Hai ClimateController dùng chung đồng hồ và bảng luật mặc định như
+// zones[] trên firmware, mỗi zone có cảm biến + IR riêng:
+//
+//   pio test -e native
+//
+// Kiểm tra: luật, lệnh và khung IR của zone này không rò sang zone kia;
+// zone thiếu PIR/LDR được báo đúng các luật không thể chạy.
+
+#include <Arduino.h>
+#include <unity.h>
+#include "hal_native.h"
+#include "controller.h"
+#include "default_rules.h"
+
+LogRing logRing;
+
+#define TEST_ZONE_COUNT 2
+#define TEST_STEP_MS 10
+#define TEST_SENSOR_MS 2000 // sensorInterval trên ESP32
+#define TEST_AI_MS 1000
+
+SimClock simClock(12 * 3600); // 12:00, ngoài khung night_quiet
+VirtualLcd virtualLcd;
+
+struct TestZone
+{
+  TestZone() : hal{simClock, sensors, ir, virtualLcd}, core(hal) {}
+
+  FakeSensors sensors;
+  RecordingIrSink ir;
+  Hal hal;
+  ClimateController core;
+};
+
+TestZone *zones[TEST_ZONE_COUNT];
+
+int findRule(const char *name)
+{
+  return zones[0]->core.rules.findRule(name);
+}
+
+// Vòng lặp giống loop() firmware: cảm biến, AI, IR cho từng zone
+void runFor(uint32_t ms)
+{
+  for (uint32_t t = 0; t < ms; t += TEST_STEP_MS)
+  {
+    simClock.advanceMs(TEST_STEP_MS);
+    uint32_t now = millis();
+    for (TestZone *z : zones)
+    {
+      if (now % TEST_SENSOR_MS == 0)
+      {
+        z->core.sampleSensors(now);
+        z->core.publish();
+      }
+      if (now % TEST_AI_MS == 0)
+        z->core.runAuto(now);
+      z->core.transmitTick(now);
+    }
+  }
+}
+
+void setUp()
+{
+  for (TestZone *&z : zones)
+  {
+    z = new TestZone();
+    z->core.begin(DEFAULT_RULES, sizeof(DEFAULT_RULES) / sizeof(DEFAULT_RULES[0]));
+    z->core.aiEnabled = true;
+  }
+}
+
+void tearDown()
+{
+  for (TestZone *&z : zones)
+  {
+    delete z;
+    z = nullptr;
+  }
+}
+
+void test_rules_run_per_zone()
+{
+  zones[0]->sensors.setClimate(32.0f, 60.0f); // very_hot_on
+  zones[0]->sensors.motion = true;
+  zones[1]->sensors.setClimate(24.0f, 60.0f); // không luật nào
+  zones[1]->sensors.motion = true;
+
+  runFor(5000);
+
+  TEST_ASSERT_TRUE(zones[0]->core.ctrl.ac.power);
+  TEST_ASSERT_EQUAL(22, zones[0]->core.ctrl.ac.temp);
+  TEST_ASSERT_TRUE(zones[0]->ir.hasFrame());
+  TEST_ASSERT_TRUE(zones[0]->ir.lastState().power);
+
+  TEST_ASSERT_FALSE(zones[1]->core.ctrl.ac.power);
+  TEST_ASSERT_EQUAL_UINT32(0, zones[1]->ir.sent);
+  TEST_ASSERT_FALSE(zones[1]->ir.hasFrame());
+}
+
+void test_command_targets_one_zone()
+{
+  zones[0]->sensors.setClimate(24.0f, 60.0f);
+  zones[1]->sensors.setClimate(24.0f, 60.0f);
+  for (TestZone *z : zones)
+    z->core.aiEnabled = false;
+
+  AcCommand cmd = {AC_SET_POWER | AC_SET_TEMP, zones[1]->core.ctrl.ac, "API_COMMAND"};
+  cmd.value.power = true;
+  cmd.value.temp = 26;
+  zones[1]->core.apply(cmd);
+  runFor(2000);
+
+  TEST_ASSERT_TRUE(zones[1]->ir.hasFrame());
+  TEST_ASSERT_TRUE(zones[1]->ir.lastState().power);
+  TEST_ASSERT_EQUAL(26, zones[1]->ir.lastState().temp);
+  TEST_ASSERT_FALSE(zones[0]->core.ctrl.ac.power);
+  TEST_ASSERT_EQUAL_UINT32(0, zones[0]->ir.sent);
+}
+
+void test_absent_off_only_where_empty()
+{
+  for (TestZone *z : zones)
+  {
+    AcCommand on = {AC_SET_POWER, z->core.ctrl.ac, "API_COMMAND"};
+    on.value.power = true;
+    z->core.apply(on);
+    z->sensors.setClimate(25.0f, 60.0f);
+  }
+  zones[0]->sensors.motion = true;
+  zones[1]->sensors.motion = false; // phòng 2 trống
+
+  runFor(PIR_HOLD_MS + 20000);
+
+  TEST_ASSERT_TRUE(zones[0]->core.ctrl.ac.power);
+  TEST_ASSERT_FALSE(zones[1]->core.ctrl.ac.power);
+  TEST_ASSERT_FALSE(zones[1]->ir.lastState().power);
+}
+
+void test_inactive_rules_without_sensors()
+{
+  RuleEngine &rules = zones[1]->core.rules;
+  RuleSnapshot fixed = {};
+  fixed.field[RF_PRESENCE] = 1; // không PIR: luôn có người
+  uint32_t noPir = (1UL << RF_PRESENCE) | (1UL << RF_ABSENT_S);
+  uint32_t noLdr = 1UL << RF_LIGHT;
+
+  TEST_ASSERT_FALSE(rules.applicable(findRule("absent_off"), noPir, fixed));
+  TEST_ASSERT_TRUE(rules.applicable(findRule("hot_on"), noPir, fixed));
+  TEST_ASSERT_TRUE(rules.applicable(findRule("night_quiet"), noPir, fixed));
+  TEST_ASSERT_FALSE(rules.applicable(findRule("night_quiet"), noLdr, fixed));
+  TEST_ASSERT_TRUE(rules.applicable(findRule("cold_off"), noPir | noLdr, fixed));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_rules_run_per_zone);
+  RUN_TEST(test_command_targets_one_zone);
+  RUN_TEST(test_absent_off_only_where_empty);
+  RUN_TEST(test_inactive_rules_without_sensors);
+  return UNITY_END();
+}